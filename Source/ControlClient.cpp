@@ -0,0 +1,166 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "ControlClient.h"
+
+#if !JUCE_WINDOWS
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#endif
+
+Result ControlClient::connect(const String& socketPath)
+{
+    disconnect();
+
+#if JUCE_WINDOWS
+    ignoreUnused(socketPath);
+    return Result::fail("The control API is not available on Windows");
+#else
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+
+    if (socketPath.getNumBytesAsUTF8() >= sizeof(address.sun_path))
+        return Result::fail("Socket path is too long: " + socketPath);
+
+    std::strcpy(address.sun_path, socketPath.toRawUTF8());
+
+    socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (socket < 0 || ::connect(socket, (sockaddr*) &address, sizeof(address)) != 0)
+    {
+        const String error(std::strerror(errno));
+        disconnect();
+        return Result::fail("Unable to connect to " + socketPath + ": " + error);
+    }
+
+#ifdef SO_NOSIGPIPE
+    const int noSigPipe = 1;
+    ::setsockopt(socket, SOL_SOCKET, SO_NOSIGPIPE, &noSigPipe, sizeof(noSigPipe));
+#endif
+
+    return Result::ok();
+#endif
+}
+
+void ControlClient::disconnect()
+{
+#if !JUCE_WINDOWS
+    if (socket >= 0)
+        ::close(socket);
+#endif
+
+    socket = -1;
+}
+
+bool ControlClient::send(ControlCommand command, int32 argument, ControlResponse& response, int timeoutMs)
+{
+#if JUCE_WINDOWS
+    ignoreUnused(command, argument, response, timeoutMs);
+    return false;
+#else
+    if (socket < 0)
+        return false;
+
+    ControlRequest request;
+    request.command = (uint16) command;
+    request.id = nextId++;
+    request.argument = argument;
+
+    const int64 startTicks = Time::getHighResolutionTicks();
+    const int64 deadlineTicks = startTicks + Time::secondsToHighResolutionTicks(timeoutMs / 1000.0);
+
+    // Requests are tiny, so the send never blocks for long
+    if (::send(socket, &request, sizeof(request), MSG_NOSIGNAL) != (ssize_t) sizeof(request)
+        || !receive(&response, sizeof(response), deadlineTicks)
+        || response.magic != controlMagic
+        || response.id != request.id)
+    {
+        disconnect();
+        return false;
+    }
+
+    lastRoundTripMicros = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - startTicks) * 1.0e6;
+
+    return true;
+#endif
+}
+
+bool ControlClient::receive(void* data, size_t size, int64 deadlineTicks)
+{
+#if JUCE_WINDOWS
+    ignoreUnused(data, size, deadlineTicks);
+    return false;
+#else
+    char* bytes = (char*) data;
+
+    while (size > 0)
+    {
+        const double remainingMs = Time::highResolutionTicksToSeconds(deadlineTicks - Time::getHighResolutionTicks()) * 1000.0;
+
+        if (remainingMs <= 0)
+            return false;
+
+        pollfd descriptor = { socket, POLLIN, 0 };
+        const int numReady = ::poll(&descriptor, 1, jmax(1, (int) std::ceil(remainingMs)));
+
+        if (numReady < 0 && errno == EINTR)
+            continue;
+
+        if (numReady <= 0)
+            return false;
+
+        const ssize_t numRead = ::recv(socket, bytes, size, 0);
+
+        if (numRead < 0 && errno == EINTR)
+            continue;
+
+        if (numRead <= 0)
+            return false;
+
+        bytes += numRead;
+        size -= (size_t) numRead;
+    }
+
+    return true;
+#endif
+}
+
+String ControlClient::getStatusName(int status)
+{
+    const char* const names[] = { "ok", "bad request", "unknown command", "invalid argument", "rejected", "timeout" };
+    return isPositiveAndBelow(status, (int) numElementsInArray(names)) ? names[status] : "unknown";
+}
+
+String ControlClient::getStateName(int state)
+{
+    const char* const names[] = { "idle", "armed", "running", "paused", "finished", "simulating" };
+    return isPositiveAndBelow(state, (int) numElementsInArray(names)) ? names[state] : "unknown";
+}
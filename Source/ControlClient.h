@@ -0,0 +1,78 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef CONTROLCLIENT_H_DEFINED
+#define CONTROLCLIENT_H_DEFINED
+
+#include "ControlMessages.h"
+
+/**
+    Connects to a ControlServer and sends it commands.
+
+    send() blocks until the matching response arrives or the timeout
+    expires, and measures the round trip. Not available on Windows.
+*/
+class ControlClient
+{
+public:
+    /** Constructor */
+    ControlClient() { }
+
+    /** Destructor */
+    ~ControlClient() { disconnect(); }
+
+    /** Connects to a server */
+    Result connect(const String& socketPath);
+
+    /** Closes the connection */
+    void disconnect();
+
+    /** Whether a connection is open */
+    bool isConnected() const { return socket >= 0; }
+
+    /** Sends a command and waits for its response; returns false (and
+        disconnects) if the connection fails or no response arrives in time */
+    bool send(ControlCommand command, int32 argument, ControlResponse& response, int timeoutMs = 1000);
+
+    /** Round-trip time of the last successful send(), in microseconds */
+    double getLastRoundTripMicros() const { return lastRoundTripMicros; }
+
+    /** Returns a name for a ControlStatus */
+    static String getStatusName(int status);
+
+    /** Returns a name for a ControlState */
+    static String getStateName(int state);
+
+private:
+
+    /** Reads exactly size bytes before a deadline (in high-resolution ticks) */
+    bool receive(void* data, size_t size, int64 deadlineTicks);
+
+    int socket = -1;
+    uint32 nextId = 1;
+    double lastRoundTripMicros = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(ControlClient);
+};
+
+#endif // CONTROLCLIENT_H_DEFINED
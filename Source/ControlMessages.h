@@ -0,0 +1,180 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef CONTROLMESSAGES_H_DEFINED
+#define CONTROLMESSAGES_H_DEFINED
+
+#include "SampleTime.h"
+
+/**
+    Wire format of the local control API.
+
+    A client sends fixed-size ControlRequests over a Unix domain
+    socket and receives one fixed-size ControlResponse for each, in
+    order. Every response carries the current playback status, so a
+    client can poll with CONTROL_STATUS or read the state that
+    followed any other command. Messages are little-endian, naturally
+    aligned and have no padding.
+*/
+
+/** Commands accepted by the control server */
+enum ControlCommand
+{
+    /** Reports the status without changing anything */
+    CONTROL_STATUS = 0,
+
+    /** Selects the protocol whose position is reported (argument: protocol index) */
+    CONTROL_SELECT = 1,
+
+    /** Queues every protocol for playback without starting */
+    CONTROL_ARM = 2,
+
+    /** Starts or continues playback (arming first if needed) */
+    CONTROL_RUN = 3,
+
+    /** Pauses playback */
+    CONTROL_PAUSE = 4,
+
+    /** Stops playback and rewinds every protocol */
+    CONTROL_RESET = 5,
+
+    /** Starts recording a trace (see TraceRecorder) */
+    CONTROL_START_TRACE = 6,
+
+    /** Stops tracing and saves the trace next to the run's metrics */
+    CONTROL_STOP_TRACE = 7
+};
+
+/** Outcome of a request */
+enum ControlStatus
+{
+    /** The command was carried out */
+    CONTROL_OK = 0,
+
+    /** The request had the wrong magic number or version */
+    CONTROL_BAD_REQUEST = 1,
+
+    /** The command is not a ControlCommand */
+    CONTROL_UNKNOWN_COMMAND = 2,
+
+    /** The argument is out of range */
+    CONTROL_INVALID_ARGUMENT = 3,
+
+    /** The command can't be carried out in the current state */
+    CONTROL_REJECTED = 4,
+
+    /** The plugin didn't handle the request in time; it may still be carried out */
+    CONTROL_TIMEOUT = 5
+};
+
+/** Playback state */
+enum ControlState
+{
+    STATE_IDLE = 0,
+    STATE_ARMED = 1,
+    STATE_RUNNING = 2,
+    STATE_PAUSED = 3,
+    STATE_FINISHED = 4,
+
+    /** A simulation is running; only CONTROL_STATUS is accepted */
+    STATE_SIMULATING = 5
+};
+
+/** Identifies control messages ("OPTC") */
+static constexpr uint32 controlMagic = 0x4354504f;
+
+/** Current wire format version */
+static constexpr uint16 controlVersion = 1;
+
+/** A command sent to the plugin */
+struct ControlRequest
+{
+    uint32 magic = controlMagic;
+    uint16 version = controlVersion;
+
+    /** ControlCommand */
+    uint16 command = CONTROL_STATUS;
+
+    /** Echoed in the response */
+    uint32 id = 0;
+
+    /** Command argument (the protocol index for CONTROL_SELECT) */
+    int32 argument = 0;
+};
+
+static_assert(sizeof(ControlRequest) == 16, "ControlRequest layout is part of the wire format");
+
+/** The plugin's answer to a ControlRequest */
+struct ControlResponse
+{
+    uint32 magic = controlMagic;
+    uint16 version = controlVersion;
+
+    /** ControlStatus */
+    uint16 status = CONTROL_OK;
+
+    /** The id of the request being answered */
+    uint32 id = 0;
+
+    /** ControlState */
+    int32 state = STATE_IDLE;
+
+    /** Index of the selected protocol */
+    int32 protocol = 0;
+
+    /** Number of protocols */
+    int32 numProtocols = 0;
+
+    /** Current sequence of the selected protocol */
+    int32 sequence = 0;
+
+    /** Next trial of the selected protocol within its current sequence */
+    int32 trial = 0;
+
+    /** Number of trials in the selected protocol */
+    int32 totalTrials = 0;
+
+    /** Time from receiving the request to having its response ready (us) */
+    int32 handlingMicros = 0;
+
+    /** Trials of the selected protocol delivered since its run started */
+    int64 trialsDelivered = 0;
+};
+
+static_assert(sizeof(ControlResponse) == 48, "ControlResponse layout is part of the wire format");
+
+/** Returns the socket path used when none is given: in $XDG_RUNTIME_DIR if
+    it is set, otherwise in the temporary directory, named per user */
+inline String getDefaultControlSocketPath()
+{
+    const String runtimeDirectory = SystemStats::getEnvironmentVariable("XDG_RUNTIME_DIR", {});
+
+    if (runtimeDirectory.isNotEmpty())
+        return File(runtimeDirectory).getChildFile("opto-protocol-generator.sock").getFullPathName();
+
+    return File::getSpecialLocation(File::tempDirectory)
+        .getChildFile("opto-protocol-generator-" + SystemStats::getLogonName() + ".sock")
+        .getFullPathName();
+}
+
+#endif // CONTROLMESSAGES_H_DEFINED
@@ -0,0 +1,295 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "ControlServer.h"
+#include "TraceRecorder.h"
+
+#if !JUCE_WINDOWS
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 // macOS uses SO_NOSIGPIPE instead
+#endif
+
+namespace
+{
+    /** Fills a socket address; returns false if the path doesn't fit */
+    bool makeAddress(const String& path, sockaddr_un& address)
+    {
+        address = {};
+        address.sun_family = AF_UNIX;
+
+        if (path.getNumBytesAsUTF8() >= sizeof(address.sun_path))
+            return false;
+
+        std::strcpy(address.sun_path, path.toRawUTF8());
+        return true;
+    }
+
+    /** Writes a whole buffer to a blocking socket */
+    bool sendAll(int socket, const void* data, size_t size)
+    {
+        const char* bytes = (const char*) data;
+
+        while (size > 0)
+        {
+            const ssize_t numSent = ::send(socket, bytes, size, MSG_NOSIGNAL);
+
+            if (numSent < 0 && errno == EINTR)
+                continue;
+
+            if (numSent <= 0)
+                return false;
+
+            bytes += numSent;
+            size -= (size_t) numSent;
+        }
+
+        return true;
+    }
+}
+#endif
+
+ControlServer::ControlServer(Handler handler_)
+    : Thread("Opto control server"),
+      handler(std::move(handler_))
+{
+}
+
+ControlServer::~ControlServer()
+{
+    stop();
+}
+
+Result ControlServer::start(const String& path)
+{
+    stop();
+
+#if JUCE_WINDOWS
+    ignoreUnused(path);
+    return Result::fail("The control API is not available on Windows");
+#else
+    sockaddr_un address;
+
+    if (!makeAddress(path, address))
+        return Result::fail("Socket path is too long: " + path);
+
+    // A socket left behind by a crash is removed; one that is still served is not
+    const int probe = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    const bool inUse = ::connect(probe, (sockaddr*) &address, sizeof(address)) == 0;
+    const bool stale = !inUse && errno == ECONNREFUSED;
+    ::close(probe);
+
+    if (inUse)
+        return Result::fail("Another instance is listening on " + path);
+
+    if (stale)
+        ::unlink(path.toRawUTF8());
+
+    listenSocket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (listenSocket < 0 || ::bind(listenSocket, (sockaddr*) &address, sizeof(address)) != 0)
+    {
+        const String error(std::strerror(errno));
+        stop();
+        return Result::fail("Unable to listen on " + path + ": " + error);
+    }
+
+    // Only the current user may connect
+    if (::chmod(path.toRawUTF8(), S_IRUSR | S_IWUSR) != 0
+        || ::listen(listenSocket, maxClients) != 0
+        || ::pipe(wakePipe) != 0)
+    {
+        const String error(std::strerror(errno));
+        stop();
+        ::unlink(path.toRawUTF8());
+        return Result::fail("Unable to listen on " + path + ": " + error);
+    }
+
+    socketPath = path;
+    startThread();
+
+    return Result::ok();
+#endif
+}
+
+void ControlServer::stop()
+{
+#if !JUCE_WINDOWS
+    if (isThreadRunning())
+    {
+        signalThreadShouldExit();
+
+        const char wake = 0;
+        ignoreUnused(::write(wakePipe[1], &wake, 1));
+
+        stopThread(1000);
+    }
+
+    for (auto& client : clients)
+        ::close(client.socket);
+
+    clients.clear();
+
+    for (int* descriptor : { &listenSocket, &wakePipe[0], &wakePipe[1] })
+    {
+        if (*descriptor >= 0)
+            ::close(*descriptor);
+
+        *descriptor = -1;
+    }
+
+    if (socketPath.isNotEmpty())
+        ::unlink(socketPath.toRawUTF8());
+
+    socketPath = String();
+#endif
+}
+
+void ControlServer::run()
+{
+#if !JUCE_WINDOWS
+    pollfd descriptors[2 + maxClients];
+
+    while (!threadShouldExit())
+    {
+        descriptors[0] = { wakePipe[0], POLLIN, 0 };
+        descriptors[1] = { listenSocket, POLLIN, 0 };
+
+        for (int i = 0; i < clients.size(); ++i)
+            descriptors[2 + i] = { clients[i].socket, POLLIN, 0 };
+
+        if (::poll(descriptors, (nfds_t) (2 + clients.size()), -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            break;
+        }
+
+        if (descriptors[0].revents != 0)
+            break;
+
+        for (int i = clients.size(); --i >= 0;)
+        {
+            if (descriptors[2 + i].revents != 0 && !serviceClient(clients.getReference(i)))
+            {
+                ::close(clients[i].socket);
+                clients.remove(i);
+            }
+        }
+
+        if ((descriptors[1].revents & POLLIN) != 0)
+        {
+            const int socket = ::accept(listenSocket, nullptr, nullptr);
+
+            if (socket < 0)
+                continue;
+
+            if (clients.size() >= maxClients)
+            {
+                ::close(socket);
+                continue;
+            }
+
+            // Responses are written blocking, but a client that stops reading is dropped
+            timeval sendTimeout = { 1, 0 };
+            ::setsockopt(socket, SOL_SOCKET, SO_SNDTIMEO, &sendTimeout, sizeof(sendTimeout));
+
+#ifdef SO_NOSIGPIPE
+            const int noSigPipe = 1;
+            ::setsockopt(socket, SOL_SOCKET, SO_NOSIGPIPE, &noSigPipe, sizeof(noSigPipe));
+#endif
+
+            clients.add({ socket, 0, ControlRequest() });
+        }
+    }
+#endif
+}
+
+bool ControlServer::serviceClient(Client& client)
+{
+#if JUCE_WINDOWS
+    ignoreUnused(client);
+    return false;
+#else
+    for (;;)
+    {
+        char* destination = (char*) &client.request + client.numBuffered;
+        const ssize_t numRead = ::recv(client.socket, destination,
+                                       sizeof(ControlRequest) - (size_t) client.numBuffered,
+                                       MSG_DONTWAIT);
+
+        if (numRead == 0)
+            return false;
+
+        if (numRead < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+
+        client.numBuffered += (int) numRead;
+
+        if (client.numBuffered < (int) sizeof(ControlRequest))
+            continue;
+
+        client.numBuffered = 0;
+
+        ControlResponse response = respond(client.request);
+
+        if (!sendAll(client.socket, &response, sizeof(response)))
+            return false;
+
+        // The stream can't be resynchronized after a malformed request
+        if (response.status == CONTROL_BAD_REQUEST)
+            return false;
+    }
+#endif
+}
+
+ControlResponse ControlServer::respond(const ControlRequest& request)
+{
+    const int64 startTicks = Time::getHighResolutionTicks();
+    const TraceScope trace("control", "request", request.command);
+
+    ControlResponse response;
+
+    if (request.magic != controlMagic || request.version != controlVersion)
+        response.status = CONTROL_BAD_REQUEST;
+    else
+        response = handler(request);
+
+    response.magic = controlMagic;
+    response.version = controlVersion;
+    response.id = request.id;
+
+    const double seconds = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - startTicks);
+    response.handlingMicros = (int32) jmin(seconds * 1.0e6, (double) std::numeric_limits<int32>::max());
+
+    return response;
+}
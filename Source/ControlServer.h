@@ -0,0 +1,105 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef CONTROLSERVER_H_DEFINED
+#define CONTROLSERVER_H_DEFINED
+
+#include "ControlMessages.h"
+
+/**
+    Serves the local control API on a Unix domain socket.
+
+    A background thread accepts up to maxClients connections and
+    answers each request with the handler's response, in the order
+    the requests arrive. The handler is called on that thread, so it
+    must hand anything that touches the GUI over to the message thread
+    and return within responseTimeoutMs (replying CONTROL_TIMEOUT if
+    it can't). The time spent in the handler is reported back in
+    ControlResponse::handlingMicros.
+
+    The socket is only accessible to the current user. Not available
+    on Windows.
+*/
+class ControlServer : private Thread
+{
+public:
+    /** Produces the response to a request (called on the server thread) */
+    using Handler = std::function<ControlResponse(const ControlRequest& request)>;
+
+    /** Constructor */
+    ControlServer(Handler handler);
+
+    /** Destructor (stops the server) */
+    ~ControlServer();
+
+    /** Starts listening on a socket path; fails if another server is already listening on it */
+    Result start(const String& socketPath);
+
+    /** Stops listening, disconnects every client and removes the socket */
+    void stop();
+
+    /** Whether the server is listening */
+    bool isListening() const { return listenSocket >= 0; }
+
+    /** Returns the socket path (empty if not listening) */
+    String getSocketPath() const { return socketPath; }
+
+    /** Maximum number of connected clients */
+    static const int maxClients = 8;
+
+    /** Longest a handler should take before answering CONTROL_TIMEOUT */
+    static const int responseTimeoutMs = 250;
+
+private:
+
+    /** Accepts clients and answers their requests */
+    void run() override;
+
+    /** A connected client and its partially received request */
+    struct Client
+    {
+        int socket;
+        int numBuffered;
+        ControlRequest request;
+    };
+
+    /** Reads whatever a client has sent and answers every complete request;
+        returns false if the client has disconnected */
+    bool serviceClient(Client& client);
+
+    /** Answers one request */
+    ControlResponse respond(const ControlRequest& request);
+
+    Handler handler;
+    String socketPath;
+    int listenSocket = -1;
+
+    /** Written to wake the server thread when stopping */
+    int wakePipe[2] = { -1, -1 };
+
+    Array<Client> clients;
+
+    JUCE_DECLARE_NON_COPYABLE(ControlServer);
+};
+
+#endif // CONTROLSERVER_H_DEFINED
@@ -0,0 +1,196 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include "DeviceRegistry.h"
+
+int SourceDescription::getChannel(int site, int wavelength) const
+{
+    const int wavelengthIndex = wavelengths.indexOf(wavelength);
+
+    if (!isPositiveAndBelow(site, numSites) || wavelengthIndex < 0)
+        return -1;
+
+    return site * wavelengths.size() + wavelengthIndex;
+}
+
+DeviceRegistry::DeviceRegistry()
+{
+    if (!loadFromFile(getCacheFile()))
+        sources = getDefaultSources();
+}
+
+Array<SourceDescription> DeviceRegistry::getDefaultSources()
+{
+    Array<SourceDescription> defaults;
+
+    for (auto name : { "Probe A", "Probe B" })
+    {
+        SourceDescription source;
+        source.name = name;
+        source.numSites = 14;
+        source.wavelengths = { 638, 450 };
+
+        defaults.add(source);
+    }
+
+    return defaults;
+}
+
+File DeviceRegistry::getCacheFile()
+{
+    return File::getSpecialLocation(File::userApplicationDataDirectory)
+        .getChildFile("Open Ephys")
+        .getChildFile("opto-protocol-generator")
+        .getChildFile("devices.xml");
+}
+
+bool DeviceRegistry::loadFromFile(const File& file)
+{
+    if (!file.existsAsFile())
+        return false;
+
+    std::unique_ptr<XmlElement> xml = parseXML(file);
+
+    if (xml == nullptr || !xml->hasTagName("OPTO_DEVICES"))
+        return false;
+
+    Array<SourceDescription> loaded;
+
+    for (auto* sourceXml : xml->getChildWithTagNameIterator("SOURCE"))
+    {
+        SourceDescription source;
+        source.name = sourceXml->getStringAttribute("name");
+        source.numSites = sourceXml->getIntAttribute("num_sites", 1);
+        source.maxPower = (float) sourceXml->getDoubleAttribute("max_power", source.maxPower);
+        source.maxUpdateRate = sourceXml->getDoubleAttribute("max_update_rate", source.maxUpdateRate);
+
+        for (auto& token : StringArray::fromTokens(sourceXml->getStringAttribute("wavelengths"), " ,", ""))
+        {
+            if (token.getIntValue() > 0)
+                source.wavelengths.addIfNotAlreadyThere(token.getIntValue());
+        }
+
+        if (source.name.isEmpty() || source.numSites < 1 || source.wavelengths.isEmpty())
+            return false;
+
+        loaded.add(source);
+    }
+
+    if (loaded.isEmpty())
+        return false;
+
+    sources = loaded;
+    return true;
+}
+
+bool DeviceRegistry::saveToFile(const File& file) const
+{
+    XmlElement xml("OPTO_DEVICES");
+
+    for (auto& source : sources)
+    {
+        StringArray wavelengths;
+
+        for (int wavelength : source.wavelengths)
+            wavelengths.add(String(wavelength));
+
+        XmlElement* sourceXml = xml.createNewChildElement("SOURCE");
+        sourceXml->setAttribute("name", source.name);
+        sourceXml->setAttribute("num_sites", source.numSites);
+        sourceXml->setAttribute("wavelengths", wavelengths.joinIntoString(" "));
+        sourceXml->setAttribute("max_power", (double) source.maxPower);
+        sourceXml->setAttribute("max_update_rate", source.maxUpdateRate);
+    }
+
+    return file.getParentDirectory().createDirectory() && xml.writeTo(file);
+}
+
+bool DeviceRegistry::query(DeviceProvider& provider)
+{
+    Array<SourceDescription> described;
+
+    if (!provider.describeSources(described) || described.isEmpty())
+        return false;
+
+    setSources(described);
+    saveToFile(getCacheFile());
+
+    return true;
+}
+
+void DeviceRegistry::setSources(const Array<SourceDescription>& sources_)
+{
+    if (!sources_.isEmpty())
+        sources = sources_;
+}
+
+int DeviceRegistry::indexOfSource(const String& name) const
+{
+    for (int i = 0; i < sources.size(); ++i)
+    {
+        if (sources.getReference(i).name == name)
+            return i;
+    }
+
+    return -1;
+}
+
+Array<String> DeviceRegistry::getSourceNames() const
+{
+    Array<String> names;
+
+    for (auto& source : sources)
+        names.add(source.name);
+
+    return names;
+}
+
+Array<int> DeviceRegistry::getSitesPerSource() const
+{
+    Array<int> sitesPerSource;
+
+    for (auto& source : sources)
+        sitesPerSource.add(source.numSites);
+
+    return sitesPerSource;
+}
+
+Array<int> DeviceRegistry::getAllWavelengths() const
+{
+    Array<int> wavelengths;
+
+    for (auto& source : sources)
+    {
+        for (int wavelength : source.wavelengths)
+            wavelengths.addIfNotAlreadyThere(wavelength);
+    }
+
+    wavelengths.sort();
+    return wavelengths;
+}
+
+int DeviceRegistry::getDefaultWavelength() const
+{
+    return sources.getReference(0).wavelengths.getFirst();
+}
@@ -0,0 +1,139 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef DEVICEREGISTRY_H_DEFINED
+#define DEVICEREGISTRY_H_DEFINED
+
+#ifdef OPTO_STANDALONE
+#include <juce_core/juce_core.h>
+using namespace juce;
+#else
+#include <JuceHeader.h>
+#endif
+
+/** What one stimulation source (e.g. a laser or a probe) can do */
+struct SourceDescription
+{
+    /** Source name, as shown in the UI */
+    String name;
+
+    /** Number of emission sites */
+    int numSites = 1;
+
+    /** Available wavelengths (in nm) */
+    Array<int> wavelengths;
+
+    /** Maximum light power (uW) */
+    float maxPower = 10000.0f;
+
+    /** Maximum rate at which the output can be updated (Hz) */
+    double maxUpdateRate = 30000.0;
+
+    /** Number of output channels (one per site and wavelength) */
+    int getNumChannels() const { return numSites * wavelengths.size(); }
+
+    /** Returns the output channel for a site and wavelength (-1 if unavailable) */
+    int getChannel(int site, int wavelength) const;
+};
+
+/**
+    Queried for the sources an output backend can drive.
+*/
+class DeviceProvider
+{
+public:
+    /** Destructor */
+    virtual ~DeviceProvider() { }
+
+    /** Describes the available sources; returns false if the device can't be reached */
+    virtual bool describeSources(Array<SourceDescription>& sources) = 0;
+};
+
+/**
+    The sources, sites and wavelengths that protocols can use.
+
+    Loaded from a device description file, or queried from a
+    DeviceProvider and cached to that file, so the hardware only
+    needs to be queried once. Falls back to two 14-site probes
+    with 638 and 450 nm light when nothing has been cached.
+
+    Shared through a SharedResourcePointer, and only used from
+    the message thread; renderers keep their own copy of the
+    SourceDescriptions they need.
+*/
+class DeviceRegistry
+{
+public:
+    /** Constructor (loads the cached description, if there is one) */
+    DeviceRegistry();
+
+    /** Destructor */
+    ~DeviceRegistry() { }
+
+    /** Loads a device description file */
+    bool loadFromFile(const File& file);
+
+    /** Writes the current sources to a device description file */
+    bool saveToFile(const File& file) const;
+
+    /** Replaces the sources with those reported by a device, and caches them */
+    bool query(DeviceProvider& provider);
+
+    /** Replaces the sources */
+    void setSources(const Array<SourceDescription>& sources);
+
+    /** Returns the number of sources */
+    int getNumSources() const { return sources.size(); }
+
+    /** Returns a source by index */
+    const SourceDescription& getSource(int index) const { return sources.getReference(index); }
+
+    /** Returns the index of a source by name (-1 if not found) */
+    int indexOfSource(const String& name) const;
+
+    /** Returns the source names, in registry order */
+    Array<String> getSourceNames() const;
+
+    /** Returns the number of sites of each source, in registry order */
+    Array<int> getSitesPerSource() const;
+
+    /** Returns every wavelength offered by any source, in ascending order */
+    Array<int> getAllWavelengths() const;
+
+    /** Returns the wavelength selected for new conditions */
+    int getDefaultWavelength() const;
+
+    /** The sources used when no device has been described */
+    static Array<SourceDescription> getDefaultSources();
+
+    /** Where queried device descriptions are cached */
+    static File getCacheFile();
+
+private:
+    Array<SourceDescription> sources;
+
+    JUCE_DECLARE_NON_COPYABLE(DeviceRegistry);
+};
+
+#endif // DEVICEREGISTRY_H_DEFINED
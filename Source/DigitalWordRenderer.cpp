@@ -0,0 +1,469 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "DigitalWordRenderer.h"
+
+namespace
+{
+    /** Samples of a custom waveform's envelope thresholded at a time */
+    const int customChunkSize = 1024;
+
+    /** Calls back with the [from, to) intervals of a stimulus that are at half power or
+        more, clipped to [start, end) (all relative to the stimulus onset) */
+    template <typename Callback>
+    void forEachOnInterval(const StimulusSpec& stimulus, int64 start, int64 end, Callback&& callback)
+    {
+        start = jmax((int64) 0, start);
+        end = jmin(stimulus.numSamples, end);
+
+        if (end <= start)
+            return;
+
+        auto clipped = [&] (int64 from, int64 to)
+        {
+            from = jmax(from, start);
+            to = jmin(to, end);
+
+            if (from < to)
+                callback(from, to);
+        };
+
+        switch (stimulus.type)
+        {
+            case PULSE_TRAIN:
+            {
+                // The samples of a pulse's linear ramps that are below half
+                // height; see renderPulseTrain() in StimulusRenderer.cpp
+                const int64 width = stimulus.pulseWidth;
+                const int64 ramp = jmin(stimulus.pulseRamp, width / 2);
+                const int64 first = jmax((int64) 0, (int64) std::floor((start - width) / stimulus.pulsePeriod));
+
+                for (int64 pulse = first; pulse < stimulus.numPulses; ++pulse)
+                {
+                    const int64 onset = (int64) std::llround(pulse * stimulus.pulsePeriod);
+
+                    if (onset >= end)
+                        break;
+
+                    clipped(onset + ramp / 2, onset + width - ramp / 2);
+                }
+
+                break;
+            }
+
+            case SINUSOID:
+            {
+                // The raised cosine is at half power or more from a quarter to three quarters of each cycle
+                const double frequency = stimulus.sineFrequency;
+
+                if (frequency <= 0)
+                    break;
+
+                const int64 lastCycle = (int64) std::ceil(frequency * (double) end);
+
+                for (int64 cycle = jmax((int64) 0, (int64) std::floor(frequency * (double) start) - 1); cycle <= lastCycle; ++cycle)
+                {
+                    const int64 from = (int64) std::ceil(((double) cycle + 0.25) / frequency);
+                    const int64 to = (int64) std::floor(((double) cycle + 0.75) / frequency) + 1;
+
+                    if (from >= end)
+                        break;
+
+                    clipped(from, to);
+                }
+
+                break;
+            }
+
+            case RAMP:
+            {
+                // Both profiles pass half height half-way through the onset and offset
+                const int64 offsetStart = stimulus.rampOnset + stimulus.rampPlateau;
+                clipped(stimulus.rampOnset / 2, offsetStart + (stimulus.rampOffset + 1) / 2);
+                break;
+            }
+
+            case CUSTOM:
+            {
+                float envelope[customChunkSize];
+                const StimulusRenderer::EnvelopeKernel kernel = StimulusRenderer::getEnvelopeKernel(stimulus);
+                int64 runStart = -1;
+
+                for (int64 chunk = start; chunk < end; chunk += customChunkSize)
+                {
+                    const int count = (int) jmin((int64) customChunkSize, end - chunk);
+                    StimulusRenderer::renderEnvelope(stimulus, chunk, count, envelope, kernel);
+
+                    for (int i = 0; i < count; ++i)
+                    {
+                        const bool on = envelope[i] >= 0.5f;
+
+                        if (on && runStart < 0)
+                            runStart = chunk + i;
+                        else if (!on && runStart >= 0)
+                        {
+                            callback(runStart, chunk + i);
+                            runStart = -1;
+                        }
+                    }
+                }
+
+                if (runStart >= 0)
+                    callback(runStart, end);
+
+                break;
+            }
+        }
+    }
+
+    /** ORs a mask into a run of words (a loop the compiler vectorizes) */
+    template <typename Word>
+    void setBits(Word* words, int count, Word mask)
+    {
+        for (int i = 0; i < count; ++i)
+            words[i] |= mask;
+    }
+
+    /** A bit switching on (+1) or off (-1) */
+    struct Transition
+    {
+        int64 sample;
+        int bit;
+        int change;
+
+        bool operator<(const Transition& other) const { return sample < other.sample; }
+    };
+}
+
+DigitalWordRenderer::DigitalWordRenderer(const Array<SourceDescription>& sources_)
+    : sources(sources_)
+{
+    for (auto& source : sources)
+    {
+        channelOffsets.add(numChannels);
+        numChannels += source.getNumChannels();
+    }
+
+    // Channels past the 64th can't be packed
+    jassert(numChannels <= maxBits);
+}
+
+int DigitalWordRenderer::getBit(int source, int site, int wavelength) const
+{
+    if (!isPositiveAndBelow(source, sources.size()))
+        return -1;
+
+    const int channel = sources.getReference(source).getChannel(site, wavelength);
+
+    if (channel < 0 || channelOffsets[source] + channel >= maxBits)
+        return -1;
+
+    return channelOffsets[source] + channel;
+}
+
+void DigitalWordRenderer::clear()
+{
+    trials.clear();
+    sequences.clear();
+    stimuli.clear();
+}
+
+int64 DigitalWordRenderer::getNumTrials() const
+{
+    int64 numTrials = trials.size();
+
+    for (auto* sequence : sequences)
+        numTrials += sequence->generator != nullptr ? sequence->numTrials : sequence->trials.size();
+
+    return numTrials;
+}
+
+int64 DigitalWordRenderer::getEndSample() const
+{
+    int64 end = trials.isEmpty() ? 0 : trials.getLast().end;
+
+    for (auto* sequence : sequences)
+        end = jmax(end, sequence->end);
+
+    return end;
+}
+
+void DigitalWordRenderer::addTrial(int64 onset, const StimulusSpec& stimulus, int bit)
+{
+    jassert(trials.isEmpty() || onset >= trials.getLast().onset);
+
+    if (bit < 0 || bit >= maxBits || stimulus.numSamples <= 0)
+        return;
+
+    Trial trial;
+    trial.onset = onset;
+    trial.end = trials.isEmpty() ? onset + stimulus.numSamples : jmax(onset + stimulus.numSamples, trials.getLast().end);
+    trial.stimulus = addStimulus(stimulus);
+    trial.bit = bit;
+
+    trials.add(trial);
+}
+
+int DigitalWordRenderer::addStimulus(const StimulusSpec& stimulus)
+{
+    // Trials usually repeat the last few stimuli, so only the most recent ones are checked
+    const uint64 hash = stimulus.getHash();
+
+    for (int i = stimuli.size(); --i >= jmax(0, stimuli.size() - 8);)
+        if (stimuli.getReference(i).getHash() == hash)
+            return i;
+
+    stimuli.add(stimulus);
+    return stimuli.size() - 1;
+}
+
+int64 DigitalWordRenderer::addSequence(const SequenceSpec& spec,
+                                       const CompiledSequence& compiled,
+                                       const Array<int>& conditionSources,
+                                       int64 onset)
+{
+    const int64 numTrials = spec.getNumTrials();
+
+    auto* sequence = sequences.add(new SequenceTimeline());
+
+    onset += spec.baselineSamples;
+
+    if (numTrials > ScheduleCompiler::maxCompiledTrials)
+    {
+        // One pass finds the end of the sequence and indexes its onsets; the trials are generated again when rendered
+        sequence->generator = std::make_unique<TrialGenerator>(spec);
+        sequence->conditions = spec.conditions;
+        sequence->conditionSources = conditionSources;
+        sequence->onsets.ensureStorageAllocated((int) ((numTrials + onsetInterval - 1) / onsetInterval));
+
+        for (int64 position = 0; position < numTrials; ++position)
+        {
+            if (position % onsetInterval == 0)
+                sequence->onsets.add(onset);
+
+            const TrialEntry trial = sequence->generator->getTrial(position);
+            const StimulusSpec& stimulus = spec.conditions.getReference(trial.condition).stimuli.getReference(trial.stimulus);
+
+            if (!trial.catchTrial && stimulus.numSamples > 0
+                && getBit(conditionSources[trial.condition], trial.site, trial.wavelength) >= 0)
+            {
+                sequence->numTrials++;
+                sequence->end = onset + stimulus.numSamples;
+            }
+
+            onset += stimulus.numSamples + sequence->generator->getIti(position);
+        }
+
+        return onset;
+    }
+
+    // Each condition's stimuli get a table entry once, rather than one per trial
+    Array<int> firstStimulus;
+
+    for (auto& condition : spec.conditions)
+    {
+        firstStimulus.add(stimuli.size());
+        stimuli.addArray(condition.stimuli);
+    }
+
+    // A sequence that hasn't been compiled yet has no trials to add
+    const int numCompiled = jmin((int) numTrials, compiled.order.size());
+
+    for (int position = 0; position < numCompiled; ++position)
+    {
+        const int slot = compiled.order[position];
+        const TrialEntry& trial = compiled.trials.getReference(slot);
+
+        const StimulusSpec& stimulus = spec.conditions.getReference(trial.condition).stimuli.getReference(trial.stimulus);
+        const int bit = getBit(conditionSources[trial.condition], trial.site, trial.wavelength);
+
+        if (!trial.catchTrial && bit >= 0 && stimulus.numSamples > 0)
+        {
+            Trial entry;
+            entry.onset = onset;
+            entry.end = onset + stimulus.numSamples;
+            entry.stimulus = firstStimulus[trial.condition] + trial.stimulus;
+            entry.bit = bit;
+
+            sequence->trials.add(entry);
+            sequence->end = entry.end;
+        }
+
+        onset += stimulus.numSamples + compiled.itiSamples[slot];
+    }
+
+    return onset;
+}
+
+int DigitalWordRenderer::findFirstTrial(const Array<Trial>& trials, int64 start)
+{
+    // Trial::end never decreases, so the first trial that reaches past start can be bisected
+    int low = 0;
+    int high = trials.size();
+
+    while (low < high)
+    {
+        const int middle = (low + high) / 2;
+
+        if (trials.getReference(middle).end > start)
+            high = middle;
+        else
+            low = middle + 1;
+    }
+
+    return low;
+}
+
+template <typename Callback>
+void DigitalWordRenderer::forEachTrialInterval(const Array<Trial>& trials, int64 start, int64 end, Callback&& callback) const
+{
+    for (int i = findFirstTrial(trials, start); i < trials.size(); ++i)
+    {
+        const Trial& trial = trials.getReference(i);
+
+        if (trial.onset >= end)
+            break;
+
+        forEachOnInterval(stimuli.getReference(trial.stimulus),
+                          start - trial.onset,
+                          end - trial.onset,
+                          [&] (int64 from, int64 to) { callback(trial.onset + from, trial.onset + to, trial.bit); });
+    }
+}
+
+template <typename Callback>
+void DigitalWordRenderer::forEachGeneratedInterval(const SequenceTimeline& sequence, int64 start, int64 end, Callback&& callback) const
+{
+    // Every trial ends before the next onset, so none before the last indexed onset at or before start can reach it
+    const auto& onsets = sequence.onsets;
+    const int index = jmax(0, (int) (std::upper_bound(onsets.begin(), onsets.end(), start) - onsets.begin()) - 1);
+
+    if (onsets.isEmpty() || onsets[index] >= end)
+        return;
+
+    const TrialGenerator& generator = *sequence.generator;
+    int64 onset = onsets[index];
+
+    for (int64 position = (int64) index * onsetInterval; position < generator.getNumTrials() && onset < end; ++position)
+    {
+        const TrialEntry trial = generator.getTrial(position);
+        const StimulusSpec& stimulus = sequence.conditions.getReference(trial.condition).stimuli.getReference(trial.stimulus);
+
+        if (!trial.catchTrial && onset + stimulus.numSamples > start)
+        {
+            const int bit = getBit(sequence.conditionSources[trial.condition], trial.site, trial.wavelength);
+
+            if (bit >= 0)
+                forEachOnInterval(stimulus,
+                                  start - onset,
+                                  end - onset,
+                                  [&] (int64 from, int64 to) { callback(onset + from, onset + to, bit); });
+        }
+
+        onset += stimulus.numSamples + generator.getIti(position);
+    }
+}
+
+template <typename Callback>
+void DigitalWordRenderer::forEachInterval(int64 start, int64 end, Callback&& callback) const
+{
+    forEachTrialInterval(trials, start, end, callback);
+
+    for (auto* sequence : sequences)
+    {
+        if (sequence->generator != nullptr)
+            forEachGeneratedInterval(*sequence, start, end, callback);
+        else
+            forEachTrialInterval(sequence->trials, start, end, callback);
+    }
+}
+
+template <typename Word>
+void DigitalWordRenderer::render(int64 start, int numSamples, Word* words) const
+{
+    std::fill(words, words + numSamples, (Word) 0);
+
+    forEachInterval(start, start + numSamples, [&] (int64 from, int64 to, int bit)
+    {
+        if (bit < (int) sizeof(Word) * 8)
+            setBits(words + (from - start), (int) (to - from), (Word) ((Word) 1 << bit));
+    });
+}
+
+template void DigitalWordRenderer::render<uint32>(int64, int, uint32*) const;
+template void DigitalWordRenderer::render<uint64>(int64, int, uint64*) const;
+
+void DigitalWordRenderer::getEdges(int64 start, int64 end, Array<DigitalEdge>& edges) const
+{
+    edges.clearQuick();
+
+    if (end <= start)
+        return;
+
+    Array<Transition> transitions;
+
+    forEachInterval(start, end, [&] (int64 from, int64 to, int bit)
+    {
+        transitions.add({ from, bit, 1 });
+
+        if (to < end)
+            transitions.add({ to, bit, -1 });
+    });
+
+    std::stable_sort(transitions.begin(), transitions.end());
+
+    // Overlapping trials on the same channel keep it on until the last one ends
+    int counts[maxBits] = {};
+    uint64 word = 0;
+
+    edges.add({ start, 0 });
+
+    for (int i = 0; i < transitions.size();)
+    {
+        const int64 sample = transitions.getReference(i).sample;
+
+        for (; i < transitions.size() && transitions.getReference(i).sample == sample; ++i)
+        {
+            const Transition& transition = transitions.getReference(i);
+            counts[transition.bit] += transition.change;
+
+            if (counts[transition.bit] > 0)
+                word |= (uint64) 1 << transition.bit;
+            else
+                word &= ~((uint64) 1 << transition.bit);
+        }
+
+        if (sample == start)
+            edges.getReference(0).word = word;
+        else if (word != edges.getLast().word)
+            edges.add({ sample, word });
+    }
+}
+
+void DigitalWordRenderer::getOnIntervals(const StimulusSpec& stimulus,
+                                         int64 start,
+                                         int64 end,
+                                         const std::function<void(int64, int64)>& callback)
+{
+    forEachOnInterval(stimulus, start, end, callback);
+}
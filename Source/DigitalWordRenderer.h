@@ -0,0 +1,197 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef DIGITALWORDRENDERER_H_DEFINED
+#define DIGITALWORDRENDERER_H_DEFINED
+
+#include "StimulusRenderer.h"
+#include "TrialGenerator.h"
+
+/** A change of the packed digital output */
+struct DigitalEdge
+{
+    /** First sample with the new word */
+    int64 sample = 0;
+
+    /** One bit per channel (see DigitalWordRenderer::getBit()) */
+    uint64 word = 0;
+};
+
+/**
+    Renders trials as packed digital words, for backends that only
+    switch channels on and off.
+
+    Every channel of every source gets one bit: the sources' channels
+    are numbered one after another, each in SourceDescription::getChannel()
+    order, so two 14-site probes with two wavelengths use bits 0 to 55.
+    A channel is on wherever its stimulus is at half power or more:
+    during each pulse of a pulse train, the half of each sine cycle
+    around its peak, and between the half-way points of a ramp's
+    onset and offset. Custom waveforms are thresholded sample by sample.
+
+    The on intervals of pulse trains, sines and ramps are computed
+    from the stimulus parameters, so no envelope is rendered. render()
+    ORs each interval's bit into a run of words, and getEdges() merges
+    the interval boundaries into a list of changes, which is all a
+    timed digital output needs.
+
+    Trials are added one by one, in onset order, or a whole sequence
+    at a time. Each sequence keeps a timeline of its own, so sequences
+    of protocols that play at the same time can be added one after
+    the other. Sequences with more than ScheduleCompiler::maxCompiledTrials
+    trials aren't stored: their trials are generated again as they are
+    rendered, from the onset of every onsetInterval-th trial. Catch
+    trials are left out, since the light stays off.
+*/
+class DigitalWordRenderer
+{
+public:
+    /** Constructor */
+    DigitalWordRenderer(const Array<SourceDescription>& sources);
+
+    /** Destructor */
+    ~DigitalWordRenderer() { }
+
+    /** Returns the number of channels across all sources */
+    int getNumChannels() const { return numChannels; }
+
+    /** Returns the bit for a source's site and wavelength (-1 if unavailable or past bit 63) */
+    int getBit(int source, int site, int wavelength) const;
+
+    /** Removes every trial */
+    void clear();
+
+    /** Adds a trial that sets a bit (onsets must not decrease; bits below 0 are ignored) */
+    void addTrial(int64 onset, const StimulusSpec& stimulus, int bit);
+
+    /** Adds the trials of a compiled sequence in playback order, starting with its
+        baseline at onset, and returns the sample after its last ITI. conditionSources
+        gives the source index of each condition. Sequences with more than
+        ScheduleCompiler::maxCompiledTrials trials are generated on demand. */
+    int64 addSequence(const SequenceSpec& spec,
+                      const CompiledSequence& compiled,
+                      const Array<int>& conditionSources,
+                      int64 onset);
+
+    /** Returns the number of trials added that switch a channel on */
+    int64 getNumTrials() const;
+
+    /** Returns the sample after the end of the last stimulus */
+    int64 getEndSample() const;
+
+    /** Writes one word per sample for [start, start + numSamples)
+        (bits that don't fit in Word are left out) */
+    template <typename Word>
+    void render(int64 start, int numSamples, Word* words) const;
+
+    /** Returns the changes in [start, end); the first edge is always at start
+        and holds the word at that sample */
+    void getEdges(int64 start, int64 end, Array<DigitalEdge>& edges) const;
+
+    /** Calls back with each [from, to) interval (relative to the stimulus onset,
+        and clipped to [start, end)) in which a stimulus is at half power or more */
+    static void getOnIntervals(const StimulusSpec& stimulus,
+                               int64 start,
+                               int64 end,
+                               const std::function<void(int64, int64)>& callback);
+
+    /** Most channels that can be packed into a word */
+    static const int maxBits = 64;
+
+    /** Trials between the onsets kept for a generated sequence */
+    static const int onsetInterval = 256;
+
+private:
+
+    /** A trial on the timeline */
+    struct Trial
+    {
+        /** First sample of the stimulus */
+        int64 onset;
+
+        /** Latest stimulus end of this and every earlier trial, so
+            the first trial that reaches a sample can be binary searched */
+        int64 end;
+
+        /** Index into stimuli */
+        int stimulus;
+
+        /** Output bit */
+        int bit;
+    };
+
+    /** The trials of a sequence added with addSequence() */
+    struct SequenceTimeline
+    {
+        /** Stored trials (empty if they are generated) */
+        Array<Trial> trials;
+
+        /** Generates the trials of long sequences (nullptr if they are stored) */
+        std::unique_ptr<TrialGenerator> generator;
+
+        /** The conditions and condition sources the generated trials refer to */
+        Array<ConditionSpec> conditions;
+        Array<int> conditionSources;
+
+        /** Onset of every onsetInterval-th generated trial */
+        Array<int64> onsets;
+
+        /** Generated trials that switch a channel on */
+        int64 numTrials = 0;
+
+        /** Sample after the end of the last stimulus */
+        int64 end = 0;
+    };
+
+    /** Returns the first of a set of trials that may overlap samples from start onwards */
+    static int findFirstTrial(const Array<Trial>& trials, int64 start);
+
+    /** Calls back with the on intervals of a set of trials in [start, end), as absolute samples */
+    template <typename Callback>
+    void forEachTrialInterval(const Array<Trial>& trials, int64 start, int64 end, Callback&& callback) const;
+
+    /** Calls back with the on intervals of a generated sequence in [start, end), as absolute samples */
+    template <typename Callback>
+    void forEachGeneratedInterval(const SequenceTimeline& sequence, int64 start, int64 end, Callback&& callback) const;
+
+    /** Calls back with the on intervals of every trial in [start, end), as absolute samples */
+    template <typename Callback>
+    void forEachInterval(int64 start, int64 end, Callback&& callback) const;
+
+    /** Adds a stimulus to the table and returns its index */
+    int addStimulus(const StimulusSpec& stimulus);
+
+    Array<int> channelOffsets;
+    Array<SourceDescription> sources;
+    int numChannels = 0;
+
+    /** Trials added with addTrial() */
+    Array<Trial> trials;
+
+    OwnedArray<SequenceTimeline> sequences;
+    Array<StimulusSpec> stimuli;
+
+    JUCE_DECLARE_NON_COPYABLE(DigitalWordRenderer);
+};
+
+#endif // DIGITALWORDRENDERER_H_DEFINED
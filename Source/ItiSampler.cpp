@@ -0,0 +1,150 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include "ItiSampler.h"
+
+ItiSampler::ItiSampler(const SequenceSpec& spec)
+    : distribution(spec.itiDistribution),
+      seed(ScheduleCompiler::deriveSeed(spec.seed, 0)),
+      minIti(spec.minItiSamples),
+      maxIti(jmax(spec.minItiSamples, spec.maxItiSamples)),
+      scale(spec.itiMeanSamples),
+      table(spec.itiTable)
+{
+    // Distributions that can't be drawn from fall back to a fixed ITI
+    if ((distribution == EXPONENTIAL_ITI && (scale <= 0 || maxIti == minIti))
+        || (distribution == EMPIRICAL_ITI && table.size() == 0))
+        distribution = FIXED_ITI;
+
+    if (distribution == EXPONENTIAL_ITI)
+        truncatedMass = -std::expm1(-(double) (maxIti - minIti) / scale);
+
+    computeMoments();
+}
+
+int64 ItiSampler::sample(int64 slot) const
+{
+    int64 iti;
+    sample(slot, 1, &iti);
+    return iti;
+}
+
+void ItiSampler::sample(int64 firstSlot, int numSlots, int64* destination) const
+{
+    switch (distribution)
+    {
+        case UNIFORM_ITI:
+        {
+            // Matches ScheduleCompiler::uniform()
+            const uint64 range = (uint64) (maxIti - minIti) + 1;
+
+            for (int i = 0; i < numSlots; ++i)
+                destination[i] = minIti + (int64) (ScheduleCompiler::draw(seed, firstSlot + i) % range);
+
+            break;
+        }
+
+        case EXPONENTIAL_ITI:
+        {
+            // Inverse CDF of the exponential, restricted to [0, maxIti - minIti]
+            for (int i = 0; i < numSlots; ++i)
+            {
+                const double u = toUnit(ScheduleCompiler::draw(seed, firstSlot + i));
+                destination[i] = minIti + (int64) std::llround(-scale * std::log1p(-u * truncatedMass));
+            }
+
+            break;
+        }
+
+        case FIXED_ITI:
+        {
+            std::fill(destination, destination + numSlots, minIti);
+            break;
+        }
+
+        case EMPIRICAL_ITI:
+        {
+            const uint64 size = (uint64) table.size();
+            const int64* values = table.begin();
+
+            for (int i = 0; i < numSlots; ++i)
+                destination[i] = values[ScheduleCompiler::draw(seed, firstSlot + i) % size];
+
+            break;
+        }
+    }
+}
+
+void ItiSampler::computeMoments()
+{
+    switch (distribution)
+    {
+        case UNIFORM_ITI:
+        {
+            // Discrete uniform over maxIti - minIti + 1 values
+            const double count = (double) (maxIti - minIti) + 1.0;
+            mean = 0.5 * (double) (minIti + maxIti);
+            variance = (count * count - 1.0) / 12.0;
+            break;
+        }
+
+        case EXPONENTIAL_ITI:
+        {
+            // Exponential with mean s, truncated at w:
+            //   E[x]   = s - w e^(-w/s) / (1 - e^(-w/s))
+            //   E[x^2] = 2 s^2 - (w^2 + 2 s w) e^(-w/s) / (1 - e^(-w/s))
+            // Rounding to whole samples adds 1/12 to the variance.
+            const double width = (double) (maxIti - minIti);
+            const double tail = (1.0 - truncatedMass) / truncatedMass;
+            const double offset = scale - width * tail;
+
+            mean = (double) minIti + offset;
+            variance = 2.0 * scale * scale - (width * width + 2.0 * scale * width) * tail - offset * offset + 1.0 / 12.0;
+            break;
+        }
+
+        case FIXED_ITI:
+        {
+            mean = (double) minIti;
+            variance = 0;
+            break;
+        }
+
+        case EMPIRICAL_ITI:
+        {
+            double sum = 0;
+            double sumOfSquares = 0;
+
+            for (int64 iti : table)
+            {
+                sum += (double) iti;
+                sumOfSquares += (double) iti * (double) iti;
+            }
+
+            mean = sum / table.size();
+            variance = jmax(0.0, sumOfSquares / table.size() - mean * mean);
+            break;
+        }
+    }
+}
@@ -0,0 +1,88 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef ITISAMPLER_H_DEFINED
+#define ITISAMPLER_H_DEFINED
+
+#include "ScheduleCompiler.h"
+
+/**
+    Draws a sequence's inter-trial intervals.
+
+    Each ITI depends only on the sequence seed and the trial's
+    expansion-order index, so a whole trial table can be filled in one
+    batch, and a single trial's ITI can be drawn on demand with the
+    same result. The batch loop picks the distribution once and then
+    runs a branch-free transform over the whole range, which the
+    compiler can vectorize.
+
+    The mean and variance of one ITI are computed analytically when
+    the sampler is created, so the expected length of a sequence (and
+    its spread) is known without drawing every trial.
+*/
+class ItiSampler
+{
+public:
+    /** Constructor */
+    ItiSampler(const SequenceSpec& spec);
+
+    /** Returns the ITI of one trial, in samples */
+    int64 sample(int64 slot) const;
+
+    /** Fills the ITIs of trials [firstSlot, firstSlot + numSlots) */
+    void sample(int64 firstSlot, int numSlots, int64* destination) const;
+
+    /** Expected ITI, in samples */
+    double getMean() const { return mean; }
+
+    /** Variance of one ITI, in samples squared */
+    double getVariance() const { return variance; }
+
+    /** Heap memory used by the empirical table, in bytes */
+    size_t getMemoryUsage() const { return (size_t) table.size() * sizeof(int64); }
+
+private:
+
+    /** Maps 64 random bits to [0, 1) */
+    static double toUnit(uint64 bits) { return (double) (bits >> 11) * (1.0 / 9007199254740992.0); }
+
+    /** Works out the mean and variance of the distribution */
+    void computeMoments();
+
+    ItiDistribution distribution;
+    int64 seed;
+    int64 minIti;
+    int64 maxIti;
+
+    /** EXPONENTIAL_ITI: mean before truncation, and the probability mass below the maximum */
+    double scale = 0;
+    double truncatedMass = 0;
+
+    Array<int64> table;
+
+    double mean = 0;
+    double variance = 0;
+};
+
+#endif // ITISAMPLER_H_DEFINED
@@ -0,0 +1,203 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "MemoryReport.h"
+
+int MemoryReport::addNode(const String& kind, const String& name, int depth, const void* owner)
+{
+    MemoryNode node;
+    node.kind = kind;
+    node.name = name;
+    node.depth = depth;
+    node.owner = owner;
+
+    nodes.add(node);
+    return nodes.size() - 1;
+}
+
+void MemoryReport::addBytes(int node, MemoryCategory category, int64 numBytes)
+{
+    if (isPositiveAndBelow(node, nodes.size()))
+        nodes.getReference(node).bytes[category] += numBytes;
+}
+
+int MemoryReport::findNode(const void* owner) const
+{
+    for (int i = 0; i < nodes.size(); ++i)
+    {
+        if (nodes.getReference(i).owner == owner)
+            return i;
+    }
+
+    return -1;
+}
+
+int MemoryReport::getEnd(int node) const
+{
+    const int depth = nodes.getReference(node).depth;
+    int end = node + 1;
+
+    while (end < nodes.size() && nodes.getReference(end).depth > depth)
+        end++;
+
+    return end;
+}
+
+int64 MemoryReport::getNodeTotal(int node, int category) const
+{
+    if (!isPositiveAndBelow(node, nodes.size()))
+        return 0;
+
+    const int end = getEnd(node);
+    int64 total = 0;
+
+    for (int i = node; i < end; ++i)
+    {
+        for (int c = 0; c < NUM_MEMORY_CATEGORIES; ++c)
+        {
+            if (category < 0 || category == c)
+                total += nodes.getReference(i).bytes[c];
+        }
+    }
+
+    return total;
+}
+
+int64 MemoryReport::getTotal(int category) const
+{
+    int64 total = 0;
+
+    for (int i = 0; i < nodes.size(); i = getEnd(i))
+        total += getNodeTotal(i, category);
+
+    return total;
+}
+
+var MemoryReport::createVar(int node) const
+{
+    const MemoryNode& memoryNode = nodes.getReference(node);
+
+    DynamicObject::Ptr bytes = new DynamicObject();
+
+    for (int c = 0; c < NUM_MEMORY_CATEGORIES; ++c)
+        bytes->setProperty(getCategoryName(c), getNodeTotal(node, c));
+
+    const int end = getEnd(node);
+    Array<var> children;
+
+    for (int i = node + 1; i < end; i = getEnd(i))
+        children.add(createVar(i));
+
+    DynamicObject::Ptr object = new DynamicObject();
+    object->setProperty("kind", memoryNode.kind);
+    object->setProperty("name", memoryNode.name);
+    object->setProperty("total", getNodeTotal(node));
+    object->setProperty("bytes", var(bytes.get()));
+
+    if (!children.isEmpty())
+        object->setProperty("children", children);
+
+    return var(object.get());
+}
+
+var MemoryReport::toVar() const
+{
+    Array<var> roots;
+
+    for (int i = 0; i < nodes.size(); i = getEnd(i))
+        roots.add(createVar(i));
+
+    DynamicObject::Ptr totals = new DynamicObject();
+
+    for (int c = 0; c < NUM_MEMORY_CATEGORIES; ++c)
+        totals->setProperty(getCategoryName(c), getTotal(c));
+
+    DynamicObject::Ptr object = new DynamicObject();
+    object->setProperty("total", getTotal());
+    object->setProperty("bytes", var(totals.get()));
+    object->setProperty("nodes", roots);
+
+    return var(object.get());
+}
+
+String MemoryReport::toText() const
+{
+    const int nameWidth = 36;
+    const int columnWidth = 11;
+
+    String text = String("").paddedRight(' ', nameWidth);
+
+    for (int c = 0; c < NUM_MEMORY_CATEGORIES; ++c)
+        text << getCategoryName(c).paddedLeft(' ', columnWidth);
+
+    text << String("total").paddedLeft(' ', columnWidth) << "\n";
+
+    for (int i = 0; i < nodes.size(); ++i)
+    {
+        const MemoryNode& node = nodes.getReference(i);
+        const String label = String::repeatedString("  ", node.depth) + node.name;
+
+        text << label.substring(0, nameWidth - 1).paddedRight(' ', nameWidth);
+
+        for (int c = 0; c < NUM_MEMORY_CATEGORIES; ++c)
+            text << formatBytes(getNodeTotal(i, c)).paddedLeft(' ', columnWidth);
+
+        text << formatBytes(getNodeTotal(i)).paddedLeft(' ', columnWidth) << "\n";
+    }
+
+    text << String("Total").paddedRight(' ', nameWidth);
+
+    for (int c = 0; c < NUM_MEMORY_CATEGORIES; ++c)
+        text << formatBytes(getTotal(c)).paddedLeft(' ', columnWidth);
+
+    text << formatBytes(getTotal()).paddedLeft(' ', columnWidth) << "\n";
+
+    return text;
+}
+
+String MemoryReport::getCategoryName(int category)
+{
+    const char* const names[] = { "model", "schedule", "waveforms", "ui" };
+
+    return isPositiveAndBelow(category, (int) NUM_MEMORY_CATEGORIES) ? names[category] : "";
+}
+
+String MemoryReport::formatBytes(int64 numBytes)
+{
+    if (numBytes < 1024)
+        return String(numBytes) + " B";
+
+    if (numBytes < 1024 * 1024)
+        return String((double) numBytes / 1024.0, 1) + " KB";
+
+    if (numBytes < (int64) 1024 * 1024 * 1024)
+        return String((double) numBytes / (1024.0 * 1024.0), 1) + " MB";
+
+    return String((double) numBytes / (1024.0 * 1024.0 * 1024.0), 2) + " GB";
+}
+
+int64 MemoryReport::getStringBytes(const String& text)
+{
+    // JUCE strings share one block per value, with a reference count and size in front
+    return text.isEmpty() ? 0 : (int64) text.getNumBytesAsUTF8() + 1 + 2 * (int64) sizeof(size_t);
+}
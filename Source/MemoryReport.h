@@ -0,0 +1,135 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef MEMORYREPORT_H_DEFINED
+#define MEMORYREPORT_H_DEFINED
+
+#ifdef OPTO_STANDALONE
+#include <juce_core/juce_core.h>
+using namespace juce;
+#else
+#include <JuceHeader.h>
+#endif
+
+/** What the bytes in a MemoryReport are used for */
+enum MemoryCategory
+{
+    /** Protocol objects and their parameters */
+    MEMORY_MODEL,
+
+    /** Compiled trial tables, specs and generators */
+    MEMORY_SCHEDULE,
+
+    /** Waveform samples, resamplers and overviews */
+    MEMORY_WAVEFORMS,
+
+    /** Editor components and their drawing caches */
+    MEMORY_UI,
+
+    NUM_MEMORY_CATEGORIES
+};
+
+/** One protocol, sequence, condition or stimulus in a MemoryReport */
+struct MemoryNode
+{
+    /** "protocol", "sequence", "condition" or "stimulus" */
+    String kind;
+
+    /** Shown in the breakdown */
+    String name;
+
+    /** 0 for a protocol, increasing towards its stimuli */
+    int depth = 0;
+
+    /** The object the node describes (used to find it again) */
+    const void* owner = nullptr;
+
+    /** Bytes held by the object itself, not including its children */
+    int64 bytes[NUM_MEMORY_CATEGORIES] = {};
+};
+
+/**
+    How much memory the loaded protocols use, broken down by node and
+    by MemoryCategory.
+
+    Nodes are stored depth-first: each node is followed by the nodes
+    below it, which have a greater depth. Sizes are estimates from the
+    objects' sizes and the elements their arrays and strings hold;
+    spare capacity and allocator overhead are not counted, and memory
+    shared between nodes is counted once, by the node that owns it.
+*/
+class MemoryReport
+{
+public:
+    /** Constructor */
+    MemoryReport() { }
+
+    /** Appends a node; returns its index */
+    int addNode(const String& kind, const String& name, int depth, const void* owner);
+
+    /** Adds bytes to a node (ignored if the index is out of range) */
+    void addBytes(int node, MemoryCategory category, int64 numBytes);
+
+    /** Returns the node describing an object (-1 if there is none) */
+    int findNode(const void* owner) const;
+
+    /** Returns the number of nodes */
+    int getNumNodes() const { return nodes.size(); }
+
+    /** Returns a node */
+    const MemoryNode& getNode(int node) const { return nodes.getReference(node); }
+
+    /** Returns the bytes of a node and every node below it (in one category, or all if category < 0) */
+    int64 getNodeTotal(int node, int category = -1) const;
+
+    /** Returns the bytes of every node (in one category, or all if category < 0) */
+    int64 getTotal(int category = -1) const;
+
+    /** Returns the report as nested JSON objects */
+    var toVar() const;
+
+    /** Returns the report as an indented table */
+    String toText() const;
+
+    /** Returns the name of a MemoryCategory */
+    static String getCategoryName(int category);
+
+    /** Formats a number of bytes (B, KB, MB or GB) */
+    static String formatBytes(int64 numBytes);
+
+    /** Estimates the heap bytes of a string */
+    static int64 getStringBytes(const String& text);
+
+private:
+
+    /** Returns the index after the last node below a node */
+    int getEnd(int node) const;
+
+    /** Builds the JSON object of a node and the nodes below it */
+    var createVar(int node) const;
+
+    Array<MemoryNode> nodes;
+};
+
+#endif // MEMORYREPORT_H_DEFINED
@@ -22,59 +22,84 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "OptoProtocolCanvas.h"
+#include "OptoProtocolGenerator.h"
+#include "TraceRecorder.h"
 #include <juce_gui_basics/juce_gui_basics.h>
+
+/** Estimates the memory used by a component and its descendants, leaving out the
+    subtrees in skipped (only the Component part of each one is counted) */
+static size_t getComponentMemoryUsage(Component* component, const Array<Component*>& skipped)
+{
+    size_t bytes = sizeof(Component) + (size_t) MemoryReport::getStringBytes(component->getName());
+
+    for (int i = 0; i < component->getNumChildComponents(); ++i)
+    {
+        Component* child = component->getChildComponent(i);
+
+        if (!skipped.contains(child))
+            bytes += getComponentMemoryUsage(child, skipped);
+    }
+
+    return bytes;
+}
 using namespace juce;
 
 ColourSelectorWidget::ColourSelectorWidget(Condition* condition_, OptoProtocolInterface* parent_)
     : condition(condition_), parent(parent_)
 {
-    redButton = std::make_unique<TextButton>("redButton");
-    redButton->setButtonText("638");
-    redButton->setClickingTogglesState(true);
-    redButton->setToggleState(true, dontSendNotification);
-    redButton->setColour(TextButton::buttonColourId, Colours::darkgrey);
-    redButton->setColour(TextButton::buttonOnColourId, Colours::red);
-    redButton->setColour(TextButton::textColourOnId, Colours::white);
-    redButton->setColour(TextButton::textColourOffId, Colours::white);
-    redButton->addListener(this);
-    addAndMakeVisible(redButton.get());
-    redButton->setBounds(46, 0, 40, 20);
-    
-    blueButton = std::make_unique<TextButton>("blueButton");
-    blueButton->setButtonText("450");
-    blueButton->setClickingTogglesState(true);
-    blueButton->setToggleState(false, dontSendNotification);
-    blueButton->setColour(TextButton::buttonColourId, Colours::darkgrey);
-    blueButton->setColour(TextButton::buttonOnColourId, Colour(38, 173, 252));
-    blueButton->setColour(TextButton::textColourOnId, Colours::white);
-    blueButton->setColour(TextButton::textColourOffId, Colours::white);
-    blueButton->addListener(this);
-    addAndMakeVisible(blueButton.get());
-    blueButton->setBounds(0, 0, 40, 20);
+    wavelengths = SharedResourcePointer<DeviceRegistry>()->getAllWavelengths();
+
+    int x = 0;
+
+    for (int wavelength : wavelengths)
+    {
+        TextButton* button = wavelengthButtons.add(new TextButton("wavelengthButton" + String(wavelength)));
+        button->setButtonText(String(wavelength));
+        button->setClickingTogglesState(true);
+        button->setToggleState(condition->availableWavelengths.contains(wavelength), dontSendNotification);
+        button->setColour(TextButton::buttonColourId, Colours::darkgrey);
+        button->setColour(TextButton::buttonOnColourId, getWavelengthColour(wavelength));
+        button->setColour(TextButton::textColourOnId, Colours::white);
+        button->setColour(TextButton::textColourOffId, Colours::white);
+        button->addListener(this);
+        addAndMakeVisible(button);
+        button->setBounds(x, 0, 40, 20);
+
+        x += 46;
+    }
     
     wavelengthLabel = std::make_unique<Label>("wavelengthLabel", "Wavelength");
     wavelengthLabel->setFont(FontOptions ("Inter", "Regular", 13.5));
     wavelengthLabel->setJustificationType(Justification::centredLeft);
     addAndMakeVisible(wavelengthLabel.get());
-    wavelengthLabel->setBounds(90, 0, 100, 20);
+    wavelengthLabel->setBounds(x, 0, 100, 20);
     
 }
 
+Colour ColourSelectorWidget::getWavelengthColour(int wavelength)
+{
+    if (wavelength < 420)
+        return Colour(130, 0, 200);
+    if (wavelength < 490)
+        return Colour(38, 173, 252);
+    if (wavelength < 570)
+        return Colour(40, 200, 60);
+    if (wavelength < 600)
+        return Colour(240, 200, 0);
+
+    return Colours::red;
+}
+
 void ColourSelectorWidget::buttonClicked(Button* button)
 {
-    if (redButton->getToggleState())
-    {
-        condition->addWavelength(638);
-    } else {
-        condition->removeWavelength(638);
-    }
-        
-    if (blueButton->getToggleState())
+    for (int i = 0; i < wavelengths.size(); ++i)
     {
-        condition->addWavelength(450);
-    } else {
-        condition->removeWavelength(450);
+        if (wavelengthButtons[i]->getToggleState())
+            condition->addWavelength(wavelengths[i]);
+        else
+            condition->removeWavelength(wavelengths[i]);
     }
+
     parent->parameterChangeRequest(nullptr);
     
 }
@@ -82,16 +107,18 @@ void ColourSelectorWidget::buttonClicked(Button* button)
 
 void ColourSelectorWidget::enable()
 {
-    redButton->setEnabled(true);
-    blueButton->setEnabled(true);
+    for (auto* button : wavelengthButtons)
+        button->setEnabled(true);
+
     wavelengthLabel->setEnabled(true);
 
 }
 
 void ColourSelectorWidget::disable()
 {
-    redButton->setEnabled(false);
-    blueButton->setEnabled(false);
+    for (auto* button : wavelengthButtons)
+        button->setEnabled(false);
+
     wavelengthLabel->setEnabled(false);
 
 }
@@ -103,6 +130,19 @@ CustomStimulusInterface::CustomStimulusInterface(CustomStimulus* custom_stimulus
     
     sampleFrequencyEditor = std::make_unique<BoundedValueParameterEditor>(&custom_stimulus->sample_frequency);
     addAndMakeVisible(sampleFrequencyEditor.get());
+
+    importButton = std::make_unique<TextButton>("importButton");
+    importButton->setButtonText("Import");
+    importButton->setTooltip("Load a waveform from a .npy, .wav, .csv or .txt file");
+    importButton->addListener(this);
+    addAndMakeVisible(importButton.get());
+
+    statusLabel = std::make_unique<Label>("statusLabel",
+        custom_stimulus->getWaveform().isEmpty() ? "No waveform"
+                                                     : String(custom_stimulus->getWaveform().size()) + " samples");
+    statusLabel->setFont(FontOptions ("Inter", "Regular", 13));
+    statusLabel->setJustificationType(Justification::centredLeft);
+    addAndMakeVisible(statusLabel.get());
     
     setBounds(0, 0, 0, 400);
 }
@@ -111,18 +151,125 @@ void CustomStimulusInterface::resized()
 {
     
     sampleFrequencyEditor->setBounds(0, 0, 150, 20);
+    importButton->setBounds(0, 30, 70, 20);
+    statusLabel->setBounds(80, 30, 220, 20);
     
 }
 
+void CustomStimulusInterface::paint(Graphics& g)
+{
+    const WaveformOverview& overview = custom_stimulus->getOverview();
+    const Rectangle<int> bounds = getOverviewBounds();
+
+    if (overview.size() == 0 || bounds.getWidth() <= 0)
+        return;
+
+    float minimum = overview.minimum[0];
+    float maximum = overview.maximum[0];
+
+    for (int i = 1; i < overview.size(); ++i)
+    {
+        minimum = jmin(minimum, overview.minimum[i]);
+        maximum = jmax(maximum, overview.maximum[i]);
+    }
+
+    const float range = jmax(1.0e-6f, maximum - minimum);
+    auto toY = [&] (float value) { return (float) bounds.getBottom() - (value - minimum) / range * (float) bounds.getHeight(); };
+
+    g.setColour(findColour(ThemeColours::defaultText).withAlpha(0.7f));
+
+    // One vertical line per pixel column, spanning every bucket that falls in it
+    for (int x = 0; x < bounds.getWidth(); ++x)
+    {
+        const int first = x * overview.size() / bounds.getWidth();
+        const int last = jmax(first + 1, (x + 1) * overview.size() / bounds.getWidth());
+
+        float low = overview.minimum[first];
+        float high = overview.maximum[first];
+
+        for (int i = first + 1; i < last; ++i)
+        {
+            low = jmin(low, overview.minimum[i]);
+            high = jmax(high, overview.maximum[i]);
+        }
+
+        g.drawVerticalLine(bounds.getX() + x, toY(high), jmax(toY(high) + 1.0f, toY(low)));
+    }
+}
+
+void CustomStimulusInterface::buttonClicked(Button* button)
+{
+    if (button != importButton.get())
+        return;
+
+    FileChooser chooser("Select a waveform file", File(), WaveformFile::getWildcard());
+
+    if (!chooser.browseForFileToOpen())
+        return;
+
+    waveformFile = chooser.getResult();
+    loader.load(waveformFile);
+
+    importButton->setEnabled(false);
+    statusLabel->setText("Loading " + waveformFile.getFileName(), dontSendNotification);
+    startTimer(50);
+}
+
+void CustomStimulusInterface::timerCallback()
+{
+    if (loader.isLoading())
+    {
+        statusLabel->setText("Loading " + waveformFile.getFileName() + " ("
+                                 + String(roundToInt(loader.getProgress() * 100)) + "%)",
+                             dontSendNotification);
+        return;
+    }
+
+    stopTimer();
+    importButton->setEnabled(true);
+
+    Result result = Result::ok();
+    DecodedWaveform waveform;
+
+    if (!loader.getResult(result, waveform))
+        return;
+
+    if (result.failed())
+    {
+        LOGE("Unable to load waveform: ", result.getErrorMessage());
+        statusLabel->setText(result.getErrorMessage(), dontSendNotification);
+        return;
+    }
+
+    LOGC("Loaded ", waveform.samples.size(), " samples from ", waveformFile.getFullPathName());
+
+    custom_stimulus->setWaveform(std::move(waveform.samples), std::move(waveform.overview));
+
+    // WAV files carry their own rate
+    if (waveform.sampleRate > 0)
+        custom_stimulus->sample_frequency.setNextValue(jlimit(custom_stimulus->sample_frequency.getMinValue(),
+                                                              custom_stimulus->sample_frequency.getMaxValue(),
+                                                              (float) waveform.sampleRate));
+
+    statusLabel->setText(waveformFile.getFileName() + ": "
+                             + String(custom_stimulus->getWaveform().size()) + " samples",
+                         dontSendNotification);
+
+    parent->parameterChangeRequest(nullptr);
+    repaint();
+}
+
 void CustomStimulusInterface::enable()
 {
     sampleFrequencyEditor->parameterEnabled(true);
+    importButton->setEnabled(!loader.isLoading());
 
 }
 
 void CustomStimulusInterface::disable()
 {
     sampleFrequencyEditor->parameterEnabled(false);
+    importButton->setEnabled(false);
 
 }
     
@@ -286,6 +433,64 @@ void RemoveConditionButton::colourChanged()
     setImages(&normalDrawable, &overDrawable, nullptr, nullptr, nullptr);
 }
 
+StimulusThumbnail::StimulusThumbnail(Stimulus* stimulus_)
+    : stimulus(stimulus_)
+{
+    setInterceptsMouseClicks(false, false);
+    update();
+}
+
+void StimulusThumbnail::update()
+{
+    const double sampleRate = stimulus->condition->sequence->protocol->getSampleRate();
+
+    if (preview.update(stimulus->createSpec(sampleRate)))
+    {
+        updateColumns();
+        repaint();
+    }
+}
+
+void StimulusThumbnail::resized()
+{
+    updateColumns();
+}
+
+void StimulusThumbnail::updateColumns()
+{
+    columns = preview.getColumns(getWidth());
+}
+
+void StimulusThumbnail::paint(Graphics& g)
+{
+    const TraceScope trace("ui", "thumbnail_paint");
+
+    if (columns.size() == 0)
+        return;
+
+    // Envelopes are drawn on a fixed 0 to 1 scale; custom waveforms are fitted to their range
+    float minimum = 0.0f;
+    float maximum = 1.0f;
+
+    if (stimulus->type == StimulusType::CUSTOM)
+    {
+        minimum = preview.getMinimum();
+        maximum = preview.getMaximum();
+    }
+
+    const float range = jmax(1.0e-6f, maximum - minimum);
+    const float height = (float) getHeight() - 1.0f;
+    auto toY = [&] (float value) { return height - (value - minimum) / range * height; };
+
+    g.setColour(findColour(ThemeColours::defaultText).withAlpha(0.7f));
+
+    for (int x = 0; x < columns.size(); ++x)
+    {
+        const float top = toY(columns.maximum[x]);
+        g.drawVerticalLine(x, top, jmax(top + 1.0f, toY(columns.minimum[x])));
+    }
+}
+
 OptoConditionInterface::OptoConditionInterface(Condition* condition_, Stimulus* stimulus_,
                                              OptoProtocolInterface* parent_)
     : condition(condition_), stimulus(stimulus_), parent(parent_)
@@ -325,6 +530,9 @@ OptoConditionInterface::OptoConditionInterface(Condition* condition_, Stimulus*
     stimulusTypeLabel->setJustificationType(Justification::centredLeft);
     addAndMakeVisible(stimulusTypeLabel.get());
 
+    thumbnail = std::make_unique<StimulusThumbnail>(stimulus);
+    addAndMakeVisible(thumbnail.get());
+
     // DrawableButton for delete (X)
     deleteButton = std::make_unique<RemoveConditionButton>();
     deleteButton->setTooltip("Delete this condition");
@@ -343,6 +551,7 @@ OptoConditionInterface::~OptoConditionInterface()
 void OptoConditionInterface::resized()
 {
     stimulusTypeLabel->setBounds(12, 12, 100, 20);
+    thumbnail->setBounds(112, 12, 70, 22);
     sourceEditor->setBounds(190, 15, 180, 20);
     colourSelectorWidget->setBounds(15, 50, 180, 20);
     siteEditor->setBounds(15, 80, 150, 20);
@@ -358,12 +567,26 @@ void OptoConditionInterface::resized()
     if (rampStimulusInterface.get() != nullptr)
         rampStimulusInterface->setBounds(190, 55, getWidth()-190, getHeight()-55);
 
+    if (customStimulusInterface.get() != nullptr)
+        customStimulusInterface->setBounds(190, 55, getWidth()-190, getHeight()-55);
+
     // Place delete button in top-right corner
     if (deleteButton)
         deleteButton->setBounds(getWidth() - 20, 4, 16, 16);
     
 }
 
+void OptoConditionInterface::updateThumbnail()
+{
+    thumbnail->update();
+}
+
+void OptoConditionInterface::addMemoryUsage(MemoryReport& report)
+{
+    report.addBytes(report.findNode(condition), MEMORY_UI,
+                    (int64) (getComponentMemoryUsage(this, {}) + thumbnail->getMemoryUsage()));
+}
+
 void OptoConditionInterface::requestDelete()
 {
     if (parent)
@@ -437,25 +660,34 @@ OptoSequenceInterface::OptoSequenceInterface(const String& name,
     addAndMakeVisible(addConditionButton.get());
     
     
-    Array<String> availableSources = {"Probe A", "Probe B"};
-    Array<int> sitesPerSource = {14, 14};
-    Array<int> availableWavelengths = {638};
-    
-    Condition* condition = new Condition(parent,                                             availableSources,
-                                         sitesPerSource,
-                                         availableWavelengths,
-                                         sequence);
-    
-    sequence->addCondition(condition);
-    
-    PulseTrain* pulseTrain = new PulseTrain(parent,
-                                            condition);
-    
-    
-    condition->addStimulus(pulseTrain);
+    if (sequence->conditions.isEmpty())
+    {
+        SharedResourcePointer<DeviceRegistry> devices;
+        
+        Condition* condition = new Condition(parent,
+                                             devices->getSourceNames(),
+                                             devices->getSitesPerSource(),
+                                             { devices->getDefaultWavelength() },
+                                             sequence);
+        
+        sequence->addCondition(condition);
+        
+        PulseTrain* pulseTrain = new PulseTrain(parent,
+                                                condition);
+        
+        
+        condition->addStimulus(pulseTrain);
+    }
     
-    conditionInterfaces.add(new OptoConditionInterface(condition, pulseTrain, parent));
-    addAndMakeVisible(conditionInterfaces.getLast());
+    // Restored sequences already have their conditions
+    for (auto* condition : sequence->conditions)
+    {
+        if (condition->stimuli.isEmpty())
+            continue;
+
+        conditionInterfaces.add(new OptoConditionInterface(condition, condition->stimuli.getFirst(), parent));
+        addAndMakeVisible(conditionInterfaces.getLast());
+    }
     
     baselineIntervalEditor = std::make_unique<BoundedValueParameterEditor>(&sequence->baseline_interval);
     addAndMakeVisible(baselineIntervalEditor.get());
@@ -463,10 +695,24 @@ OptoSequenceInterface::OptoSequenceInterface(const String& name,
     addAndMakeVisible(minItiEditor.get());
     maxItiEditor = std::make_unique<BoundedValueParameterEditor>(&sequence->max_iti);
     addAndMakeVisible(maxItiEditor.get());
+    itiDistributionEditor = std::make_unique<ComboBoxParameterEditor>(&sequence->iti_distribution);
+    addAndMakeVisible(itiDistributionEditor.get());
+    meanItiEditor = std::make_unique<BoundedValueParameterEditor>(&sequence->mean_iti);
+    addAndMakeVisible(meanItiEditor.get());
+    itiTableEditor = std::make_unique<TextBoxParameterEditor>(&sequence->iti_table);
+    addAndMakeVisible(itiTableEditor.get());
     randomizeEditor = std::make_unique<ToggleParameterEditor>(&sequence->randomize);
     addAndMakeVisible(randomizeEditor.get());
+    randomizationEditor = std::make_unique<ComboBoxParameterEditor>(&sequence->randomization);
+    addAndMakeVisible(randomizationEditor.get());
+    maxRunLengthEditor = std::make_unique<BoundedValueParameterEditor>(&sequence->max_run_length);
+    addAndMakeVisible(maxRunLengthEditor.get());
+    runCategoryEditor = std::make_unique<ComboBoxParameterEditor>(&sequence->run_category);
+    addAndMakeVisible(runCategoryEditor.get());
+    catchRatioEditor = std::make_unique<BoundedValueParameterEditor>(&sequence->catch_ratio);
+    addAndMakeVisible(catchRatioEditor.get());
     
-    setBounds(0, 0, 0, 230 + conditionInterfaceHeight);
+    setBounds(0, 0, 0, 280 + (10 + conditionInterfaceHeight) * conditionInterfaces.size());
 }
     
 
@@ -487,7 +733,16 @@ void OptoSequenceInterface::resized()
     maxItiEditor->setBounds(leftMargin, 110, 150, 20);
     randomizeEditor->setBounds(leftMargin, 140, 150, 20);
     
-    int currentHeight = 180;
+    randomizationEditor->setBounds(200, 50, 165, 20);
+    maxRunLengthEditor->setBounds(200, 80, 150, 20);
+    runCategoryEditor->setBounds(200, 110, 165, 20);
+    catchRatioEditor->setBounds(200, 140, 150, 20);
+    
+    itiDistributionEditor->setBounds(leftMargin, 170, 165, 20);
+    meanItiEditor->setBounds(200, 170, 150, 20);
+    itiTableEditor->setBounds(leftMargin, 200, 335, 20);
+    
+    int currentHeight = 240;
     LOGD("OptoSequenceInterface::resized()");
     LOGD("Starting height: ", currentHeight);
     LOGD("Num condition interfaces: ", conditionInterfaces.size());
@@ -513,7 +768,14 @@ void OptoSequenceInterface::enable()
     baselineIntervalEditor->setEnabled(true);
     minItiEditor->setEnabled(true);
     maxItiEditor->setEnabled(true);
+    itiDistributionEditor->setEnabled(true);
+    meanItiEditor->setEnabled(true);
+    itiTableEditor->setEnabled(true);
     randomizeEditor->setEnabled(true);
+    randomizationEditor->setEnabled(true);
+    maxRunLengthEditor->setEnabled(true);
+    runCategoryEditor->setEnabled(true);
+    catchRatioEditor->setEnabled(true);
     
     for (auto condition : conditionInterfaces)
     {
@@ -531,7 +793,14 @@ void OptoSequenceInterface::disable()
     baselineIntervalEditor->setEnabled(false);
     minItiEditor->setEnabled(false);
     maxItiEditor->setEnabled(false);
+    itiDistributionEditor->setEnabled(false);
+    meanItiEditor->setEnabled(false);
+    itiTableEditor->setEnabled(false);
     randomizeEditor->setEnabled(false);
+    randomizationEditor->setEnabled(false);
+    maxRunLengthEditor->setEnabled(false);
+    runCategoryEditor->setEnabled(false);
+    catchRatioEditor->setEnabled(false);
     
     for (auto condition : conditionInterfaces)
     {
@@ -541,6 +810,25 @@ void OptoSequenceInterface::disable()
     addConditionButton->setEnabled(false);
 }
 
+void OptoSequenceInterface::updateThumbnails()
+{
+    for (auto conditionInterface : conditionInterfaces)
+        conditionInterface->updateThumbnail();
+}
+
+void OptoSequenceInterface::addMemoryUsage(MemoryReport& report)
+{
+    Array<Component*> skipped;
+
+    for (auto conditionInterface : conditionInterfaces)
+        skipped.add(conditionInterface);
+
+    report.addBytes(report.findNode(sequence), MEMORY_UI, (int64) getComponentMemoryUsage(this, skipped));
+
+    for (auto conditionInterface : conditionInterfaces)
+        conditionInterface->addMemoryUsage(report);
+}
+
 bool OptoSequenceInterface::removeCondition(OptoConditionInterface* conditionInterface)
 {
     if (conditionInterfaces.contains(conditionInterface))
@@ -551,7 +839,7 @@ bool OptoSequenceInterface::removeCondition(OptoConditionInterface* conditionInt
         conditionInterfaces.removeObject(conditionInterface, true);
         LOGD("New number of condition interfaces: ", conditionInterfaces.size());
         int numInterfaces = conditionInterfaces.size();
-        setBounds(0,0,0,230 + (10 + conditionInterfaceHeight) * numInterfaces);
+        setBounds(0,0,0,290 + (10 + conditionInterfaceHeight) * numInterfaces);
         return true;
     } else {
         LOGD("Condition interface not found in this sequence.");
@@ -567,14 +855,13 @@ void OptoSequenceInterface::buttonClicked(Button* button)
         // add stimulus
         LOGD("Add condition button clicked.");
         
-        Array<String> availableSources = {"Probe A", "Probe B"};
-        Array<int> sitesPerSource = {14, 14};
-        Array<int> availableWavelengths = {638};
+        SharedResourcePointer<DeviceRegistry> devices;
         
-        Condition* condition =new Condition(parent,                                                 availableSources,
-                                            sitesPerSource,
-                                            availableWavelengths,
-                                            sequence);
+        Condition* condition = new Condition(parent,
+                                             devices->getSourceNames(),
+                                             devices->getSitesPerSource(),
+                                             { devices->getDefaultWavelength() },
+                                             sequence);
         
         sequence->addCondition(condition);
         
@@ -627,28 +914,38 @@ void OptoSequenceInterface::buttonClicked(Button* button)
         addAndMakeVisible(conditionInterfaces.getLast());
         
         int numInterfaces = conditionInterfaces.size();
-        setBounds(0,0,0,230 + (10 + conditionInterfaceHeight) * numInterfaces);
+        setBounds(0,0,0,290 + (10 + conditionInterfaceHeight) * numInterfaces);
         parent->resized();
         parent->updateBounds(conditionInterfaceHeight-20);
         
-        parent->timeline->setTotalTime(sequence->protocol->getTotalTime());
+        parent->timeline->setTotalTime(sequence->protocol->getTotalTime(), sequence->protocol->getTotalTimeStdDev());
         parent->timeline->setTotalTrials(sequence->protocol->getTotalTrials());
     
     }
 }
     
 
-OptoProtocolInterface::OptoProtocolInterface(const String& name, Viewport* viewport_)
+OptoProtocolInterface::OptoProtocolInterface(const String& name, Viewport* viewport_, XmlElement* state)
     : ParameterOwner(ParameterOwner::OTHER), viewport(viewport_)
 {
 
     protocol = std::make_unique<Protocol>(name, this);
-    
-    Sequence* defaultSequence = new Sequence(this, protocol.get());
-    
-    protocol->addSequence(defaultSequence);
-    sequenceInterfaces.add(new OptoSequenceInterface("Sequence 1", defaultSequence, this));
-    addAndMakeVisible(sequenceInterfaces.getLast());
+
+    if (state != nullptr)
+        protocol->loadState(*state);
+
+    if (protocol->sequences.isEmpty())
+    {
+        Sequence* defaultSequence = new Sequence(this, protocol.get());
+        
+        protocol->addSequence(defaultSequence);
+    }
+
+    for (auto* sequence : protocol->sequences)
+    {
+        sequenceInterfaces.add(new OptoSequenceInterface("Sequence " + String(sequenceInterfaces.size() + 1), sequence, this));
+        addAndMakeVisible(sequenceInterfaces.getLast());
+    }
     
     addSequenceButton = std::make_unique<TextButton>("addSequenceButton");
     addSequenceButton->setButtonText("Add Sequence");
@@ -717,7 +1014,7 @@ void OptoProtocolInterface::buttonClicked(Button* button)
        
         updateBounds(sequenceInterfaces.getLast()->getHeight());
         
-        timeline->setTotalTime(protocol->getTotalTime());
+        timeline->setTotalTime(protocol->getTotalTime(), protocol->getTotalTimeStdDev());
         timeline->setTotalTrials(protocol->getTotalTrials());
     }
 }
@@ -749,20 +1046,38 @@ void OptoProtocolInterface::parameterChangeRequest(Parameter* parameter)
     protocol->reset();
     protocol->createTrials();
     
-    timeline->setTotalTime(protocol->getTotalTime());
+    timeline->setTotalTime(protocol->getTotalTime(), protocol->getTotalTimeStdDev());
     timeline->setTotalTrials(protocol->getTotalTrials());
     
+    for (auto sequenceInterface : sequenceInterfaces)
+        sequenceInterface->updateThumbnails();
+    
 }
 
 void OptoProtocolInterface::setTimeline(ProtocolTimeline* timeline_)
 {
     timeline = timeline_;
     
-    timeline->setTotalTime(protocol->getTotalTime());
+    timeline->setTotalTime(protocol->getTotalTime(), protocol->getTotalTimeStdDev());
     timeline->setTotalTrials(protocol->getTotalTrials());
     protocol->addActionListener(timeline);
 }
 
+void OptoProtocolInterface::addMemoryUsage(MemoryReport& report)
+{
+    const int node = protocol->addMemoryUsage(report);
+
+    Array<Component*> skipped;
+
+    for (auto sequenceInterface : sequenceInterfaces)
+        skipped.add(sequenceInterface);
+
+    report.addBytes(node, MEMORY_UI, (int64) getComponentMemoryUsage(this, skipped));
+
+    for (auto sequenceInterface : sequenceInterfaces)
+        sequenceInterface->addMemoryUsage(report);
+}
+
 void OptoProtocolInterface::enable()
 {
     for (auto sequence : sequenceInterfaces)
@@ -788,6 +1103,8 @@ void OptoProtocolInterface::disable()
 
 void ProtocolTimeline::paint(Graphics& g)
 {
+    const TraceScope trace("ui", "timeline_paint");
+
     g.setColour(findColour(ThemeColours::defaultText));
     g.drawText(getTimeString(elapsedTime), 0, 0, 50, 20, Justification::centredLeft);
     g.drawText(getTimeString(totalTime-elapsedTime),getWidth()-150, 0, 50, 20, Justification::centredRight);
@@ -892,9 +1209,15 @@ void ProtocolTimeline::reset()
     LOGD("Resetting protocol timeline");
 }
  
-void ProtocolTimeline::setTotalTime(float timeInSeconds)
+void ProtocolTimeline::setTotalTime(float timeInSeconds, float stdDevInSeconds)
 {
      totalTime = timeInSeconds;
+
+     if (stdDevInSeconds > 0)
+         setTooltip("Expected duration " + getTimeString(timeInSeconds) + " +/- " + getTimeString(stdDevInSeconds) + " (ITI spread, 1 s.d.)");
+     else
+         setTooltip("Duration " + getTimeString(timeInSeconds));
+
      repaint();
 }
  
@@ -917,6 +1240,29 @@ void ProtocolTimeline::setCurrentTrial(int trialNumber)
 }
 
 
+SimulationThread::SimulationThread(const Array<SourceDescription>& sources,
+                                   const PowerCalibration* calibration,
+                                   const Array<Protocol*>& protocols_,
+                                   const File& directory_,
+                                   bool writeOutput_)
+    : ThreadWithProgressWindow("Simulating protocols", true, true),
+      simulator(sources, calibration),
+      protocols(protocols_),
+      directory(directory_),
+      writeOutput(writeOutput_)
+{
+}
+
+void SimulationThread::run()
+{
+    result = simulator.run(protocols, directory, writeOutput, summary, [this](double progress)
+    {
+        setProgress(progress);
+        return !threadShouldExit();
+    });
+}
+
+
 OptoProtocolCanvas::OptoProtocolCanvas(OptoProtocolGenerator* processor_)
     : processor(processor_)
 {
@@ -925,19 +1271,8 @@ OptoProtocolCanvas::OptoProtocolCanvas(OptoProtocolGenerator* processor_)
     viewport->setScrollBarsShown(true, false);
     viewport->setScrollBarThickness(15);
     addAndMakeVisible(viewport.get());
-    
-    // Create the content component
-    protocolInterfaces.add(new OptoProtocolInterface("Optotagging 1", viewport.get()));
-    
-    // Set an initial size for the content component
-    protocolInterfaces.getLast()->setSize(getWidth(), 500); // Initial height, will be adjusted in resized()
-    
-    // Set the content component as the viewport's viewed component
-    viewport->setViewedComponent(protocolInterfaces[0], false);
 
     protocolSelector = std::make_unique<ComboBox>("protocolSelector");
-    protocolSelector->addItem("Optotagging 1", 1);
-    protocolSelector->setSelectedId(1, dontSendNotification);
     protocolSelector->addListener(this);
     addAndMakeVisible(protocolSelector.get());
     
@@ -948,11 +1283,43 @@ OptoProtocolCanvas::OptoProtocolCanvas(OptoProtocolGenerator* processor_)
     
     protocolTimeline = std::make_unique<ProtocolTimeline>();
     addAndMakeVisible(protocolTimeline.get());
-    
-    protocolInterfaces.getLast()->setTimeline(protocolTimeline.get());
-    currentProtocol = protocolInterfaces.getLast()->getProtocol();
-    currentProtocol->addActionListener(this);
-    
+
+    protocolRunner = std::make_unique<ProtocolRunner>();
+    protocolRunner->addActionListener(this);
+    protocolRunner->setRenderPipeline(processor->getRenderPipeline());
+    protocolRunner->setMetrics(processor->getMetrics());
+    processor->setCanvas(this);
+
+    lookaheadSelector = std::make_unique<ComboBox>("lookaheadSelector");
+
+    for (int numTrials = 1; numTrials <= 32; numTrials *= 2)
+        lookaheadSelector->addItem(String(numTrials), numTrials);
+
+    lookaheadSelector->setSelectedId(processor->getRenderPipeline()->getLookahead(), dontSendNotification);
+    lookaheadSelector->addListener(this);
+    addAndMakeVisible(lookaheadSelector.get());
+
+    lookaheadLabel = std::make_unique<Label>("lookaheadLabel", "Trials ahead");
+    lookaheadLabel->setFont(FontOptions ("Inter", "Regular", 15));
+    lookaheadLabel->setJustificationType(Justification::centredLeft);
+    addAndMakeVisible(lookaheadLabel.get());
+
+    renderStatusLabel = std::make_unique<Label>("renderStatusLabel", "");
+    renderStatusLabel->setFont(FontOptions ("Inter", "Regular", 13));
+    renderStatusLabel->setJustificationType(Justification::centredLeft);
+    addAndMakeVisible(renderStatusLabel.get());
+
+    // Protocols saved with the settings, or a default one
+    if (XmlElement* savedProtocols = processor->getSavedProtocols())
+    {
+        loadProtocols(*savedProtocols);
+    }
+    else
+    {
+        addProtocolInterface("Optotagging 1");
+        updateSettings();
+    }
+
     newProtocolButton = std::make_unique<TextButton>("newProtocolButton");
     newProtocolButton->setButtonText("New");
     newProtocolButton->addListener(this);
@@ -962,6 +1329,12 @@ OptoProtocolCanvas::OptoProtocolCanvas(OptoProtocolGenerator* processor_)
     deleteProtocolButton->setButtonText("Delete");
     deleteProtocolButton->addListener(this);
     addAndMakeVisible(deleteProtocolButton.get());
+
+    exportButton = std::make_unique<TextButton>("exportButton");
+    exportButton->setButtonText("Export");
+    exportButton->setTooltip("Save the protocol's definition for the command-line compiler");
+    exportButton->addListener(this);
+    addAndMakeVisible(exportButton.get());
     
     runButton = std::make_unique<TextButton>("runButton");
     runButton->setButtonText("Run");
@@ -972,21 +1345,193 @@ OptoProtocolCanvas::OptoProtocolCanvas(OptoProtocolGenerator* processor_)
     resetButton->setButtonText("Reset");
     resetButton->addListener(this);
     addAndMakeVisible(resetButton.get());
+
+    simulateButton = std::make_unique<TextButton>("simulateButton");
+    simulateButton->setButtonText("Simulate");
+    simulateButton->setTooltip("Play every protocol faster than real time and save the trials and rendered output");
+    simulateButton->addListener(this);
+    addAndMakeVisible(simulateButton.get());
+
+    traceButton = std::make_unique<TextButton>("traceButton");
+    traceButton->setButtonText("Trace");
+    traceButton->setTooltip("Record what each thread is doing; the trace is saved for Perfetto when this is turned off");
+    traceButton->setClickingTogglesState(true);
+    traceButton->addListener(this);
+    addAndMakeVisible(traceButton.get());
+
+    memoryButton = std::make_unique<TextButton>("memoryButton");
+    memoryButton->setButtonText("Memory");
+    memoryButton->setTooltip("Show how much memory each protocol, sequence and condition uses");
+    memoryButton->addListener(this);
+    addAndMakeVisible(memoryButton.get());
+
+    TraceRecorder::setThreadName("Message thread");
+
+    processor->setMemoryReporter([canvas = Component::SafePointer<OptoProtocolCanvas>(this)](MemoryReport& report)
+        {
+            if (canvas == nullptr)
+                return;
+
+            for (auto* protocolInterface : canvas->protocolInterfaces)
+                protocolInterface->addMemoryUsage(report);
+        });
+
+    controlServer = std::make_unique<ControlServer>(
+        [canvas = Component::SafePointer<OptoProtocolCanvas>(this)](const ControlRequest& request)
+        {
+            return handleControlRequest(canvas, request);
+        });
+
+    Result result = controlServer->start(getDefaultControlSocketPath());
+
+    if (result.failed())
+        LOGE("Control API unavailable: ", result.getErrorMessage());
+    else
+        LOGC("Control API listening on ", controlServer->getSocketPath());
 }
 
 OptoProtocolCanvas::~OptoProtocolCanvas()
 {
+    releaseProcessor();
+
     // The viewport will delete the content component when it's no longer needed
     viewport->setViewedComponent(nullptr, false);
 }
 
+void OptoProtocolCanvas::releaseProcessor()
+{
+    if (processor == nullptr)
+        return;
+
+    // Requests are carried out against the processor
+    controlServer.reset();
+
+    finishRun();
+
+    if (TraceRecorder::isEnabled())
+        stopTracing();
+
+    protocolRunner->clear();
+    protocolRunner->setRenderPipeline(nullptr);
+    protocolRunner->setMetrics(nullptr);
+
+    for (auto* protocolInterface : protocolInterfaces)
+    {
+        protocolInterface->getProtocol()->setTrialLog(nullptr);
+        protocolInterface->getProtocol()->setTrialEvents(nullptr);
+    }
+
+    // A canvas created later starts from these protocols
+    processor->setSavedProtocols(createProtocolsXml());
+    processor->setMemoryReporter(nullptr);
+    processor->setCanvas(nullptr);
+    processor = nullptr;
+}
+
+std::unique_ptr<XmlElement> OptoProtocolCanvas::createProtocolsXml()
+{
+    auto xml = std::make_unique<XmlElement>("PROTOCOLS");
+
+    for (auto* protocolInterface : protocolInterfaces)
+        protocolInterface->getProtocol()->saveState(*xml->createNewChildElement("PROTOCOL"));
+
+    return xml;
+}
+
+void OptoProtocolCanvas::loadProtocols(XmlElement& xml)
+{
+    if (protocolRunner->isRunning())
+        resetProtocols();
+
+    currentInterface = nullptr;
+    currentProtocol = nullptr;
+    viewport->setViewedComponent(nullptr, false);
+    protocolSelector->clear(dontSendNotification);
+    protocolRunner->clear();
+    armed = false;
+    protocolInterfaces.clear();
+    nextProtocolId = 1;
+
+    for (auto* protocolXml : xml.getChildWithTagNameIterator("PROTOCOL"))
+        addProtocolInterface(protocolXml->getStringAttribute("name", "Optotagging " + String(nextProtocolId)), protocolXml);
+
+    if (protocolInterfaces.isEmpty())
+        addProtocolInterface("Optotagging 1");
+
+    selectProtocolInterface(0);
+
+    // Checkpoints are only compared once the protocols are at the stream's rate
+    resumePending = true;
+    updateSettings();
+}
+
+void OptoProtocolCanvas::addProtocolInterface(const String& name, XmlElement* state)
+{
+    auto* protocolInterface = new OptoProtocolInterface(name, viewport.get(), state);
+    protocolInterfaces.add(protocolInterface);
+
+    // Set an initial size for the content component; it will be adjusted in resized()
+    protocolInterface->setSize(getWidth(), 500);
+
+    if (state != nullptr)
+        protocolInterface->updateBounds();
+
+    Protocol* protocol = protocolInterface->getProtocol();
+    protocol->setTrialLog(processor->getTrialLog());
+    protocol->setTrialEvents(processor->getTrialEvents());
+    protocol->setNodeId(processor->getNodeId());
+    protocol->setSampleRate(protocolInterfaces.getFirst()->getProtocol()->getSampleRate());
+    protocolInterface->setTimeline(protocolTimeline.get());
+
+    protocolSelector->addItem(name, nextProtocolId++);
+    selectProtocolInterface(protocolInterfaces.size() - 1);
+}
+
+void OptoProtocolCanvas::selectProtocolInterface(int index)
+{
+    // Only the selected protocol drives the timeline
+    for (auto* protocolInterface : protocolInterfaces)
+        protocolInterface->getProtocol()->removeActionListener(protocolTimeline.get());
+
+    currentInterface = protocolInterfaces[index];
+    currentProtocol = currentInterface->getProtocol();
+    currentProtocol->addActionListener(protocolTimeline.get());
+
+    protocolSelector->setSelectedItemIndex(index, dontSendNotification);
+    viewport->setViewedComponent(currentInterface, false);
+
+    if (protocolRunner->getCurrentStage() < 0)
+        protocolTimeline->setTotalTime(currentProtocol->getTotalTime(), currentProtocol->getTotalTimeStdDev());
+
+    protocolTimeline->setTotalTrials(currentProtocol->getTotalTrials());
+    protocolTimeline->setCurrentTrial(currentProtocol->getCurrentTrialIndex());
+
+    currentInterface->setSize(viewport->getMaximumVisibleWidth(), currentInterface->getHeight());
+}
+
+void OptoProtocolCanvas::setEditingEnabled(bool enabled)
+{
+    for (auto* protocolInterface : protocolInterfaces)
+    {
+        if (enabled)
+            protocolInterface->enable();
+        else
+            protocolInterface->disable();
+    }
+
+    newProtocolButton->setEnabled(enabled);
+    deleteProtocolButton->setEnabled(enabled);
+}
+
 void OptoProtocolCanvas::actionListenerCallback(const String& message)
 {
     if (message.equalsIgnoreCase("FINISHED"))
     {
         runButton->setButtonText("Run");
         runButton->setEnabled(false);
-        protocolInterfaces.getLast()->enable();
+        currentInterface->enable();
+
+        finishRun();
     }
 }
 
@@ -1006,24 +1551,61 @@ void OptoProtocolCanvas::resized()
     
     newProtocolButton->setBounds(margin, margin*3 + controlHeight, buttonWidth, controlHeight);
     deleteProtocolButton->setBounds(margin + buttonWidth + 10, margin*3 + controlHeight, buttonWidth, controlHeight);
+    exportButton->setBounds(margin + (buttonWidth + 10) * 2, margin*3 + controlHeight, buttonWidth, controlHeight);
     
     runButton->setBounds(250, margin*2, buttonWidth, controlHeight);
     resetButton->setBounds(250 + 10 + buttonWidth, margin*2, buttonWidth, controlHeight);
+    simulateButton->setBounds(250 + (10 + buttonWidth) * 2, margin*2, buttonWidth, controlHeight);
+    traceButton->setBounds(250 + (10 + buttonWidth) * 3, margin*2, buttonWidth, controlHeight);
+    memoryButton->setBounds(250 + (10 + buttonWidth) * 4, margin*2, buttonWidth, controlHeight);
     
     protocolTimeline->setBounds(250, margin*2+controlHeight * 2 -5, 350, controlHeight);
 
+    lookaheadSelector->setBounds(710, margin*2, 60, controlHeight);
+    lookaheadLabel->setBounds(710 + 65, margin*2, 100, controlHeight);
+    renderStatusLabel->setBounds(710, margin*2 + controlHeight * 2 - 5, 480, controlHeight);
+
 
      // Set the viewport below the header
      viewport->setBounds(0, headerHeight, getWidth(), getHeight()-headerHeight);
 
      // Set the width of the content component to match the viewport's width
-    protocolInterfaces[0]->setSize(viewport->getMaximumVisibleWidth(), protocolInterfaces[0]->getHeight());
+    if (currentInterface != nullptr)
+        currentInterface->setSize(viewport->getMaximumVisibleWidth(), currentInterface->getHeight());
 
 }
 
 void OptoProtocolCanvas::updateSettings()
 {
-    
+    // Durations are rounded against the rate of the first incoming stream
+    if (processor->getDataStreams().size() == 0)
+        return;
+
+    float sampleRate = processor->getDataStreams()[0]->getSampleRate();
+
+    for (auto* protocolInterface : protocolInterfaces)
+        protocolInterface->getProtocol()->setSampleRate(sampleRate);
+
+    // Schedule hashes depend on the sample rate, so this waits for the stream
+    if (resumePending)
+        resumeProtocols();
+
+    protocolTimeline->setTotalTime(currentProtocol->getTotalTime(), currentProtocol->getTotalTimeStdDev());
+    protocolTimeline->setTotalTrials(currentProtocol->getTotalTrials());
+}
+
+void OptoProtocolCanvas::resumeProtocols()
+{
+    resumePending = false;
+
+    if (protocolRunner->getCurrentStage() >= 0 || armed)
+        return;
+
+    // Pick up where an interrupted run left off
+    for (auto* protocolInterface : protocolInterfaces)
+        protocolInterface->getProtocol()->resumeFromCheckpoint();
+
+    protocolTimeline->setCurrentTrial(currentProtocol->getCurrentTrialIndex());
 }
 
 void OptoProtocolCanvas::refreshState()
@@ -1033,39 +1615,409 @@ void OptoProtocolCanvas::refreshState()
 
 void OptoProtocolCanvas::refresh()
 {
-    
+    const TraceScope trace("ui", "refresh");
+
+    RenderAheadPipeline* pipeline = processor->getRenderPipeline();
+
+    String status = "Buffers: " + String(pipeline->getNumBlocksInUse()) + "/" + String(pipeline->getNumBlocks())
+                    + "   Underruns: " + String(pipeline->getNumUnderruns())
+                    + "   Late: " + String(pipeline->getNumLateStarts());
+
+    // Percentiles come from the collector, which updates once a second
+    const MetricsSnapshot snapshot = processor->getMetrics()->getSnapshot();
+
+    if (const MetricSample* processTime = snapshot.find("process_time"))
+        status << "   Block p99: " << String(processTime->p99 / 1000.0, 1) << " us";
+
+    if (const MetricSample* onsetLateness = snapshot.find("onset_lateness"))
+        status << "   Onset p99: " << String(onsetLateness->p99 / 1000.0, 2) << " ms";
+
+    renderStatusLabel->setText(status, dontSendNotification);
 }
 
 void OptoProtocolCanvas::buttonClicked(Button* button)
 {
     if (button == runButton.get())
     {
-        if (!protocolTimeline->isRunning)
+        if (!protocolRunner->isRunning())
+            runProtocols();
+        else
+            pauseProtocols();
+
+    } else if (button == resetButton.get())
+    {
+        resetProtocols();
+
+    } else if (button == simulateButton.get())
+    {
+        simulateProtocols();
+
+    } else if (button == traceButton.get())
+    {
+        if (traceButton->getToggleState())
+            startTracing();
+        else
+            stopTracing();
+
+    } else if (button == memoryButton.get())
+    {
+        showMemoryReport();
+
+    } else if (button == newProtocolButton.get())
+    {
+        addProtocolInterface("Optotagging " + String(nextProtocolId));
+
+    } else if (button == exportButton.get())
+    {
+        File defaultFile = File::getSpecialLocation(File::userHomeDirectory)
+                               .getChildFile(File::createLegalFileName(currentProtocol->name) + ".xml");
+
+        FileChooser chooser("Export protocol definition", defaultFile, ProtocolFile::getWildcard());
+
+        if (!chooser.browseForFileToSave(true))
+            return;
+
+        Result result = ProtocolFile::save(currentProtocol->createDefinition(), chooser.getResult());
+
+        if (result.failed())
+            LOGE("Unable to export ", currentProtocol->name, ": ", result.getErrorMessage());
+        else
+            LOGC("Exported ", currentProtocol->name, " to ", chooser.getResult().getFullPathName());
+
+    } else if (button == deleteProtocolButton.get())
+    {
+        if (protocolInterfaces.size() < 2)
+            return;
+
+        int index = protocolInterfaces.indexOf(currentInterface);
+
+        viewport->setViewedComponent(nullptr, false);
+        protocolSelector->clear(dontSendNotification);
+        protocolInterfaces.remove(index);
+
+        for (int i = 0; i < protocolInterfaces.size(); ++i)
+            protocolSelector->addItem(protocolInterfaces[i]->getProtocol()->name, i + 1);
+
+        nextProtocolId = jmax(nextProtocolId, protocolInterfaces.size() + 1);
+        selectProtocolInterface(jmin(index, protocolInterfaces.size() - 1));
+    }
+}
+
+void OptoProtocolCanvas::armProtocols()
+{
+    Array<Protocol*> protocols;
+
+    for (auto* protocolInterface : protocolInterfaces)
+        protocols.add(protocolInterface->getProtocol());
+
+    protocolRunner->clear();
+    protocolRunner->addProtocols(protocols);
+    protocolTimeline->setTotalTime(protocolRunner->getTotalTime());
+
+    armed = true;
+    setEditingEnabled(false);
+}
+
+void OptoProtocolCanvas::runProtocols()
+{
+    // Queue every protocol in selector order the first time Run is pressed
+    if (protocolRunner->getCurrentStage() < 0 && !armed)
+        armProtocols();
+
+    // A run that has started is not replaced by a checkpoint
+    resumePending = false;
+
+    // Metrics cover one run, from the first Run to the end or a reset
+    if (!runStarted)
+    {
+        processor->getMetrics()->reset();
+        runStarted = true;
+    }
+
+    protocolTimeline->start();
+    protocolRunner->run();
+    runButton->setButtonText("Pause");
+
+    setEditingEnabled(false);
+}
+
+void OptoProtocolCanvas::pauseProtocols()
+{
+    protocolTimeline->pause();
+    protocolRunner->pause();
+    runButton->setButtonText("Run");
+}
+
+void OptoProtocolCanvas::finishRun()
+{
+    if (!runStarted)
+        return;
+
+    runStarted = false;
+    processor->saveMetrics();
+}
+
+void OptoProtocolCanvas::startTracing()
+{
+    TraceRecorder::start();
+    traceButton->setToggleState(true, dontSendNotification);
+
+    LOGC("Opto tracing started");
+}
+
+void OptoProtocolCanvas::stopTracing()
+{
+    TraceRecorder::stop();
+    traceButton->setToggleState(false, dontSendNotification);
+
+    processor->saveTrace();
+}
+
+void OptoProtocolCanvas::showMemoryReport()
+{
+    const MemoryReport report = processor->createMemoryReport();
+
+    auto text = std::make_unique<TextEditor>("memoryReport");
+    text->setMultiLine(true);
+    text->setReadOnly(true);
+    text->setFont(FontOptions (Font::getDefaultMonospacedFontName(), 13.0f, Font::plain));
+    text->setText(report.toText(), false);
+    text->setSize(620, jmin(500, 40 + (report.getNumNodes() + 2) * 16));
+
+    CallOutBox::launchAsynchronously(std::move(text), memoryButton->getScreenBounds(), nullptr);
+}
+
+void OptoProtocolCanvas::resetProtocols()
+{
+    finishRun();
+    resumePending = false;
+
+    protocolTimeline->reset();
+    protocolRunner->clear();
+    armed = false;
+
+    for (auto* protocolInterface : protocolInterfaces)
+        protocolInterface->getProtocol()->reset();
+
+    protocolTimeline->setTotalTime(currentProtocol->getTotalTime(), currentProtocol->getTotalTimeStdDev());
+    runButton->setButtonText("Run");
+    runButton->setEnabled(true);
+    setEditingEnabled(true);
+}
+
+void OptoProtocolCanvas::simulateProtocols()
+{
+    const ControlState state = getControlState();
+
+    if (state == STATE_RUNNING || state == STATE_PAUSED)
+    {
+        LOGE("Reset the protocols before simulating them");
+        return;
+    }
+
+    PopupMenu menu;
+    menu.setLookAndFeel(&getLookAndFeel());
+    menu.addItem(1, "Trials only");
+    menu.addItem(2, "Trials and rendered output");
+
+    const int choice = menu.showMenu(PopupMenu::Options().withTargetComponent(simulateButton.get()));
+
+    if (choice == 0)
+        return;
+
+    FileChooser chooser("Choose a folder for the simulation results",
+                        File::getSpecialLocation(File::userHomeDirectory));
+
+    if (!chooser.browseForDirectory())
+        return;
+
+    resetProtocols();
+
+    Array<Protocol*> protocols;
+
+    for (auto* protocolInterface : protocolInterfaces)
+        protocols.add(protocolInterface->getProtocol());
+
+    SharedResourcePointer<DeviceRegistry> devices;
+    Array<SourceDescription> sources;
+
+    for (int i = 0; i < devices->getNumSources(); ++i)
+        sources.add(devices->getSource(i));
+
+    SimulationThread thread(sources, processor->getCalibration(), protocols, chooser.getResult(), choice == 2);
+
+    // The modal loop still delivers control requests, which must not touch the protocols
+    simulating = true;
+    thread.runThread();
+    simulating = false;
+
+    const Result& result = thread.getResult();
+    const SimulationSummary& summary = thread.getSummary();
+
+    if (result.failed())
+        LOGE("Simulation failed: ", result.getErrorMessage());
+    else
+        LOGC("Simulated ", summary.numTrials, " trials (", SampleTime::toSeconds(summary.numSamples, summary.sampleRate),
+             " s) in ", summary.elapsedSeconds, " s with ", summary.numUnderruns, " underruns; results are in ",
+             chooser.getResult().getFullPathName());
+}
+
+ControlState OptoProtocolCanvas::getControlState() const
+{
+    if (simulating)
+        return STATE_SIMULATING;
+
+    if (protocolRunner->isRunning())
+        return STATE_RUNNING;
+
+    if (protocolRunner->getCurrentStage() >= 0)
+    {
+        for (auto* protocolInterface : protocolInterfaces)
         {
-            protocolTimeline->start();
-            currentProtocol->run();
-            button->setButtonText("Pause");
-            
-        } else {
-            protocolTimeline->pause();
-            currentProtocol->pause();
-            button->setButtonText("Run");
+            if (!protocolInterface->getProtocol()->isFinished())
+                return STATE_PAUSED;
         }
-        
-        protocolInterfaces.getLast()->disable();
-        
-    } else if (button == resetButton.get())
+
+        return STATE_FINISHED;
+    }
+
+    return armed ? STATE_ARMED : STATE_IDLE;
+}
+
+ControlResponse OptoProtocolCanvas::handleControlRequest(Component::SafePointer<OptoProtocolCanvas> canvas,
+                                                         const ControlRequest& request)
+{
+    // Shared with the message thread, which may finish after this thread has given up
+    struct PendingRequest
+    {
+        ControlRequest request;
+        ControlResponse response;
+        WaitableEvent done;
+    };
+
+    auto pending = std::make_shared<PendingRequest>();
+    pending->request = request;
+
+    MessageManager::callAsync([canvas, pending]
     {
-        protocolTimeline->reset();
-        currentProtocol->reset();
-        runButton->setEnabled(true);
-        protocolInterfaces.getLast()->enable();
+        if (canvas != nullptr)
+            pending->response = canvas->performControlRequest(pending->request);
+        else
+            pending->response.status = CONTROL_REJECTED;
+
+        pending->done.signal();
+    });
+
+    if (!pending->done.wait(ControlServer::responseTimeoutMs))
+    {
+        ControlResponse response;
+        response.status = CONTROL_TIMEOUT;
+        return response;
+    }
+
+    return pending->response;
+}
+
+ControlResponse OptoProtocolCanvas::performControlRequest(const ControlRequest& request)
+{
+    const TraceScope trace("control", "command", request.command);
+
+    ControlResponse response;
+    const ControlState state = getControlState();
+
+    if (state == STATE_SIMULATING)
+    {
+        // The simulator thread owns the protocols until it finishes
+        if (request.command != CONTROL_STATUS)
+            response.status = CONTROL_REJECTED;
+
+        response.state = state;
+        response.protocol = protocolInterfaces.indexOf(currentInterface);
+        response.numProtocols = protocolInterfaces.size();
+
+        return response;
+    }
+
+    switch (request.command)
+    {
+        case CONTROL_STATUS:
+            break;
+
+        case CONTROL_SELECT:
+            if (isPositiveAndBelow(request.argument, protocolInterfaces.size()))
+                selectProtocolInterface(request.argument);
+            else
+                response.status = CONTROL_INVALID_ARGUMENT;
+            break;
+
+        case CONTROL_ARM:
+            if (state == STATE_IDLE || state == STATE_ARMED)
+                armProtocols();
+            else
+                response.status = CONTROL_REJECTED;
+            break;
+
+        case CONTROL_RUN:
+            if (state == STATE_FINISHED)
+                response.status = CONTROL_REJECTED;
+            else if (state != STATE_RUNNING)
+                runProtocols();
+            break;
+
+        case CONTROL_PAUSE:
+            if (state == STATE_RUNNING)
+                pauseProtocols();
+            else
+                response.status = CONTROL_REJECTED;
+            break;
+
+        case CONTROL_RESET:
+            resetProtocols();
+            break;
+
+        case CONTROL_START_TRACE:
+            if (!TraceRecorder::isEnabled())
+                startTracing();
+            else
+                response.status = CONTROL_REJECTED;
+            break;
+
+        case CONTROL_STOP_TRACE:
+            if (TraceRecorder::isEnabled())
+                stopTracing();
+            else
+                response.status = CONTROL_REJECTED;
+            break;
+
+        default:
+            response.status = CONTROL_UNKNOWN_COMMAND;
+            break;
     }
+
+    response.state = getControlState();
+    response.protocol = protocolInterfaces.indexOf(currentInterface);
+    response.numProtocols = protocolInterfaces.size();
+    response.sequence = currentProtocol->getCurrentSequenceIndex();
+    response.trial = currentProtocol->getCurrentTrialIndex();
+    response.totalTrials = currentProtocol->getTotalTrials();
+    response.trialsDelivered = currentProtocol->getTrialsDelivered();
+
+    return response;
 }
 
 void OptoProtocolCanvas::comboBoxChanged(ComboBox* comboBox)
 {
-    
+    if (comboBox == protocolSelector.get())
+    {
+        int index = protocolSelector->getSelectedItemIndex();
+
+        if (isPositiveAndBelow(index, protocolInterfaces.size()))
+            selectProtocolInterface(index);
+    }
+    else if (comboBox == lookaheadSelector.get())
+    {
+        processor->getRenderPipeline()->setLookahead(lookaheadSelector->getSelectedId());
+    }
 }
 
 void OptoProtocolCanvas::paint(Graphics& g)
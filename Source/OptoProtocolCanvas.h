@@ -26,7 +26,13 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <VisualizerWindowHeaders.h>
 
+#include "ControlServer.h"
+#include "DeviceRegistry.h"
 #include "Protocol.h"
+#include "ProtocolRunner.h"
+#include "ProtocolSimulator.h"
+#include "StimulusPreview.h"
+#include "WaveformFile.h"
 
 class OptoProtocolGenerator;
 class OptoProtocolInterface;
@@ -35,7 +41,9 @@ class OptoProtocolInterface;
 /**
 * Interface for editing a custom stimulus
 */
-class CustomStimulusInterface : public Component
+class CustomStimulusInterface : public Component,
+                                public Button::Listener,
+                                private Timer
 {
 public:
 
@@ -54,10 +62,32 @@ public:
     
     /** Disables the CustomStimulusInterface */
     void disable();
+
+    /** Draws the waveform overview */
+    void paint(Graphics& g) override;
+
+    /** Opens a waveform file */
+    void buttonClicked(Button* button) override;
     
 private:
+
+    /** Shows loading progress, and applies the waveform once it is decoded */
+    void timerCallback() override;
+
+    /** Area the waveform overview is drawn in */
+    Rectangle<int> getOverviewBounds() const { return { 0, 60, jmin(300, getWidth()), 60 }; }
     
     std::unique_ptr<BoundedValueParameterEditor> sampleFrequencyEditor;
+
+    std::unique_ptr<TextButton> importButton;
+
+    std::unique_ptr<Label> statusLabel;
+
+    /** Decodes waveform files off the message thread */
+    WaveformLoader loader;
+
+    /** The file being loaded */
+    File waveformFile;
     
     CustomStimulus* custom_stimulus;
     OptoProtocolInterface* parent;
@@ -196,10 +226,15 @@ public:
     void disable();
     
 private:
-    /** Buttons */
-    std::unique_ptr<TextButton> redButton;
-    std::unique_ptr<TextButton> blueButton;
+    /** Returns the display colour for a wavelength (in nm) */
+    static Colour getWavelengthColour(int wavelength);
+
+    /** One toggle button per available wavelength */
+    OwnedArray<TextButton> wavelengthButtons;
     std::unique_ptr<Label> wavelengthLabel;
+
+    /** Wavelengths shown by the buttons */
+    Array<int> wavelengths;
     
     Condition* condition;
     OptoProtocolInterface* parent;
@@ -225,6 +260,45 @@ public:
 };
 
 
+/**
+* Thumbnail plot of a stimulus's intensity over time.
+*
+* The plot is resummarized only when the stimulus's parameters
+* change (see StimulusPreview) and is kept as one min/max pair
+* per pixel column, so repainting only draws lines.
+*/
+class StimulusThumbnail : public Component
+{
+public:
+    /** Constructor */
+    StimulusThumbnail(Stimulus* stimulus);
+    
+    /** Destructor */
+    ~StimulusThumbnail() { }
+    
+    /** Re-reads the stimulus and repaints if it has changed */
+    void update();
+    
+    /** Re-fits the columns to the new width */
+    void resized() override;
+    
+    /** Draws the cached columns */
+    void paint(Graphics& g) override;
+
+    /** Heap memory used by the summary and the columns, in bytes */
+    size_t getMemoryUsage() const { return preview.getMemoryUsage() + columns.getMemoryUsage(); }
+    
+private:
+    
+    /** Fetches one bucket per pixel column from the preview */
+    void updateColumns();
+    
+    Stimulus* stimulus;
+    StimulusPreview preview;
+    WaveformOverview columns;
+};
+
+
 /**
 * Interface for editing an opto condition
 */
@@ -260,6 +334,12 @@ public:
     /** Return the condition object for this interface*/
     Condition* getCondition() { return condition; }
     
+    /** Redraws the stimulus thumbnail if the stimulus has changed */
+    void updateThumbnail();
+
+    /** Adds the memory used by the interface to its condition's node */
+    void addMemoryUsage(MemoryReport& report);
+    
 protected:
     
     std::unique_ptr<Label> stimulusTypeLabel;
@@ -275,6 +355,8 @@ protected:
     std::unique_ptr<RampStimulusInterface> rampStimulusInterface;
     std::unique_ptr<CustomStimulusInterface> customStimulusInterface;
     
+    std::unique_ptr<StimulusThumbnail> thumbnail;
+    
     std::unique_ptr<RemoveConditionButton> deleteButton; // DrawableButton to delete this condition
     
     Condition* condition;
@@ -292,7 +374,7 @@ class OptoSequenceInterface : public Component,
 {
 public:
 
-    /** Constructor */
+    /** Constructor (adds a default condition if the sequence has none) */
     OptoSequenceInterface(const String& name,
                           Sequence* sequence,
                           OptoProtocolInterface* parent);
@@ -318,6 +400,12 @@ public:
     /** Removes a condition and its interface; returns true if interface was found */
     bool removeCondition(OptoConditionInterface* conditionInterface);
     
+    /** Redraws the thumbnails of conditions whose stimulus has changed */
+    void updateThumbnails();
+
+    /** Adds the memory used by the interface to its sequence's node */
+    void addMemoryUsage(MemoryReport& report);
+    
 private:
     
     OwnedArray<OptoConditionInterface> conditionInterfaces;
@@ -328,7 +416,14 @@ private:
     std::unique_ptr<BoundedValueParameterEditor> baselineIntervalEditor;
     std::unique_ptr<BoundedValueParameterEditor> minItiEditor;
     std::unique_ptr<BoundedValueParameterEditor> maxItiEditor;
+    std::unique_ptr<ComboBoxParameterEditor> itiDistributionEditor;
+    std::unique_ptr<BoundedValueParameterEditor> meanItiEditor;
+    std::unique_ptr<TextBoxParameterEditor> itiTableEditor;
     std::unique_ptr<ToggleParameterEditor> randomizeEditor;
+    std::unique_ptr<ComboBoxParameterEditor> randomizationEditor;
+    std::unique_ptr<BoundedValueParameterEditor> maxRunLengthEditor;
+    std::unique_ptr<ComboBoxParameterEditor> runCategoryEditor;
+    std::unique_ptr<BoundedValueParameterEditor> catchRatioEditor;
     
     Sequence* sequence;
     OptoProtocolInterface* parent;
@@ -343,6 +438,7 @@ private:
 * Shows a timeline for the currently selected protocol
 */
 class ProtocolTimeline : public Component,
+                         public SettableTooltipClient,
                          public Timer,
                          public ActionListener
 {
@@ -366,8 +462,8 @@ public:
     /** Resets the timeline */
     void reset();
     
-    /** Sets the total time */
-    void setTotalTime(float timeInSeconds);
+    /** Sets the (expected) total time, and its standard deviation if the ITIs are random */
+    void setTotalTime(float timeInSeconds, float stdDevInSeconds = 0);
     
     /** Sets the elapsed time */
     void setElapsedTime(float timeInSeconds);
@@ -415,8 +511,8 @@ class OptoProtocolInterface : public Component,
 {
 public:
 
-    /** Constructor */
-    OptoProtocolInterface(const String& name, Viewport* viewport);
+    /** Constructor (restores the protocol from a PROTOCOL element, if given) */
+    OptoProtocolInterface(const String& name, Viewport* viewport, XmlElement* state = nullptr);
     
     /** Destructor */
     ~OptoProtocolInterface();
@@ -453,6 +549,9 @@ public:
 
     /** Removes a condition interface */
     void removeConditionInterface(OptoConditionInterface* conditionInterface);
+
+    /** Adds the protocol and the memory used by its interfaces to a report */
+    void addMemoryUsage(MemoryReport& report);
     
 private:
     
@@ -467,6 +566,41 @@ private:
 };
 
 
+/**
+    Runs a ProtocolSimulator behind a modal progress window
+*/
+class SimulationThread : public ThreadWithProgressWindow
+{
+public:
+
+    /** Constructor */
+    SimulationThread(const Array<SourceDescription>& sources,
+                     const PowerCalibration* calibration,
+                     const Array<Protocol*>& protocols,
+                     const File& directory,
+                     bool writeOutput);
+
+    /** Runs the simulation */
+    void run() override;
+
+    /** Returns the outcome once the thread has finished */
+    const Result& getResult() const { return result; }
+
+    /** Returns what the simulation produced */
+    const SimulationSummary& getSummary() const { return summary; }
+
+private:
+
+    ProtocolSimulator simulator;
+    Array<Protocol*> protocols;
+    File directory;
+    bool writeOutput;
+
+    Result result { Result::ok() };
+    SimulationSummary summary;
+};
+
+
 /**
 *
     Holds a drop-down menu for selecting protocols,
@@ -497,7 +631,8 @@ public:
     /** Called when the visualizer's tab becomes visible again */
     void refreshState() override;
 
-    /** Called instead of "repaint()" to avoid re-painting sub-components*/
+    /** Called instead of "repaint()" to avoid re-painting sub-components
+        (updates the render-ahead counters during acquisition) */
     void refresh() override;
 
     /** Draws the canvas background */
@@ -512,8 +647,70 @@ public:
     /** Receives a trial update notification */
     void actionListenerCallback(const String& message) override;
 
+    /** Disconnects everything that refers to the processor. The processor calls this
+        before its members are destroyed, since the editor that owns the canvas is
+        destroyed after them; the canvas calls it too if it goes first. */
+    void releaseProcessor();
+
+    /** Writes every protocol, in selector order, to a PROTOCOLS element */
+    std::unique_ptr<XmlElement> createProtocolsXml();
+
+    /** Replaces every protocol with those in a PROTOCOLS element */
+    void loadProtocols(XmlElement& xml);
+
 private:
 
+    /** Creates a protocol (restored from a PROTOCOL element, if given),
+        adds it to the selector and shows it */
+    void addProtocolInterface(const String& name, XmlElement* state = nullptr);
+
+    /** Resumes every protocol that has a matching checkpoint */
+    void resumeProtocols();
+
+    /** Shows a protocol and connects it to the timeline */
+    void selectProtocolInterface(int index);
+
+    /** Enables or disables editing of every protocol */
+    void setEditingEnabled(bool enabled);
+
+    /** Queues every protocol in selector order for playback */
+    void armProtocols();
+
+    /** Starts or continues playback (arming first if needed) */
+    void runProtocols();
+
+    /** Pauses playback */
+    void pauseProtocols();
+
+    /** Saves the metrics of a run that has finished or been reset */
+    void finishRun();
+
+    /** Stops playback and rewinds every protocol */
+    void resetProtocols();
+
+    /** Starts recording a trace of every thread */
+    void startTracing();
+
+    /** Stops tracing and saves the trace */
+    void stopTracing();
+
+    /** Plays every protocol on a virtual clock and writes the results to a directory */
+    void simulateProtocols();
+
+    /** Shows how much memory each protocol, sequence and condition uses */
+    void showMemoryReport();
+
+    /** Returns the playback state reported by the control API */
+    ControlState getControlState() const;
+
+    /** Answers a control request (called on the control server's thread;
+        the request is carried out on the message thread) */
+    static ControlResponse handleControlRequest(Component::SafePointer<OptoProtocolCanvas> canvas,
+                                                const ControlRequest& request);
+
+    /** Carries out a control request and reports the resulting status */
+    ControlResponse performControlRequest(const ControlRequest& request);
+
     /** ComboBox for selecting a protocol */
     std::unique_ptr<ComboBox> protocolSelector;
     
@@ -525,6 +722,9 @@ private:
     
     /** Button for deleting a protocol */
     std::unique_ptr<TextButton> deleteProtocolButton;
+
+    /** Button for saving a protocol's definition */
+    std::unique_ptr<TextButton> exportButton;
     
     /** Button for running a protocol */
     std::unique_ptr<TextButton> runButton;
@@ -532,9 +732,27 @@ private:
     /** Button for resetting a protocol */
     std::unique_ptr<TextButton> resetButton;
 
+    /** Button for simulating every protocol */
+    std::unique_ptr<TextButton> simulateButton;
+
+    /** Toggles tracing */
+    std::unique_ptr<TextButton> traceButton;
+
+    /** Shows the memory breakdown */
+    std::unique_ptr<TextButton> memoryButton;
+
     /** Label for the protocol combo */
     std::unique_ptr<Label> protocolLabel;
 
+    /** ComboBox for selecting how many trials are rendered ahead */
+    std::unique_ptr<ComboBox> lookaheadSelector;
+
+    /** Label for the lookahead combo */
+    std::unique_ptr<Label> lookaheadLabel;
+
+    /** Shows render-ahead buffer occupancy, underruns, late starts and timing percentiles */
+    std::unique_ptr<Label> renderStatusLabel;
+
     /** Viewport to enable scrolling */
     std::unique_ptr<Viewport> viewport;
     
@@ -544,11 +762,35 @@ private:
     /** Pointer to the processor class */
     OptoProtocolGenerator* processor;
 
+    /** Plays every protocol, back to back or concurrently */
+    std::unique_ptr<ProtocolRunner> protocolRunner;
+
+    /** True once the protocols have been queued for playback */
+    bool armed = false;
+
+    /** True from the first Run until the run finishes or is reset */
+    bool runStarted = false;
+
+    /** True while the simulator thread is playing the protocols */
+    bool simulating = false;
+
+    /** Serves the local control API */
+    std::unique_ptr<ControlServer> controlServer;
+
+    /** Selector ID for the next new protocol */
+    int nextProtocolId = 1;
+
+    /** True until checkpoints have been checked against the protocols at the stream's sample rate */
+    bool resumePending = true;
+
     /** Generates an assertion if this class leaks */
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(OptoProtocolCanvas);
     
     /** Current protocol */
-    Protocol* currentProtocol;
+    Protocol* currentProtocol = nullptr;
+
+    /** Interface for the current protocol */
+    OptoProtocolInterface* currentInterface = nullptr;
 };
 
 
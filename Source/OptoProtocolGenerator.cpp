@@ -23,19 +23,42 @@
 
 #include "OptoProtocolGenerator.h"
 
+#include "OptoProtocolCanvas.h"
 #include "OptoProtocolEditor.h"
+#include "TraceRecorder.h"
 
 
 OptoProtocolGenerator::OptoProtocolGenerator() 
     : GenericProcessor("Opto Protocol Gen")
 {
+    SharedResourcePointer<DeviceRegistry> devices;
+    Array<SourceDescription> sources;
 
+    for (int i = 0; i < devices->getNumSources(); ++i)
+        sources.add(devices->getSource(i));
+
+    renderPipeline = std::make_unique<RenderAheadPipeline>(sources, &calibration);
+    renderPipeline->setMetrics(&metrics);
+
+    metrics.add("process_time", "ns", &processTimes);
+
+    Result result = trialEvents.open();
+
+    if (result.wasOk())
+        LOGC("Publishing trial events to ", TrialEventRing::getDefaultName());
+    else
+        LOGE("Trial events will not be published: ", result.getErrorMessage());
 }
 
 
 OptoProtocolGenerator::~OptoProtocolGenerator()
 {
+    // The canvas belongs to the editor, which the base class destroys after these members
+    if (canvas != nullptr)
+        canvas->releaseProcessor();
 
+    memoryReporter = nullptr;
+    metrics.stopCollecting();
 }
 
 
@@ -46,13 +69,160 @@ AudioProcessorEditor* OptoProtocolGenerator::createEditor()
 }
 
 
+void OptoProtocolGenerator::process(AudioBuffer<float>& continuousBuffer)
+{
+    if (getDataStreams().size() == 0)
+        return;
+
+    const ScopedMetricTimer timer(processTimes);
+    const TraceScope trace("audio", "process");
+
+    // The audio thread can change between acquisitions
+    if (!audioThreadNamed && TraceRecorder::isEnabled())
+    {
+        TraceRecorder::setThreadName("Audio thread");
+        audioThreadNamed = true;
+    }
+
+    renderPipeline->process((int) getNumSamplesInBlock(getDataStreams()[0]->getStreamId()));
+}
+
+
+bool OptoProtocolGenerator::startAcquisition()
+{
+    if (getDataStreams().size() > 0)
+        renderPipeline->setSampleRate(getDataStreams()[0]->getSampleRate());
+
+    audioThreadNamed = false;
+
+    if (renderPipeline->getOutputSink() == nullptr)
+        LOGC("No opto output is attached; trials will be rendered and logged but not driven");
+
+    renderPipeline->start();
+    metrics.startCollecting();
+    return true;
+}
+
+
+bool OptoProtocolGenerator::stopAcquisition()
+{
+    renderPipeline->stop();
+    metrics.stopCollecting();
+    return true;
+}
+
+
+void OptoProtocolGenerator::startRecording()
+{
+    File recordingDirectory = CoreServices::getRecordingParentDirectory()
+                                  .getChildFile(CoreServices::getRecordingDirectoryName());
+
+    File logFile = recordingDirectory.getNonexistentChildFile("opto_trials", ".npy", false);
+
+    if (trialLog.open(logFile, false))
+        LOGC("Writing opto trial log to ", logFile.getFullPathName());
+    else
+        LOGE("Unable to create opto trial log at ", logFile.getFullPathName());
+}
+
+
+void OptoProtocolGenerator::stopRecording()
+{
+    trialLog.close();
+}
+
+
+File OptoProtocolGenerator::getOutputDirectory()
+{
+    if (CoreServices::getRecordingStatus())
+        return CoreServices::getRecordingParentDirectory()
+                   .getChildFile(CoreServices::getRecordingDirectoryName());
+
+    return File::getSpecialLocation(File::userApplicationDataDirectory)
+        .getChildFile("Open Ephys")
+        .getChildFile("opto-protocol-generator")
+        .getChildFile("metrics");
+}
+
+
+void OptoProtocolGenerator::saveMetrics()
+{
+    const File directory = getOutputDirectory();
+    const String baseName = "opto_metrics_" + Time::getCurrentTime().formatted("%Y-%m-%d_%H-%M-%S");
+    Result result = metrics.writeFiles(directory, baseName);
+
+    if (result.wasOk())
+        LOGC("Wrote opto metrics to ", directory.getChildFile(baseName).getFullPathName(), ".json/.csv");
+    else
+        LOGE("Unable to write opto metrics: ", result.getErrorMessage());
+}
+
+
+void OptoProtocolGenerator::saveTrace()
+{
+    const File directory = getOutputDirectory();
+    const File file = directory.getChildFile("opto_trace_" + Time::getCurrentTime().formatted("%Y-%m-%d_%H-%M-%S") + ".json");
+
+    Result result = directory.createDirectory();
+
+    if (result.wasOk())
+        result = TraceRecorder::writeJson(file);
+
+    if (result.wasOk())
+        LOGC("Wrote opto trace (", TraceRecorder::getNumEvents(), " spans recorded, ",
+             TraceRecorder::getNumDroppedEvents(), " dropped) to ", file.getFullPathName());
+    else
+        LOGE("Unable to write opto trace: ", result.getErrorMessage());
+}
+
+
+MemoryReport OptoProtocolGenerator::createMemoryReport()
+{
+    MemoryReport report;
+
+    if (memoryReporter)
+        memoryReporter(report);
+
+    // Shared by every protocol, so it gets a node of its own
+    const int node = report.addNode("pipeline", "Render pipeline", 0, renderPipeline.get());
+    report.addBytes(node, MEMORY_WAVEFORMS, (int64) renderPipeline->getMemoryUsage());
+
+    return report;
+}
+
+
+String OptoProtocolGenerator::handleConfigMessage(const String& message)
+{
+    if (!message.trim().equalsIgnoreCase("memory"))
+        return "Unknown message: " + message;
+
+    // The protocols and their interfaces are only touched on the message thread
+    const MessageManagerLock mml;
+
+    return JSON::toString(createMemoryReport().toVar());
+}
+
+
 void OptoProtocolGenerator::saveCustomParametersToXml(XmlElement* parentElement)
 {
+    // The protocols live in the canvas, which may not have been opened
+    if (canvas != nullptr)
+        savedProtocols = canvas->createProtocolsXml();
 
+    if (savedProtocols != nullptr)
+        parentElement->addChildElement(new XmlElement(*savedProtocols));
 }
 
 
 void OptoProtocolGenerator::loadCustomParametersFromXml(XmlElement* parentElement)
 {
+    XmlElement* protocols = parentElement->getChildByName("PROTOCOLS");
+
+    if (protocols == nullptr)
+        return;
+
+    savedProtocols = std::make_unique<XmlElement>(*protocols);
 
+    if (canvas != nullptr)
+        canvas->loadProtocols(*savedProtocols);
 }
@@ -27,6 +27,12 @@
 
 #include <ProcessorHeaders.h>
 
+#include "MemoryReport.h"
+#include "TrialLog.h"
+#include "TrialEventRing.h"
+#include "RenderAheadPipeline.h"
+
+class OptoProtocolCanvas;
 
 /** 
 	A plugin for defining a custom protocol for optogenetic stimulation.
@@ -36,6 +42,12 @@
 
 	This is a meant to be a convenient way to define and share protocols for 
 	experiments.
+
+	While acquisition runs, the trials are rendered ahead and played in
+	step with the incoming data. The drive levels of each block go to the
+	RenderAheadPipeline::OutputSink set on getRenderPipeline(), which a
+	light-source backend provides; without one, the timeline still
+	advances and trials are logged, but nothing is driven.
 */
 
 class OptoProtocolGenerator : public GenericProcessor
@@ -59,11 +71,100 @@ public:
 	void loadCustomParametersFromXml(XmlElement* parentElement) override;
     
     
-    /** Process function (not used)  */
-    void process (AudioBuffer<float>& continuousBuffer) override {}
+    /** Plays trials that were rendered ahead, and hands them to the pipeline's output sink */
+    void process (AudioBuffer<float>& continuousBuffer) override;
+
+    /** Starts rendering upcoming trials */
+    bool startAcquisition() override;
+
+    /** Stops rendering and discards pending trials */
+    bool stopAcquisition() override;
+
+    /** Opens a trial log in the recording directory */
+    void startRecording() override;
+
+    /** Closes the trial log */
+    void stopRecording() override;
+
+    /** Answers "memory" with the memory report as JSON (see MemoryReport) */
+    String handleConfigMessage(const String& message) override;
+
+    /** Returns the trial log that running protocols write to */
+    TrialLogWriter* getTrialLog() { return &trialLog; }
+
+    /** Returns the ring that trial onsets are published to */
+    TrialEventRing* getTrialEvents() { return &trialEvents; }
+
+    /** Returns the calibration that rendered power is converted through */
+    const PowerCalibration* getCalibration() const { return &calibration; }
+
+    /** Returns the pipeline that renders upcoming trials */
+    RenderAheadPipeline* getRenderPipeline() { return renderPipeline.get(); }
+
+    /** Returns the registry of performance metrics */
+    RuntimeMetrics* getMetrics() { return &metrics; }
+
+    /** Writes the current metrics to the recording directory (or, when
+        not recording, to the plugin's settings directory) */
+    void saveMetrics();
+
+    /** Writes the current trace next to the metrics (see TraceRecorder) */
+    void saveTrace();
+
+    /** Adds the loaded protocols to a memory report (message thread) */
+    using MemoryReporter = std::function<void(MemoryReport& report)>;
+
+    /** Sets the function that reports the loaded protocols (may be nullptr) */
+    void setMemoryReporter(MemoryReporter reporter) { memoryReporter = std::move(reporter); }
+
+    /** Reports the memory used by the loaded protocols and the render pipeline (message thread) */
+    MemoryReport createMemoryReport();
+
+    /** Sets the canvas that plays the protocols (may be nullptr) */
+    void setCanvas(OptoProtocolCanvas* canvas_) { canvas = canvas_; }
+
+    /** Returns the protocols loaded with the settings, or last kept by the canvas (may be nullptr) */
+    XmlElement* getSavedProtocols() { return savedProtocols.get(); }
+
+    /** Keeps the protocols for a canvas created later */
+    void setSavedProtocols(std::unique_ptr<XmlElement> protocols) { savedProtocols = std::move(protocols); }
 
 private:
 
+    /** Where metrics and traces are written */
+    static File getOutputDirectory();
+
+    /** True once the audio thread has been named in the trace */
+    bool audioThreadNamed = false;
+
+    /** Time taken by each call to process() (ns) */
+    MetricHistogram processTimes;
+
+    /** Collects the metrics of the pipeline, the runner and this processor */
+    RuntimeMetrics metrics;
+
+    /** Calibration for every source */
+    PowerCalibration calibration;
+
+    /** Renders upcoming trials off the audio thread */
+    std::unique_ptr<RenderAheadPipeline> renderPipeline;
+
+    /** Per-trial records for the current recording */
+    TrialLogWriter trialLog;
+
+    /** Trial onsets for other processes */
+    TrialEventRing trialEvents;
+
+    /** Set by the canvas, which owns the protocols */
+    MemoryReporter memoryReporter;
+
+    /** The protocols to restore if there is no canvas yet */
+    std::unique_ptr<XmlElement> savedProtocols;
+
+    /** Released in the destructor, so it stops using the metrics, pipeline and logs
+        (cleared by the canvas if it is destroyed first) */
+    OptoProtocolCanvas* canvas = nullptr;
+
 	/** Generates an assertion if this class leaks */
 	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(OptoProtocolGenerator);
 
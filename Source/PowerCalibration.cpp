@@ -0,0 +1,167 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include "PowerCalibration.h"
+
+CalibrationTable::CalibrationTable(const SourceDescription& source)
+    : numChannels(source.getNumChannels()),
+      maxPower(jmax(1.0f, source.maxPower)),
+      scale((tableSize - 1) / maxPower),
+      values((size_t) (source.getNumChannels() * tableSize))
+{
+    for (int channel = 0; channel < numChannels; ++channel)
+        setCurve(channel, { { 0.0f, 0.0f }, { maxPower, 1.0f } });
+}
+
+void CalibrationTable::setCurve(int channel, Array<CalibrationPoint> points)
+{
+    jassert(isPositiveAndBelow(channel, numChannels) && points.size() > 0);
+
+    std::sort(points.begin(), points.end(),
+              [](const CalibrationPoint& a, const CalibrationPoint& b) { return a.power < b.power; });
+
+    float* table = values.get() + channel * tableSize;
+    int segment = 0;
+
+    // Piecewise-linear through the measured points, held flat beyond them
+    for (int i = 0; i < tableSize; ++i)
+    {
+        const float power = i / scale;
+
+        while (segment < points.size() - 1 && points.getReference(segment + 1).power <= power)
+            ++segment;
+
+        const CalibrationPoint& a = points.getReference(segment);
+
+        if (segment == points.size() - 1 || power <= a.power)
+        {
+            table[i] = a.drive;
+            continue;
+        }
+
+        const CalibrationPoint& b = points.getReference(segment + 1);
+        table[i] = a.drive + (power - a.power) / (b.power - a.power) * (b.drive - a.drive);
+    }
+}
+
+void CalibrationTable::apply(const float* envelope, float power, float* destination, int numSamples, int channel) const
+{
+    jassert(isPositiveAndBelow(channel, numChannels));
+
+    const float* table = values.get() + channel * tableSize;
+    const float positionScale = power * scale;
+    const float maxPosition = (float) (tableSize - 1);
+
+    for (int i = 0; i < numSamples; ++i)
+    {
+        const float position = std::min(std::max(envelope[i] * positionScale, 0.0f), maxPosition);
+        const int index = std::min((int) position, tableSize - 2);
+        const float fraction = position - (float) index;
+
+        destination[i] = table[index] + fraction * (table[index + 1] - table[index]);
+    }
+}
+
+float CalibrationTable::getDrive(float power, int channel) const
+{
+    const float envelope = 1.0f;
+    float drive;
+
+    apply(&envelope, power, &drive, 1, channel);
+    return drive;
+}
+
+PowerCalibration::PowerCalibration()
+{
+    SharedResourcePointer<DeviceRegistry> devices;
+    Array<SourceDescription> sources;
+
+    for (int i = 0; i < devices->getNumSources(); ++i)
+        sources.add(devices->getSource(i));
+
+    if (!loadFromFile(getDefaultFile(), sources))
+        reset(sources);
+}
+
+File PowerCalibration::getDefaultFile()
+{
+    return File::getSpecialLocation(File::userApplicationDataDirectory)
+        .getChildFile("Open Ephys")
+        .getChildFile("opto-protocol-generator")
+        .getChildFile("calibration.csv");
+}
+
+void PowerCalibration::reset(const Array<SourceDescription>& sources)
+{
+    sourceNames.clear();
+    tables.clear();
+
+    for (auto& source : sources)
+    {
+        sourceNames.add(source.name);
+        tables.add(new CalibrationTable(source));
+    }
+}
+
+bool PowerCalibration::loadFromFile(const File& file, const Array<SourceDescription>& sources)
+{
+    if (!file.existsAsFile())
+        return false;
+
+    reset(sources);
+
+    // Collect the measured points for each (source, channel)
+    std::map<std::pair<int, int>, Array<CalibrationPoint>> curves;
+
+    StringArray lines = StringArray::fromLines(file.loadFileAsString());
+
+    for (auto& line : lines)
+    {
+        StringArray fields = StringArray::fromTokens(line, ",", "\"");
+
+        if (fields.size() < 5 || !fields[3].trim().containsOnly("0123456789.-+eE"))
+            continue; // header or malformed line
+
+        const int sourceIndex = sourceNames.indexOf(fields[0].trim().unquoted());
+
+        if (sourceIndex < 0)
+            continue;
+
+        const int channel = sources.getReference(sourceIndex).getChannel(fields[1].getIntValue(),
+                                                                         fields[2].getIntValue());
+
+        if (channel >= 0)
+            curves[{ sourceIndex, channel }].add({ fields[3].getFloatValue(), fields[4].getFloatValue() });
+    }
+
+    for (auto& curve : curves)
+        tables[curve.first.first]->setCurve(curve.first.second, curve.second);
+
+    return true;
+}
+
+const CalibrationTable* PowerCalibration::getTable(const String& source) const
+{
+    return tables[sourceNames.indexOf(source)];
+}
@@ -0,0 +1,123 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef POWERCALIBRATION_H_DEFINED
+#define POWERCALIBRATION_H_DEFINED
+
+#include "DeviceRegistry.h"
+
+/** One measured point of a transfer curve */
+struct CalibrationPoint
+{
+    /** Light power (uW) */
+    float power;
+
+    /** Drive level (V or mA) that produces it */
+    float drive;
+};
+
+/**
+    Maps light power to drive level for every channel of one source.
+
+    Each channel's transfer curve is resampled onto a uniform power
+    grid from 0 to the source's maximum power, and all curves are
+    stored in one dense array. A lookup is then an index computation
+    and a linear interpolation, with no branches or searches, so a
+    whole block can be converted in a single vectorizable loop.
+*/
+class CalibrationTable
+{
+public:
+    /** Constructor (every channel starts with a linear curve: max power -> 1.0) */
+    CalibrationTable(const SourceDescription& source);
+
+    /** Destructor */
+    ~CalibrationTable() { }
+
+    /** Sets a channel's curve from measured (power, drive) points */
+    void setCurve(int channel, Array<CalibrationPoint> points);
+
+    /** Converts an envelope (0 to 1) scaled by a power (uW) to drive levels
+        (source and destination may be the same buffer) */
+    void apply(const float* envelope, float power, float* destination, int numSamples, int channel) const;
+
+    /** Converts a single power (uW) to a drive level */
+    float getDrive(float power, int channel) const;
+
+    /** Number of points in each channel's curve */
+    static const int tableSize = 256;
+
+private:
+    int numChannels;
+    float maxPower;
+
+    /** Grid points per uW */
+    float scale;
+
+    /** numChannels * tableSize drive levels */
+    HeapBlock<float> values;
+
+    JUCE_DECLARE_NON_COPYABLE(CalibrationTable);
+};
+
+/**
+    Calibration tables for every source in the DeviceRegistry.
+
+    Loaded once from calibration.csv in the plugin's data directory,
+    with one measured point per line:
+
+        source,site,wavelength,power_uw,drive
+
+    Channels without measurements keep a linear curve.
+*/
+class PowerCalibration
+{
+public:
+    /** Constructor (loads the default calibration file, if there is one) */
+    PowerCalibration();
+
+    /** Destructor */
+    ~PowerCalibration() { }
+
+    /** Loads measured points for the given sources; returns false if the file can't be read */
+    bool loadFromFile(const File& file, const Array<SourceDescription>& sources);
+
+    /** Returns the table for a source (nullptr if the source is unknown) */
+    const CalibrationTable* getTable(const String& source) const;
+
+    /** Where the calibration is loaded from */
+    static File getDefaultFile();
+
+private:
+
+    /** Creates linear tables for every source */
+    void reset(const Array<SourceDescription>& sources);
+
+    StringArray sourceNames;
+    OwnedArray<CalibrationTable> tables;
+
+    JUCE_DECLARE_NON_COPYABLE(PowerCalibration);
+};
+
+#endif // POWERCALIBRATION_H_DEFINED
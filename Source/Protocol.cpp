@@ -22,12 +22,53 @@
 */
 
 #include "Protocol.h"
+#include "DeviceRegistry.h"
+#include "TraceRecorder.h"
 
 int Protocol::numProtocolsCreated = 0;
 int Sequence::numSequencesCreated = 0;
 int Condition::numConditionsCreated = 0;
 int Stimulus::numStimuliCreated = 0;
 
+/** Names of stimuli in memory reports (in StimulusType order) */
+static const char* const stimulusNames[] = { "Pulse train", "Sine wave", "Ramp", "Custom" };
+
+/** Names of stimuli in saved settings (as in protocol files) */
+static const char* const stimulusTypeNames[] = { "pulse_train", "sine", "ramp", "custom" };
+
+/** Writes parameters as attributes named after them */
+static void saveParameters(const Array<Parameter*>& parameters, XmlElement& xml)
+{
+    for (auto* parameter : parameters)
+        parameter->toXml(&xml);
+}
+
+/** Restores parameters written by saveParameters(), without notifying their owner */
+static void loadParameters(const Array<Parameter*>& parameters, XmlElement& xml)
+{
+    for (auto* parameter : parameters)
+        parameter->fromXml(&xml);
+}
+
+/** Estimates the heap memory used by a parameter's strings */
+static size_t getParameterMemoryUsage(Parameter& parameter)
+{
+    return (size_t) (MemoryReport::getStringBytes(parameter.getName())
+                     + MemoryReport::getStringBytes(parameter.getDisplayName())
+                     + MemoryReport::getStringBytes(parameter.getValueAsString()))
+         + parameter.getKey().size();
+}
+
+/** Estimates the heap memory used by a categorical parameter, including its categories */
+static size_t getParameterMemoryUsage(CategoricalParameter& parameter)
+{
+    size_t bytes = getParameterMemoryUsage(static_cast<Parameter&>(parameter));
+
+    for (const auto& category : parameter.getCategories())
+        bytes += sizeof(String) + (size_t) MemoryReport::getStringBytes(category);
+
+    return bytes;
+}
 
 CustomStimulus::CustomStimulus(ParameterOwner* owner_,
                        Condition* condition_)
@@ -45,12 +86,9 @@ CustomStimulus::CustomStimulus(ParameterOwner* owner_,
     Parameter::registerParameter(&sample_frequency);
 }
 
-float CustomStimulus::getTotalTime()
+int64 CustomStimulus::getTotalSamples(double sampleRate)
 {
-    // Calculate the total time of the pulse train
-    
-    return stimulus_waveform.size() / sample_frequency.getFloatValue();
-
+    return SampleTime::fromSeconds(stimulus_waveform.size() / (double) sample_frequency.getFloatValue(), sampleRate);
 }
 
 PulseTrain::PulseTrain(ParameterOwner* owner_,
@@ -99,17 +137,59 @@ PulseTrain::PulseTrain(ParameterOwner* owner_,
 
 }
 
-float PulseTrain::getTotalTime()
+StimulusSpec CustomStimulus::createSpec(double sampleRate)
+{
+    StimulusSpec spec;
+    spec.type = type;
+    spec.numSamples = getTotalSamples(sampleRate);
+
+    if (stimulus_waveform.size() > 0)
+    {
+        // Resampling is only repeated when the waveform or either rate changes
+        const double waveformRate = sample_frequency.getFloatValue();
+        const uint64 rates = ScheduleCompiler::hashCombine((uint64) std::llround(waveformRate * 1000.0),
+                                                           (uint64) std::llround(sampleRate * 1000.0));
+        const uint64 key = ScheduleCompiler::hashCombine(waveformHash, rates);
+
+        if (waveformBuffer == nullptr || key != waveformKey)
+        {
+            waveformBuffer = WaveformBuffer::create(stimulus_waveform, waveformRate, sampleRate);
+            waveformKey = key;
+        }
+
+        spec.waveform = waveformBuffer;
+    }
+
+    return spec;
+}
+
+void CustomStimulus::addMemoryUsage(MemoryReport& report, int node)
+{
+    report.addBytes(node, MEMORY_MODEL, (int64) (sizeof(CustomStimulus) + getParameterMemoryUsage(sample_frequency)));
+
+    // The prepared buffer is shared with the specs made from it, so it is only counted here
+    size_t waveformBytes = (size_t) stimulus_waveform.size() * sizeof(float) + overview.getMemoryUsage();
+
+    if (waveformBuffer != nullptr)
+        waveformBytes += waveformBuffer->getMemoryUsage();
+
+    report.addBytes(node, MEMORY_WAVEFORMS, (int64) waveformBytes);
+}
+
+int64 PulseTrain::getTotalSamples(double sampleRate)
 {
-    // Calculate the total time of the pulse train
-    
     int numPulses = pulse_count.getIntValue();
-    float pulseWidth = pulse_width.getFloatValue() / 1000.0f;
-    float pulseFrequency = pulse_frequency.getFloatValue();
-    
-    return (numPulses * pulseWidth) +
-           (numPulses - 1) * (1.0f / pulseFrequency);
 
+    if (numPulses <= 0)
+        return 0;
+
+    // Onset of the last pulse plus its width. The onset is rounded from its
+    // exact time, so a period that isn't a whole number of samples doesn't
+    // accumulate error over the train.
+    double lastOnset = (numPulses - 1) / (double) pulse_frequency.getFloatValue();
+
+    return SampleTime::fromSeconds(lastOnset, sampleRate)
+           + SampleTime::fromMilliseconds(pulse_width.getFloatValue(), sampleRate);
 }
 
 
@@ -158,9 +238,33 @@ RampStimulus::RampStimulus(ParameterOwner* owner_,
 
 }
 
-float RampStimulus::getTotalTime()
+StimulusSpec PulseTrain::createSpec(double sampleRate)
 {
-    return (plateau_duration.getFloatValue() + ramp_onset_duration.getFloatValue() + ramp_offset_duration.getFloatValue()) / 1000.0f;
+    StimulusSpec spec;
+    spec.type = type;
+    spec.numSamples = getTotalSamples(sampleRate);
+    spec.numPulses = jmax(0, pulse_count.getIntValue());
+    spec.pulsePeriod = sampleRate / pulse_frequency.getFloatValue();
+    spec.pulseWidth = SampleTime::fromMilliseconds(pulse_width.getFloatValue(), sampleRate);
+    spec.pulseRamp = SampleTime::fromMilliseconds(ramp_duration.getFloatValue(), sampleRate);
+
+    return spec;
+}
+
+void PulseTrain::addMemoryUsage(MemoryReport& report, int node)
+{
+    report.addBytes(node, MEMORY_MODEL, (int64) (sizeof(PulseTrain)
+                                                 + getParameterMemoryUsage(pulse_width)
+                                                 + getParameterMemoryUsage(pulse_frequency)
+                                                 + getParameterMemoryUsage(ramp_duration)
+                                                 + getParameterMemoryUsage(pulse_count)));
+}
+
+int64 RampStimulus::getTotalSamples(double sampleRate)
+{
+    return SampleTime::fromMilliseconds(ramp_onset_duration.getFloatValue(), sampleRate)
+           + SampleTime::fromMilliseconds(plateau_duration.getFloatValue(), sampleRate)
+           + SampleTime::fromMilliseconds(ramp_offset_duration.getFloatValue(), sampleRate);
 }
 
 
@@ -190,9 +294,31 @@ SineWave::SineWave(ParameterOwner* owner_,
     Parameter::registerParameter(&sine_wave_frequency);
 }
 
-float SineWave::getTotalTime()
+StimulusSpec RampStimulus::createSpec(double sampleRate)
 {
-    return sine_wave_duration.getFloatValue() / 1000.0f;
+    StimulusSpec spec;
+    spec.type = type;
+    spec.rampOnset = SampleTime::fromMilliseconds(ramp_onset_duration.getFloatValue(), sampleRate);
+    spec.rampPlateau = SampleTime::fromMilliseconds(plateau_duration.getFloatValue(), sampleRate);
+    spec.rampOffset = SampleTime::fromMilliseconds(ramp_offset_duration.getFloatValue(), sampleRate);
+    spec.rampProfile = ramp_profile.getSelectedIndex() == 1 ? COSINE_RAMP : LINEAR_RAMP;
+    spec.numSamples = spec.rampOnset + spec.rampPlateau + spec.rampOffset;
+
+    return spec;
+}
+
+void RampStimulus::addMemoryUsage(MemoryReport& report, int node)
+{
+    report.addBytes(node, MEMORY_MODEL, (int64) (sizeof(RampStimulus)
+                                                 + getParameterMemoryUsage(plateau_duration)
+                                                 + getParameterMemoryUsage(ramp_onset_duration)
+                                                 + getParameterMemoryUsage(ramp_offset_duration)
+                                                 + getParameterMemoryUsage(ramp_profile)));
+}
+
+int64 SineWave::getTotalSamples(double sampleRate)
+{
+    return SampleTime::fromMilliseconds(sine_wave_duration.getFloatValue(), sampleRate);
 }
 
 Stimulus::Stimulus(ParameterOwner* owner_,
@@ -213,6 +339,104 @@ Stimulus::~Stimulus()
     --numStimuliCreated;
 }
 
+StimulusSpec SineWave::createSpec(double sampleRate)
+{
+    StimulusSpec spec;
+    spec.type = type;
+    spec.numSamples = getTotalSamples(sampleRate);
+    spec.sineFrequency = sine_wave_frequency.getFloatValue() / sampleRate;
+
+    return spec;
+}
+
+void SineWave::addMemoryUsage(MemoryReport& report, int node)
+{
+    report.addBytes(node, MEMORY_MODEL, (int64) (sizeof(SineWave)
+                                                 + getParameterMemoryUsage(sine_wave_duration)
+                                                 + getParameterMemoryUsage(sine_wave_frequency)));
+}
+
+float Stimulus::getTotalTime()
+{
+    double sampleRate = condition->sequence->protocol->getSampleRate();
+
+    return (float) SampleTime::toSeconds(getTotalSamples(sampleRate), sampleRate);
+}
+
+void Stimulus::saveState(XmlElement& xml)
+{
+    xml.setAttribute("type", stimulusTypeNames[type]);
+    saveParameters(getParameters(), xml);
+}
+
+void Stimulus::loadState(XmlElement& xml)
+{
+    loadParameters(getParameters(), xml);
+}
+
+Stimulus* Stimulus::create(StimulusType type, ParameterOwner* owner, Condition* condition)
+{
+    switch (type)
+    {
+        case SINUSOID:
+            return new SineWave(owner, condition);
+        case RAMP:
+            return new RampStimulus(owner, condition);
+        case CUSTOM:
+            return new CustomStimulus(owner, condition);
+        default:
+            return new PulseTrain(owner, condition);
+    }
+}
+
+void CustomStimulus::saveState(XmlElement& xml)
+{
+    Stimulus::saveState(xml);
+
+    if (stimulus_waveform.isEmpty())
+        return;
+
+    // Float32, as in exported definitions
+    MemoryBlock data(stimulus_waveform.begin(), (size_t) stimulus_waveform.size() * sizeof(float));
+
+    xml.setAttribute("waveform_samples", stimulus_waveform.size());
+    xml.addTextElement(data.toBase64Encoding());
+}
+
+void CustomStimulus::loadState(XmlElement& xml)
+{
+    Stimulus::loadState(xml);
+
+    const int numSamples = xml.getIntAttribute("waveform_samples");
+
+    if (numSamples <= 0)
+        return;
+
+    MemoryBlock data;
+
+    if (!data.fromBase64Encoding(xml.getAllSubText().trim())
+        || data.getSize() != (size_t) numSamples * sizeof(float))
+    {
+        LOGE("Saved custom waveform is corrupt; it was not restored");
+        return;
+    }
+
+    Array<float> samples((const float*) data.getData(), numSamples);
+    WaveformOverview newOverview = WaveformOverview::create(samples.begin(), numSamples);
+
+    setWaveform(std::move(samples), std::move(newOverview));
+}
+
+void CustomStimulus::setWaveform(Array<float> samples, WaveformOverview newOverview)
+{
+    stimulus_waveform = std::move(samples);
+    overview = std::move(newOverview);
+
+    // The rates are combined with this in createSpec, since they can change on their own
+    waveformHash = WaveformBuffer::getHash(stimulus_waveform, 0.0);
+    waveformBuffer = nullptr;
+}
+
 std::string Stimulus::generateParameterKey(const String &name)
 {
     return (String(condition->sequence->protocol->index) +
@@ -331,11 +555,13 @@ std::string Condition::generateParameterKey(const String &name)
 
 float Condition::getTotalTime() 
 {
-    float totalTime = 0;
+    double sampleRate = sequence->protocol->getSampleRate();
+
+    int64 totalSamples = 0;
     for (auto* stimulus : stimuli)
-        totalTime += stimulus->getTotalTime();
+        totalSamples += stimulus->getTotalSamples(sampleRate);
 
-    return totalTime * getTotalTrials();
+    return (float) SampleTime::toSeconds(totalSamples * getTotalTrials(), sampleRate);
 }
 
 int Condition::getTotalTrials() 
@@ -348,6 +574,74 @@ int Condition::getTotalTrials()
     return numRepeats * numSites * numWavelegths;
 }
 
+void Condition::addMemoryUsage(MemoryReport& report, int node)
+{
+    size_t bytes = sizeof(Condition)
+                 + (size_t) stimuli.size() * sizeof(Stimulus*)
+                 + (size_t) (availableWavelengths.size() + sitesPerSource.size()) * sizeof(int)
+                 + getParameterMemoryUsage(num_repeats)
+                 + getParameterMemoryUsage(source)
+                 + getParameterMemoryUsage(pulse_power);
+
+    if (sites != nullptr)
+        bytes += sizeof(SelectedChannelsParameter) + getParameterMemoryUsage(*sites);
+
+    report.addBytes(node, MEMORY_MODEL, (int64) bytes);
+
+    const int depth = report.getNode(node).depth + 1;
+
+    for (auto* stimulus : stimuli)
+        stimulus->addMemoryUsage(report, report.addNode("stimulus", stimulusNames[stimulus->type], depth, stimulus));
+}
+
+void Condition::saveState(XmlElement& xml)
+{
+    saveParameters(getParameters(), xml);
+
+    StringArray wavelengths;
+
+    for (int wavelength : availableWavelengths)
+        wavelengths.add(String(wavelength));
+
+    xml.setAttribute("wavelengths", wavelengths.joinIntoString(","));
+
+    for (auto* stimulus : stimuli)
+        stimulus->saveState(*xml.createNewChildElement("STIMULUS"));
+}
+
+void Condition::loadState(XmlElement& xml)
+{
+    loadParameters(getParameters(), xml);
+
+    if (xml.hasAttribute("wavelengths"))
+    {
+        // The order is kept, since it determines the trial order
+        availableWavelengths.clear();
+
+        for (auto& wavelength : StringArray::fromTokens(xml.getStringAttribute("wavelengths"), ",", ""))
+        {
+            if (wavelength.trim().isNotEmpty())
+                availableWavelengths.add(wavelength.getIntValue());
+        }
+    }
+
+    for (auto* stimulusXml : xml.getChildWithTagNameIterator("STIMULUS"))
+    {
+        const int type = StringArray(stimulusTypeNames, numElementsInArray(stimulusTypeNames))
+                             .indexOf(stimulusXml->getStringAttribute("type"));
+
+        if (type < 0)
+        {
+            LOGE("Unknown stimulus type ", stimulusXml->getStringAttribute("type"), "; skipping it");
+            continue;
+        }
+
+        Stimulus* stimulus = Stimulus::create((StimulusType) type, owner, this);
+        stimuli.add(stimulus);
+        stimulus->loadState(*stimulusXml);
+    }
+}
+
 Sequence::Sequence(ParameterOwner* owner_, Protocol* protocol_)
     : owner(owner_),
       index(++numSequencesCreated),
@@ -379,20 +673,88 @@ Sequence::Sequence(ParameterOwner* owner_, Protocol* protocol_)
             1.0f,
             0.0f,
             60.0f),
+    iti_distribution(owner_,
+                     Parameter::VISUALIZER_SCOPE,
+                     "iti_distribution",
+                     "ITI",
+                     "How ITIs are drawn: uniform between min and max, exponential from min (truncated at max), fixed at min, or from a table",
+                     {"Uniform", "Exponential", "Fixed", "Empirical"},
+                     0),
+    mean_iti(owner_,
+             Parameter::VISUALIZER_SCOPE,
+             "mean_iti",
+             "Mean ITI",
+             "Mean of the exponential ITI distribution, before truncation",
+             "s",
+             1.0f,
+             0.01f,
+             60.0f),
+    iti_table(owner_,
+              Parameter::VISUALIZER_SCOPE,
+              "iti_table",
+              "ITI table",
+              "ITIs (in s, comma-separated) drawn with equal probability",
+              "1, 2, 3"),
     randomize(owner_,
             Parameter::VISUALIZER_SCOPE,
             "randomize",
             "Randomize",
             "Randomize trial order",
-            true)
+            true),
+    randomization(owner_,
+                  Parameter::VISUALIZER_SCOPE,
+                  "randomization",
+                  "Order",
+                  "Shuffle all trials, shuffle within blocks of one repeat, or limit runs of the same condition or site",
+                  {"Shuffled", "Blocked", "Max run"},
+                  0),
+    max_run_length(owner_,
+                   Parameter::VISUALIZER_SCOPE,
+                   "max_run_length",
+                   "Max run",
+                   "Longest run of trials from the same condition or site",
+                   3,
+                   1,
+                   100),
+    run_category(owner_,
+                 Parameter::VISUALIZER_SCOPE,
+                 "run_category",
+                 "Run by",
+                 "Whether runs are counted by condition or by site",
+                 {"Condition", "Site"},
+                 0),
+    catch_ratio(owner_,
+                Parameter::VISUALIZER_SCOPE,
+                "catch_ratio",
+                "Catch ratio",
+                "Catch trials (light off) per stimulus trial",
+                "",
+                0.0f,
+                0.0f,
+                1.0f,
+                0.05f)
 
 {
     min_iti.setKey((String(protocol->index) + ":" + String(index) + ":min_iti").toStdString());
     Parameter::registerParameter(&min_iti);
     max_iti.setKey((String(protocol->index) + ":" + String(index) + ":max_iti").toStdString());
     Parameter::registerParameter(&max_iti);
+    iti_distribution.setKey((String(protocol->index) + ":" + String(index) + ":iti_distribution").toStdString());
+    Parameter::registerParameter(&iti_distribution);
+    mean_iti.setKey((String(protocol->index) + ":" + String(index) + ":mean_iti").toStdString());
+    Parameter::registerParameter(&mean_iti);
+    iti_table.setKey((String(protocol->index) + ":" + String(index) + ":iti_table").toStdString());
+    Parameter::registerParameter(&iti_table);
     randomize.setKey((String(protocol->index) + ":" + String(index) + ":randomize").toStdString());
     Parameter::registerParameter(&randomize);
+    randomization.setKey((String(protocol->index) + ":" + String(index) + ":randomization").toStdString());
+    Parameter::registerParameter(&randomization);
+    max_run_length.setKey((String(protocol->index) + ":" + String(index) + ":max_run_length").toStdString());
+    Parameter::registerParameter(&max_run_length);
+    run_category.setKey((String(protocol->index) + ":" + String(index) + ":run_category").toStdString());
+    Parameter::registerParameter(&run_category);
+    catch_ratio.setKey((String(protocol->index) + ":" + String(index) + ":catch_ratio").toStdString());
+    Parameter::registerParameter(&catch_ratio);
     baseline_interval.setKey((String(protocol->index) + ":" + String(index) + ":baseline_interval").toStdString());
     Parameter::registerParameter(&baseline_interval);
 
@@ -425,95 +787,224 @@ void Sequence::removeCondition(Condition* condition)
     createTrials();
 }
 
-void Sequence::createTrials()
+SequenceSpec Sequence::createSpec()
 {
-    iti_values.clear();
-    order.clear();
-    stimuli.clear();
+    SequenceSpec spec;
 
-    int trialIndex = 0;
+    // Every duration is rounded to samples here, once
+    double sampleRate = protocol->getSampleRate();
 
-    // Create the trials for each condition
     for (auto* condition : conditions)
     {
-        int numRepeats = condition->num_repeats.getIntValue();
-        int numSites = condition->sites->getArrayValue().size();
-        int numWavelegths = condition->availableWavelengths.size();
+        ConditionSpec conditionSpec;
+        conditionSpec.numRepeats = condition->num_repeats.getIntValue();
 
-        LOGD("Condition ", condition->index, " has ", numRepeats, " repeats and ", numSites, " sites and ", condition->stimuli.size(), " stimuli");
+        for (auto& site : condition->sites->getArrayValue())
+            conditionSpec.sites.add(int(site));
 
-        for (int i = 0; i < numRepeats; ++i)
-        {
-            for (int j = 0; j < numSites; ++j)
-            {
-                for (int k = 0; k < numWavelegths; ++k)
-                {
-
-                    for (auto* stimulus : condition->stimuli)
-                    {
-                        // Add the stimulus to the list
-                        stimuli.add(stimulus);
-
-                        // Add the order
-                        order.add(trialIndex++);
-
-                        // Add the ITI value
-                        float minITI = min_iti.getFloatValue();
-                        float maxITI = max_iti.getFloatValue();
-                        float iti = Random::getSystemRandom().nextFloat() * (maxITI - minITI) + minITI;
-                        iti_values.add(iti);
-                    }
-                }
-            }
-        }
+        conditionSpec.wavelengths = condition->availableWavelengths;
+        conditionSpec.numStimuli = condition->stimuli.size();
+
+        for (auto* stimulus : condition->stimuli)
+            conditionSpec.stimuli.add(stimulus->createSpec(sampleRate));
+
+        conditionSpec.numCatchTrials = roundToInt(conditionSpec.getNumStimulusTrials() * catch_ratio.getFloatValue());
+
+        LOGD("Condition ", condition->index, " has ", conditionSpec.numRepeats, " repeats and ", conditionSpec.sites.size(), " sites and ", conditionSpec.numStimuli, " stimuli");
+
+        spec.conditions.add(conditionSpec);
     }
-    
-    LOGD("Created ", trialIndex, " total trials");
+
+    spec.sampleRate = sampleRate;
+    spec.baselineSamples = SampleTime::fromSeconds(baseline_interval.getFloatValue(), sampleRate);
+    spec.minItiSamples = SampleTime::fromSeconds(min_iti.getFloatValue(), sampleRate);
+    spec.maxItiSamples = SampleTime::fromSeconds(max_iti.getFloatValue(), sampleRate);
+    spec.itiDistribution = (ItiDistribution) jlimit(0, 3, iti_distribution.getSelectedIndex());
+    spec.itiMeanSamples = mean_iti.getFloatValue() * sampleRate;
+
+    StringArray tableEntries = StringArray::fromTokens(iti_table.getStringValue(), ", ;", "");
+    tableEntries.removeEmptyStrings();
+
+    for (auto& entry : tableEntries)
+    {
+        if (entry.containsOnly("0123456789.") && entry.getDoubleValue() >= 0)
+            spec.itiTable.add(SampleTime::fromSeconds(entry.getDoubleValue(), sampleRate));
+    }
+    spec.order = SEQUENTIAL_ORDER;
 
     if (randomize.getBoolValue())
     {
-        LOGD("Randomizing trial order...");
-        
-        for (int i = order.size() - 1; i > 0; --i)
-        {
-            int j = Random::getSystemRandom().nextInt(i + 1);
-            order.swap(i, j);
-        }
+        const TrialOrder orders[] = { SHUFFLED_ORDER, BLOCKED_ORDER, MAX_RUN_ORDER };
+        spec.order = orders[jlimit(0, 2, randomization.getSelectedIndex())];
     }
+
+    spec.maxRunLength = max_run_length.getIntValue();
+    spec.runCategory = run_category.getSelectedIndex() == 1 ? RUN_BY_SITE : RUN_BY_CONDITION;
+    spec.seed = ScheduleCompiler::deriveSeed(protocol->getSeed(), protocol->sequences.indexOf(this));
+
+    return spec;
 }
 
-float Sequence::getTrialDuration(int trialIndex)
+bool Sequence::prepareTrials(const SequenceSpec& spec)
 {
-    int nextTrial = order[trialIndex];
-    return stimuli[nextTrial]->getTotalTime() + iti_values[nextTrial];
+    compiledSpec = spec;
+    itiSampler = std::make_unique<ItiSampler>(spec);
+
+    if (spec.getNumTrials() > maxMaterializedTrials)
+    {
+        LOGD("Generating ", spec.getNumTrials(), " trials on demand");
+
+        compiled.clear();
+        compiled.trials.minimiseStorageOverheads();
+        compiled.itiSamples.minimiseStorageOverheads();
+        compiled.order.minimiseStorageOverheads();
+
+        generator = std::make_unique<TrialGenerator>(spec);
+        return false;
+    }
+
+    generator.reset();
+    return true;
 }
 
-float Sequence::getTotalTime() 
+void Sequence::createTrials()
 {
-    float totalTime = baseline_interval.getFloatValue();
+    SequenceSpec spec = createSpec();
 
-    for (int i = 0; i < order.size(); ++i)
+    if (prepareTrials(spec))
     {
-        int stimulusIndex = order[i];
-
-        totalTime += stimuli[stimulusIndex]->getTotalTime();
-        totalTime += iti_values[i];
+        const TraceScope trace("schedule", "compile", 1);
+        protocol->getCompiler().compile(spec, compiled);
     }
-        
-    return totalTime;
+    
+    LOGD("Created ", getTotalTrials(), " total trials");
+}
+
+TrialEntry Sequence::getTrial(int trialIndex)
+{
+    if (generator != nullptr)
+        return generator->getTrial(trialIndex);
+
+    return compiled.trials[compiled.order[trialIndex]];
+}
+
+int64 Sequence::getIti(int trialIndex)
+{
+    if (generator != nullptr)
+        return generator->getIti(trialIndex);
+
+    return compiled.itiSamples[compiled.order[trialIndex]];
+}
+
+int64 Sequence::getStimulusSamples(int trialIndex)
+{
+    TrialEntry trial = getTrial(trialIndex);
+
+    return compiledSpec.conditions.getReference(trial.condition).stimuli.getReference(trial.stimulus).numSamples;
+}
+
+int64 Sequence::getTrialSamples(int trialIndex)
+{
+    return getStimulusSamples(trialIndex) + getIti(trialIndex);
+}
+
+int64 Sequence::getTotalSamples()
+{
+    // Stimulus time depends only on how often each condition is played
+    const double itiSamples = itiSampler->getMean() * getTotalTrials();
+
+    return compiledSpec.baselineSamples + compiledSpec.getStimulusSamples() + (int64) std::llround(itiSamples);
+}
+
+double Sequence::getTotalSamplesVariance()
+{
+    // ITIs are drawn independently
+    return itiSampler->getVariance() * getTotalTrials();
+}
+
+float Sequence::getTotalTime() 
+{
+    return (float) SampleTime::toSeconds(getTotalSamples(), compiledSpec.sampleRate);
 }
 
 int Sequence::getTotalTrials() 
 {
-    int totalTrials = 0;
+    if (generator != nullptr)
+        return (int) generator->getNumTrials();
+
+    return compiled.order.size();
+}
+
+void Sequence::addMemoryUsage(MemoryReport& report, int node)
+{
+    // The compiled spec and trial table are members, but belong to the schedule
+    const size_t modelBytes = sizeof(Sequence) - sizeof(SequenceSpec) - sizeof(CompiledSequence)
+                            + (size_t) conditions.size() * sizeof(Condition*)
+                            + getParameterMemoryUsage(baseline_interval)
+                            + getParameterMemoryUsage(min_iti)
+                            + getParameterMemoryUsage(max_iti)
+                            + getParameterMemoryUsage(iti_distribution)
+                            + getParameterMemoryUsage(mean_iti)
+                            + getParameterMemoryUsage(iti_table)
+                            + getParameterMemoryUsage(randomize)
+                            + getParameterMemoryUsage(randomization)
+                            + getParameterMemoryUsage(max_run_length)
+                            + getParameterMemoryUsage(run_category)
+                            + getParameterMemoryUsage(catch_ratio);
+
+    size_t scheduleBytes = sizeof(SequenceSpec) + compiledSpec.getMemoryUsage()
+                         + sizeof(CompiledSequence) + compiled.getMemoryUsage();
+
+    if (generator != nullptr)
+        scheduleBytes += sizeof(TrialGenerator) + generator->getMemoryUsage();
+
+    if (itiSampler != nullptr)
+        scheduleBytes += sizeof(ItiSampler) + itiSampler->getMemoryUsage();
+
+    report.addBytes(node, MEMORY_MODEL, (int64) modelBytes);
+    report.addBytes(node, MEMORY_SCHEDULE, (int64) scheduleBytes);
+
+    const int depth = report.getNode(node).depth + 1;
+
+    for (int i = 0; i < conditions.size(); ++i)
+        conditions[i]->addMemoryUsage(report, report.addNode("condition", "Condition " + String(i + 1), depth, conditions[i]));
+}
+
+Array<Parameter*> Sequence::getParameters()
+{
+    return { &baseline_interval, &min_iti, &max_iti, &iti_distribution, &mean_iti, &iti_table,
+             &randomize, &randomization, &max_run_length, &run_category, &catch_ratio };
+}
+
+void Sequence::saveState(XmlElement& xml)
+{
+    saveParameters(getParameters(), xml);
+
     for (auto* condition : conditions)
-        totalTrials += condition->getTotalTrials();
+        condition->saveState(*xml.createNewChildElement("CONDITION"));
+}
 
-    return totalTrials;
+void Sequence::loadState(XmlElement& xml)
+{
+    loadParameters(getParameters(), xml);
+
+    SharedResourcePointer<DeviceRegistry> devices;
+
+    for (auto* conditionXml : xml.getChildWithTagNameIterator("CONDITION"))
+    {
+        Condition* condition = new Condition(owner,
+                                             devices->getSourceNames(),
+                                             devices->getSitesPerSource(),
+                                             { devices->getDefaultWavelength() },
+                                             this);
+        conditions.add(condition);
+        condition->loadState(*conditionXml);
+    }
 }
 
 Protocol::Protocol(const String& name_, ParameterOwner* owner_)
-    : name(name_), owner(owner_), index(++numProtocolsCreated)
+    : name(name_), owner(owner_), index(++numProtocolsCreated),
+      seed(Random::getSystemRandom().nextInt64())
 {
 }
 
@@ -525,29 +1016,35 @@ Protocol::~Protocol()
 
 void Protocol::run()
 {
-    if (baselineInterval)
+    if (checkpoint == nullptr && !simulated)
     {
-        float baselineInterval = sequences[currentSequenceIndex]->baseline_interval.getFloatValue();
+        // A fresh run replaces the previous checkpoint file; a resumed run appends to it
+        checkpoint = std::make_unique<ProtocolCheckpoint>();
+        runScheduleHash = getScheduleHash();
 
-        LOGD("Starting baseline interval for sequence ", currentSequenceIndex, " with duration ", baselineInterval);
-        startTimer(baselineInterval * 1000.0f);
-    } else {
-        startTimer(0);
-    }
-}
+        if (!checkpoint->open(getCheckpointFile(), resumed))
+            LOGE("Unable to write checkpoints to ", getCheckpointFile().getFullPathName());
 
-void Protocol::pause()
-{
-    stopTimer();
+        resumed = false;
+    }
 }
 
 void Protocol::reset()
 {
-    // Stop the protocol
-    stopTimer();
     currentTrialIndex = 0;
     currentSequenceIndex = 0;
+    trialsDelivered = 0;
     baselineInterval = true;
+    finished = false;
+
+    // A reset run must not be resumed
+    if (checkpoint != nullptr)
+    {
+        checkpoint->record(seed, runScheduleHash, 0, 0, ProtocolCheckpoint::FINISHED);
+        checkpoint.reset();
+    }
+
+    resumed = false;
 }
 
 void Protocol::addSequence(Sequence* sequence)
@@ -560,61 +1057,359 @@ void Protocol::removeSequence(Sequence* sequence)
     sequences.removeObject(sequence, true);
 }
 
-void Protocol::timerCallback()
+int64 Protocol::advance()
 {
-    stopTimer();
+    if (finished)
+        return -1;
 
     if (baselineInterval)
     {
-        LOGD("Ending baseline interval for sequence ", currentSequenceIndex);
+        // The baseline starts now; the first trial follows it
         baselineInterval = false;
+
+        if (sequences.size() > 0)
+        {
+            int64 baselineSamples = sequences[currentSequenceIndex]->getBaselineSamples();
+
+            LOGD("Starting baseline interval for sequence ", currentSequenceIndex, " with ", baselineSamples, " samples");
+            return baselineSamples;
+        }
     }
 
-    if (currentTrialIndex >= sequences[currentSequenceIndex]->getTotalTrials())
+    if (currentSequenceIndex < sequences.size()
+        && currentTrialIndex >= sequences[currentSequenceIndex]->getTotalTrials())
     {
         LOGD("Ending sequence ", currentSequenceIndex);
         currentTrialIndex = 0;
         currentSequenceIndex++;
 
-        if (currentSequenceIndex >= sequences.size())
+        if (currentSequenceIndex < sequences.size())
         {
-            // All sequences are done
-            sendActionMessage("FINISHED");
-            return;
-        } else {
             baselineInterval = true;
-            run();
+            return advance();
         }
-    }   
+    }
+
+    if (currentSequenceIndex >= sequences.size())
+    {
+        // All sequences are done
+        if (checkpoint != nullptr)
+        {
+            checkpoint->record(seed, runScheduleHash, currentSequenceIndex, 0, ProtocolCheckpoint::FINISHED);
+            checkpoint.reset();
+        }
+
+        finished = true;
+
+        if (!simulated)
+            sendActionMessage("FINISHED");
+
+        return -1;
+    }
+
+    // Every trial before this one has been delivered
+    if (checkpoint != nullptr)
+        checkpoint->record(seed, runScheduleHash, currentSequenceIndex, currentTrialIndex);
 
     LOGD("Starting sequence ", currentSequenceIndex, " trial ", currentTrialIndex);
-    float nextTrialDuration = sequences[currentSequenceIndex]->getTrialDuration(currentTrialIndex);
+    int64 trialSamples = sequences[currentSequenceIndex]->getTrialSamples(currentTrialIndex);
+
+    const bool logging = !simulated && trialLog != nullptr && trialLog->isOpen();
+    const bool publishing = !simulated && trialEvents != nullptr && trialEvents->isOpen();
+
+    if (logging || publishing)
+    {
+        const TrialRecord record = createTrialRecord(currentSequenceIndex, currentTrialIndex, trialsDelivered);
+
+        if (publishing)
+            trialEvents->publish(record);
+
+        if (logging)
+            trialLog->write(record);
+    }
 
+    trialsDelivered++;
     currentTrialIndex++;
-    sendActionMessage(String(currentTrialIndex));
 
-    startTimer(nextTrialDuration * 1000.0f);
+    if (!simulated)
+        sendActionMessage(String(currentTrialIndex));
+
+    return trialSamples;
+}
+
+StringArray Protocol::getSources()
+{
+    StringArray sources;
+
+    for (auto* sequence : sequences)
+    {
+        for (auto* condition : sequence->conditions)
+        {
+            if (condition->getTotalTrials() > 0 && condition->stimuli.size() > 0)
+                sources.addIfNotAlreadyThere(condition->source.getSelectedString());
+        }
+    }
+
+    return sources;
+}
+
+TrialRecord Protocol::createTrialRecord(int sequenceIndex, int trialIndex, int64 runTrial)
+{
+    Sequence* sequence = sequences[sequenceIndex];
+    TrialEntry trial = sequence->getTrial(trialIndex);
+    Condition* condition = sequence->conditions[trial.condition];
+    Stimulus* stimulus = condition->stimuli[trial.stimulus];
+
+    TrialRecord record;
+    record.trial = runTrial;
+    record.timestamp = Time::currentTimeMillis();
+    record.protocol = index;
+    record.sequence = sequenceIndex;
+    record.sequenceTrial = trialIndex;
+    record.condition = trial.condition;
+    record.stimulusType = (int32) stimulus->type;
+    record.source = condition->source.getSelectedIndex();
+    record.site = trial.site;
+    record.wavelength = trial.wavelength;
+    record.power = trial.catchTrial ? 0.0f : condition->pulse_power.getFloatValue();
+    record.catchTrial = trial.catchTrial ? 1 : 0;
+    record.duration = (float) SampleTime::toSeconds(sequence->getStimulusSamples(trialIndex), sampleRate);
+    record.iti = (float) SampleTime::toSeconds(sequence->getIti(trialIndex), sampleRate);
+
+    return record;
+}
+
+bool Protocol::getTrialRecord(int64 runTrial, TrialRecord& record)
+{
+    const int64 trial = runTrial;
+
+    for (int i = 0; i < sequences.size(); ++i)
+    {
+        const int numTrials = sequences[i]->getTotalTrials();
+
+        if (runTrial < numTrials)
+        {
+            record = createTrialRecord(i, (int) runTrial, trial);
+            return true;
+        }
 
+        runTrial -= numTrials;
+    }
+
+    return false;
+}
+
+bool Protocol::getTrialAt(int64 runTrial, TrialRenderRequest& request)
+{
+    request.ticket = getTrialTicket(runTrial);
+
+    for (auto* sequence : sequences)
+    {
+        const int numTrials = sequence->getTotalTrials();
+
+        if (runTrial < numTrials)
+        {
+            TrialEntry trial = sequence->getTrial((int) runTrial);
+            Condition* condition = sequence->conditions[trial.condition];
+
+            request.stimulus = sequence->getCompiledSpec().conditions.getReference(trial.condition).stimuli[trial.stimulus];
+            request.source = condition->source.getSelectedIndex();
+            request.site = trial.site;
+            request.wavelength = trial.wavelength;
+            request.power = trial.catchTrial ? 0.0f : condition->pulse_power.getFloatValue();
+
+            return true;
+        }
+
+        runTrial -= numTrials;
+    }
+
+    return false;
+}
+
+int64 Protocol::addToDigitalTimeline(DigitalWordRenderer& renderer, int64 onset)
+{
+    for (auto* sequence : sequences)
+    {
+        Array<int> conditionSources;
+
+        for (auto* condition : sequence->conditions)
+            conditionSources.add(condition->source.getSelectedIndex());
+
+        onset = renderer.addSequence(sequence->getCompiledSpec(), sequence->getCompiledSequence(), conditionSources, onset);
+    }
+
+    return onset;
+}
+
+void Protocol::setSeed(int64 seed_)
+{
+    seed = seed_;
+    createTrials();
+}
+
+void Protocol::setSampleRate(double sampleRate_)
+{
+    if (sampleRate_ <= 0 || sampleRate_ == sampleRate)
+        return;
+
+    sampleRate = sampleRate_;
+    createTrials();
+}
+
+uint64 Protocol::getScheduleHash()
+{
+    return createDefinition().getHash();
+}
+
+ProtocolDefinition Protocol::createDefinition()
+{
+    ProtocolDefinition definition;
+    definition.name = name;
+    definition.seed = seed;
+    definition.sampleRate = sampleRate;
+
+    for (auto* sequence : sequences)
+        definition.sequences.add(sequence->createSpec());
+
+    return definition;
+}
+
+void Protocol::saveState(XmlElement& xml)
+{
+    xml.setAttribute("name", name);
+    xml.setAttribute("seed", String(seed));
+
+    for (auto* sequence : sequences)
+        sequence->saveState(*xml.createNewChildElement("SEQUENCE"));
+}
+
+void Protocol::loadState(XmlElement& xml)
+{
+    name = xml.getStringAttribute("name", name);
+    seed = xml.getStringAttribute("seed", String(seed)).getLargeIntValue();
+
+    sequences.clear();
+
+    for (auto* sequenceXml : xml.getChildWithTagNameIterator("SEQUENCE"))
+    {
+        Sequence* sequence = new Sequence(owner, this);
+        sequences.add(sequence);
+        sequence->loadState(*sequenceXml);
+    }
+
+    // Compiled once, after everything has been restored
+    createTrials();
+}
+
+int Protocol::addMemoryUsage(MemoryReport& report)
+{
+    const int node = report.addNode("protocol", name, 0, this);
+
+    report.addBytes(node, MEMORY_MODEL, (int64) (sizeof(Protocol) + (size_t) sequences.size() * sizeof(Sequence*))
+                                            + MemoryReport::getStringBytes(name)
+                                            + MemoryReport::getStringBytes(description));
+
+    for (int i = 0; i < sequences.size(); ++i)
+        sequences[i]->addMemoryUsage(report, report.addNode("sequence", "Sequence " + String(i + 1), 1, sequences[i]));
+
+    return node;
+}
+
+File Protocol::getCheckpointFile()
+{
+    return File::getSpecialLocation(File::userApplicationDataDirectory)
+        .getChildFile("Open Ephys")
+        .getChildFile("opto-protocol-generator")
+        .getChildFile(File::createLegalFileName(name + " (node " + String(nodeId) + ", seed " + String(seed) + ")")
+                      + ".checkpoint");
+}
+
+bool Protocol::resumeFromCheckpoint()
+{
+    CheckpointRecord record;
+
+    if (!ProtocolCheckpoint::readLast(getCheckpointFile(), record)
+        || record.flags == ProtocolCheckpoint::FINISHED)
+        return false;
+
+    // The order is rebuilt from the seed, so the protocol must be unchanged
+    const int64 previousSeed = seed;
+    setSeed(record.seed);
+
+    if (getScheduleHash() != record.scheduleHash
+        || !isPositiveAndBelow(record.sequenceIndex, sequences.size()))
+    {
+        LOGC("Checkpoint for ", name, " does not match the current protocol; not resuming");
+        setSeed(previousSeed);
+        return false;
+    }
+
+    currentSequenceIndex = record.sequenceIndex;
+    currentTrialIndex = record.trialIndex;
+    baselineInterval = false;
+    finished = false;
+    resumed = true;
+
+    trialsDelivered = currentTrialIndex;
+
+    for (int i = 0; i < currentSequenceIndex; ++i)
+        trialsDelivered += sequences[i]->getTotalTrials();
+
+    LOGC("Resuming ", name, " at sequence ", currentSequenceIndex, ", trial ", currentTrialIndex);
+
+    return true;
 }
 
 void Protocol::createTrials()
 {
+    // Snapshot every sequence first, then compile them as one batch
+    // so conditions from all sequences share the thread pool
+    Array<SequenceSpec> specs;
+    Array<const SequenceSpec*> specPointers;
+    Array<CompiledSequence*> results;
+
     for (auto* sequence : sequences)
+        specs.add(sequence->createSpec());
+
+    for (int i = 0; i < sequences.size(); ++i)
     {
-        sequence->createTrials();
+        if (sequences[i]->prepareTrials(specs.getReference(i)))
+        {
+            specPointers.add(&specs.getReference(i));
+            results.add(&sequences[i]->getCompiledSequence());
+        }
     }
+
+    const TraceScope trace("schedule", "compile", specPointers.size());
+    compiler.compile(specPointers, results);
 }
 
-float Protocol::getTotalTime()
+int64 Protocol::getTotalSamples()
 {
-    int totalTime = 0;
+    int64 totalSamples = 0;
 
     for (auto* sequence : sequences)
     {
-        totalTime += sequence->getTotalTime();
+        totalSamples += sequence->getTotalSamples();
     }
-    
-    return totalTime;
+
+    return totalSamples;
+}
+
+float Protocol::getTotalTime()
+{
+    return (float) SampleTime::toSeconds(getTotalSamples(), sampleRate);
+}
+
+float Protocol::getTotalTimeStdDev()
+{
+    double variance = 0;
+
+    for (auto* sequence : sequences)
+        variance += sequence->getTotalSamplesVariance();
+
+    return (float) (std::sqrt(variance) / sampleRate);
 }
 
 int Protocol::getTotalTrials() 
@@ -27,20 +27,21 @@
 
 #include <ProcessorHeaders.h>
 
+#include "DigitalWordRenderer.h"
+#include "MemoryReport.h"
+#include "ProtocolCheckpoint.h"
+#include "ProtocolFile.h"
+#include "RenderAheadPipeline.h"
+#include "WaveformFile.h"
+#include "TrialLog.h"
+#include "TrialEventRing.h"
+#include "TrialGenerator.h"
+
 class Protocol;
 class Sequence;
 class Condition;
 class Stimulus;
 
-/** Available stimulus types*/
-enum StimulusType
-{
-    PULSE_TRAIN,
-    SINUSOID,
-    RAMP,
-    CUSTOM
-};
-
 /** 
 	Holds parameters for a specific optogenetic stimulus.
     
@@ -57,8 +58,29 @@ public:
 	/** The class destructor, used to deallocate memory*/
 	virtual ~Stimulus();
 
-    /** Returns the total time of the stimulus */
-    virtual float getTotalTime() = 0;
+    /** Returns the total time of the stimulus in seconds, at the protocol's sample rate */
+    float getTotalTime();
+
+    /** Returns the duration of the stimulus, rounded to whole samples */
+    virtual int64 getTotalSamples(double sampleRate) = 0;
+
+    /** Captures everything needed to render the stimulus at a sample rate */
+    virtual StimulusSpec createSpec(double sampleRate) = 0;
+
+    /** Adds the memory used by the stimulus to a report node */
+    virtual void addMemoryUsage(MemoryReport& report, int node) = 0;
+
+    /** Returns the stimulus's editable parameters */
+    virtual Array<Parameter*> getParameters() = 0;
+
+    /** Writes the stimulus type and parameters to a STIMULUS element */
+    virtual void saveState(XmlElement& xml);
+
+    /** Restores the parameters written by saveState() */
+    virtual void loadState(XmlElement& xml);
+
+    /** Creates an empty stimulus of a given type */
+    static Stimulus* create(StimulusType type, ParameterOwner* owner, Condition* condition);
     
     /** Index of the current stimulus */
     static int numStimuliCreated;
@@ -93,15 +115,53 @@ public:
     /** The class destructor, used to deallocate memory*/
     ~CustomStimulus() { }
 
-    /** The total time of the stimulus */
-    float getTotalTime() override;
+    /** The duration of the stimulus in samples */
+    int64 getTotalSamples(double sampleRate) override;
+
+    /** Captures the stimulus for rendering */
+    StimulusSpec createSpec(double sampleRate) override;
+
+    /** Adds the memory used by the stimulus to a report node */
+    void addMemoryUsage(MemoryReport& report, int node) override;
+
+    /** Returns the stimulus's editable parameters */
+    Array<Parameter*> getParameters() override { return { &sample_frequency }; }
+
+    /** Also writes the waveform (float32, base64) */
+    void saveState(XmlElement& xml) override;
+
+    /** Also restores the waveform and its overview */
+    void loadState(XmlElement& xml) override;
+
+    /** Replaces the waveform and its overview */
+    void setWaveform(Array<float> samples, WaveformOverview newOverview);
+
+    /** Stimulus waveform */
+    const Array<float>& getWaveform() const { return stimulus_waveform; }
+
+    /** Min/max summary of the waveform, for drawing */
+    const WaveformOverview& getOverview() const { return overview; }
     
     /** Sample frequency (Hz) */
     FloatParameter sample_frequency;
-    
-    /** Stimulus waveform*/
+
+private:
+
+    /** Stimulus waveform */
     Array<float> stimulus_waveform;
 
+    /** Min/max summary of the waveform, for drawing */
+    WaveformOverview overview;
+
+    /** Hash of the waveform's samples, so specs don't rehash them */
+    uint64 waveformHash = 0;
+
+    /** The waveform prepared for the last output rate, reused while nothing changes */
+    WaveformBuffer::Ptr waveformBuffer;
+
+    /** Hash of the waveform, its rate and the output rate waveformBuffer was made for */
+    uint64 waveformKey = 0;
+
 };
 
 
@@ -116,8 +176,17 @@ public:
     /** The class destructor, used to deallocate memory*/
     ~PulseTrain() { }
 
-    /** The total time of the stimulus */
-    float getTotalTime() override;
+    /** The duration of the stimulus in samples */
+    int64 getTotalSamples(double sampleRate) override;
+
+    /** Captures the stimulus for rendering */
+    StimulusSpec createSpec(double sampleRate) override;
+
+    /** Adds the memory used by the stimulus to a report node */
+    void addMemoryUsage(MemoryReport& report, int node) override;
+
+    /** Returns the stimulus's editable parameters */
+    Array<Parameter*> getParameters() override { return { &pulse_width, &pulse_frequency, &ramp_duration, &pulse_count }; }
     
     /** Pulse width (ms) */
     FloatParameter pulse_width;
@@ -145,8 +214,17 @@ public:
     /** The class destructor, used to deallocate memory*/
     ~RampStimulus() { }
 
-    /** The total time of the stimulus */
-    float getTotalTime() override;
+    /** The duration of the stimulus in samples */
+    int64 getTotalSamples(double sampleRate) override;
+
+    /** Captures the stimulus for rendering */
+    StimulusSpec createSpec(double sampleRate) override;
+
+    /** Adds the memory used by the stimulus to a report node */
+    void addMemoryUsage(MemoryReport& report, int node) override;
+
+    /** Returns the stimulus's editable parameters */
+    Array<Parameter*> getParameters() override { return { &plateau_duration, &ramp_onset_duration, &ramp_offset_duration, &ramp_profile }; }
     
     /** Plateau duration (ms) */
     FloatParameter plateau_duration;
@@ -174,8 +252,17 @@ public:
     /** The class destructor, used to deallocate memory*/
     ~SineWave() { }
 
-    /** The total time of the stimulus */
-    float getTotalTime() override;
+    /** The duration of the stimulus in samples */
+    int64 getTotalSamples(double sampleRate) override;
+
+    /** Captures the stimulus for rendering */
+    StimulusSpec createSpec(double sampleRate) override;
+
+    /** Adds the memory used by the stimulus to a report node */
+    void addMemoryUsage(MemoryReport& report, int node) override;
+
+    /** Returns the stimulus's editable parameters */
+    Array<Parameter*> getParameters() override { return { &sine_wave_duration, &sine_wave_frequency }; }
     
     /** Sine wave duration (ms) */
     FloatParameter sine_wave_duration;
@@ -217,6 +304,19 @@ public:
     /** Total number of trials for this condition */
     int getTotalTrials();
 
+    /** Adds the memory used by the condition to a report node, and a node for each stimulus */
+    void addMemoryUsage(MemoryReport& report, int node);
+
+    /** Returns the condition's editable parameters */
+    Array<Parameter*> getParameters() { return { &num_repeats, &source, &pulse_power, sites.get() }; }
+
+    /** Writes the parameters, wavelengths and stimuli to a CONDITION element */
+    void saveState(XmlElement& xml);
+
+    /** Restores the state written by saveState(), creating the stimuli
+        (the sequence's trials are not recompiled) */
+    void loadState(XmlElement& xml);
+
     /** Number of repeats for this condition */
     IntParameter num_repeats;
 
@@ -267,7 +367,8 @@ private:
     sequence, composed of a set of conditions.alignas
     
     Each sequence can have a baseline interval, a minimum and maximum
-    inter-trial interval, and a randomization flag.
+    inter-trial interval, a randomization mode, and a ratio of catch
+    trials.
 */
 
 class Sequence
@@ -285,18 +386,69 @@ public:
     /** Removes a condition from the sequence */
     void removeCondition(Condition* condition);
 
-    /** Returns the total time of this sequence */
+    /** Returns the expected total time of this sequence in seconds */
     float getTotalTime();
 
+    /** Returns the expected total length of this sequence in samples
+        (ITIs are counted at their mean, without summing every trial) */
+    int64 getTotalSamples();
+
+    /** Returns the variance of the total length, in samples squared */
+    double getTotalSamplesVariance();
+
     /** Returns the total number of trials */
     int getTotalTrials();
 
-    /** Gets the duration for the next stimulus */
-    float getTrialDuration(int trialIndex);
+    /** Adds the memory used by the sequence to a report node, and a node for each condition */
+    void addMemoryUsage(MemoryReport& report, int node);
+
+    /** Returns the sequence's editable parameters */
+    Array<Parameter*> getParameters();
+
+    /** Writes the parameters and conditions to a SEQUENCE element */
+    void saveState(XmlElement& xml);
+
+    /** Restores the state written by saveState(), creating the conditions
+        (the trials are not recompiled) */
+    void loadState(XmlElement& xml);
+
+    /** Returns the length of a trial (stimulus and ITI) in samples */
+    int64 getTrialSamples(int trialIndex);
+
+    /** Returns the length of a trial's stimulus in samples */
+    int64 getStimulusSamples(int trialIndex);
+
+    /** Returns the baseline interval in samples */
+    int64 getBaselineSamples() const { return compiledSpec.baselineSamples; }
 
     /** Creates the trials */
     void createTrials();
 
+    /** Captures the parameters needed to compile this sequence */
+    SequenceSpec createSpec();
+
+    /** Chooses between a stored trial table and on-demand generation;
+        returns true if the trial table still needs to be compiled */
+    bool prepareTrials(const SequenceSpec& spec);
+
+    /** Returns the compiled trial table */
+    CompiledSequence& getCompiledSequence() { return compiled; }
+
+    /** Returns the spec the current trials were compiled from */
+    const SequenceSpec& getCompiledSpec() const { return compiledSpec; }
+
+    /** Returns the trial at a given position in the playback order */
+    TrialEntry getTrial(int trialIndex);
+
+    /** Returns the ITI (in samples) that follows the trial at a given position */
+    int64 getIti(int trialIndex);
+
+    /** Whether trials are generated on demand instead of stored */
+    bool isUsingGenerator() const { return generator != nullptr; }
+
+    /** Sequences with more trials than this are generated on demand */
+    static const int maxMaterializedTrials = ScheduleCompiler::maxCompiledTrials;
+
     /** Baseline interval in seconds (delay before start of stimulation) */
     FloatParameter baseline_interval;
 
@@ -306,9 +458,30 @@ public:
     /** Maximum inter-trial interval in seconds */
     FloatParameter max_iti;
 
+    /** ITI distribution (uniform, exponential, fixed or empirical) */
+    CategoricalParameter iti_distribution;
+
+    /** Mean of the exponential ITI distribution in seconds (before truncation) */
+    FloatParameter mean_iti;
+
+    /** ITIs in seconds for the empirical distribution (comma-separated) */
+    StringParameter iti_table;
+
     /** Whether to randomize the trial order */
     BooleanParameter randomize;
 
+    /** How the order is randomized (shuffled, blocked or with limited runs) */
+    CategoricalParameter randomization;
+
+    /** Longest run of trials from the same condition or site (for "Max run") */
+    IntParameter max_run_length;
+
+    /** Whether runs are counted by condition or by site (for "Max run") */
+    CategoricalParameter run_category;
+
+    /** Catch trials (light off) per stimulus trial */
+    FloatParameter catch_ratio;
+
     /** Holds the conditions for this sequence */
     OwnedArray<Condition> conditions;
     
@@ -325,14 +498,17 @@ private:
     /** The parameter owner */
     ParameterOwner* owner;
 
-    /** ITI values */
-    Array<float> iti_values;
+    /** The spec the current trials were compiled from */
+    SequenceSpec compiledSpec;
+
+    /** Compiled trials, ITI values and order */
+    CompiledSequence compiled;
 
-    /** Stimuli */
-    Array<Stimulus*> stimuli;
+    /** Produces trials on demand for very long sequences */
+    std::unique_ptr<TrialGenerator> generator;
 
-    /** Order */
-    Array<int> order;
+    /** Draws the ITIs of the current spec (and knows their mean and variance) */
+    std::unique_ptr<ItiSampler> itiSampler;
     
 };
 
@@ -347,8 +523,7 @@ private:
     or custom waveforms).)
 */
 
-class Protocol : public Timer,
-                 public ActionBroadcaster
+class Protocol : public ActionBroadcaster
 {
 public:
 	/** The class constructor, used to initialize any members.*/
@@ -357,15 +532,23 @@ public:
 	/** The class destructor, used to deallocate memory*/
 	~Protocol();
 
-    /** Run protocol */
+    /** Prepares the protocol for playback (called before its first event) */
     void run();
 
-    /** Pause protocol */
-    void pause();
+    /** Performs the next event (a baseline or a trial onset) and returns the
+        number of samples until the one after it, or -1 once every sequence
+        has finished. Playback is timed by a ProtocolRunner. */
+    int64 advance();
 
     /** Reset protocol */
     void reset();
 
+    /** Whether every sequence has been delivered */
+    bool isFinished() const { return finished; }
+
+    /** Returns the names of the sources used by any condition with trials */
+    StringArray getSources();
+
     /** The name of the protocol */
     String name;
 
@@ -381,12 +564,98 @@ public:
      /** Updates the trial info for each sequence */
     void createTrials();
 
-    /** Returns the total time of this protocol */
+    /** Returns the expected total time of this protocol in seconds */
     float getTotalTime();
 
+    /** Returns the standard deviation of the total time in seconds */
+    float getTotalTimeStdDev();
+
+    /** Returns the expected total length of this protocol in samples */
+    int64 getTotalSamples();
+
+    /** Returns the sample rate that durations are rounded against */
+    double getSampleRate() const { return sampleRate; }
+
+    /** Sets the sample rate that durations are rounded against */
+    void setSampleRate(double sampleRate);
+
     /** Returns the total number of trials */
     int getTotalTrials();
 
+    /** Returns the seed used for ITI sampling and trial order */
+    int64 getSeed() const { return seed; }
+
+    /** Sets the seed used for ITI sampling and trial order */
+    void setSeed(int64 seed);
+
+    /** Returns the compiler shared by this protocol's sequences */
+    ScheduleCompiler& getCompiler() { return compiler; }
+
+    /** Returns a hash of everything that determines the trial schedule */
+    uint64 getScheduleHash();
+
+    /** Snapshots every sequence into a definition that can be saved and compiled without the GUI */
+    ProtocolDefinition createDefinition();
+
+    /** Writes the name, seed and editable parameters of every sequence to a PROTOCOL element */
+    void saveState(XmlElement& xml);
+
+    /** Replaces the sequences with those written by saveState() and compiles them */
+    void loadState(XmlElement& xml);
+
+    /** Adds a node for the protocol to a report, followed by its sequences,
+        conditions and stimuli; returns the protocol's node */
+    int addMemoryUsage(MemoryReport& report);
+
+    /** Returns the file that checkpoints for this protocol are written to, named
+        after the processor's node, the protocol and its seed so that protocols
+        of other plugin instances never share it */
+    File getCheckpointFile();
+
+    /** Sets the node ID of the processor that plays the protocol */
+    void setNodeId(int nodeId_) { nodeId = nodeId_; }
+
+    /** Restores the position of an interrupted run from its checkpoint;
+        returns false if there is nothing to resume or the protocol has changed */
+    bool resumeFromCheckpoint();
+
+    /** Returns the current sequence */
+    int getCurrentSequenceIndex() const { return currentSequenceIndex; }
+
+    /** Returns the index of the next trial within the current sequence */
+    int getCurrentTrialIndex() const { return currentTrialIndex; }
+
+    /** Returns the number of trials delivered since the run started */
+    int64 getTrialsDelivered() const { return trialsDelivered; }
+
+    /** Describes a trial of the run (counted across sequences) for rendering
+        ahead of its onset; returns false if the run has fewer trials */
+    bool getTrialAt(int64 runTrial, TrialRenderRequest& request);
+
+    /** Describes a trial of the run (counted across sequences) as it is
+        written to the trial log; returns false if the run has fewer trials */
+    bool getTrialRecord(int64 runTrial, TrialRecord& record);
+
+    /** Adds every trial of the run to a digital timeline, with the first
+        baseline starting at onset; returns the sample after the last ITI */
+    int64 addToDigitalTimeline(DigitalWordRenderer& renderer, int64 onset);
+
+    /** Returns the render ticket for a trial of the run */
+    int64 getTrialTicket(int64 runTrial) const { return ((int64) index << 40) + runTrial; }
+
+    /** Sets the log that delivered trials are written to (may be nullptr) */
+    void setTrialLog(TrialLogWriter* trialLog_) { trialLog = trialLog_; }
+
+    /** Sets the ring that trial onsets are published to (may be nullptr) */
+    void setTrialEvents(TrialEventRing* trialEvents_) { trialEvents = trialEvents_; }
+
+    /** While simulated, the protocol plays as usual but writes no checkpoints,
+        trial log or trial events and sends no messages */
+    void setSimulated(bool shouldBeSimulated) { simulated = shouldBeSimulated; }
+
+    /** Whether the protocol is being simulated */
+    bool isSimulated() const { return simulated; }
+
     /** Holds the sequences for this protocol */
     OwnedArray<Sequence> sequences;
     
@@ -398,8 +667,8 @@ public:
     
 private:
 
-    /** Timer callback */
-    void timerCallback() override;
+    /** Describes a trial of a sequence */
+    TrialRecord createTrialRecord(int sequenceIndex, int trialIndex, int64 runTrial);
 
     /** The parameter owner */
     ParameterOwner* owner;
@@ -412,6 +681,42 @@ private:
 
     /** Baseline interval */
     bool baselineInterval = true;
+
+    /** True once every sequence has been delivered */
+    bool finished = false;
+
+    /** Seed for ITI sampling and trial order */
+    int64 seed;
+
+    /** Sample rate of the incoming stream */
+    double sampleRate = SampleTime::defaultSampleRate;
+
+    /** Expands sequences into trials */
+    ScheduleCompiler compiler;
+
+    /** Writes checkpoints while the protocol is running */
+    std::unique_ptr<ProtocolCheckpoint> checkpoint;
+
+    /** Schedule hash for the current run */
+    uint64 runScheduleHash = 0;
+
+    /** True if the next run continues from a checkpoint */
+    bool resumed = false;
+
+    /** Receives a record for every delivered trial */
+    TrialLogWriter* trialLog = nullptr;
+
+    /** Receives an event for every delivered trial */
+    TrialEventRing* trialEvents = nullptr;
+
+    /** True while played on a virtual clock */
+    bool simulated = false;
+
+    /** Node ID of the processor that plays the protocol */
+    int nodeId = 0;
+
+    /** Trials delivered since the run started */
+    int64 trialsDelivered = 0;
     
 };
 
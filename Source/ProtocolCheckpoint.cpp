@@ -0,0 +1,68 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "ProtocolCheckpoint.h"
+
+ProtocolCheckpoint::ProtocolCheckpoint()
+    : RecordWriter<CheckpointRecord>("Opto checkpoint writer", 1024, flushIntervalMs)
+{
+}
+
+void ProtocolCheckpoint::record(int64 seed, uint64 scheduleHash, int sequenceIndex, int trialIndex, Flags flags)
+{
+    CheckpointRecord checkpoint;
+    checkpoint.seed = seed;
+    checkpoint.scheduleHash = scheduleHash;
+    checkpoint.sequenceIndex = sequenceIndex;
+    checkpoint.trialIndex = trialIndex;
+    checkpoint.flags = (uint32) flags;
+
+    write(checkpoint);
+}
+
+bool ProtocolCheckpoint::readLast(const File& file, CheckpointRecord& record)
+{
+    std::unique_ptr<FileInputStream> stream = file.createInputStream();
+
+    if (stream == nullptr)
+        return false;
+
+    // A crash can leave a partially written record at the end; ignore it
+    const int64 numRecords = stream->getTotalLength() / (int64) sizeof(CheckpointRecord);
+
+    for (int64 i = numRecords - 1; i >= 0; --i)
+    {
+        CheckpointRecord candidate;
+        stream->setPosition(i * (int64) sizeof(CheckpointRecord));
+
+        if (stream->read(&candidate, (int) sizeof(candidate)) == (int) sizeof(candidate)
+            && candidate.magic == CheckpointRecord().magic
+            && candidate.version == CheckpointRecord().version)
+        {
+            record = candidate;
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,96 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef PROTOCOLCHECKPOINT_H_DEFINED
+#define PROTOCOLCHECKPOINT_H_DEFINED
+
+#include "RecordWriter.h"
+
+/**
+    One checkpoint, written at a trial boundary.
+
+    Every trial before (sequenceIndex, trialIndex) has been delivered.
+    Together with the seed, this is enough to rebuild the schedule and
+    continue with the same order.
+*/
+struct CheckpointRecord
+{
+    /** Identifies a checkpoint record ("OPCK") */
+    uint32 magic = 0x4b43504f;
+
+    /** Record layout version */
+    uint32 version = 1;
+
+    /** Protocol seed */
+    int64 seed = 0;
+
+    /** Hash of the compiled schedule */
+    uint64 scheduleHash = 0;
+
+    /** Sequence of the next trial */
+    int32 sequenceIndex = 0;
+
+    /** Next trial within that sequence */
+    int32 trialIndex = 0;
+
+    /** ProtocolCheckpoint::Flags */
+    uint32 flags = 0;
+
+    /** Unused (keeps the record 8-byte aligned) */
+    uint32 reserved = 0;
+};
+
+static_assert(sizeof(CheckpointRecord) == 40, "CheckpointRecord layout must not change");
+
+/**
+    Appends checkpoint records to a file without blocking the caller.
+
+    Records are batched and synced to disk on a background thread.
+*/
+class ProtocolCheckpoint : public RecordWriter<CheckpointRecord>
+{
+public:
+    /** Checkpoint states */
+    enum Flags
+    {
+        RUNNING = 0,
+        FINISHED = 1
+    };
+
+    /** Constructor */
+    ProtocolCheckpoint();
+
+    /** Destructor */
+    ~ProtocolCheckpoint() { close(); }
+
+    /** Queues a checkpoint */
+    void record(int64 seed, uint64 scheduleHash, int sequenceIndex, int trialIndex, Flags flags = RUNNING);
+
+    /** Reads the last complete record in a checkpoint file */
+    static bool readLast(const File& file, CheckpointRecord& record);
+
+    /** Records are synced to disk at this interval */
+    static const int flushIntervalMs = 250;
+};
+
+#endif // PROTOCOLCHECKPOINT_H_DEFINED
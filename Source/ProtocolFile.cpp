@@ -0,0 +1,376 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "ProtocolFile.h"
+
+namespace
+{
+    const char* const itiDistributionNames[] = { "uniform", "exponential", "fixed", "empirical" };
+    const char* const trialOrderNames[] = { "sequential", "shuffled", "blocked", "max_run" };
+    const char* const runCategoryNames[] = { "condition", "site" };
+    const char* const stimulusTypeNames[] = { "pulse_train", "sine", "ramp", "custom" };
+    const char* const rampProfileNames[] = { "linear", "cosine" };
+
+    /** Returns the index of a name in a table, or -1 */
+    template <size_t N>
+    int findName(const char* const (&names)[N], const String& name)
+    {
+        for (size_t i = 0; i < N; ++i)
+        {
+            if (name == names[i])
+                return (int) i;
+        }
+
+        return -1;
+    }
+
+    /** Formats a double with enough digits to read back the same value */
+    String exactDouble(double value)
+    {
+        return String::formatted("%.17g", value);
+    }
+
+    int64 getInt64(const XmlElement& xml, const char* name)
+    {
+        return xml.getStringAttribute(name).getLargeIntValue();
+    }
+
+    template <typename IntType>
+    String joinIntegers(const Array<IntType>& values)
+    {
+        StringArray tokens;
+
+        for (auto value : values)
+            tokens.add(String(value));
+
+        return tokens.joinIntoString(" ");
+    }
+
+    template <typename IntType>
+    Array<IntType> splitIntegers(const String& text)
+    {
+        StringArray tokens = StringArray::fromTokens(text, " ,", "");
+        tokens.removeEmptyStrings();
+
+        Array<IntType> values;
+
+        for (auto& token : tokens)
+            values.add((IntType) token.getLargeIntValue());
+
+        return values;
+    }
+}
+
+int64 ProtocolDefinition::getNumTrials() const
+{
+    int64 numTrials = 0;
+
+    for (auto& sequence : sequences)
+        numTrials += sequence.getNumTrials();
+
+    return numTrials;
+}
+
+uint64 ProtocolDefinition::getHash() const
+{
+    uint64 hash = ScheduleCompiler::hashCombine(0, (uint64) sequences.size());
+
+    for (auto& sequence : sequences)
+    {
+        hash = ScheduleCompiler::hashCombine(hash, sequence.getHash());
+        hash = ScheduleCompiler::hashCombine(hash, (uint64) sequence.getNumTrials());
+    }
+
+    return hash;
+}
+
+std::unique_ptr<XmlElement> ProtocolFile::toXml(const ProtocolDefinition& definition)
+{
+    auto xml = std::make_unique<XmlElement>(rootTag);
+
+    xml->setAttribute("version", currentVersion);
+    xml->setAttribute("name", definition.name);
+    xml->setAttribute("seed", String(definition.seed));
+    xml->setAttribute("sample_rate", exactDouble(definition.sampleRate));
+
+    for (auto& sequence : definition.sequences)
+        writeSequence(sequence, *xml->createNewChildElement("SEQUENCE"));
+
+    return xml;
+}
+
+void ProtocolFile::writeSequence(const SequenceSpec& sequence, XmlElement& xml)
+{
+    xml.setAttribute("seed", String(sequence.seed));
+    xml.setAttribute("baseline_samples", String(sequence.baselineSamples));
+    xml.setAttribute("min_iti_samples", String(sequence.minItiSamples));
+    xml.setAttribute("max_iti_samples", String(sequence.maxItiSamples));
+    xml.setAttribute("iti_distribution", itiDistributionNames[sequence.itiDistribution]);
+
+    if (sequence.itiDistribution == EXPONENTIAL_ITI)
+        xml.setAttribute("iti_mean_samples", exactDouble(sequence.itiMeanSamples));
+
+    if (sequence.itiDistribution == EMPIRICAL_ITI)
+        xml.setAttribute("iti_table_samples", joinIntegers(sequence.itiTable));
+
+    xml.setAttribute("order", trialOrderNames[sequence.order]);
+
+    if (sequence.order == MAX_RUN_ORDER)
+    {
+        xml.setAttribute("max_run_length", sequence.maxRunLength);
+        xml.setAttribute("run_category", runCategoryNames[sequence.runCategory]);
+    }
+
+    for (auto& condition : sequence.conditions)
+    {
+        XmlElement* conditionXml = xml.createNewChildElement("CONDITION");
+
+        conditionXml->setAttribute("repeats", condition.numRepeats);
+        conditionXml->setAttribute("sites", joinIntegers(condition.sites));
+        conditionXml->setAttribute("wavelengths", joinIntegers(condition.wavelengths));
+        conditionXml->setAttribute("catch_trials", condition.numCatchTrials);
+
+        for (auto& stimulus : condition.stimuli)
+            writeStimulus(stimulus, *conditionXml->createNewChildElement("STIMULUS"));
+    }
+}
+
+void ProtocolFile::writeStimulus(const StimulusSpec& stimulus, XmlElement& xml)
+{
+    xml.setAttribute("type", stimulusTypeNames[stimulus.type]);
+    xml.setAttribute("samples", String(stimulus.numSamples));
+
+    switch (stimulus.type)
+    {
+        case PULSE_TRAIN:
+            xml.setAttribute("pulses", stimulus.numPulses);
+            xml.setAttribute("period_samples", exactDouble(stimulus.pulsePeriod));
+            xml.setAttribute("width_samples", String(stimulus.pulseWidth));
+            xml.setAttribute("ramp_samples", String(stimulus.pulseRamp));
+            break;
+        case RAMP:
+            xml.setAttribute("onset_samples", String(stimulus.rampOnset));
+            xml.setAttribute("plateau_samples", String(stimulus.rampPlateau));
+            xml.setAttribute("offset_samples", String(stimulus.rampOffset));
+            xml.setAttribute("profile", rampProfileNames[stimulus.rampProfile]);
+            break;
+        case SINUSOID:
+            xml.setAttribute("cycles_per_sample", exactDouble(stimulus.sineFrequency));
+            break;
+        case CUSTOM:
+            if (stimulus.waveform != nullptr)
+            {
+                // Float32, little-endian
+                const Array<float>& samples = stimulus.waveform->samples;
+                MemoryBlock data(samples.begin(), (size_t) samples.size() * sizeof(float));
+
+                xml.setAttribute("waveform_rate", exactDouble(stimulus.waveform->sampleRate));
+                xml.setAttribute("waveform_samples", samples.size());
+                xml.addTextElement(data.toBase64Encoding());
+            }
+            break;
+    }
+}
+
+Result ProtocolFile::fromXml(const XmlElement& xml, ProtocolDefinition& definition)
+{
+    if (!xml.hasTagName(rootTag))
+        return Result::fail("Not a protocol definition");
+
+    if (xml.getIntAttribute("version") > currentVersion)
+        return Result::fail("Written by a newer version (" + xml.getStringAttribute("version") + ")");
+
+    definition = ProtocolDefinition();
+    definition.name = xml.getStringAttribute("name");
+    definition.seed = getInt64(xml, "seed");
+    definition.sampleRate = xml.getDoubleAttribute("sample_rate", SampleTime::defaultSampleRate);
+
+    if (definition.sampleRate <= 0)
+        return Result::fail("Invalid sample rate");
+
+    int index = 0;
+
+    for (auto* sequenceXml : xml.getChildWithTagNameIterator("SEQUENCE"))
+    {
+        SequenceSpec sequence;
+        Result result = readSequence(*sequenceXml, definition.sampleRate, sequence);
+
+        if (result.failed())
+            return Result::fail("Sequence " + String(index + 1) + ": " + result.getErrorMessage());
+
+        definition.sequences.add(sequence);
+        index++;
+    }
+
+    return Result::ok();
+}
+
+Result ProtocolFile::readSequence(const XmlElement& xml, double sampleRate, SequenceSpec& sequence)
+{
+    sequence.sampleRate = sampleRate;
+    sequence.seed = getInt64(xml, "seed");
+    sequence.baselineSamples = getInt64(xml, "baseline_samples");
+    sequence.minItiSamples = getInt64(xml, "min_iti_samples");
+    sequence.maxItiSamples = getInt64(xml, "max_iti_samples");
+
+    const int distribution = findName(itiDistributionNames, xml.getStringAttribute("iti_distribution", "uniform"));
+    const int order = findName(trialOrderNames, xml.getStringAttribute("order", "shuffled"));
+    const int runCategory = findName(runCategoryNames, xml.getStringAttribute("run_category", "condition"));
+
+    if (distribution < 0)
+        return Result::fail("Unknown ITI distribution " + xml.getStringAttribute("iti_distribution").quoted());
+
+    if (order < 0)
+        return Result::fail("Unknown trial order " + xml.getStringAttribute("order").quoted());
+
+    if (runCategory < 0)
+        return Result::fail("Unknown run category " + xml.getStringAttribute("run_category").quoted());
+
+    sequence.itiDistribution = (ItiDistribution) distribution;
+    sequence.itiMeanSamples = xml.getDoubleAttribute("iti_mean_samples");
+    sequence.itiTable = splitIntegers<int64>(xml.getStringAttribute("iti_table_samples"));
+    sequence.order = (TrialOrder) order;
+    sequence.maxRunLength = xml.getIntAttribute("max_run_length", 1);
+    sequence.runCategory = (RunCategory) runCategory;
+
+    if (sequence.baselineSamples < 0 || sequence.minItiSamples < 0 || sequence.maxItiSamples < 0)
+        return Result::fail("Negative baseline or ITI");
+
+    int index = 0;
+
+    for (auto* conditionXml : xml.getChildWithTagNameIterator("CONDITION"))
+    {
+        ConditionSpec condition;
+        condition.numRepeats = conditionXml->getIntAttribute("repeats", 1);
+        condition.sites = splitIntegers<int>(conditionXml->getStringAttribute("sites"));
+        condition.wavelengths = splitIntegers<int>(conditionXml->getStringAttribute("wavelengths"));
+        condition.numCatchTrials = conditionXml->getIntAttribute("catch_trials");
+
+        if (condition.numRepeats < 0 || condition.numCatchTrials < 0)
+            return Result::fail("Condition " + String(index + 1) + ": negative number of trials");
+
+        for (auto* stimulusXml : conditionXml->getChildWithTagNameIterator("STIMULUS"))
+        {
+            StimulusSpec stimulus;
+            Result result = readStimulus(*stimulusXml, sampleRate, stimulus);
+
+            if (result.failed())
+                return Result::fail("Condition " + String(index + 1) + ": " + result.getErrorMessage());
+
+            condition.stimuli.add(stimulus);
+        }
+
+        condition.numStimuli = condition.stimuli.size();
+        sequence.conditions.add(condition);
+        index++;
+    }
+
+    return Result::ok();
+}
+
+Result ProtocolFile::readStimulus(const XmlElement& xml, double sampleRate, StimulusSpec& stimulus)
+{
+    const int type = findName(stimulusTypeNames, xml.getStringAttribute("type"));
+
+    if (type < 0)
+        return Result::fail("Unknown stimulus type " + xml.getStringAttribute("type").quoted());
+
+    stimulus.type = (StimulusType) type;
+    stimulus.numSamples = getInt64(xml, "samples");
+
+    if (stimulus.numSamples < 0)
+        return Result::fail("Negative stimulus duration");
+
+    switch (stimulus.type)
+    {
+        case PULSE_TRAIN:
+            stimulus.numPulses = xml.getIntAttribute("pulses");
+            stimulus.pulsePeriod = xml.getDoubleAttribute("period_samples");
+            stimulus.pulseWidth = getInt64(xml, "width_samples");
+            stimulus.pulseRamp = getInt64(xml, "ramp_samples");
+            break;
+        case RAMP:
+        {
+            const int profile = findName(rampProfileNames, xml.getStringAttribute("profile", "linear"));
+
+            if (profile < 0)
+                return Result::fail("Unknown ramp profile " + xml.getStringAttribute("profile").quoted());
+
+            stimulus.rampOnset = getInt64(xml, "onset_samples");
+            stimulus.rampPlateau = getInt64(xml, "plateau_samples");
+            stimulus.rampOffset = getInt64(xml, "offset_samples");
+            stimulus.rampProfile = (RampProfile) profile;
+            break;
+        }
+        case SINUSOID:
+            stimulus.sineFrequency = xml.getDoubleAttribute("cycles_per_sample");
+            break;
+        case CUSTOM:
+        {
+            const int numSamples = xml.getIntAttribute("waveform_samples");
+            const double waveformRate = xml.getDoubleAttribute("waveform_rate");
+
+            if (numSamples <= 0)
+                break;
+
+            MemoryBlock data;
+
+            if (waveformRate <= 0
+                || !data.fromBase64Encoding(xml.getAllSubText().trim())
+                || data.getSize() != (size_t) numSamples * sizeof(float))
+                return Result::fail("Corrupt custom waveform");
+
+            Array<float> samples((const float*) data.getData(), numSamples);
+            stimulus.waveform = WaveformBuffer::create(samples, waveformRate, sampleRate);
+            break;
+        }
+    }
+
+    return Result::ok();
+}
+
+Result ProtocolFile::save(const ProtocolDefinition& definition, const File& file)
+{
+    std::unique_ptr<XmlElement> xml = toXml(definition);
+
+    if (!xml->writeTo(file))
+        return Result::fail("Could not write " + file.getFullPathName());
+
+    return Result::ok();
+}
+
+Result ProtocolFile::load(const File& file, ProtocolDefinition& definition)
+{
+    XmlDocument document(file);
+    std::unique_ptr<XmlElement> xml = document.getDocumentElement();
+
+    if (xml == nullptr)
+        return Result::fail(file.getFileName() + ": " + document.getLastParseError());
+
+    Result result = fromXml(*xml, definition);
+
+    if (result.failed())
+        return Result::fail(file.getFileName() + ": " + result.getErrorMessage());
+
+    return Result::ok();
+}
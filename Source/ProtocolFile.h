@@ -0,0 +1,98 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef PROTOCOLFILE_H_DEFINED
+#define PROTOCOLFILE_H_DEFINED
+
+#include "ScheduleCompiler.h"
+
+/**
+    Everything needed to compile a protocol's schedule, without the GUI.
+
+    Sequences are stored as the specs the plugin compiles, so a
+    definition exported from the plugin produces exactly the schedule
+    the plugin would play.
+*/
+struct ProtocolDefinition
+{
+    /** Protocol name */
+    String name;
+
+    /** Protocol seed (each sequence's spec holds the seed derived from it) */
+    int64 seed = 0;
+
+    /** Sample rate that every duration was rounded against */
+    double sampleRate = SampleTime::defaultSampleRate;
+
+    /** Sequences, in playback order */
+    Array<SequenceSpec> sequences;
+
+    /** Total number of trials */
+    int64 getNumTrials() const;
+
+    /** Hash of everything that determines the trial schedule */
+    uint64 getHash() const;
+};
+
+/**
+    Reads and writes protocol definitions as XML.
+
+    Durations are stored in samples and the pulse period and sine
+    frequency with full precision, so a definition read back compiles
+    to the same schedule (and has the same hash) as the one written.
+    Custom waveforms are embedded as base64-encoded float32 samples.
+*/
+class ProtocolFile
+{
+public:
+    /** Converts a definition to XML */
+    static std::unique_ptr<XmlElement> toXml(const ProtocolDefinition& definition);
+
+    /** Reads a definition from XML */
+    static Result fromXml(const XmlElement& xml, ProtocolDefinition& definition);
+
+    /** Writes a definition to a file */
+    static Result save(const ProtocolDefinition& definition, const File& file);
+
+    /** Reads a definition from a file */
+    static Result load(const File& file, ProtocolDefinition& definition);
+
+    /** File chooser pattern for definitions */
+    static String getWildcard() { return "*.xml"; }
+
+    /** Name of the root element */
+    static constexpr const char* rootTag = "OPTO_PROTOCOL";
+
+    /** Version written to new files */
+    static const int currentVersion = 1;
+
+private:
+
+    static void writeSequence(const SequenceSpec& sequence, XmlElement& xml);
+    static void writeStimulus(const StimulusSpec& stimulus, XmlElement& xml);
+
+    static Result readSequence(const XmlElement& xml, double sampleRate, SequenceSpec& sequence);
+    static Result readStimulus(const XmlElement& xml, double sampleRate, StimulusSpec& stimulus);
+};
+
+#endif // PROTOCOLFILE_H_DEFINED
@@ -0,0 +1,351 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include "ProtocolRunner.h"
+#include "TraceRecorder.h"
+
+namespace
+{
+    /** Fails if two protocols in a stage use the same source */
+    Result checkSources(const Array<Protocol*>& protocols)
+    {
+        HashMap<String, Protocol*> owners;
+
+        for (auto* protocol : protocols)
+        {
+            for (auto& source : protocol->getSources())
+            {
+                if (owners.contains(source) && owners[source] != protocol)
+                    return Result::fail(owners[source]->name + " and " + protocol->name
+                                        + " both use " + source);
+
+                owners.set(source, protocol);
+            }
+        }
+
+        return Result::ok();
+    }
+}
+
+Result ProtocolRunner::addStage(const Array<Protocol*>& protocols)
+{
+    Result result = checkSources(protocols);
+
+    if (result.wasOk())
+        stages.add(protocols);
+
+    return result;
+}
+
+void ProtocolRunner::addProtocols(const Array<Protocol*>& protocols)
+{
+    for (auto* protocol : protocols)
+    {
+        if (!stages.isEmpty())
+        {
+            Array<Protocol*> candidate = stages.getLast();
+            candidate.add(protocol);
+
+            if (checkSources(candidate).wasOk())
+            {
+                stages.getReference(stages.size() - 1).add(protocol);
+                continue;
+            }
+        }
+
+        stages.add({ protocol });
+    }
+}
+
+void ProtocolRunner::setRenderPipeline(RenderAheadPipeline* pipeline)
+{
+    if (renderPipeline != nullptr)
+        renderPipeline->cancel();
+
+    renderPipeline = pipeline;
+}
+
+void ProtocolRunner::setMetrics(RuntimeMetrics* newMetrics)
+{
+    if (metrics != nullptr)
+        metrics->remove(&onsetLateness);
+
+    metrics = newMetrics;
+
+    if (metrics != nullptr)
+        metrics->add("onset_lateness", "us", &onsetLateness);
+}
+
+void ProtocolRunner::clear()
+{
+    stopTimer();
+
+    if (renderPipeline != nullptr)
+        renderPipeline->cancel();
+
+    stages.clear();
+    lanes.clear();
+    currentStage = -1;
+    stageEndSample = 0;
+}
+
+Result ProtocolRunner::validate()
+{
+    // Sources can be changed after a protocol is queued
+    for (auto& stage : stages)
+    {
+        Result result = checkSources(stage);
+
+        if (result.failed())
+            return result;
+    }
+
+    return Result::ok();
+}
+
+void ProtocolRunner::run()
+{
+    if (stages.isEmpty() || isTimerRunning())
+        return;
+
+    if (currentStage < 0)
+    {
+        Result result = validate();
+
+        if (result.failed())
+        {
+            LOGE("Unable to run protocols: ", result.getErrorMessage());
+            return;
+        }
+
+        startStage(0, 0);
+    }
+
+    // Event times are measured from here; after a pause, pending events start immediately
+    int nextLane = getNextLane();
+    anchorSample = nextLane >= 0 ? lanes[nextLane].nextEventSample : stageEndSample;
+    anchorMs = Time::getMillisecondCounterHiRes();
+
+    startTimer(1);
+}
+
+Result ProtocolRunner::startSimulation()
+{
+    if (isTimerRunning() || currentStage >= 0)
+        return Result::fail("The queue has already started");
+
+    if (stages.isEmpty())
+        return Result::fail("No protocols are queued");
+
+    Result result = validate();
+
+    if (result.wasOk())
+        startStage(0, 0);
+
+    return result;
+}
+
+int64 ProtocolRunner::advanceTo(int64 sample)
+{
+    jassert(!isTimerRunning());
+
+    if (currentStage < 0)
+        return -1;
+
+    return fireEvents(sample);
+}
+
+void ProtocolRunner::pause()
+{
+    stopTimer();
+}
+
+void ProtocolRunner::startStage(int stageIndex, int64 startSample)
+{
+    LOGD("Starting protocol stage ", stageIndex, " at sample ", startSample);
+
+    currentStage = stageIndex;
+    stageEndSample = startSample;
+    lanes.clearQuick();
+
+    if (stageCallback)
+        stageCallback(stages.getReference(stageIndex), startSample);
+
+    for (auto* protocol : stages.getReference(stageIndex))
+    {
+        protocol->run();
+        lanes.add({ protocol, startSample, true, protocol->getTrialsDelivered() });
+        requestTrials(lanes.getReference(lanes.size() - 1));
+    }
+}
+
+void ProtocolRunner::requestTrials(Lane& lane)
+{
+    if (renderPipeline == nullptr)
+        return;
+
+    const int64 lastRequest = lane.protocol->getTrialsDelivered() + renderPipeline->getLookahead();
+    TrialRenderRequest request;
+
+    // A full queue is retried after the next event
+    while (lane.nextRequest < lastRequest
+           && lane.protocol->getTrialAt(lane.nextRequest, request)
+           && renderPipeline->request(request))
+    {
+        lane.nextRequest++;
+    }
+}
+
+int ProtocolRunner::getNextLane() const
+{
+    // Stages hold a handful of protocols, so a linear scan is the cheapest merge.
+    // Ties go to the protocol queued first, which keeps the order deterministic.
+    int nextLane = -1;
+
+    for (int i = 0; i < lanes.size(); ++i)
+    {
+        const Lane& lane = lanes.getReference(i);
+
+        if (lane.active && (nextLane < 0 || lane.nextEventSample < lanes.getReference(nextLane).nextEventSample))
+            nextLane = i;
+    }
+
+    return nextLane;
+}
+
+double ProtocolRunner::getSampleRate() const
+{
+    for (auto& stage : stages)
+    {
+        if (!stage.isEmpty())
+            return stage.getFirst()->getSampleRate();
+    }
+
+    return SampleTime::defaultSampleRate;
+}
+
+int64 ProtocolRunner::fireEvents(int64 dueSample)
+{
+    while (true)
+    {
+        int nextLane = getNextLane();
+
+        if (nextLane < 0)
+        {
+            // The next stage starts on the sample the last protocol of this one ended
+            if (currentStage + 1 >= stages.size())
+                return -1;
+
+            startStage(currentStage + 1, stageEndSample);
+            continue;
+        }
+
+        Lane& lane = lanes.getReference(nextLane);
+
+        if (lane.nextEventSample > dueSample)
+            return lane.nextEventSample;
+
+        const int64 trial = lane.protocol->getTrialsDelivered();
+        const TraceScope trace("scheduler", "trial_onset", trial);
+
+        int64 delaySamples = lane.protocol->advance();
+
+        if (lane.protocol->getTrialsDelivered() > trial)
+        {
+            if (clockSample >= 0)
+                onsetLateness.record(roundToInt(SampleTime::toMilliseconds(clockSample - lane.nextEventSample,
+                                                                          getSampleRate()) * 1000.0));
+
+            if (trialCallback)
+                trialCallback(*lane.protocol, trial, lane.nextEventSample);
+
+            if (renderPipeline != nullptr)
+            {
+                renderPipeline->trigger(lane.protocol->getTrialTicket(trial));
+                requestTrials(lane);
+            }
+        }
+
+        if (delaySamples < 0)
+        {
+            lane.active = false;
+            stageEndSample = jmax(stageEndSample, lane.nextEventSample);
+        }
+        else
+        {
+            lane.nextEventSample += delaySamples;
+        }
+    }
+}
+
+void ProtocolRunner::timerCallback()
+{
+    const TraceScope trace("scheduler", "timer");
+
+    stopTimer();
+
+    const double sampleRate = getSampleRate();
+
+    clockSample = anchorSample + SampleTime::fromMilliseconds(Time::getMillisecondCounterHiRes() - anchorMs, sampleRate);
+
+    // Timers can fire slightly early; anything due within a millisecond is started now
+    const int64 nextEventSample = fireEvents(clockSample + SampleTime::fromMilliseconds(1.0, sampleRate));
+
+    clockSample = -1;
+
+    if (nextEventSample < 0)
+    {
+        LOGD("All protocol stages finished");
+        sendActionMessage("FINISHED");
+        return;
+    }
+
+    // Each event is due at a fixed offset from the anchor, so timer
+    // lateness is absorbed by the next interval instead of accumulating
+    const double dueMs = anchorMs + SampleTime::toMilliseconds(nextEventSample - anchorSample, sampleRate);
+
+    startTimer(jmax(1, roundToInt(dueMs - Time::getMillisecondCounterHiRes())));
+}
+
+int64 ProtocolRunner::getTotalSamples()
+{
+    int64 totalSamples = 0;
+
+    for (auto& stage : stages)
+    {
+        int64 stageSamples = 0;
+
+        for (auto* protocol : stage)
+            stageSamples = jmax(stageSamples, protocol->getTotalSamples());
+
+        totalSamples += stageSamples;
+    }
+
+    return totalSamples;
+}
+
+float ProtocolRunner::getTotalTime()
+{
+    return (float) SampleTime::toSeconds(getTotalSamples(), getSampleRate());
+}
@@ -0,0 +1,196 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef PROTOCOLRUNNER_H_DEFINED
+#define PROTOCOLRUNNER_H_DEFINED
+
+#include "Protocol.h"
+
+/**
+    Plays a queue of protocols on a single sample timeline.
+
+    The queue is a list of stages. Protocols within a stage run
+    concurrently and must use disjoint sources; their events are
+    merged in time order. Each stage starts on the exact sample at
+    which the previous one ended, so there is no dead time between
+    back-to-back protocols.
+
+    With a RenderAheadPipeline, each protocol keeps the pipeline's
+    lookahead of upcoming trials requested, and every trial onset
+    triggers the trial that was rendered for it.
+
+    Normally events are timed by the wall clock. For simulation, the
+    queue can instead be started on a virtual clock, which only moves
+    when advanceTo() is called.
+*/
+class ProtocolRunner : public Timer,
+                       public ActionBroadcaster
+{
+public:
+    /** Constructor */
+    ProtocolRunner() { }
+
+    /** Destructor */
+    ~ProtocolRunner() { setMetrics(nullptr); }
+
+    /** Adds a stage of concurrent protocols; fails if two of them share a source */
+    Result addStage(const Array<Protocol*>& protocols);
+
+    /** Queues protocols in order, adding each one to the last stage
+        if it shares no sources with it, or starting a new stage otherwise */
+    void addProtocols(const Array<Protocol*>& protocols);
+
+    /** Stops playback and removes all stages (the protocols keep their position) */
+    void clear();
+
+    /** Checks every stage for source conflicts */
+    Result validate();
+
+    /** Starts or continues playback */
+    void run();
+
+    /** Pauses playback; pending events start immediately when it continues */
+    void pause();
+
+    /** Whether playback is in progress */
+    bool isRunning() const { return isTimerRunning(); }
+
+    /** Returns the number of queued stages */
+    int getNumStages() const { return stages.size(); }
+
+    /** Returns the stage that is playing (-1 before the first one starts) */
+    int getCurrentStage() const { return currentStage; }
+
+    /** Returns the timeline position at which the current stage ends (so far) */
+    int64 getStageEndSample() const { return stageEndSample; }
+
+    /** Sets the pipeline that renders upcoming trials (may be nullptr) */
+    void setRenderPipeline(RenderAheadPipeline* pipeline);
+
+    /** Registers the runner's metrics (may be nullptr to unregister them) */
+    void setMetrics(RuntimeMetrics* metrics);
+
+    /** Called with the timeline sample of every trial onset */
+    using TrialCallback = std::function<void(Protocol& protocol, int64 trial, int64 sample)>;
+
+    /** Sets the function called for every trial onset (may be empty) */
+    void setTrialCallback(TrialCallback callback) { trialCallback = std::move(callback); }
+
+    /** Called with the protocols of every stage and the timeline sample it starts at */
+    using StageCallback = std::function<void(const Array<Protocol*>& protocols, int64 sample)>;
+
+    /** Sets the function called as every stage starts (may be empty) */
+    void setStageCallback(StageCallback callback) { stageCallback = std::move(callback); }
+
+    /** Starts the queue from its first stage on a virtual clock; events are then fired by advanceTo() */
+    Result startSimulation();
+
+    /** Fires every event up to and including a sample on the virtual clock; returns
+        the sample of the next event, or -1 once every stage has finished */
+    int64 advanceTo(int64 sample);
+
+    /** Returns the total length of the queue in samples */
+    int64 getTotalSamples();
+
+    /** Returns the total length of the queue in seconds */
+    float getTotalTime();
+
+private:
+
+    /** Fires every event that is due and schedules the next one */
+    void timerCallback() override;
+
+    /** Fires every event up to and including dueSample; returns the sample of
+        the next event, or -1 once every stage has finished */
+    int64 fireEvents(int64 dueSample);
+
+    /** Starts the protocols of a stage at a position on the timeline */
+    void startStage(int stageIndex, int64 startSample);
+
+    /** Returns the lane with the earliest pending event (-1 if all have finished) */
+    int getNextLane() const;
+
+    /** Sample rate shared by the queued protocols */
+    double getSampleRate() const;
+
+    struct Lane;
+
+    /** Requests a lane's trials up to the pipeline's lookahead */
+    void requestTrials(Lane& lane);
+
+    /** A protocol within the current stage */
+    struct Lane
+    {
+        Protocol* protocol;
+
+        /** Timeline position of its next event */
+        int64 nextEventSample;
+
+        /** False once it has finished */
+        bool active;
+
+        /** Next trial (within the protocol's run) to request from the pipeline */
+        int64 nextRequest;
+    };
+
+    /** Queued stages */
+    Array<Array<Protocol*>> stages;
+
+    /** Protocols of the current stage */
+    Array<Lane> lanes;
+
+    /** Index of the current stage */
+    int currentStage = -1;
+
+    /** Timeline position at which the current stage ends (so far) */
+    int64 stageEndSample = 0;
+
+    /** Timeline position at which playback was (re)started */
+    int64 anchorSample = 0;
+
+    /** Time at which playback was (re)started */
+    double anchorMs = 0;
+
+    /** Renders upcoming trials */
+    RenderAheadPipeline* renderPipeline = nullptr;
+
+    /** Told about every trial onset */
+    TrialCallback trialCallback;
+
+    /** Told about every stage start */
+    StageCallback stageCallback;
+
+    /** Wall-clock position of the timeline while the timer fires events (-1 on the virtual clock) */
+    int64 clockSample = -1;
+
+    /** How long after its due time each onset was fired, on the wall clock (us) */
+    MetricHistogram onsetLateness;
+
+    /** Where the metrics are registered */
+    RuntimeMetrics* metrics = nullptr;
+
+    JUCE_DECLARE_NON_COPYABLE(ProtocolRunner);
+};
+
+#endif // PROTOCOLRUNNER_H_DEFINED
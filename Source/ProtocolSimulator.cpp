@@ -0,0 +1,391 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "ProtocolSimulator.h"
+
+namespace
+{
+    /** Number of events buffered before each write */
+    const int eventsPerWrite = 4096;
+
+    /** Fields of digital.npy (see DigitalEdge) */
+    const char* const digitalFields = "('sample', '<i8'), ('word', '<u8')";
+
+    /** Samples played between progress reports */
+    const int64 progressInterval = 1 << 20;
+
+    /** Sums a buffer in independent lanes, so the loop vectorizes */
+    double sumValues(const float* values, int numValues)
+    {
+        constexpr int numLanes = 8;
+        float lanes[numLanes] = {};
+        int i = 0;
+
+        for (; i + numLanes <= numValues; i += numLanes)
+            for (int lane = 0; lane < numLanes; ++lane)
+                lanes[lane] += values[i + lane];
+
+        double sum = 0;
+
+        for (float lane : lanes)
+            sum += lane;
+
+        for (; i < numValues; ++i)
+            sum += values[i];
+
+        return sum;
+    }
+
+    /** Sums the drive levels of each source, and writes them to its file if it has one */
+    class SimulationOutput : public RenderAheadPipeline::OutputSink
+    {
+    public:
+        SimulationOutput(const Array<SourceDescription>& sources_,
+                         Array<double>& driveSums_,
+                         OwnedArray<FileOutputStream>& streams_)
+            : sources(sources_),
+              driveSums(driveSums_),
+              streams(streams_)
+        {
+        }
+
+        void writeOutput(const RenderAheadPipeline& pipeline, int numFrames) override
+        {
+            for (int i = 0; i < sources.size(); ++i)
+            {
+                const float* output = pipeline.getOutput(i);
+                const int numValues = numFrames * sources.getReference(i).getNumChannels();
+
+                driveSums.getReference(i) += sumValues(output, numValues);
+
+                if (i < streams.size())
+                    streams[i]->write(output, sizeof(float) * (size_t) numValues);
+            }
+        }
+
+    private:
+        const Array<SourceDescription>& sources;
+        Array<double>& driveSums;
+        OwnedArray<FileOutputStream>& streams;
+    };
+
+    /** Creates an NPY file with an empty shape, ready for records to be appended */
+    std::unique_ptr<FileOutputStream> createNpyFile(const File& file, const String& fields)
+    {
+        file.deleteFile();
+
+        auto stream = std::make_unique<FileOutputStream>(file, 1 << 20);
+
+        if (stream->failedToOpen())
+            return nullptr;
+
+        MemoryBlock header = NpyHeader::create(fields, 0, ProtocolSimulator::headerSize);
+        stream->write(header.getData(), header.getSize());
+
+        return stream;
+    }
+
+    /** Rewrites an NPY header with the final number of records */
+    Result finishNpyFile(FileOutputStream& stream, const String& fields, int64 numRecords)
+    {
+        stream.flush();
+
+        const int64 end = stream.getPosition();
+        MemoryBlock header = NpyHeader::create(fields, numRecords, ProtocolSimulator::headerSize);
+
+        stream.setPosition(0);
+        stream.write(header.getData(), header.getSize());
+        stream.setPosition(end);
+        stream.flush();
+
+        if (stream.getStatus().failed())
+            return Result::fail("Could not write " + stream.getFile().getFullPathName() + ": "
+                                + stream.getStatus().getErrorMessage());
+
+        return Result::ok();
+    }
+}
+
+var SimulationSummary::toVar(const Array<SourceDescription>& sources) const
+{
+    const double duration = (double) numSamples / sampleRate;
+
+    Array<var> sourceList;
+
+    for (int i = 0; i < sources.size(); ++i)
+    {
+        DynamicObject::Ptr object = new DynamicObject();
+        object->setProperty("name", sources.getReference(i).name);
+        object->setProperty("channels", sources.getReference(i).getNumChannels());
+        object->setProperty("drive_sum", driveSums[i]);
+
+        if (outputFiles[i].isNotEmpty())
+            object->setProperty("file", outputFiles[i]);
+
+        sourceList.add(var(object.get()));
+    }
+
+    DynamicObject::Ptr object = new DynamicObject();
+    object->setProperty("sample_rate", sampleRate);
+    object->setProperty("samples", numSamples);
+    object->setProperty("duration", duration);
+    object->setProperty("trials", numTrials);
+    object->setProperty("underruns", numUnderruns);
+
+    if (digitalFile.isNotEmpty())
+    {
+        object->setProperty("digital_edges", numDigitalEdges);
+        object->setProperty("digital_file", digitalFile);
+    }
+
+    object->setProperty("elapsed", elapsedSeconds);
+    object->setProperty("speedup", elapsedSeconds > 0 ? duration / elapsedSeconds : 0.0);
+    object->setProperty("sources", sourceList);
+
+    return var(object.get());
+}
+
+ProtocolSimulator::ProtocolSimulator(const Array<SourceDescription>& sources_,
+                                     const PowerCalibration* calibration_)
+    : sources(sources_),
+      calibration(calibration_)
+{
+}
+
+Result ProtocolSimulator::run(const Array<Protocol*>& protocols,
+                              const File& directory,
+                              bool writeOutput,
+                              SimulationSummary& summary,
+                              ProgressCallback progress)
+{
+    summary = SimulationSummary();
+
+    if (protocols.isEmpty())
+        return Result::fail("No protocols to simulate");
+
+    Result result = directory.createDirectory();
+
+    if (result.failed())
+        return result;
+
+    for (auto* protocol : protocols)
+    {
+        protocol->reset();
+        protocol->setSimulated(true);
+    }
+
+    const double startMs = Time::getMillisecondCounterHiRes();
+
+    result = simulate(protocols, directory, writeOutput, summary, progress);
+
+    summary.elapsedSeconds = (Time::getMillisecondCounterHiRes() - startMs) / 1000.0;
+
+    for (auto* protocol : protocols)
+    {
+        protocol->reset();
+        protocol->setSimulated(false);
+    }
+
+    if (result.failed())
+        return result;
+
+    if (!directory.getChildFile("summary.json").replaceWithText(JSON::toString(summary.toVar(sources))))
+        return Result::fail("Could not write " + directory.getChildFile("summary.json").getFullPathName());
+
+    return Result::ok();
+}
+
+Result ProtocolSimulator::simulate(const Array<Protocol*>& protocols,
+                                   const File& directory,
+                                   bool writeOutput,
+                                   SimulationSummary& summary,
+                                   ProgressCallback& progress)
+{
+    summary.sampleRate = protocols.getFirst()->getSampleRate();
+    summary.driveSums.insertMultiple(0, 0.0, sources.size());
+
+    RenderAheadPipeline pipeline(sources, calibration);
+    pipeline.setSampleRate(summary.sampleRate);
+
+    ProtocolRunner runner;
+    runner.addProtocols(protocols);
+    runner.setRenderPipeline(&pipeline);
+
+    // Trial onsets
+    const String eventFields = "('sample', '<i8'), " + TrialLogWriter::getFields();
+    const File eventFile = directory.getChildFile("events.npy");
+    std::unique_ptr<FileOutputStream> eventStream = createNpyFile(eventFile, eventFields);
+
+    if (eventStream == nullptr)
+        return Result::fail("Could not write " + eventFile.getFullPathName());
+
+    HeapBlock<SimulationEvent> events(eventsPerWrite);
+    int numBuffered = 0;
+    const int64 startTime = Time::currentTimeMillis();
+
+    runner.setTrialCallback([&] (Protocol& protocol, int64 trial, int64 sample)
+    {
+        SimulationEvent& event = events[numBuffered++];
+        event.sample = sample;
+        protocol.getTrialRecord(trial, event.trial);
+        event.trial.timestamp = startTime + (int64) std::llround(SampleTime::toMilliseconds(sample, summary.sampleRate));
+
+        summary.numTrials++;
+
+        if (numBuffered == eventsPerWrite)
+        {
+            eventStream->write(events.getData(), sizeof(SimulationEvent) * (size_t) numBuffered);
+            numBuffered = 0;
+        }
+    });
+
+    // Rendered drive levels
+    OwnedArray<FileOutputStream> outputStreams;
+    StringArray outputFields;
+
+    for (int i = 0; i < sources.size(); ++i)
+    {
+        if (!writeOutput)
+        {
+            summary.outputFiles.add(String());
+            continue;
+        }
+
+        const File outputFile = directory.getChildFile("source" + String(i) + ".npy");
+        outputFields.add("('drive', '<f4', (" + String(sources.getReference(i).getNumChannels()) + ",))");
+
+        std::unique_ptr<FileOutputStream> stream = createNpyFile(outputFile, outputFields[i]);
+
+        if (stream == nullptr)
+            return Result::fail("Could not write " + outputFile.getFullPathName());
+
+        outputStreams.add(stream.release());
+        summary.outputFiles.add(outputFile.getFileName());
+    }
+
+    // Digital output, added to the timeline a stage at a time
+    std::unique_ptr<DigitalWordRenderer> digital;
+    std::unique_ptr<FileOutputStream> digitalStream;
+    Array<DigitalEdge> edges;
+    uint64 lastWord = 0;
+
+    int numChannels = 0;
+
+    for (auto& source : sources)
+        numChannels += source.getNumChannels();
+
+    if (numChannels <= DigitalWordRenderer::maxBits)
+    {
+        digital = std::make_unique<DigitalWordRenderer>(sources);
+
+        const File digitalOutputFile = directory.getChildFile("digital.npy");
+        digitalStream = createNpyFile(digitalOutputFile, digitalFields);
+
+        if (digitalStream == nullptr)
+            return Result::fail("Could not write " + digitalOutputFile.getFullPathName());
+
+        summary.digitalFile = digitalOutputFile.getFileName();
+
+        runner.setStageCallback([&] (const Array<Protocol*>& stageProtocols, int64 sample)
+        {
+            for (auto* protocol : stageProtocols)
+                protocol->addToDigitalTimeline(*digital, sample);
+        });
+    }
+
+    SimulationOutput output(sources, summary.driveSums, outputStreams);
+    pipeline.setOutputSink(&output);
+
+    Result result = runner.startSimulation();
+
+    if (result.failed())
+        return result;
+
+    const double expectedSamples = (double) jmax((int64) 1, runner.getTotalSamples());
+    int64 position = 0;
+    int64 lastProgress = 0;
+    int64 nextEvent = runner.advanceTo(0);
+
+    while (nextEvent >= 0)
+    {
+        // Play up to the next event, rendering ahead of every block
+        while (position < nextEvent)
+        {
+            const int numFrames = (int) jmin((int64) blockSize, nextEvent - position);
+
+            pipeline.renderPending();
+            pipeline.process(numFrames);
+
+            if (digitalStream != nullptr)
+            {
+                digital->getEdges(position, position + numFrames, edges);
+
+                // Each block starts with the word at its first sample, which is only written if it changed
+                for (auto& edge : edges)
+                {
+                    if (edge.word == lastWord)
+                        continue;
+
+                    digitalStream->write(&edge, sizeof(DigitalEdge));
+                    lastWord = edge.word;
+                    summary.numDigitalEdges++;
+                }
+            }
+
+            position += numFrames;
+        }
+
+        nextEvent = runner.advanceTo(position);
+
+        if (progress && position - lastProgress >= progressInterval)
+        {
+            lastProgress = position;
+
+            if (!progress((double) position / expectedSamples))
+            {
+                runner.clear();
+                return Result::fail("Simulation cancelled");
+            }
+        }
+    }
+
+    // The last event of each protocol marks its end, so nothing is left playing
+    jassert(position == runner.getStageEndSample());
+
+    summary.numSamples = position;
+    summary.numUnderruns = pipeline.getNumUnderruns();
+    runner.clear();
+
+    if (numBuffered > 0)
+        eventStream->write(events.getData(), sizeof(SimulationEvent) * (size_t) numBuffered);
+
+    result = finishNpyFile(*eventStream, eventFields, summary.numTrials);
+
+    if (digitalStream != nullptr && result.wasOk())
+        result = finishNpyFile(*digitalStream, digitalFields, summary.numDigitalEdges);
+
+    for (int i = 0; i < outputStreams.size() && result.wasOk(); ++i)
+        result = finishNpyFile(*outputStreams[i], outputFields[i], summary.numSamples);
+
+    return result;
+}
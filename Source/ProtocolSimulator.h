@@ -0,0 +1,144 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef PROTOCOLSIMULATOR_H_DEFINED
+#define PROTOCOLSIMULATOR_H_DEFINED
+
+#include "ProtocolRunner.h"
+#include "DigitalWordRenderer.h"
+
+/** A trial onset on the simulated timeline */
+struct SimulationEvent
+{
+    /** Timeline sample of the onset */
+    int64 sample = 0;
+
+    /** The trial, as written to the trial log */
+    TrialRecord trial;
+};
+
+static_assert(sizeof(SimulationEvent) == 72, "SimulationEvent layout must match the NPY header");
+static_assert(sizeof(DigitalEdge) == 16, "DigitalEdge layout must match the NPY header");
+
+/** What a simulation produced */
+struct SimulationSummary
+{
+    /** Sample rate of the timeline */
+    double sampleRate = SampleTime::defaultSampleRate;
+
+    /** Length of the timeline */
+    int64 numSamples = 0;
+
+    /** Number of trial onsets */
+    int64 numTrials = 0;
+
+    /** Blocks that were not rendered in time (should always be 0) */
+    int64 numUnderruns = 0;
+
+    /** Sum of every rendered drive level of each source */
+    Array<double> driveSums;
+
+    /** Names of the drive level files, by source (empty if they weren't written) */
+    StringArray outputFiles;
+
+    /** Number of changes of the digital output */
+    int64 numDigitalEdges = 0;
+
+    /** Name of the digital output file (empty if the sources have more than 64 channels) */
+    String digitalFile;
+
+    /** Wall-clock time the simulation took, in seconds */
+    double elapsedSeconds = 0;
+
+    /** Converts the summary for writing to JSON */
+    var toVar(const Array<SourceDescription>& sources) const;
+};
+
+/**
+    Plays a queue of protocols on a virtual clock, as fast as the CPU allows.
+
+    The protocols are queued on a ProtocolRunner of their own, as
+    ProtocolRunner::addProtocols() would queue them for a live run,
+    and rendered by a RenderAheadPipeline that is driven from the
+    calling thread. Between two events, the pipeline renders what it
+    has been asked for and then plays up to the next event, so every
+    trial starts on its exact sample and the output is the same on
+    every run.
+
+    Writes to a directory:
+     - events.npy: one SimulationEvent per trial onset, with
+       timestamps that follow the virtual clock from the time the
+       simulation started
+     - sourceN.npy: the drive levels rendered for source N, one row
+       of channels per sample (optional; these are large)
+     - digital.npy: every change of the digital output, as the sample
+       and the word that DigitalWordRenderer packs the channels into
+       (if they fit in 64 bits)
+     - summary.json
+
+    The protocols are rewound before and after the simulation, and
+    write no checkpoints, trial log or trial events while it runs.
+    They must not be played or edited until it has finished.
+*/
+class ProtocolSimulator
+{
+public:
+    /** Called now and then with the fraction of the timeline done; returns false to cancel */
+    using ProgressCallback = std::function<bool(double progress)>;
+
+    /** Constructor */
+    ProtocolSimulator(const Array<SourceDescription>& sources,
+                      const PowerCalibration* calibration = nullptr);
+
+    /** Destructor */
+    ~ProtocolSimulator() { }
+
+    /** Simulates a queue of protocols and writes the results to a directory */
+    Result run(const Array<Protocol*>& protocols,
+               const File& directory,
+               bool writeOutput,
+               SimulationSummary& summary,
+               ProgressCallback progress = nullptr);
+
+    /** Most samples played at once */
+    static const int blockSize = 4096;
+
+    /** Size of the NPY headers, in bytes */
+    static const int headerSize = 512;
+
+private:
+
+    /** Plays the queue; called by run() between rewinding the protocols */
+    Result simulate(const Array<Protocol*>& protocols,
+                    const File& directory,
+                    bool writeOutput,
+                    SimulationSummary& summary,
+                    ProgressCallback& progress);
+
+    Array<SourceDescription> sources;
+    const PowerCalibration* calibration;
+
+    JUCE_DECLARE_NON_COPYABLE(ProtocolSimulator);
+};
+
+#endif // PROTOCOLSIMULATOR_H_DEFINED
@@ -0,0 +1,242 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef RECORDWRITER_H_DEFINED
+#define RECORDWRITER_H_DEFINED
+
+#ifdef OPTO_STANDALONE
+#include <juce_core/juce_core.h>
+using namespace juce;
+#else
+#include <JuceHeader.h>
+#endif
+
+#include <cstdio>
+
+#if JUCE_WINDOWS
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+/** Builds NPY v1.0 headers for files of fixed-size records */
+struct NpyHeader
+{
+    /** Returns a header of exactly headerSize bytes describing a 1-D structured
+        array of numRecords records (fields is a dtype list such as "('trial', '<i8')") */
+    static MemoryBlock create(const String& fields, int64 numRecords, int headerSize)
+    {
+        String dict = "{'descr': [" + fields + "], 'fortran_order': False, 'shape': ("
+                      + String(numRecords) + ",), }";
+
+        // magic (6) + version (2) + header length (2) + dict, padded with spaces, ending in '\n'
+        const int dictLength = headerSize - 10;
+        jassert(dict.length() < dictLength);
+
+        dict = dict.paddedRight(' ', dictLength - 1) + "\n";
+
+        MemoryBlock header;
+        MemoryOutputStream stream(header, false);
+
+        stream.write("\x93NUMPY", 6);
+        stream.writeByte(1);
+        stream.writeByte(0);
+        stream.writeShort((short) dictLength);
+        stream.write(dict.toRawUTF8(), (size_t) dictLength);
+        stream.flush();
+
+        return header;
+    }
+};
+
+/**
+    Appends fixed-size binary records to a file from a background thread.
+
+    write() copies the record into a pre-allocated ring and returns
+    immediately, so it never blocks on disk. The writer thread drains
+    the ring in batches, flushes, and syncs the file to storage.
+
+    write() must only be called from one thread at a time.
+*/
+template <typename RecordType>
+class RecordWriter : private Thread
+{
+public:
+    /** Constructor */
+    RecordWriter(const String& threadName, int capacity, int flushIntervalMs_)
+        : Thread(threadName),
+          fifo(capacity),
+          ring((size_t) capacity),
+          flushIntervalMs(flushIntervalMs_)
+    {
+    }
+
+    /** Destructor */
+    virtual ~RecordWriter()
+    {
+        // Derived classes with a finishFile() override must call close()
+        // in their own destructor
+        close();
+    }
+
+    /** Opens a file and starts the writer thread */
+    bool open(const File& file_, bool append)
+    {
+        close();
+
+        file_.getParentDirectory().createDirectory();
+
+        stream = std::fopen(file_.getFullPathName().toRawUTF8(), append ? "ab" : "w+b");
+
+        if (stream == nullptr)
+            return false;
+
+        file = file_;
+        numWritten = 0;
+        numDropped = 0;
+
+        if (!append)
+            startFile(stream);
+
+        startThread();
+        return true;
+    }
+
+    /** Writes everything that is queued, finishes the file and closes it */
+    void close()
+    {
+        if (stream == nullptr)
+            return;
+
+        stopThread(2000);
+        drain();
+
+        finishFile(stream);
+        sync();
+
+        std::fclose(stream);
+        stream = nullptr;
+    }
+
+    /** Queues a record; returns false if the ring is full and the record was dropped */
+    bool write(const RecordType& record)
+    {
+        if (stream == nullptr)
+            return false;
+
+        int start1, size1, start2, size2;
+        fifo.prepareToWrite(1, start1, size1, start2, size2);
+
+        if (size1 + size2 == 0)
+        {
+            ++numDropped;
+            return false;
+        }
+
+        ring[(size_t) (size1 > 0 ? start1 : start2)] = record;
+        fifo.finishedWrite(1);
+
+        return true;
+    }
+
+    /** Whether a file is open */
+    bool isOpen() const { return stream != nullptr; }
+
+    /** The file being written */
+    const File& getFile() const { return file; }
+
+    /** Number of records written to disk so far */
+    int64 getNumWritten() const { return numWritten; }
+
+    /** Number of records dropped because the ring was full */
+    int64 getNumDropped() const { return numDropped; }
+
+    /** Number of records waiting to be written */
+    int getNumQueued() const { return fifo.getNumReady(); }
+
+protected:
+
+    /** Called after a new (non-appended) file is opened, e.g. to write a header */
+    virtual void startFile(FILE*) { }
+
+    /** Called from close() after the last record is written, e.g. to patch a header */
+    virtual void finishFile(FILE*) { }
+
+private:
+
+    /** Writer thread: drains the ring every flush interval */
+    void run() override
+    {
+        while (!threadShouldExit())
+        {
+            wait(flushIntervalMs);
+
+            if (drain() > 0)
+                sync();
+        }
+    }
+
+    /** Writes all queued records; returns the number written */
+    int drain()
+    {
+        int start1, size1, start2, size2;
+        fifo.prepareToRead(fifo.getNumReady(), start1, size1, start2, size2);
+
+        if (size1 > 0)
+            std::fwrite(&ring[(size_t) start1], sizeof(RecordType), (size_t) size1, stream);
+
+        if (size2 > 0)
+            std::fwrite(&ring[(size_t) start2], sizeof(RecordType), (size_t) size2, stream);
+
+        fifo.finishedRead(size1 + size2);
+        numWritten += size1 + size2;
+
+        return size1 + size2;
+    }
+
+    /** Flushes the C buffer and asks the OS to commit the file to storage */
+    void sync()
+    {
+        std::fflush(stream);
+
+       #if JUCE_WINDOWS
+        _commit(_fileno(stream));
+       #else
+        fsync(fileno(stream));
+       #endif
+    }
+
+    AbstractFifo fifo;
+    std::vector<RecordType> ring;
+    const int flushIntervalMs;
+
+    File file;
+    FILE* stream = nullptr;
+
+    std::atomic<int64> numWritten { 0 };
+    std::atomic<int64> numDropped { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(RecordWriter);
+};
+
+#endif // RECORDWRITER_H_DEFINED
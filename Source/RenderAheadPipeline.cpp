@@ -0,0 +1,615 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include "RenderAheadPipeline.h"
+#include "TraceRecorder.h"
+
+namespace
+{
+    /** Writes one item to a FIFO's buffer; returns false if it is full */
+    template <typename Type>
+    bool push(AbstractFifo& fifo, Type* buffer, const Type& item)
+    {
+        int start1, size1, start2, size2;
+        fifo.prepareToWrite(1, start1, size1, start2, size2);
+
+        if (size1 + size2 == 0)
+            return false;
+
+        buffer[size1 > 0 ? start1 : start2] = item;
+        fifo.finishedWrite(1);
+        return true;
+    }
+
+    /** Reads one item from a FIFO's buffer; returns false if it is empty */
+    template <typename Type>
+    bool pop(AbstractFifo& fifo, Type* buffer, Type& item)
+    {
+        int start1, size1, start2, size2;
+        fifo.prepareToRead(1, start1, size1, start2, size2);
+
+        if (size1 + size2 == 0)
+            return false;
+
+        item = buffer[size1 > 0 ? start1 : start2];
+        fifo.finishedRead(1);
+        return true;
+    }
+
+    /** Metric names for each StimulusType */
+    const char* const stimulusTypeNames[] = { "pulse_train", "sine", "ramp", "custom" };
+}
+
+RenderAheadPipeline::RenderAheadPipeline(const Array<SourceDescription>& sources_,
+                                         const PowerCalibration* calibration,
+                                         int blockSize_,
+                                         int numBlocks_,
+                                         int maxFrames_)
+    : Thread("Opto render-ahead"),
+      sources(sources_),
+      blockSize(jmax(1, blockSize_)),
+      numBlocks(jlimit(1, 0xffffff, numBlocks_)),
+      maxFrames(jmax(1, maxFrames_)),
+      pool((size_t) numBlocks * (size_t) blockSize, true),
+      requestGenerations((size_t) maxTrials + 1),
+      triggerBuffer((size_t) maxTrials + 1),
+      announceBuffer((size_t) maxTrials + 1),
+      releaseBuffer((size_t) maxTrials + 1),
+      freedFifo(numBlocks + 1),
+      freedBuffer((size_t) numBlocks + 1),
+      announcedSlots((size_t) maxTrials),
+      pendingTriggers((size_t) maxTrials)
+{
+    requestBuffer.resize(maxTrials + 1);
+
+    for (auto& source : sources)
+    {
+        const CalibrationTable* table = calibration != nullptr ? calibration->getTable(source.name) : nullptr;
+
+        auto* renderer = renderers.add(new StimulusRenderer(source, blockSize, table));
+        renderer->setTemplateCache(&templateCache, SampleTime::defaultSampleRate);
+
+        outputs.add(new HeapBlock<float>((size_t) maxFrames * (size_t) renderer->getNumChannels(), true));
+        outputChannels.add(renderer->getNumChannels());
+    }
+
+    // Worker-side lists never grow past these sizes, so nothing is allocated while running
+    freeBlocks.ensureStorageAllocated(numBlocks);
+    freeSlots.ensureStorageAllocated(maxTrials);
+    activeSlots.ensureStorageAllocated(maxTrials);
+
+    resetState();
+}
+
+RenderAheadPipeline::~RenderAheadPipeline()
+{
+    stopThread(1000);
+    setMetrics(nullptr);
+}
+
+void RenderAheadPipeline::start()
+{
+    if (!isThreadRunning())
+        startThread();
+}
+
+void RenderAheadPipeline::stop()
+{
+    stopThread(1000);
+    resetState();
+}
+
+void RenderAheadPipeline::setMetrics(RuntimeMetrics* newMetrics)
+{
+    if (metrics != nullptr)
+    {
+        for (auto& renderTime : renderTimes)
+            metrics->remove(&renderTime);
+
+        metrics->remove(&requestDepths);
+        metrics->remove(&readyDepths);
+        metrics->remove(&triggerDepths);
+        metrics->remove(&blockDepths);
+        metrics->remove(&startDelays);
+        metrics->remove(&numLateStarts);
+        metrics->remove(&numUnderruns);
+    }
+
+    metrics = newMetrics;
+
+    if (metrics == nullptr)
+        return;
+
+    for (int i = 0; i < numStimulusTypes; ++i)
+        metrics->add("render_time_" + String(stimulusTypeNames[i]), "ns", &renderTimes[i]);
+
+    metrics->add("request_queue_depth", "trials", &requestDepths);
+    metrics->add("ready_trials", "trials", &readyDepths);
+    metrics->add("pending_triggers", "triggers", &triggerDepths);
+    metrics->add("blocks_in_use", "blocks", &blockDepths);
+    metrics->add("start_delay", "samples", &startDelays);
+    metrics->add("late_starts", "trials", &numLateStarts);
+    metrics->add("underruns", "blocks", &numUnderruns);
+}
+
+void RenderAheadPipeline::setSampleRate(double sampleRate)
+{
+    jassert(!isThreadRunning());
+
+    // Only used to key the template cache
+    for (auto* renderer : renderers)
+        renderer->setTemplateCache(&templateCache, sampleRate);
+}
+
+void RenderAheadPipeline::setLookahead(int numTrials)
+{
+    lookahead.store(jlimit(1, maxTrials, numTrials), std::memory_order_relaxed);
+}
+
+size_t RenderAheadPipeline::getMemoryUsage() const
+{
+    size_t bytes = (size_t) numBlocks * (size_t) blockSize * sizeof(float)
+                 + templateCache.getMemoryUsage();
+
+    for (auto* renderer : renderers)
+        bytes += (size_t) maxFrames * (size_t) renderer->getNumChannels() * sizeof(float);
+
+    return bytes;
+}
+
+bool RenderAheadPipeline::request(const TrialRenderRequest& trial)
+{
+    int start1, size1, start2, size2;
+    requestFifo.prepareToWrite(1, start1, size1, start2, size2);
+
+    if (size1 + size2 == 0)
+        return false;
+
+    const int index = size1 > 0 ? start1 : start2;
+    requestBuffer.getReference(index) = trial;
+    requestGenerations[index] = generation.load(std::memory_order_relaxed);
+    requestFifo.finishedWrite(1);
+
+    notify();
+    return true;
+}
+
+bool RenderAheadPipeline::trigger(int64 ticket)
+{
+    return push(triggerFifo, triggerBuffer.get(), Trigger { ticket, generation.load(std::memory_order_relaxed), 0 });
+}
+
+void RenderAheadPipeline::cancel()
+{
+    generation.fetch_add(1, std::memory_order_acq_rel);
+    notify();
+}
+
+void RenderAheadPipeline::resetState()
+{
+    requestFifo.reset();
+    triggerFifo.reset();
+    announceFifo.reset();
+    releaseFifo.reset();
+    freedFifo.reset();
+
+    for (auto& request : requestBuffer)
+        request.stimulus = StimulusSpec();
+
+    freeBlocks.clearQuick();
+    freeSlots.clearQuick();
+    activeSlots.clearQuick();
+
+    for (int i = numBlocks; --i >= 0;)
+        freeBlocks.add(i);
+
+    for (int i = maxTrials; --i >= 0;)
+    {
+        Slot& slot = slots[i];
+        slot.stimulus = StimulusSpec();
+        slot.numConsumed.store(0);
+        slot.playing = false;
+        slot.heldBlock = -1;
+        slot.heldBlockNumber = -1;
+
+        for (auto& entry : slot.ring)
+            entry.store(emptyEntry);
+
+        freeSlots.add(i);
+    }
+
+    numAnnounced = 0;
+    numPendingTriggers = 0;
+    audioGeneration = generation.load();
+
+    numBlocksInUse.store(0);
+}
+
+void RenderAheadPipeline::run()
+{
+    while (!threadShouldExit())
+    {
+        reclaimSlots();
+        acceptRequests();
+
+        if (!renderBlocks())
+            wait(1);
+    }
+}
+
+void RenderAheadPipeline::renderPending()
+{
+    jassert(!isThreadRunning());
+
+    reclaimSlots();
+    acceptRequests();
+
+    while (renderBlocks())
+    {
+    }
+}
+
+int RenderAheadPipeline::allocateBlock()
+{
+    int block;
+
+    while (pop(freedFifo, freedBuffer.get(), block))
+        freeBlocks.add(block);
+
+    if (freeBlocks.isEmpty())
+        return -1;
+
+    numBlocksInUse.fetch_add(1, std::memory_order_relaxed);
+    return freeBlocks.removeAndReturn(freeBlocks.size() - 1);
+}
+
+void RenderAheadPipeline::releaseBlock(int block)
+{
+    numBlocksInUse.fetch_sub(1, std::memory_order_relaxed);
+    freeBlocks.add(block);
+}
+
+void RenderAheadPipeline::freeBlock(int block)
+{
+    // The FIFO holds every block in the pool, so this never fails
+    numBlocksInUse.fetch_sub(1, std::memory_order_relaxed);
+    push(freedFifo, freedBuffer.get(), block);
+}
+
+void RenderAheadPipeline::reclaimSlots()
+{
+    int slotIndex;
+
+    while (pop(releaseFifo, releaseBuffer.get(), slotIndex))
+    {
+        Slot& slot = slots[slotIndex];
+
+        // Blocks the audio thread never reached are still in the ring
+        for (auto& entry : slot.ring)
+        {
+            const int64 previous = entry.exchange(emptyEntry, std::memory_order_acq_rel);
+
+            if (previous != emptyEntry)
+                releaseBlock(getBlock(previous));
+        }
+
+        slot.stimulus = StimulusSpec();
+        activeSlots.removeFirstMatchingValue(slotIndex);
+        freeSlots.add(slotIndex);
+    }
+}
+
+void RenderAheadPipeline::acceptRequests()
+{
+    const uint32 currentGeneration = generation.load(std::memory_order_acquire);
+
+    while (!freeSlots.isEmpty())
+    {
+        int start1, size1, start2, size2;
+        requestFifo.prepareToRead(1, start1, size1, start2, size2);
+
+        if (size1 + size2 == 0)
+            return;
+
+        const int index = size1 > 0 ? start1 : start2;
+        TrialRenderRequest& request = requestBuffer.getReference(index);
+
+        const int channel = isPositiveAndBelow(request.source, sources.size())
+                                ? sources.getReference(request.source).getChannel(request.site, request.wavelength)
+                                : -1;
+
+        if (requestGenerations[index] == currentGeneration && channel >= 0 && request.stimulus.numSamples > 0)
+        {
+            const int slotIndex = freeSlots.removeAndReturn(freeSlots.size() - 1);
+            Slot& slot = slots[slotIndex];
+
+            slot.ticket = request.ticket;
+            slot.source = request.source;
+            slot.channel = channel;
+            slot.numSamples = request.stimulus.numSamples;
+            slot.numBlocks = (slot.numSamples + blockSize - 1) / blockSize;
+            slot.generation = currentGeneration;
+            slot.stimulus = request.stimulus;
+            slot.kernel = StimulusRenderer::getEnvelopeKernel(slot.stimulus);
+            slot.power = request.power;
+            slot.nextBlock = 0;
+            slot.numConsumed.store(0, std::memory_order_relaxed);
+
+            activeSlots.add(slotIndex);
+            push(announceFifo, announceBuffer.get(), slotIndex);
+        }
+
+        request.stimulus = StimulusSpec();
+        requestFifo.finishedRead(1);
+    }
+}
+
+bool RenderAheadPipeline::renderBlocks()
+{
+    const uint32 currentGeneration = generation.load(std::memory_order_acquire);
+    bool renderedAny = false;
+
+    // Slots are in request order, so the trial that plays first is topped up first
+    for (int slotIndex : activeSlots)
+    {
+        Slot& slot = slots[slotIndex];
+
+        if (slot.generation != currentGeneration || slot.nextBlock >= slot.numBlocks)
+            continue;
+
+        // Blocks the audio thread has already skipped are not worth rendering
+        const int64 numConsumed = slot.numConsumed.load(std::memory_order_acquire);
+        slot.nextBlock = jmax(slot.nextBlock, numConsumed);
+
+        while (slot.nextBlock < slot.numBlocks && slot.nextBlock < numConsumed + blocksPerTrial)
+        {
+            const int block = allocateBlock();
+
+            if (block < 0)
+                return renderedAny;
+
+            const int64 startSample = slot.nextBlock * blockSize;
+            const int numSamples = (int) jmin((int64) blockSize, slot.numSamples - startSample);
+
+            {
+                const TraceScope trace("render", "render_block", slot.ticket);
+                const ScopedMetricTimer timer(renderTimes[jlimit(0, numStimulusTypes - 1, (int) slot.stimulus.type)]);
+
+                renderers[slot.source]->renderDrive(slot.stimulus, startSample, numSamples,
+                                                    slot.channel, slot.power,
+                                                    pool.get() + (size_t) block * (size_t) blockSize,
+                                                    slot.kernel);
+            }
+
+            // Anything left in this position was skipped by the audio thread
+            const int64 previous = slot.ring[slot.nextBlock % blocksPerTrial]
+                                       .exchange(makeEntry(slot.nextBlock, block), std::memory_order_acq_rel);
+
+            if (previous != emptyEntry)
+                releaseBlock(getBlock(previous));
+
+            renderedAny = true;
+
+            if (++slot.nextBlock == slot.numBlocks)
+                numTrialsRendered.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    return renderedAny;
+}
+
+void RenderAheadPipeline::releaseSlot(int slotIndex)
+{
+    Slot& slot = slots[slotIndex];
+
+    if (slot.heldBlock >= 0)
+        freeBlock(slot.heldBlock);
+
+    slot.playing = false;
+    slot.position = 0;
+    slot.heldBlock = -1;
+    slot.heldBlockNumber = -1;
+
+    push(releaseFifo, releaseBuffer.get(), slotIndex);
+}
+
+void RenderAheadPipeline::startTrials(int numFrames)
+{
+    int slotIndex;
+
+    while (pop(announceFifo, announceBuffer.get(), slotIndex))
+    {
+        if (slots[slotIndex].generation == audioGeneration)
+            announcedSlots[numAnnounced++] = slotIndex;
+        else
+            releaseSlot(slotIndex);
+    }
+
+    Trigger trigger;
+
+    while (pop(triggerFifo, triggerBuffer.get(), trigger))
+    {
+        if (trigger.generation != audioGeneration)
+            continue;
+
+        // Too many unmatched triggers; the oldest one will never play
+        if (numPendingTriggers == maxTrials)
+        {
+            std::copy(pendingTriggers.get() + 1, pendingTriggers.get() + numPendingTriggers, pendingTriggers.get());
+            --numPendingTriggers;
+        }
+
+        pendingTriggers[numPendingTriggers++] = trigger;
+    }
+
+    int numRemaining = 0;
+
+    for (int i = 0; i < numPendingTriggers; ++i)
+    {
+        Trigger& pending = pendingTriggers[i];
+        bool matched = false;
+
+        for (int j = 0; j < numAnnounced && !matched; ++j)
+        {
+            Slot& slot = slots[announcedSlots[j]];
+
+            if (!slot.playing && slot.ticket == pending.ticket)
+            {
+                // A trial that arrives late starts where it would have been by now
+                slot.playing = true;
+                slot.position = pending.elapsed;
+                matched = true;
+
+                startDelays.record(pending.elapsed);
+
+                if (pending.elapsed > 0)
+                    numLateStarts.add();
+            }
+        }
+
+        if (matched)
+            continue;
+
+        if (pending.elapsed == 0)
+            numUnderruns.add();
+
+        pending.elapsed += numFrames;
+        pendingTriggers[numRemaining++] = pending;
+    }
+
+    numPendingTriggers = numRemaining;
+}
+
+bool RenderAheadPipeline::playSlot(Slot& slot, int numFrames)
+{
+    float* output = outputs[slot.source]->getData();
+    const int numChannels = outputChannels.getUnchecked(slot.source);
+
+    int frame = 0;
+
+    while (frame < numFrames && slot.position < slot.numSamples)
+    {
+        const int64 blockNumber = slot.position / blockSize;
+        const int offset = (int) (slot.position % blockSize);
+        const int count = (int) jmin((int64) (numFrames - frame),
+                                     (int64) (blockSize - offset),
+                                     slot.numSamples - slot.position);
+
+        if (blockNumber != slot.heldBlockNumber)
+        {
+            if (slot.heldBlock >= 0)
+                freeBlock(slot.heldBlock);
+
+            slot.heldBlock = -1;
+            slot.heldBlockNumber = blockNumber;
+
+            const int64 entry = slot.ring[blockNumber % blocksPerTrial].exchange(emptyEntry, std::memory_order_acq_rel);
+
+            if (entry != emptyEntry)
+            {
+                if (getBlockNumber(entry) == blockNumber)
+                    slot.heldBlock = getBlock(entry);
+                else
+                    freeBlock(getBlock(entry)); // rendered after it was skipped
+            }
+
+            if (slot.heldBlock < 0)
+                numUnderruns.add();
+
+            // Lets the worker reuse this ring position
+            slot.numConsumed.store(blockNumber + 1, std::memory_order_release);
+        }
+
+        if (slot.heldBlock >= 0)
+        {
+            const float* source = pool.get() + (size_t) slot.heldBlock * (size_t) blockSize + offset;
+            float* destination = output + (size_t) frame * (size_t) numChannels + slot.channel;
+
+            for (int i = 0; i < count; ++i)
+                destination[i * numChannels] += source[i];
+        }
+
+        frame += count;
+        slot.position += count;
+    }
+
+    return slot.position >= slot.numSamples;
+}
+
+void RenderAheadPipeline::process(int numFrames)
+{
+    // Every frame of the buffer is played, so the timeline stays on the sample clock
+    for (int offset = 0; offset < numFrames; offset += maxFrames)
+    {
+        const int count = jmin(maxFrames, numFrames - offset);
+
+        processChunk(count);
+
+        if (outputSink != nullptr)
+            outputSink->writeOutput(*this, count);
+    }
+}
+
+void RenderAheadPipeline::processChunk(int numFrames)
+{
+    jassert(numFrames <= maxFrames);
+
+    for (int i = 0; i < outputs.size(); ++i)
+        std::fill(outputs[i]->getData(), outputs[i]->getData() + (size_t) numFrames * (size_t) outputChannels[i], 0.0f);
+
+    // Drop everything that was requested before the last cancel()
+    const uint32 currentGeneration = generation.load(std::memory_order_acquire);
+
+    if (currentGeneration != audioGeneration)
+    {
+        for (int i = 0; i < numAnnounced; ++i)
+            releaseSlot(announcedSlots[i]);
+
+        numAnnounced = 0;
+        numPendingTriggers = 0;
+        audioGeneration = currentGeneration;
+    }
+
+    startTrials(numFrames);
+
+    requestDepths.record(requestFifo.getNumReady());
+    readyDepths.record(numAnnounced);
+    triggerDepths.record(numPendingTriggers);
+    blockDepths.record(numBlocksInUse.load(std::memory_order_relaxed));
+
+    int numRemaining = 0;
+
+    for (int i = 0; i < numAnnounced; ++i)
+    {
+        const int slotIndex = announcedSlots[i];
+        Slot& slot = slots[slotIndex];
+
+        if (slot.playing && playSlot(slot, numFrames))
+            releaseSlot(slotIndex);
+        else
+            announcedSlots[numRemaining++] = slotIndex;
+    }
+
+    numAnnounced = numRemaining;
+}
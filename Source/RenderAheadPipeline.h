@@ -0,0 +1,368 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef RENDERAHEADPIPELINE_H_DEFINED
+#define RENDERAHEADPIPELINE_H_DEFINED
+
+#include "RuntimeMetrics.h"
+#include "StimulusRenderer.h"
+
+/** A trial to be rendered ahead of its onset */
+struct TrialRenderRequest
+{
+    /** Identifies the trial when it is triggered */
+    int64 ticket = 0;
+
+    /** The trial's stimulus */
+    StimulusSpec stimulus;
+
+    /** Index of the source in the pipeline's source list */
+    int source = 0;
+
+    /** Emission site */
+    int site = 0;
+
+    /** Wavelength (in nm) */
+    int wavelength = 0;
+
+    /** Light power (uW) */
+    float power = 0;
+};
+
+/**
+    Renders upcoming trials on a worker thread, so the audio thread
+    only copies finished blocks.
+
+    Trials are requested from the message thread some time before
+    they start, and rendered into a pool of fixed-size blocks that is
+    allocated up front. Each trial streams through a short ring of
+    blocks: the first ones are rendered as soon as the trial is
+    requested (the pre-roll), and the rest are topped up while it
+    plays, so long stimuli never need to be held in memory at once.
+
+    Without the worker thread, renderPending() does the same work on
+    the calling thread; calling it before every process() has each
+    trial's blocks ready before they are played, so nothing underruns.
+
+    When a trial is triggered, process() copies its blocks into the
+    output of its source, one interleaved channel per site and
+    wavelength, and hands the outputs to the OutputSink that plays
+    them (a hardware backend, or the simulator's files). If a block is
+    not ready in time, its samples are left at zero and an underrun is
+    counted; playback keeps its position, so a late trial is truncated
+    rather than shifted. Audio blocks longer than the outputs are
+    played in chunks, so playback never falls behind the sample clock.
+
+    Requests, triggers, announcements and freed blocks all pass
+    through single-producer FIFOs, so neither thread ever waits for
+    the other and the audio thread never allocates.
+
+    Render times, queue depths, late starts and underruns are kept
+    in metrics that can be registered with a RuntimeMetrics.
+*/
+class RenderAheadPipeline : private Thread
+{
+public:
+    /** Plays the outputs of the pipeline */
+    class OutputSink
+    {
+    public:
+        /** Destructor */
+        virtual ~OutputSink() { }
+
+        /** Called on the audio thread after every chunk of numFrames frames (at most
+            getMaxFrames()), while getOutput() holds them; must not block or allocate */
+        virtual void writeOutput(const RenderAheadPipeline& pipeline, int numFrames) = 0;
+    };
+
+    /** Constructor */
+    RenderAheadPipeline(const Array<SourceDescription>& sources,
+                        const PowerCalibration* calibration = nullptr,
+                        int blockSize = defaultBlockSize,
+                        int numBlocks = defaultNumBlocks,
+                        int maxFrames = defaultMaxFrames);
+
+    /** Destructor */
+    ~RenderAheadPipeline();
+
+    /** Starts the worker thread */
+    void start();
+
+    /** Stops the worker thread and discards every pending trial
+        (must not be called while process() is running) */
+    void stop();
+
+    /** Does the worker's pending work on the calling thread (only while stopped),
+        so playback can be driven without real-time deadlines, e.g. for simulation */
+    void renderPending();
+
+    /** Queues a trial for rendering (message thread); returns false if the queue is full */
+    bool request(const TrialRenderRequest& trial);
+
+    /** Starts playing a requested trial at the next block (message thread) */
+    bool trigger(int64 ticket);
+
+    /** Discards every requested and playing trial (message thread) */
+    void cancel();
+
+    /** Registers the pipeline's metrics (may be nullptr to unregister them) */
+    void setMetrics(RuntimeMetrics* metrics);
+
+    /** Sets the rate the requested stimuli were compiled at (only while stopped) */
+    void setSampleRate(double sampleRate);
+
+    /** Sets how many trials are requested ahead of the one that is playing */
+    void setLookahead(int numTrials);
+
+    /** Returns how many trials are requested ahead of the one that is playing */
+    int getLookahead() const { return lookahead.load(std::memory_order_relaxed); }
+
+    /** Sets the sink that plays the outputs (may be nullptr; only while stopped) */
+    void setOutputSink(OutputSink* sink) { outputSink = sink; }
+
+    /** Returns the sink that plays the outputs (nullptr if there is none) */
+    OutputSink* getOutputSink() const { return outputSink; }
+
+    /** Copies the next numFrames of every playing trial to the outputs and hands
+        them to the sink, in chunks of at most getMaxFrames() (audio thread) */
+    void process(int numFrames);
+
+    /** Returns the interleaved output of a source after process() (its last chunk) */
+    const float* getOutput(int source) const { return outputs[source]->getData(); }
+
+    /** Returns the most frames the outputs hold */
+    int getMaxFrames() const { return maxFrames; }
+
+    /** Returns the number of sources */
+    int getNumSources() const { return renderers.size(); }
+
+    /** Returns the number of pool blocks that hold rendered samples */
+    int getNumBlocksInUse() const { return numBlocksInUse.load(std::memory_order_relaxed); }
+
+    /** Returns the number of blocks in the pool */
+    int getNumBlocks() const { return numBlocks; }
+
+    /** Returns the number of blocks (or trials) that were not ready when needed */
+    int64 getNumUnderruns() const { return numUnderruns.get(); }
+
+    /** Returns the number of trials that started after their trigger */
+    int64 getNumLateStarts() const { return numLateStarts.get(); }
+
+    /** Returns the number of trials that have been rendered */
+    int64 getNumTrialsRendered() const { return numTrialsRendered.load(std::memory_order_relaxed); }
+
+    /** Memory used by the block pool, the outputs and the template cache, in bytes */
+    size_t getMemoryUsage() const;
+
+    /** Samples per block */
+    static const int defaultBlockSize = 1024;
+
+    /** Blocks in the pool */
+    static const int defaultNumBlocks = 256;
+
+    /** Frames each output holds; process() plays longer buffers in chunks */
+    static const int defaultMaxFrames = 8192;
+
+    /** Most trials that can be requested or playing at once */
+    static const int maxTrials = 64;
+
+    /** Most blocks each trial holds at once */
+    static const int blocksPerTrial = 16;
+
+    /** Default number of trials rendered ahead */
+    static const int defaultLookahead = 4;
+
+private:
+
+    struct Slot;
+
+    /** Worker loop */
+    void run() override;
+
+    /** Starts rendering new requests (worker thread) */
+    void acceptRequests();
+
+    /** Reclaims trials that finished playing (worker thread) */
+    void reclaimSlots();
+
+    /** Renders the next blocks of every trial that has room; returns false if nothing was rendered */
+    bool renderBlocks();
+
+    /** Takes a block from the pool (worker thread; -1 if none is free) */
+    int allocateBlock();
+
+    /** Returns a block to the pool (worker thread) */
+    void releaseBlock(int block);
+
+    /** Returns a block to the pool (audio thread) */
+    void freeBlock(int block);
+
+    /** Plays up to maxFrames frames into the outputs (audio thread) */
+    void processChunk(int numFrames);
+
+    /** Starts announced trials and pending triggers (audio thread) */
+    void startTrials(int numFrames);
+
+    /** Copies one trial's samples to its output; returns true once it has finished (audio thread) */
+    bool playSlot(Slot& slot, int numFrames);
+
+    /** Hands a slot back to the worker (audio thread) */
+    void releaseSlot(int slotIndex);
+
+    /** Resets all shared state (only while both threads are idle) */
+    void resetState();
+
+    /** Number of StimulusTypes, each with its own render times */
+    static const int numStimulusTypes = CUSTOM + 1;
+
+    /** Ring entry marking an empty position */
+    static const int64 emptyEntry = -1;
+
+    /** A ring entry holds a block number (within the trial) and a pool block index */
+    static int64 makeEntry(int64 blockNumber, int block) { return (blockNumber << 24) | (int64) block; }
+    static int64 getBlockNumber(int64 entry) { return entry >> 24; }
+    static int getBlock(int64 entry) { return (int) (entry & 0xffffff); }
+
+    /** A trial that is being rendered or played */
+    struct Slot
+    {
+        /** Set by the worker before the slot is announced */
+        int64 ticket = 0;
+        int source = 0;
+        int channel = 0;
+        int64 numSamples = 0;
+        int64 numBlocks = 0;
+        uint32 generation = 0;
+
+        /** Worker only */
+        StimulusSpec stimulus;
+        StimulusRenderer::EnvelopeKernel kernel = nullptr;
+        float power = 0;
+        int64 nextBlock = 0;
+
+        /** Blocks by block number modulo blocksPerTrial; claimed with an
+            exchange by whichever thread gets to an entry first */
+        std::atomic<int64> ring[blocksPerTrial];
+
+        /** Number of blocks the audio thread has taken or skipped */
+        std::atomic<int64> numConsumed { 0 };
+
+        /** Audio thread only */
+        bool playing = false;
+        int64 position = 0;
+        int heldBlock = -1;
+        int64 heldBlockNumber = -1;
+    };
+
+    /** A trigger on its way to, or waiting in, the audio thread */
+    struct Trigger
+    {
+        int64 ticket;
+
+        /** Value of generation when it was sent */
+        uint32 generation;
+
+        /** Frames elapsed since it arrived without a matching trial */
+        int64 elapsed;
+    };
+
+    Array<SourceDescription> sources;
+    OwnedArray<StimulusRenderer> renderers;
+    StimulusTemplateCache templateCache;
+
+    const int blockSize;
+    const int numBlocks;
+    const int maxFrames;
+
+    /** Pool of numBlocks * blockSize drive levels */
+    HeapBlock<float> pool;
+
+    /** Interleaved per-source outputs */
+    OwnedArray<HeapBlock<float>> outputs;
+
+    /** Output channel count for each source */
+    Array<int> outputChannels;
+
+    /** Plays the outputs (may be nullptr) */
+    OutputSink* outputSink = nullptr;
+
+    Slot slots[maxTrials];
+
+    /** Message -> worker (with the generation each request was sent in) */
+    AbstractFifo requestFifo { maxTrials + 1 };
+    Array<TrialRenderRequest> requestBuffer;
+    HeapBlock<uint32> requestGenerations;
+
+    /** Message -> audio */
+    AbstractFifo triggerFifo { maxTrials + 1 };
+    HeapBlock<Trigger> triggerBuffer;
+
+    /** Worker -> audio: slots ready to be triggered */
+    AbstractFifo announceFifo { maxTrials + 1 };
+    HeapBlock<int> announceBuffer;
+
+    /** Audio -> worker: slots that have finished or were cancelled */
+    AbstractFifo releaseFifo { maxTrials + 1 };
+    HeapBlock<int> releaseBuffer;
+
+    /** Audio -> worker: blocks that have been played */
+    AbstractFifo freedFifo;
+    HeapBlock<int> freedBuffer;
+
+    /** Worker only */
+    Array<int> freeBlocks;
+    Array<int> freeSlots;
+    Array<int> activeSlots;
+
+    /** Audio thread only */
+    HeapBlock<int> announcedSlots;
+    int numAnnounced = 0;
+    HeapBlock<Trigger> pendingTriggers;
+    int numPendingTriggers = 0;
+    uint32 audioGeneration = 0;
+
+    /** Incremented by cancel(); trials from older generations are dropped */
+    std::atomic<uint32> generation { 0 };
+
+    std::atomic<int> lookahead { defaultLookahead };
+    std::atomic<int> numBlocksInUse { 0 };
+    std::atomic<int64> numTrialsRendered { 0 };
+
+    /** Updated by the worker (render times, per StimulusType) and the audio thread */
+    MetricHistogram renderTimes[numStimulusTypes];
+    MetricHistogram requestDepths;
+    MetricHistogram readyDepths;
+    MetricHistogram triggerDepths;
+    MetricHistogram blockDepths;
+    MetricHistogram startDelays;
+    MetricCounter numLateStarts;
+    MetricCounter numUnderruns;
+
+    /** Where the metrics are registered */
+    RuntimeMetrics* metrics = nullptr;
+
+    JUCE_DECLARE_NON_COPYABLE(RenderAheadPipeline);
+};
+
+#endif // RENDERAHEADPIPELINE_H_DEFINED
@@ -0,0 +1,369 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "RuntimeMetrics.h"
+
+void MetricHistogram::record(int64 value) noexcept
+{
+    value = jmax((int64) 0, value);
+
+    buckets[getBucket(value)].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(value, std::memory_order_relaxed);
+
+    int64 previous = max.load(std::memory_order_relaxed);
+
+    while (value > previous && !max.compare_exchange_weak(previous, value, std::memory_order_relaxed))
+    {
+    }
+}
+
+void MetricHistogram::reset() noexcept
+{
+    for (auto& bucket : buckets)
+        bucket.store(0, std::memory_order_relaxed);
+
+    count.store(0, std::memory_order_relaxed);
+    sum.store(0, std::memory_order_relaxed);
+    max.store(0, std::memory_order_relaxed);
+}
+
+int MetricHistogram::getBucket(int64 value) noexcept
+{
+    if (value < 4)
+        return (int) jmax((int64) 0, value);
+
+    // Index of the highest set bit, found by halving
+    uint64 bits = (uint64) value;
+    int highestBit = 0;
+
+    for (int shift = 32; shift > 0; shift >>= 1)
+    {
+        if ((bits >> shift) != 0)
+        {
+            bits >>= shift;
+            highestBit += shift;
+        }
+    }
+
+    // The two bits below the highest one pick the quarter
+    return (highestBit - 1) * 4 + (int) ((value >> (highestBit - 2)) & 3);
+}
+
+int64 MetricHistogram::getBucketStart(int bucket) noexcept
+{
+    if (bucket < 4)
+        return bucket;
+
+    return (int64) (4 + bucket % 4) << (bucket / 4 - 1);
+}
+
+int64 MetricHistogram::getTimeNanos() noexcept
+{
+    static const double nanosPerTick = 1.0e9 / (double) Time::getHighResolutionTicksPerSecond();
+
+    return (int64) ((double) Time::getHighResolutionTicks() * nanosPerTick);
+}
+
+MetricHistogram::Snapshot MetricHistogram::getSnapshot() const noexcept
+{
+    Snapshot snapshot;
+
+    for (int i = 0; i < numBuckets; ++i)
+        snapshot.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+
+    snapshot.count = count.load(std::memory_order_relaxed);
+    snapshot.sum = sum.load(std::memory_order_relaxed);
+    snapshot.max = max.load(std::memory_order_relaxed);
+
+    return snapshot;
+}
+
+double MetricHistogram::Snapshot::getPercentile(double percentile) const
+{
+    // The buckets are read one at a time, so their total can differ slightly from count
+    int64 total = 0;
+
+    for (auto bucket : buckets)
+        total += bucket;
+
+    if (total == 0)
+        return 0;
+
+    const double rank = jlimit(0.0, 100.0, percentile) / 100.0 * (double) total;
+    double below = 0;
+
+    for (int i = 0; i < numBuckets; ++i)
+    {
+        if (buckets[i] == 0 || below + (double) buckets[i] < rank)
+        {
+            below += (double) buckets[i];
+            continue;
+        }
+
+        const double value = (double) getBucketStart(i)
+                             + (double) getBucketWidth(i) * (rank - below) / (double) buckets[i];
+
+        return jmin(value, (double) max);
+    }
+
+    return (double) max;
+}
+
+const MetricSample* MetricsSnapshot::find(const String& name) const
+{
+    for (auto& metric : metrics)
+    {
+        if (metric.name == name)
+            return &metric;
+    }
+
+    return nullptr;
+}
+
+var MetricsSnapshot::toVar() const
+{
+    DynamicObject::Ptr metricList = new DynamicObject();
+
+    for (auto& metric : metrics)
+    {
+        DynamicObject::Ptr object = new DynamicObject();
+        object->setProperty("type", metric.isHistogram ? "histogram" : "counter");
+        object->setProperty("unit", metric.unit);
+        object->setProperty("count", metric.count);
+        object->setProperty("rate", metric.rate);
+
+        if (metric.isHistogram)
+        {
+            object->setProperty("mean", metric.mean);
+            object->setProperty("p50", metric.p50);
+            object->setProperty("p99", metric.p99);
+            object->setProperty("max", metric.max);
+        }
+
+        metricList->setProperty(metric.name, var(object.get()));
+    }
+
+    DynamicObject::Ptr object = new DynamicObject();
+    object->setProperty("timestamp", timestamp);
+    object->setProperty("metrics", var(metricList.get()));
+
+    return var(object.get());
+}
+
+String MetricsSnapshot::toCsv() const
+{
+    String csv = "name,type,unit,count,rate,mean,p50,p99,max\n";
+
+    for (auto& metric : metrics)
+    {
+        csv << metric.name << ","
+            << (metric.isHistogram ? "histogram" : "counter") << ","
+            << metric.unit << ","
+            << metric.count << ","
+            << String(metric.rate, 3) << ",";
+
+        if (metric.isHistogram)
+            csv << String(metric.mean, 3) << "," << String(metric.p50, 3) << ","
+                << String(metric.p99, 3) << "," << metric.max << "\n";
+        else
+            csv << ",,,\n";
+    }
+
+    return csv;
+}
+
+RuntimeMetrics::RuntimeMetrics()
+    : Thread("Opto metrics")
+{
+}
+
+RuntimeMetrics::~RuntimeMetrics()
+{
+    stopThread(1000);
+}
+
+void RuntimeMetrics::add(const String& name, const String& unit, MetricCounter* counter)
+{
+    addEntry({ name, unit, counter, nullptr });
+}
+
+void RuntimeMetrics::add(const String& name, const String& unit, MetricHistogram* histogram)
+{
+    addEntry({ name, unit, nullptr, histogram });
+}
+
+void RuntimeMetrics::addEntry(const Entry& entry)
+{
+    const ScopedLock lock(entryLock);
+
+    // A metric is registered once, under one name
+    remove(entry.counter != nullptr ? (const void*) entry.counter : (const void*) entry.histogram);
+
+    for (int i = entries.size(); --i >= 0;)
+    {
+        if (entries.getReference(i).name == entry.name)
+            entries.remove(i);
+    }
+
+    entries.add(entry);
+}
+
+void RuntimeMetrics::remove(const void* metric)
+{
+    const ScopedLock lock(entryLock);
+
+    for (int i = entries.size(); --i >= 0;)
+    {
+        const Entry& entry = entries.getReference(i);
+
+        if ((const void*) entry.counter == metric || (const void*) entry.histogram == metric)
+            entries.remove(i);
+    }
+}
+
+void RuntimeMetrics::reset()
+{
+    {
+        const ScopedLock lock(entryLock);
+
+        for (auto& entry : entries)
+        {
+            if (entry.counter != nullptr)
+                entry.counter->reset();
+            else
+                entry.histogram->reset();
+        }
+    }
+
+    const ScopedLock lock(snapshotLock);
+    latest = MetricsSnapshot();
+    latestMs = 0;
+}
+
+void RuntimeMetrics::startCollecting(int interval)
+{
+    intervalMs.store(jmax(1, interval), std::memory_order_relaxed);
+
+    if (!isThreadRunning())
+        startThread();
+}
+
+void RuntimeMetrics::stopCollecting()
+{
+    stopThread(1000);
+}
+
+void RuntimeMetrics::run()
+{
+    while (!threadShouldExit())
+    {
+        wait(intervalMs.load(std::memory_order_relaxed));
+
+        if (!threadShouldExit())
+            collect();
+    }
+}
+
+MetricsSnapshot RuntimeMetrics::collect()
+{
+    MetricsSnapshot snapshot;
+    snapshot.timestamp = Time::currentTimeMillis();
+
+    const double nowMs = Time::getMillisecondCounterHiRes();
+
+    {
+        const ScopedLock lock(entryLock);
+
+        snapshot.metrics.ensureStorageAllocated(entries.size());
+
+        for (auto& entry : entries)
+        {
+            MetricSample metric;
+            metric.name = entry.name;
+            metric.unit = entry.unit;
+            metric.isHistogram = entry.histogram != nullptr;
+
+            if (entry.counter != nullptr)
+            {
+                metric.count = entry.counter->get();
+            }
+            else
+            {
+                const MetricHistogram::Snapshot histogram = entry.histogram->getSnapshot();
+
+                metric.count = histogram.count;
+                metric.mean = histogram.getMean();
+                metric.p50 = histogram.getPercentile(50);
+                metric.p99 = histogram.getPercentile(99);
+                metric.max = histogram.max;
+            }
+
+            snapshot.metrics.add(metric);
+        }
+    }
+
+    const ScopedLock lock(snapshotLock);
+
+    if (latestMs > 0 && nowMs > latestMs)
+    {
+        const double seconds = (nowMs - latestMs) / 1000.0;
+
+        for (auto& metric : snapshot.metrics)
+        {
+            if (const MetricSample* previous = latest.find(metric.name))
+                metric.rate = (double) jmax((int64) 0, metric.count - previous->count) / seconds;
+        }
+    }
+
+    latest = snapshot;
+    latestMs = nowMs;
+
+    return snapshot;
+}
+
+MetricsSnapshot RuntimeMetrics::getSnapshot() const
+{
+    const ScopedLock lock(snapshotLock);
+    return latest;
+}
+
+Result RuntimeMetrics::writeFiles(const File& directory, const String& baseName)
+{
+    Result result = directory.createDirectory();
+
+    if (result.failed())
+        return result;
+
+    const MetricsSnapshot snapshot = collect();
+    const File jsonFile = directory.getChildFile(baseName + ".json");
+    const File csvFile = directory.getChildFile(baseName + ".csv");
+
+    if (!jsonFile.replaceWithText(JSON::toString(snapshot.toVar())))
+        return Result::fail("Could not write " + jsonFile.getFullPathName());
+
+    if (!csvFile.replaceWithText(snapshot.toCsv()))
+        return Result::fail("Could not write " + csvFile.getFullPathName());
+
+    return Result::ok();
+}
@@ -0,0 +1,259 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef RUNTIMEMETRICS_H_DEFINED
+#define RUNTIMEMETRICS_H_DEFINED
+
+#ifdef OPTO_STANDALONE
+#include <juce_core/juce_core.h>
+using namespace juce;
+#else
+#include <JuceHeader.h>
+#endif
+
+#include <atomic>
+
+/**
+    A count that only goes up.
+
+    Safe to update from any thread, including the audio thread: an
+    update is a single relaxed atomic add.
+*/
+class MetricCounter
+{
+public:
+    /** Adds to the count */
+    void add(int64 amount = 1) noexcept { value.fetch_add(amount, std::memory_order_relaxed); }
+
+    /** Returns the count */
+    int64 get() const noexcept { return value.load(std::memory_order_relaxed); }
+
+    /** Sets the count back to zero */
+    void reset() noexcept { value.store(0, std::memory_order_relaxed); }
+
+private:
+    std::atomic<int64> value { 0 };
+};
+
+/**
+    Distribution of non-negative integer values (times, depths, delays).
+
+    Values below 4 have a bucket each; above that, every power of two
+    is split into 4 equal buckets, so a bucket is never wider than a
+    quarter of its values. Recording a value is a few relaxed atomic
+    operations with no locks or allocation, so it is safe on the
+    audio thread; percentiles are interpolated within a bucket when
+    the histogram is read.
+*/
+class MetricHistogram
+{
+public:
+    /** Constructor */
+    MetricHistogram() { reset(); }
+
+    /** Counts one value (negative values count as zero) */
+    void record(int64 value) noexcept;
+
+    /** Sets every bucket back to zero */
+    void reset() noexcept;
+
+    /** Number of buckets (enough for any int64) */
+    static const int numBuckets = 248;
+
+    /** Returns the bucket a value is counted in */
+    static int getBucket(int64 value) noexcept;
+
+    /** Returns a high-resolution time in nanoseconds, for timing code */
+    static int64 getTimeNanos() noexcept;
+
+    /** Returns the smallest value counted in a bucket */
+    static int64 getBucketStart(int bucket) noexcept;
+
+    /** Returns the number of values counted in a bucket */
+    static int64 getBucketWidth(int bucket) noexcept { return bucket < 8 ? 1 : (int64) 1 << (bucket / 4 - 1); }
+
+    /** A consistent-enough copy of the histogram */
+    struct Snapshot
+    {
+        int64 buckets[numBuckets] = {};
+        int64 count = 0;
+        int64 sum = 0;
+        int64 max = 0;
+
+        /** Returns the mean of the counted values */
+        double getMean() const { return count > 0 ? (double) sum / (double) count : 0.0; }
+
+        /** Estimates a percentile (0 to 100) by interpolating within its bucket */
+        double getPercentile(double percentile) const;
+    };
+
+    /** Copies the counts (values recorded meanwhile may be partly included) */
+    Snapshot getSnapshot() const noexcept;
+
+private:
+    std::atomic<int64> buckets[numBuckets];
+    std::atomic<int64> count;
+    std::atomic<int64> sum;
+    std::atomic<int64> max;
+};
+
+/** Records the time from construction to destruction in a MetricHistogram (in ns) */
+class ScopedMetricTimer
+{
+public:
+    /** Starts timing */
+    explicit ScopedMetricTimer(MetricHistogram& histogram_) noexcept
+        : histogram(histogram_), start(MetricHistogram::getTimeNanos()) { }
+
+    /** Records the elapsed time */
+    ~ScopedMetricTimer() { histogram.record(MetricHistogram::getTimeNanos() - start); }
+
+private:
+    MetricHistogram& histogram;
+    const int64 start;
+
+    JUCE_DECLARE_NON_COPYABLE(ScopedMetricTimer);
+};
+
+/** One metric, as read by RuntimeMetrics::collect() */
+struct MetricSample
+{
+    String name;
+    String unit;
+
+    /** True for a histogram, false for a counter */
+    bool isHistogram = false;
+
+    /** Counter value, or number of values in a histogram */
+    int64 count = 0;
+
+    /** Increase of count per second since the previous collection */
+    double rate = 0;
+
+    /** Histograms only */
+    double mean = 0;
+    double p50 = 0;
+    double p99 = 0;
+    int64 max = 0;
+};
+
+/** Every metric at one point in time */
+struct MetricsSnapshot
+{
+    /** Time of collection (ms since epoch) */
+    int64 timestamp = 0;
+
+    Array<MetricSample> metrics;
+
+    /** Returns a metric by name (nullptr if there is none) */
+    const MetricSample* find(const String& name) const;
+
+    /** Returns the snapshot as a JSON object with one property per metric */
+    var toVar() const;
+
+    /** Returns the snapshot as CSV, one row per metric */
+    String toCsv() const;
+};
+
+/**
+    Registry of the plugin's performance counters and histograms.
+
+    Metrics are plain members of the objects that update them (so the
+    hot path never looks anything up) and are registered here by
+    name, from the message thread. A background thread collects every
+    registered metric at a fixed interval, keeping the latest
+    snapshot for display; writeFiles() dumps a fresh one as JSON and
+    CSV. Metrics must be removed before they are destroyed.
+*/
+class RuntimeMetrics : private Thread
+{
+public:
+    /** Constructor */
+    RuntimeMetrics();
+
+    /** Destructor */
+    ~RuntimeMetrics();
+
+    /** Registers a counter (replacing any metric with the same name) */
+    void add(const String& name, const String& unit, MetricCounter* counter);
+
+    /** Registers a histogram (replacing any metric with the same name) */
+    void add(const String& name, const String& unit, MetricHistogram* histogram);
+
+    /** Unregisters a metric */
+    void remove(const void* metric);
+
+    /** Sets every registered metric back to zero */
+    void reset();
+
+    /** Starts collecting at a fixed interval */
+    void startCollecting(int intervalMs = defaultIntervalMs);
+
+    /** Stops collecting (the last snapshot is kept) */
+    void stopCollecting();
+
+    /** Reads every metric now and keeps the result as the latest snapshot */
+    MetricsSnapshot collect();
+
+    /** Returns the latest snapshot */
+    MetricsSnapshot getSnapshot() const;
+
+    /** Collects a snapshot and writes it to <baseName>.json and <baseName>.csv in a directory */
+    Result writeFiles(const File& directory, const String& baseName);
+
+    /** Default collection interval */
+    static const int defaultIntervalMs = 1000;
+
+private:
+
+    /** Collection loop */
+    void run() override;
+
+    /** A registered metric (exactly one of counter and histogram is set) */
+    struct Entry
+    {
+        String name;
+        String unit;
+        MetricCounter* counter;
+        MetricHistogram* histogram;
+    };
+
+    /** Registers a metric, replacing any with the same name or object */
+    void addEntry(const Entry& entry);
+
+    /** Registered metrics */
+    Array<Entry> entries;
+    CriticalSection entryLock;
+
+    /** Latest snapshot, and the time it was taken (for rates) */
+    MetricsSnapshot latest;
+    double latestMs = 0;
+    CriticalSection snapshotLock;
+
+    std::atomic<int> intervalMs { defaultIntervalMs };
+
+    JUCE_DECLARE_NON_COPYABLE(RuntimeMetrics);
+};
+
+#endif // RUNTIMEMETRICS_H_DEFINED
@@ -0,0 +1,73 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef SAMPLETIME_H_DEFINED
+#define SAMPLETIME_H_DEFINED
+
+#ifdef OPTO_STANDALONE
+#include <juce_core/juce_core.h>
+using namespace juce;
+#else
+#include <JuceHeader.h>
+#endif
+
+/**
+    Conversions between parameter units and sample counts.
+
+    Durations are rounded to whole samples once, when a sequence is
+    compiled, and are only ever added as integers after that. Summing
+    any number of them is exact, so the predicted and the executed
+    timeline cannot drift apart.
+*/
+struct SampleTime
+{
+    /** Sample rate used until the stream's rate is known */
+    static constexpr double defaultSampleRate = 30000.0;
+
+    /** Rounds a duration in seconds to the nearest sample */
+    static int64 fromSeconds(double seconds, double sampleRate)
+    {
+        return jmax((int64) 0, (int64) std::llround(seconds * sampleRate));
+    }
+
+    /** Rounds a duration in milliseconds to the nearest sample */
+    static int64 fromMilliseconds(double milliseconds, double sampleRate)
+    {
+        return jmax((int64) 0, (int64) std::llround(milliseconds * sampleRate / 1000.0));
+    }
+
+    /** Converts a sample count to seconds (for display only) */
+    static double toSeconds(int64 samples, double sampleRate)
+    {
+        return (double) samples / sampleRate;
+    }
+
+    /** Converts a sample count to milliseconds (for timer scheduling) */
+    static double toMilliseconds(int64 samples, double sampleRate)
+    {
+        return (double) samples * 1000.0 / sampleRate;
+    }
+};
+
+#endif // SAMPLETIME_H_DEFINED
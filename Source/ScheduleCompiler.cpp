@@ -0,0 +1,753 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "ScheduleCompiler.h"
+#include "ItiSampler.h"
+
+namespace
+{
+    uint64 floatBits(float value)
+    {
+        uint32 bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return (uint64) bits;
+    }
+
+    uint64 doubleBits(double value)
+    {
+        uint64 bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    /**
+        The trials left in each category, as a segment tree: every node
+        holds the total of its categories and the one with the most
+        trials, so each operation takes O(log numCategories).
+    */
+    class CategoryCounts
+    {
+    public:
+        CategoryCounts(const Array<int>& counts)
+            : numLeaves(jmax(1, (int) nextPowerOfTwo(counts.size())))
+        {
+            totals.insertMultiple(0, 0, 2 * numLeaves);
+            largest.insertMultiple(0, 0, 2 * numLeaves);
+
+            for (int category = 0; category < counts.size(); ++category)
+                totals.set(numLeaves + category, counts[category]);
+
+            for (int leaf = 0; leaf < numLeaves; ++leaf)
+                largest.set(numLeaves + leaf, leaf);
+
+            for (int node = numLeaves; --node > 0;)
+                update(node);
+        }
+
+        int64 get(int category) const { return totals[numLeaves + category]; }
+
+        /** Removes a trial from a category */
+        void take(int category)
+        {
+            int node = numLeaves + category;
+            totals.getReference(node)--;
+
+            while ((node /= 2) > 0)
+                update(node);
+        }
+
+        /** Returns the category with the most trials left */
+        int getLargest() const { return largest[1]; }
+
+        /** Returns the trials left in the categories before one */
+        int64 getTotalBefore(int category) const
+        {
+            int64 total = 0;
+
+            for (int node = numLeaves + category; node > 1; node /= 2)
+                if (node % 2 == 1)
+                    total += totals[node - 1];
+
+            return total;
+        }
+
+        /** Returns the category that holds trial number pick, counting through the categories in order */
+        int find(int64 pick) const
+        {
+            int node = 1;
+
+            while (node < numLeaves)
+            {
+                node *= 2;
+
+                if (pick >= totals[node])
+                    pick -= totals[node++];
+            }
+
+            return node - numLeaves;
+        }
+
+    private:
+        void update(int node)
+        {
+            const int left = largest[2 * node];
+            const int right = largest[2 * node + 1];
+
+            totals.set(node, totals[2 * node] + totals[2 * node + 1]);
+            largest.set(node, get(right) > get(left) ? right : left);
+        }
+
+        const int numLeaves;
+        Array<int64> totals;
+        Array<int> largest;
+    };
+}
+
+WaveformBuffer::WaveformBuffer(const Array<float>& samples_, double sampleRate_)
+    : samples(samples_),
+      sampleRate(sampleRate_),
+      hash(getHash(samples_, sampleRate_))
+{
+}
+
+WaveformBuffer::Ptr WaveformBuffer::create(const Array<float>& samples, double sampleRate, double outputRate)
+{
+    if (sampleRate == outputRate)
+        return new WaveformBuffer(samples, sampleRate);
+
+    auto resampler = std::make_unique<WaveformResampler>(sampleRate, outputRate);
+
+    if (resampler->getNumOutputSamples(samples.size()) <= maxPrecomputedSamples)
+        return new WaveformBuffer(resampler->process(samples), outputRate);
+
+    Ptr buffer = new WaveformBuffer(samples, sampleRate);
+    buffer->resampler = std::move(resampler);
+
+    return buffer;
+}
+
+uint64 WaveformBuffer::getHash(const Array<float>& samples, double sampleRate)
+{
+    uint64 hash = ScheduleCompiler::hashCombine((uint64) samples.size(), doubleBits(sampleRate));
+
+    for (float sample : samples)
+        hash = ScheduleCompiler::hashCombine(hash, floatBits(sample));
+
+    return hash;
+}
+
+size_t WaveformBuffer::getMemoryUsage() const
+{
+    size_t bytes = sizeof(WaveformBuffer) + (size_t) samples.size() * sizeof(float);
+
+    if (resampler != nullptr)
+        bytes += sizeof(WaveformResampler) + resampler->getMemoryUsage();
+
+    return bytes;
+}
+
+uint64 StimulusSpec::getHash() const
+{
+    uint64 hash = ScheduleCompiler::hashCombine((uint64) type, (uint64) numSamples);
+
+    switch (type)
+    {
+        case PULSE_TRAIN:
+            hash = ScheduleCompiler::hashCombine(hash, (uint64) numPulses);
+            hash = ScheduleCompiler::hashCombine(hash, doubleBits(pulsePeriod));
+            hash = ScheduleCompiler::hashCombine(hash, (uint64) pulseWidth);
+            hash = ScheduleCompiler::hashCombine(hash, (uint64) pulseRamp);
+            break;
+        case RAMP:
+            hash = ScheduleCompiler::hashCombine(hash, (uint64) rampOnset);
+            hash = ScheduleCompiler::hashCombine(hash, (uint64) rampPlateau);
+            hash = ScheduleCompiler::hashCombine(hash, (uint64) rampOffset);
+            hash = ScheduleCompiler::hashCombine(hash, (uint64) rampProfile);
+            break;
+        case SINUSOID:
+            hash = ScheduleCompiler::hashCombine(hash, doubleBits(sineFrequency));
+            break;
+        case CUSTOM:
+            hash = ScheduleCompiler::hashCombine(hash, waveform != nullptr ? waveform->hash : 0);
+            break;
+    }
+
+    return hash;
+}
+
+int ConditionSpec::getNumTrials() const
+{
+    return getNumStimulusTrials() + numCatchTrials;
+}
+
+int ConditionSpec::getNumStimulusTrials() const
+{
+    return numRepeats * getTrialsPerRepeat();
+}
+
+int ConditionSpec::getTrialsPerRepeat() const
+{
+    return sites.size() * wavelengths.size() * numStimuli;
+}
+
+int ConditionSpec::getCatchSource(int catchIndex) const
+{
+    // The middle of the catch trial's share of the stimulus trials
+    return (int) ((2 * (int64) catchIndex + 1) * getNumStimulusTrials() / (2 * (int64) numCatchTrials));
+}
+
+int ConditionSpec::getNumCatchTrialsBefore(int64 stimulusTrial) const
+{
+    const int64 numStimulusTrials = getNumStimulusTrials();
+
+    if (numCatchTrials == 0 || numStimulusTrials == 0)
+        return 0;
+
+    // getCatchSource(j) < x  <=>  (2j + 1) N < 2 M x  <=>  j < (2 M x - N) / 2N
+    const int64 numerator = 2 * (int64) numCatchTrials * stimulusTrial - numStimulusTrials;
+
+    if (numerator <= 0)
+        return 0;
+
+    return (int) jmin((int64) numCatchTrials, (numerator + 2 * numStimulusTrials - 1) / (2 * numStimulusTrials));
+}
+
+int ConditionSpec::getBlockSize(int block) const
+{
+    if (block >= numRepeats)
+        return 0;
+
+    const int64 perRepeat = getTrialsPerRepeat();
+
+    return (int) perRepeat + getNumCatchTrialsBefore((block + 1) * perRepeat) - getNumCatchTrialsBefore(block * perRepeat);
+}
+
+int64 ConditionSpec::getBlockStart(int block) const
+{
+    const int64 stimulusTrials = (int64) jmin(block, numRepeats) * getTrialsPerRepeat();
+
+    return stimulusTrials + getNumCatchTrialsBefore(stimulusTrials);
+}
+
+int ConditionSpec::getBlockTrial(int block, int index) const
+{
+    const int perRepeat = getTrialsPerRepeat();
+
+    // Stimulus trials come first, then the catch trials that copy them
+    if (index < perRepeat)
+        return block * perRepeat + index;
+
+    return getNumStimulusTrials() + getNumCatchTrialsBefore((int64) block * perRepeat) + index - perRepeat;
+}
+
+int64 ConditionSpec::getStimulusSamples() const
+{
+    int64 samplesPerRepeat = 0;
+
+    for (auto& stimulus : stimuli)
+        samplesPerRepeat += stimulus.numSamples;
+
+    int64 totalSamples = samplesPerRepeat * numRepeats * sites.size() * wavelengths.size();
+
+    // Catch trials last as long as the trials they copy
+    for (int i = 0; i < numCatchTrials; ++i)
+        totalSamples += stimuli.getReference(getCatchSource(i) % numStimuli).numSamples;
+
+    return totalSamples;
+}
+
+size_t ConditionSpec::getMemoryUsage() const
+{
+    return (size_t) (sites.size() + wavelengths.size()) * sizeof(int)
+         + (size_t) stimuli.size() * sizeof(StimulusSpec);
+}
+
+int SequenceSpec::getNumTrials() const
+{
+    int totalTrials = 0;
+
+    for (auto& condition : conditions)
+        totalTrials += condition.getNumTrials();
+
+    return totalTrials;
+}
+
+int SequenceSpec::getNumBlocks() const
+{
+    int numBlocks = 0;
+
+    for (auto& condition : conditions)
+    {
+        if (condition.getTrialsPerRepeat() > 0)
+            numBlocks = jmax(numBlocks, condition.numRepeats);
+    }
+
+    return numBlocks;
+}
+
+int64 SequenceSpec::getStimulusSamples() const
+{
+    int64 totalSamples = 0;
+
+    for (auto& condition : conditions)
+        totalSamples += condition.getStimulusSamples();
+
+    return totalSamples;
+}
+
+uint64 SequenceSpec::getHash() const
+{
+    uint64 hash = ScheduleCompiler::hashCombine(0, (uint64) seed);
+    hash = ScheduleCompiler::hashCombine(hash, doubleBits(sampleRate));
+    hash = ScheduleCompiler::hashCombine(hash, (uint64) baselineSamples);
+    hash = ScheduleCompiler::hashCombine(hash, (uint64) minItiSamples);
+    hash = ScheduleCompiler::hashCombine(hash, (uint64) maxItiSamples);
+    hash = ScheduleCompiler::hashCombine(hash, (uint64) itiDistribution);
+
+    if (itiDistribution == EXPONENTIAL_ITI)
+        hash = ScheduleCompiler::hashCombine(hash, doubleBits(itiMeanSamples));
+
+    if (itiDistribution == EMPIRICAL_ITI)
+    {
+        for (int64 iti : itiTable)
+            hash = ScheduleCompiler::hashCombine(hash, (uint64) iti);
+    }
+    hash = ScheduleCompiler::hashCombine(hash, (uint64) order);
+
+    if (order == MAX_RUN_ORDER)
+    {
+        hash = ScheduleCompiler::hashCombine(hash, (uint64) maxRunLength);
+        hash = ScheduleCompiler::hashCombine(hash, (uint64) runCategory);
+    }
+
+    for (auto& condition : conditions)
+    {
+        hash = ScheduleCompiler::hashCombine(hash, (uint64) condition.numRepeats);
+        hash = ScheduleCompiler::hashCombine(hash, (uint64) condition.numStimuli);
+        hash = ScheduleCompiler::hashCombine(hash, (uint64) condition.numCatchTrials);
+
+        for (auto& stimulus : condition.stimuli)
+            hash = ScheduleCompiler::hashCombine(hash, stimulus.getHash());
+
+        hash = ScheduleCompiler::hashCombine(hash, 0xffffffffULL);
+
+        for (int site : condition.sites)
+            hash = ScheduleCompiler::hashCombine(hash, (uint64) site);
+
+        hash = ScheduleCompiler::hashCombine(hash, 0xffffffffULL);
+
+        for (int wavelength : condition.wavelengths)
+            hash = ScheduleCompiler::hashCombine(hash, (uint64) wavelength);
+
+        hash = ScheduleCompiler::hashCombine(hash, 0xffffffffULL);
+    }
+
+    return hash;
+}
+
+size_t SequenceSpec::getMemoryUsage() const
+{
+    size_t bytes = (size_t) conditions.size() * sizeof(ConditionSpec)
+                 + (size_t) itiTable.size() * sizeof(int64);
+
+    for (const auto& condition : conditions)
+        bytes += condition.getMemoryUsage();
+
+    return bytes;
+}
+
+void CompiledSequence::clear()
+{
+    trials.clear();
+    itiSamples.clear();
+    order.clear();
+}
+
+size_t CompiledSequence::getMemoryUsage() const
+{
+    return (size_t) trials.size() * sizeof(TrialEntry)
+         + (size_t) itiSamples.size() * sizeof(int64)
+         + (size_t) order.size() * sizeof(int);
+}
+
+int64 ScheduleCompiler::deriveSeed(int64 seed, int64 stream)
+{
+    return (int64) mix64((uint64) seed ^ mix64((uint64) stream));
+}
+
+uint64 ScheduleCompiler::hashCombine(uint64 hash, uint64 value)
+{
+    return mix64(hash ^ mix64(value));
+}
+
+int64 ScheduleCompiler::uniform(int64 seed, int64 counter, int64 minValue, int64 maxValue)
+{
+    if (maxValue <= minValue)
+        return minValue;
+
+    // The modulo bias is below range / 2^64, far smaller than one sample
+    const uint64 range = (uint64) (maxValue - minValue) + 1;
+    return minValue + (int64) (draw(seed, counter) % range);
+}
+
+void ScheduleCompiler::compile(const SequenceSpec& spec, CompiledSequence& result)
+{
+    compile({ &spec }, { &result });
+}
+
+void ScheduleCompiler::compile(const Array<const SequenceSpec*>& specs,
+                               const Array<CompiledSequence*>& results)
+{
+    jassert(specs.size() == results.size());
+
+    // Size every trial table and work out where each condition's slice starts
+    struct ConditionJob
+    {
+        int sequence;
+        int condition;
+        int offset;
+    };
+
+    Array<ConditionJob> jobs;
+    int totalTrials = 0;
+
+    for (int s = 0; s < specs.size(); ++s)
+    {
+        const SequenceSpec& spec = *specs[s];
+        CompiledSequence& result = *results[s];
+
+        int offset = 0;
+
+        for (int c = 0; c < spec.conditions.size(); ++c)
+        {
+            jobs.add({ s, c, offset });
+            offset += spec.conditions.getReference(c).getNumTrials();
+        }
+
+        result.trials.resize(offset);
+        result.itiSamples.resize(offset);
+        result.order.resize(offset);
+
+        totalTrials += offset;
+    }
+
+    auto expand = [&](int i)
+    {
+        const ConditionJob& job = jobs.getReference(i);
+        expandCondition(*specs[job.sequence], job.condition, job.offset, *results[job.sequence]);
+    };
+
+    auto finishSequence = [&](int s)
+    {
+        // ITIs are drawn in one batch per sequence, straight into the table
+        CompiledSequence& result = *results[s];
+        ItiSampler(*specs[s]).sample(0, result.itiSamples.size(), result.itiSamples.getRawDataPointer());
+
+        orderTrials(*specs[s], result);
+    };
+
+    if (totalTrials < minTrialsForParallelCompile)
+    {
+        for (int i = 0; i < jobs.size(); ++i)
+            expand(i);
+
+        for (int s = 0; s < specs.size(); ++s)
+            finishSequence(s);
+    }
+    else
+    {
+        parallelFor(jobs.size(), expand);
+        parallelFor(specs.size(), finishSequence);
+    }
+}
+
+void ScheduleCompiler::expandCondition(const SequenceSpec& spec,
+                                       int conditionIndex,
+                                       int offset,
+                                       CompiledSequence& result)
+{
+    const ConditionSpec& condition = spec.conditions.getReference(conditionIndex);
+
+    TrialEntry* trials = result.trials.getRawDataPointer() + offset;
+    int* order = result.order.getRawDataPointer() + offset;
+
+    int trialIndex = 0;
+
+    for (int i = 0; i < condition.numRepeats; ++i)
+    {
+        for (int site : condition.sites)
+        {
+            for (int wavelength : condition.wavelengths)
+            {
+                for (int stimulus = 0; stimulus < condition.numStimuli; ++stimulus)
+                {
+                    const int globalIndex = offset + trialIndex;
+
+                    trials[trialIndex] = { conditionIndex, stimulus, site, wavelength };
+                    order[trialIndex] = globalIndex;
+
+                    ++trialIndex;
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < condition.numCatchTrials; ++i)
+    {
+        const int globalIndex = offset + trialIndex;
+
+        trials[trialIndex] = trials[condition.getCatchSource(i)];
+        trials[trialIndex].catchTrial = true;
+        order[trialIndex] = globalIndex;
+
+        ++trialIndex;
+    }
+}
+
+void ScheduleCompiler::orderTrials(const SequenceSpec& spec, CompiledSequence& result)
+{
+    Random random(deriveSeed(spec.seed, 1));
+    int* order = result.order.getRawDataPointer();
+    const int numTrials = result.order.size();
+
+    switch (spec.order)
+    {
+        case SEQUENTIAL_ORDER:
+            break;
+
+        case SHUFFLED_ORDER:
+        {
+            for (int i = numTrials - 1; i > 0; --i)
+            {
+                int j = random.nextInt(i + 1);
+                std::swap(order[i], order[j]);
+            }
+
+            break;
+        }
+
+        case BLOCKED_ORDER:
+        {
+            // Lay out each block's trials, then shuffle within the block
+            Array<int> offsets;
+            int offset = 0;
+
+            for (auto& condition : spec.conditions)
+            {
+                offsets.add(offset);
+                offset += condition.getNumTrials();
+            }
+
+            int position = 0;
+
+            for (int block = 0; block < spec.getNumBlocks(); ++block)
+            {
+                const int blockStart = position;
+
+                for (int c = 0; c < spec.conditions.size(); ++c)
+                {
+                    const ConditionSpec& condition = spec.conditions.getReference(c);
+
+                    for (int i = 0; i < condition.getBlockSize(block); ++i)
+                        order[position++] = offsets[c] + condition.getBlockTrial(block, i);
+                }
+
+                for (int i = position - 1; i > blockStart; --i)
+                {
+                    int j = blockStart + random.nextInt(i - blockStart + 1);
+                    std::swap(order[i], order[j]);
+                }
+            }
+
+            jassert(position == numTrials);
+            break;
+        }
+
+        case MAX_RUN_ORDER:
+        {
+            HeapBlock<int> categories((size_t) numTrials);
+            const TrialEntry* trials = result.trials.begin();
+
+            const int numCategories = getRunCategories(spec, [trials] (int slot) { return trials[slot]; },
+                                                       numTrials, categories);
+
+            orderWithMaxRun(categories, numTrials, numCategories, spec.maxRunLength, random, order);
+            break;
+        }
+    }
+}
+
+int ScheduleCompiler::getRunCategories(const SequenceSpec& spec,
+                                       const std::function<TrialEntry(int)>& trialAtSlot,
+                                       int numSlots,
+                                       int* categories)
+{
+    // Sites are numbered in ascending order
+    Array<int> sites;
+
+    if (spec.runCategory == RUN_BY_SITE)
+    {
+        for (auto& condition : spec.conditions)
+            for (int site : condition.sites)
+                sites.addIfNotAlreadyThere(site);
+
+        sites.sort();
+    }
+
+    const int catchCategory = spec.runCategory == RUN_BY_SITE ? sites.size() : spec.conditions.size();
+
+    for (int slot = 0; slot < numSlots; ++slot)
+    {
+        const TrialEntry trial = trialAtSlot(slot);
+
+        if (trial.catchTrial)
+            categories[slot] = catchCategory;
+        else if (spec.runCategory == RUN_BY_SITE)
+            categories[slot] = sites.indexOf(trial.site);
+        else
+            categories[slot] = trial.condition;
+    }
+
+    return catchCategory + 1;
+}
+
+void ScheduleCompiler::orderWithMaxRun(const int* categories,
+                                       int numSlots,
+                                       int numCategories,
+                                       int maxRunLength,
+                                       Random& random,
+                                       int* order)
+{
+    const int64 maxRun = jmax(1, maxRunLength);
+
+    // Group the slots by category (a counting sort), and shuffle each group
+    Array<int> counts, starts, taken;
+    counts.insertMultiple(0, 0, numCategories);
+
+    for (int slot = 0; slot < numSlots; ++slot)
+        counts.getReference(categories[slot])++;
+
+    HeapBlock<int> grouped((size_t) numSlots);
+    int start = 0;
+
+    for (int category = 0; category < numCategories; ++category)
+    {
+        starts.add(start);
+        taken.add(start);
+        start += counts[category];
+    }
+
+    for (int slot = 0; slot < numSlots; ++slot)
+        grouped[taken.getReference(categories[slot])++] = slot;
+
+    for (int category = 0; category < numCategories; ++category)
+    {
+        for (int i = counts[category] - 1; i > 0; --i)
+        {
+            int j = random.nextInt(i + 1);
+            std::swap(grouped[starts[category] + i], grouped[starts[category] + j]);
+        }
+
+        taken.set(category, starts[category]);
+    }
+
+    // Deal one category at a time. A category with n trials left can still be
+    // split into runs of maxRun if the other remaining trials fill the gaps,
+    // n <= maxRun * (others + 1); a category that would break this if it were
+    // skipped now is dealt now. Otherwise the category is drawn in proportion
+    // to its remaining trials, skipping the one that has reached the limit.
+    CategoryCounts left(counts);
+    int last = -1;
+    int64 run = 0;
+    int64 remaining = numSlots;
+
+    for (int position = 0; position < numSlots; ++position)
+    {
+        const int blocked = run >= maxRun ? last : -1;
+        int chosen = -1;
+
+        // Only a category with more than half of the remaining trials can
+        // break the condition, so only the largest needs to be checked
+        const int largest = left.getLargest();
+        const int64 largestCount = left.get(largest);
+
+        if (largest != blocked && largestCount > 0 && largestCount > maxRun * (remaining - largestCount))
+            chosen = largest;
+
+        if (chosen < 0)
+        {
+            const int64 available = remaining - (blocked >= 0 ? left.get(blocked) : 0);
+
+            if (available == 0)
+            {
+                // Only the blocked category is left; the limit can't be kept
+                chosen = blocked;
+            }
+            else
+            {
+                int64 pick = random.nextInt64() & std::numeric_limits<int64>::max();
+                pick %= available;
+
+                // The blocked category's trials are stepped over
+                if (blocked >= 0 && pick >= left.getTotalBefore(blocked))
+                    pick += left.get(blocked);
+
+                chosen = left.find(pick);
+            }
+        }
+
+        order[position] = grouped[taken.getReference(chosen)++];
+        left.take(chosen);
+        --remaining;
+
+        run = chosen == last ? run + 1 : 1;
+        last = chosen;
+    }
+}
+
+void ScheduleCompiler::parallelFor(int numJobs, std::function<void(int)> job)
+{
+    if (numJobs <= 1)
+    {
+        if (numJobs == 1)
+            job(0);
+
+        return;
+    }
+
+    std::atomic<int> remaining { numJobs };
+    WaitableEvent finished;
+
+    for (int i = 0; i < numJobs; ++i)
+    {
+        threadPool->addJob([&, i]
+        {
+            job(i);
+
+            if (--remaining == 0)
+                finished.signal();
+        });
+    }
+
+    finished.wait();
+}
@@ -0,0 +1,427 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef SCHEDULECOMPILER_H_DEFINED
+#define SCHEDULECOMPILER_H_DEFINED
+
+#ifdef OPTO_STANDALONE
+#include <juce_core/juce_core.h>
+using namespace juce;
+#else
+#include <JuceHeader.h>
+#endif
+
+#include "SampleTime.h"
+#include "WaveformResampler.h"
+
+/** Available stimulus types*/
+enum StimulusType
+{
+    PULSE_TRAIN,
+    SINUSOID,
+    RAMP,
+    CUSTOM
+};
+
+/** Ramp profiles (in RampStimulus::ramp_profile order) */
+enum RampProfile
+{
+    LINEAR_RAMP,
+    COSINE_RAMP
+};
+
+/** How a sequence's playback order is generated */
+enum TrialOrder
+{
+    /** Expansion order (condition by condition) */
+    SEQUENTIAL_ORDER,
+
+    /** A uniformly random permutation */
+    SHUFFLED_ORDER,
+
+    /** One block per repeat, each holding every trial type once, shuffled within the block */
+    BLOCKED_ORDER,
+
+    /** Shuffled, with no more than maxRunLength trials in a row from the same condition or site */
+    MAX_RUN_ORDER
+};
+
+/** What counts as "the same" for MAX_RUN_ORDER */
+enum RunCategory
+{
+    RUN_BY_CONDITION,
+    RUN_BY_SITE
+};
+
+/** Distributions of inter-trial intervals (in Sequence::iti_distribution order) */
+enum ItiDistribution
+{
+    /** Uniform between the minimum and maximum ITI */
+    UNIFORM_ITI,
+
+    /** Exponential (a flat hazard) from the minimum ITI, truncated at the maximum */
+    EXPONENTIAL_ITI,
+
+    /** Always the minimum ITI */
+    FIXED_ITI,
+
+    /** Drawn with equal probability from a table */
+    EMPIRICAL_ITI
+};
+
+/**
+    A custom waveform, shared between a stimulus and its specs.
+
+    Buffers made with create() are ready to play at an output rate:
+    short waveforms are resampled to it once, up front, and long ones
+    keep their own rate and carry a resampler that streams them.
+*/
+class WaveformBuffer : public ReferenceCountedObject
+{
+public:
+    /** Constructor */
+    WaveformBuffer(const Array<float>& samples, double sampleRate);
+
+    using Ptr = ReferenceCountedObjectPtr<WaveformBuffer>;
+
+    /** Prepares a waveform for playback at an output rate */
+    static Ptr create(const Array<float>& samples, double sampleRate, double outputRate);
+
+    /** Hash of a waveform's samples and rate */
+    static uint64 getHash(const Array<float>& samples, double sampleRate);
+
+    /** Memory used by the buffer and its samples, in bytes */
+    size_t getMemoryUsage() const;
+
+    /** Waveforms up to this many output samples are resampled up front */
+    static const int maxPrecomputedSamples = 1 << 22;
+
+    /** Waveform samples */
+    const Array<float> samples;
+
+    /** Playback rate of the samples (Hz) */
+    const double sampleRate;
+
+    /** Hash of the samples and rate (computed once) */
+    const uint64 hash;
+
+    /** Streams the samples at the output rate (nullptr if they are already at it) */
+    std::unique_ptr<WaveformResampler> resampler;
+};
+
+/**
+    Snapshot of a stimulus, with every duration in output samples.
+
+    Contains everything needed to render the stimulus away from
+    the message thread.
+*/
+struct StimulusSpec
+{
+    /** StimulusType */
+    StimulusType type = PULSE_TRAIN;
+
+    /** Total duration */
+    int64 numSamples = 0;
+
+    /** Pulse train: number of pulses */
+    int numPulses = 0;
+
+    /** Pulse train: onset-to-onset period (exact, so onsets don't drift) */
+    double pulsePeriod = 0;
+
+    /** Pulse train: width of each pulse */
+    int64 pulseWidth = 0;
+
+    /** Pulse train: rise and fall time of each pulse */
+    int64 pulseRamp = 0;
+
+    /** Ramp: onset duration */
+    int64 rampOnset = 0;
+
+    /** Ramp: plateau duration */
+    int64 rampPlateau = 0;
+
+    /** Ramp: offset duration */
+    int64 rampOffset = 0;
+
+    /** Ramp: RampProfile */
+    RampProfile rampProfile = LINEAR_RAMP;
+
+    /** Sine: frequency in cycles per output sample */
+    double sineFrequency = 0;
+
+    /** Custom: the waveform (nullptr if empty) */
+    WaveformBuffer::Ptr waveform;
+
+    /** Hash of everything that affects the rendered stimulus */
+    uint64 getHash() const;
+};
+
+/**
+    Snapshot of the parameters that determine how a Condition
+    expands into trials.
+
+    Specs are captured on the message thread, so the compiler
+    never reads Parameter objects from a worker thread.
+*/
+struct ConditionSpec
+{
+    /** Number of repeats */
+    int numRepeats = 1;
+
+    /** Selected emission sites */
+    Array<int> sites;
+
+    /** Selected wavelengths (in nm) */
+    Array<int> wavelengths;
+
+    /** Number of stimuli in the condition */
+    int numStimuli = 0;
+
+    /** The condition's stimuli */
+    Array<StimulusSpec> stimuli;
+
+    /** Number of catch trials (copies of stimulus trials delivered with the light off) */
+    int numCatchTrials = 0;
+
+    /** Number of trials this condition expands into (including catch trials) */
+    int getNumTrials() const;
+
+    /** Number of trials delivered with the light on */
+    int getNumStimulusTrials() const;
+
+    /** Number of stimulus trials in each repeat */
+    int getTrialsPerRepeat() const;
+
+    /** Returns the stimulus trial (condition-local index) that a catch trial copies.
+        Catch trials are spread evenly over the stimulus trials. */
+    int getCatchSource(int catchIndex) const;
+
+    /** Returns the number of catch trials that copy a stimulus trial before a local index */
+    int getNumCatchTrialsBefore(int64 stimulusTrial) const;
+
+    /** Number of trials in a block (one per repeat; the repeat's
+        stimulus trials and the catch trials that copy them) */
+    int getBlockSize(int block) const;
+
+    /** Number of trials in every block before this one */
+    int64 getBlockStart(int block) const;
+
+    /** Returns the condition-local index of a trial within a block */
+    int getBlockTrial(int block, int index) const;
+
+    /** Stimulus time of all of this condition's trials, in samples */
+    int64 getStimulusSamples() const;
+
+    /** Heap memory used by the spec, in bytes (shared waveforms are not counted) */
+    size_t getMemoryUsage() const;
+};
+
+/** Snapshot of a Sequence's compile-time parameters */
+struct SequenceSpec
+{
+    /** Conditions, in sequence order */
+    Array<ConditionSpec> conditions;
+
+    /** Sample rate that durations were rounded against */
+    double sampleRate = SampleTime::defaultSampleRate;
+
+    /** Delay before the first trial, in samples */
+    int64 baselineSamples = 0;
+
+    /** Minimum inter-trial interval, in samples */
+    int64 minItiSamples = 0;
+
+    /** Maximum inter-trial interval, in samples */
+    int64 maxItiSamples = 0;
+
+    /** How ITIs are drawn */
+    ItiDistribution itiDistribution = UNIFORM_ITI;
+
+    /** EXPONENTIAL_ITI: mean of the exponential before truncation, in samples */
+    double itiMeanSamples = 0;
+
+    /** EMPIRICAL_ITI: the ITIs to draw from, in samples */
+    Array<int64> itiTable;
+
+    /** How trials are ordered */
+    TrialOrder order = SHUFFLED_ORDER;
+
+    /** MAX_RUN_ORDER: longest allowed run of trials from the same condition or site */
+    int maxRunLength = 1;
+
+    /** MAX_RUN_ORDER: what a run is made of */
+    RunCategory runCategory = RUN_BY_CONDITION;
+
+    /** Seed for ITI sampling and shuffling */
+    int64 seed = 0;
+
+    /** Total number of trials in the sequence */
+    int getNumTrials() const;
+
+    /** Number of blocks for BLOCKED_ORDER (the largest number of repeats) */
+    int getNumBlocks() const;
+
+    /** Stimulus time of all trials, in samples (excludes baseline and ITIs) */
+    int64 getStimulusSamples() const;
+
+    /** Hash of everything that affects the compiled schedule */
+    uint64 getHash() const;
+
+    /** Heap memory used by the spec, in bytes (shared waveforms are not counted) */
+    size_t getMemoryUsage() const;
+};
+
+/** A single expanded trial */
+struct TrialEntry
+{
+    /** Index into SequenceSpec::conditions */
+    int condition = 0;
+
+    /** Index into the condition's stimuli */
+    int stimulus = 0;
+
+    /** Emission site */
+    int site = 0;
+
+    /** Wavelength (in nm) */
+    int wavelength = 0;
+
+    /** Whether the light stays off (a sham trial with the timing of the trial it copies) */
+    bool catchTrial = false;
+};
+
+/** The trial table produced by compiling a SequenceSpec */
+struct CompiledSequence
+{
+    /** Trials, in expansion order */
+    Array<TrialEntry> trials;
+
+    /** ITIs in samples, indexed like trials */
+    Array<int64> itiSamples;
+
+    /** Playback order (indices into trials) */
+    Array<int> order;
+
+    /** Clears the trial table */
+    void clear();
+
+    /** Heap memory used by the trial table, in bytes */
+    size_t getMemoryUsage() const;
+};
+
+/**
+    Expands sequence specs into trial tables.
+
+    Each condition is expanded into its own slice of the trial table,
+    starting at an offset computed up front, so conditions can be
+    expanded concurrently. Sequences are then ordered independently.
+
+    All random draws are derived from the spec's seed and the trial's
+    position, so the result is identical for a fixed seed no matter
+    how the work is scheduled.
+*/
+class ScheduleCompiler
+{
+public:
+    /** Constructor */
+    ScheduleCompiler() { }
+
+    /** Destructor */
+    ~ScheduleCompiler() { }
+
+    /** Compiles a single sequence */
+    void compile(const SequenceSpec& spec, CompiledSequence& result);
+
+    /** Compiles a batch of sequences (specs and results must have the same size) */
+    void compile(const Array<const SequenceSpec*>& specs,
+                 const Array<CompiledSequence*>& results);
+
+    /** Derives an independent seed for a sub-stream (e.g. a sequence within a protocol) */
+    static int64 deriveSeed(int64 seed, int64 stream);
+
+    /** Returns a value drawn uniformly from [minValue, maxValue] that
+        depends only on seed and counter */
+    static int64 uniform(int64 seed, int64 counter, int64 minValue, int64 maxValue);
+
+    /** Returns 64 random bits that depend only on seed and counter */
+    static uint64 draw(int64 seed, int64 counter)
+    {
+        return mix64((uint64) seed + (uint64) counter * 0xd1b54a32d192ed03ULL);
+    }
+
+    /** SplitMix64 finalizer */
+    static uint64 mix64(uint64 x)
+    {
+        x += 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+    /** Folds a value into a running hash */
+    static uint64 hashCombine(uint64 hash, uint64 value);
+
+    /** Returns the run category of each trial slot, numbered from 0, and the number of categories.
+        Catch trials form a category of their own. */
+    static int getRunCategories(const SequenceSpec& spec,
+                                const std::function<TrialEntry(int)>& trialAtSlot,
+                                int numSlots,
+                                int* categories);
+
+    /** Orders slots so that no more than maxRunLength slots in a row share a
+        category, as far as the category sizes allow. Runs in O(numSlots * log numCategories). */
+    static void orderWithMaxRun(const int* categories,
+                                int numSlots,
+                                int numCategories,
+                                int maxRunLength,
+                                Random& random,
+                                int* order);
+
+    /** Batches smaller than this are compiled on the calling thread */
+    static const int minTrialsForParallelCompile = 16384;
+
+    /** Sequences with more trials than this are generated on demand by a TrialGenerator */
+    static const int maxCompiledTrials = 1 << 20;
+
+private:
+
+    /** Runs job(0) ... job(numJobs - 1) on the thread pool and waits for all of them */
+    void parallelFor(int numJobs, std::function<void(int)> job);
+
+    /** Fills a condition's slice of the trial table */
+    static void expandCondition(const SequenceSpec& spec,
+                                int conditionIndex,
+                                int offset,
+                                CompiledSequence& result);
+
+    /** Sets the playback order of a compiled sequence */
+    static void orderTrials(const SequenceSpec& spec, CompiledSequence& result);
+
+    /** Shared with every other compiler instance */
+    SharedResourcePointer<ThreadPool> threadPool;
+
+    JUCE_DECLARE_NON_COPYABLE(ScheduleCompiler);
+};
+
+#endif // SCHEDULECOMPILER_H_DEFINED
@@ -0,0 +1,315 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "ScheduleExport.h"
+
+namespace
+{
+    /** Number of records buffered before each write */
+    const int recordsPerWrite = 4096;
+
+    String describeCondition(int sequence, int condition)
+    {
+        return "Sequence " + String(sequence + 1) + ", condition " + String(condition + 1);
+    }
+}
+
+var ScheduleSummary::toVar(double sampleRate) const
+{
+    auto toSeconds = [sampleRate](double samples) { return samples / sampleRate; };
+
+    Array<var> sequenceList;
+
+    for (auto& sequence : sequences)
+    {
+        DynamicObject::Ptr object = new DynamicObject();
+        object->setProperty("trials", sequence.numTrials);
+        object->setProperty("catch_trials", sequence.numCatchTrials);
+        object->setProperty("duration", toSeconds((double) sequence.totalSamples));
+        object->setProperty("expected_duration", toSeconds(sequence.expectedSamples));
+        object->setProperty("duration_std", toSeconds(sequence.stdDevSamples));
+        object->setProperty("longest_run", sequence.longestRun);
+        sequenceList.add(var(object.get()));
+    }
+
+    DynamicObject::Ptr object = new DynamicObject();
+    object->setProperty("hash", String::toHexString((int64) hash));
+    object->setProperty("trials", numTrials);
+    object->setProperty("catch_trials", numCatchTrials);
+    object->setProperty("duration", toSeconds((double) totalSamples));
+    object->setProperty("expected_duration", toSeconds(expectedSamples));
+    object->setProperty("duration_std", toSeconds(stdDevSamples));
+    object->setProperty("sequences", sequenceList);
+    object->setProperty("warnings", warnings);
+
+    return var(object.get());
+}
+
+void ScheduleExport::validate(const ProtocolDefinition& definition, StringArray& errors, StringArray& warnings)
+{
+    if (definition.sequences.isEmpty())
+        errors.add("No sequences");
+
+    for (int s = 0; s < definition.sequences.size(); ++s)
+    {
+        const SequenceSpec& sequence = definition.sequences.getReference(s);
+        const String name = "Sequence " + String(s + 1);
+
+        int64 numTrials = 0;
+
+        for (int c = 0; c < sequence.conditions.size(); ++c)
+        {
+            const ConditionSpec& condition = sequence.conditions.getReference(c);
+
+            // Counted in 64 bits, since ConditionSpec::getNumTrials() would overflow
+            const int64 stimulusTrials = (int64) condition.numRepeats * condition.sites.size()
+                                         * condition.wavelengths.size() * condition.stimuli.size();
+
+            numTrials += stimulusTrials + condition.numCatchTrials;
+
+            if (stimulusTrials == 0)
+                warnings.add(describeCondition(s, c) + " has no trials (no repeats, sites, wavelengths or stimuli)");
+            else if (condition.numCatchTrials > stimulusTrials)
+                warnings.add(describeCondition(s, c) + " has more catch trials than stimulus trials");
+
+            for (int i = 0; i < condition.stimuli.size(); ++i)
+            {
+                const StimulusSpec& stimulus = condition.stimuli.getReference(i);
+                const String stimulusName = describeCondition(s, c) + ", stimulus " + String(i + 1);
+
+                if (stimulus.numSamples <= 0)
+                    errors.add(stimulusName + " is shorter than one sample");
+
+                if (stimulus.type == CUSTOM && stimulus.waveform == nullptr)
+                    errors.add(stimulusName + " has no waveform");
+
+                if (stimulus.type == PULSE_TRAIN && stimulus.numPulses > 0)
+                {
+                    if (stimulus.pulseWidth <= 0)
+                        warnings.add(stimulusName + " has pulses shorter than one sample");
+                    else if (stimulus.numPulses > 1 && (double) stimulus.pulseWidth > stimulus.pulsePeriod)
+                        warnings.add(stimulusName + " has pulses wider than their period");
+                }
+
+                if (stimulus.type == SINUSOID && stimulus.sineFrequency >= 0.5)
+                    warnings.add(stimulusName + " is above the Nyquist frequency");
+            }
+        }
+
+        if (numTrials == 0)
+            errors.add(name + " has no trials");
+        else if (numTrials > std::numeric_limits<int>::max())
+            errors.add(name + " has too many trials (" + String(numTrials) + ")");
+
+        const bool drawsFromRange = sequence.itiDistribution == UNIFORM_ITI
+                                    || sequence.itiDistribution == EXPONENTIAL_ITI;
+
+        if (drawsFromRange && sequence.minItiSamples > sequence.maxItiSamples)
+            warnings.add(name + ": minimum ITI exceeds maximum; the minimum is always used");
+
+        if (sequence.itiDistribution == EXPONENTIAL_ITI && sequence.itiMeanSamples <= 0)
+            warnings.add(name + ": exponential ITIs need a positive mean; the minimum is always used");
+
+        if (sequence.itiDistribution == EMPIRICAL_ITI && sequence.itiTable.isEmpty())
+            warnings.add(name + ": the ITI table is empty; the minimum is always used");
+
+        if (sequence.order == MAX_RUN_ORDER && sequence.maxRunLength < 1)
+            errors.add(name + ": maximum run length must be at least 1");
+    }
+}
+
+MemoryBlock ScheduleExport::createHeader(int64 numRecords)
+{
+    return NpyHeader::create("('onset', '<i8'), "
+                             "('duration', '<i8'), "
+                             "('iti', '<i8'), "
+                             "('sequence', '<i4'), "
+                             "('sequence_trial', '<i4'), "
+                             "('condition', '<i4'), "
+                             "('stimulus', '<i4'), "
+                             "('stimulus_type', '<i4'), "
+                             "('site', '<i4'), "
+                             "('wavelength', '<i4'), "
+                             "('catch_trial', '<i4')",
+                             numRecords, headerSize);
+}
+
+Result ScheduleExport::write(const ProtocolDefinition& definition,
+                             ScheduleCompiler& compiler,
+                             const File& file,
+                             ScheduleSummary& summary)
+{
+    const int numSequences = definition.sequences.size();
+
+    // Compile the small sequences as one batch, like Protocol::createTrials()
+    OwnedArray<CompiledSequence> compiled;
+    Array<const SequenceSpec*> specPointers;
+    Array<CompiledSequence*> results;
+
+    for (auto& sequence : definition.sequences)
+    {
+        CompiledSequence* result = compiled.add(new CompiledSequence());
+
+        if (sequence.getNumTrials() <= ScheduleCompiler::maxCompiledTrials)
+        {
+            specPointers.add(&sequence);
+            results.add(result);
+        }
+    }
+
+    compiler.compile(specPointers, results);
+
+    std::unique_ptr<FileOutputStream> stream;
+
+    if (file != File())
+    {
+        file.getParentDirectory().createDirectory();
+        file.deleteFile();
+
+        stream = std::make_unique<FileOutputStream>(file, 1 << 20);
+
+        if (stream->failedToOpen())
+            return Result::fail("Could not write " + file.getFullPathName());
+
+        MemoryBlock header = createHeader(definition.getNumTrials());
+        stream->write(header.getData(), header.getSize());
+    }
+
+    summary = ScheduleSummary();
+    summary.hash = definition.getHash();
+
+    HeapBlock<ScheduleRecord> records(recordsPerWrite);
+    int numBuffered = 0;
+    int64 onset = 0;
+    double variance = 0;
+
+    for (int s = 0; s < numSequences; ++s)
+    {
+        const SequenceSpec& spec = definition.sequences.getReference(s);
+        const CompiledSequence& table = *compiled[s];
+        const int64 numTrials = spec.getNumTrials();
+
+        std::unique_ptr<TrialGenerator> generator;
+
+        if (numTrials > ScheduleCompiler::maxCompiledTrials)
+            generator = std::make_unique<TrialGenerator>(spec);
+
+        ItiSampler itiSampler(spec);
+
+        SequenceSummary sequenceSummary;
+        sequenceSummary.numTrials = numTrials;
+        sequenceSummary.expectedSamples = (double) (spec.baselineSamples + spec.getStimulusSamples())
+                                          + itiSampler.getMean() * (double) numTrials;
+        sequenceSummary.stdDevSamples = std::sqrt(itiSampler.getVariance() * (double) numTrials);
+
+        const int64 sequenceStart = onset;
+        onset += spec.baselineSamples;
+
+        int previousCategory = -2;
+        int runLength = 0;
+
+        for (int64 position = 0; position < numTrials; ++position)
+        {
+            TrialEntry trial;
+            int64 iti;
+
+            if (generator != nullptr)
+            {
+                trial = generator->getTrial(position);
+                iti = generator->getIti(position);
+            }
+            else
+            {
+                const int slot = table.order[(int) position];
+                trial = table.trials[slot];
+                iti = table.itiSamples[slot];
+            }
+
+            const StimulusSpec& stimulus = spec.conditions.getReference(trial.condition).stimuli.getReference(trial.stimulus);
+
+            if (stream != nullptr)
+            {
+                ScheduleRecord& record = records[numBuffered++];
+                record.onset = onset;
+                record.duration = stimulus.numSamples;
+                record.iti = iti;
+                record.sequence = s;
+                record.sequenceTrial = (int32) position;
+                record.condition = trial.condition;
+                record.stimulus = trial.stimulus;
+                record.stimulusType = (int32) stimulus.type;
+                record.site = trial.site;
+                record.wavelength = trial.wavelength;
+                record.catchTrial = trial.catchTrial ? 1 : 0;
+
+                if (numBuffered == recordsPerWrite)
+                {
+                    stream->write(records.getData(), sizeof(ScheduleRecord) * (size_t) numBuffered);
+                    numBuffered = 0;
+                }
+            }
+
+            // Catch trials form a category of their own, as in ScheduleCompiler::getRunCategories()
+            const int category = trial.catchTrial ? -1
+                               : (spec.order == MAX_RUN_ORDER && spec.runCategory == RUN_BY_SITE) ? trial.site
+                               : trial.condition;
+
+            runLength = category == previousCategory ? runLength + 1 : 1;
+            previousCategory = category;
+            sequenceSummary.longestRun = jmax(sequenceSummary.longestRun, runLength);
+
+            if (trial.catchTrial)
+                sequenceSummary.numCatchTrials++;
+
+            onset += stimulus.numSamples + iti;
+        }
+
+        sequenceSummary.totalSamples = onset - sequenceStart;
+
+        if (spec.order == MAX_RUN_ORDER && sequenceSummary.longestRun > spec.maxRunLength)
+            summary.warnings.add("Sequence " + String(s + 1) + " has runs of " + String(sequenceSummary.longestRun)
+                                 + " trials (limit " + String(spec.maxRunLength) + "); the limit can't be met with these conditions");
+
+        summary.numTrials += sequenceSummary.numTrials;
+        summary.numCatchTrials += sequenceSummary.numCatchTrials;
+        summary.expectedSamples += sequenceSummary.expectedSamples;
+        variance += itiSampler.getVariance() * (double) numTrials;
+        summary.sequences.add(sequenceSummary);
+    }
+
+    summary.totalSamples = onset;
+    summary.stdDevSamples = std::sqrt(variance);
+
+    if (stream != nullptr)
+    {
+        if (numBuffered > 0)
+            stream->write(records.getData(), sizeof(ScheduleRecord) * (size_t) numBuffered);
+
+        stream->flush();
+
+        if (stream->getStatus().failed())
+            return Result::fail("Could not write " + file.getFullPathName() + ": " + stream->getStatus().getErrorMessage());
+    }
+
+    return Result::ok();
+}
@@ -0,0 +1,149 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef SCHEDULEEXPORT_H_DEFINED
+#define SCHEDULEEXPORT_H_DEFINED
+
+#include "ProtocolFile.h"
+#include "RecordWriter.h"
+#include "TrialGenerator.h"
+
+/**
+    One trial of a compiled schedule, as written by ScheduleExport.
+
+    Fields are naturally aligned with no padding, so the file can be
+    read directly as a NumPy structured array.
+*/
+struct ScheduleRecord
+{
+    /** Stimulus onset, in samples from the start of the protocol */
+    int64 onset = 0;
+
+    /** Stimulus duration, in samples */
+    int64 duration = 0;
+
+    /** ITI that follows the stimulus, in samples */
+    int64 iti = 0;
+
+    /** Sequence index within the protocol */
+    int32 sequence = 0;
+
+    /** Trial index within the sequence */
+    int32 sequenceTrial = 0;
+
+    /** Condition index within the sequence */
+    int32 condition = 0;
+
+    /** Stimulus index within the condition */
+    int32 stimulus = 0;
+
+    /** StimulusType */
+    int32 stimulusType = 0;
+
+    /** Emission site */
+    int32 site = 0;
+
+    /** Wavelength (nm) */
+    int32 wavelength = 0;
+
+    /** 1 for a catch trial, 0 otherwise */
+    int32 catchTrial = 0;
+};
+
+static_assert(sizeof(ScheduleRecord) == 56, "ScheduleRecord layout must match the NPY header");
+
+/** Statistics of one compiled sequence */
+struct SequenceSummary
+{
+    /** Number of trials (including catch trials) */
+    int64 numTrials = 0;
+
+    /** Number of catch trials */
+    int64 numCatchTrials = 0;
+
+    /** Length of the compiled sequence (baseline, stimuli and drawn ITIs), in samples */
+    int64 totalSamples = 0;
+
+    /** Expected length and its standard deviation over seeds, in samples */
+    double expectedSamples = 0;
+    double stdDevSamples = 0;
+
+    /** Longest run of trials from the same condition (or site, if the sequence limits site runs) */
+    int longestRun = 0;
+};
+
+/** Statistics of a compiled protocol */
+struct ScheduleSummary
+{
+    /** Per-sequence statistics */
+    Array<SequenceSummary> sequences;
+
+    /** Totals over every sequence (as in SequenceSummary) */
+    int64 numTrials = 0;
+    int64 numCatchTrials = 0;
+    int64 totalSamples = 0;
+    double expectedSamples = 0;
+    double stdDevSamples = 0;
+
+    /** Schedule hash (as recorded in checkpoints) */
+    uint64 hash = 0;
+
+    /** Problems that only show up in the compiled schedule */
+    StringArray warnings;
+
+    /** Converts the summary to a JSON-compatible var, with durations in seconds */
+    var toVar(double sampleRate) const;
+};
+
+/**
+    Checks, compiles and writes protocol schedules outside the plugin.
+
+    Sequences are compiled exactly as the plugin does it: small ones
+    through the ScheduleCompiler and large ones through a
+    TrialGenerator, so the written schedule is the one that will play.
+*/
+class ScheduleExport
+{
+public:
+    /** Checks a definition before compiling it. Errors are problems that
+        leave nothing sensible to play; warnings are settings the plugin
+        accepts but that are probably not what was intended. */
+    static void validate(const ProtocolDefinition& definition, StringArray& errors, StringArray& warnings);
+
+    /** Compiles every sequence and summarizes the schedule; also writes
+        it as an .npy file of ScheduleRecords unless file is File() */
+    static Result write(const ProtocolDefinition& definition,
+                        ScheduleCompiler& compiler,
+                        const File& file,
+                        ScheduleSummary& summary);
+
+    /** Size of the NPY header, in bytes */
+    static const int headerSize = 256;
+
+private:
+
+    /** Builds the NPY header for a given number of records */
+    static MemoryBlock createHeader(int64 numRecords);
+};
+
+#endif // SCHEDULEEXPORT_H_DEFINED
@@ -0,0 +1,274 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include "StimulusPreview.h"
+
+namespace
+{
+    /** Evaluates a stimulus's envelope at one sample */
+    struct EnvelopeProbe
+    {
+        EnvelopeProbe(const StimulusSpec& stimulus_)
+            : stimulus(stimulus_), kernel(StimulusRenderer::getEnvelopeKernel(stimulus_)) { }
+
+        float operator() (int64 sample) const
+        {
+            float value = 0;
+            StimulusRenderer::renderEnvelope(stimulus, sample, 1, &value, kernel);
+            return value;
+        }
+
+        /** Widens [low, high] to include a sample, if it lies in [from, to) */
+        void include(int64 sample, int64 from, int64 to, float& low, float& high) const
+        {
+            if (sample < from || sample >= to)
+                return;
+
+            const float value = (*this)(sample);
+            low = jmin(low, value);
+            high = jmax(high, value);
+        }
+
+        const StimulusSpec& stimulus;
+        const StimulusRenderer::EnvelopeKernel kernel;
+    };
+
+    /** Pulses rise to a single peak and fall again, so only their edges and peak can be extremes */
+    void summarizePulses(const EnvelopeProbe& probe, int64 from, int64 to, float& low, float& high)
+    {
+        const StimulusSpec& stimulus = probe.stimulus;
+        const int64 width = stimulus.pulseWidth;
+        const int64 peakOffset = (width - 1) / 2;
+
+        // Every pulse has the same shape, so whole pulses only need to be evaluated once
+        const float wholeHigh = probe(peakOffset);
+        const float wholeLow = jmin(probe(0), probe(width - 1));
+
+        int64 covered = 0;
+        int64 first = jmax((int64) 0, (int64) std::floor((from - width) / stimulus.pulsePeriod));
+
+        for (int64 pulse = first; pulse < stimulus.numPulses; ++pulse)
+        {
+            const int64 onset = (int64) std::llround(pulse * stimulus.pulsePeriod);
+
+            if (onset >= to)
+                break;
+
+            const int64 start = jmax(onset, from);
+            const int64 end = jmin(onset + width, to);
+
+            if (end <= start)
+                continue;
+
+            covered += end - start;
+
+            if (start == onset && end == onset + width)
+            {
+                low = jmin(low, wholeLow);
+                high = jmax(high, wholeHigh);
+            }
+            else
+            {
+                probe.include(start, from, to, low, high);
+                probe.include(end - 1, from, to, low, high);
+                probe.include(jlimit(start, end - 1, onset + peakOffset), from, to, low, high);
+            }
+        }
+
+        if (covered < to - from)
+            low = jmin(low, 0.0f);
+    }
+
+    /** Each ramp segment is monotonic, so extremes are at segment boundaries */
+    void summarizeRamp(const EnvelopeProbe& probe, int64 from, int64 to, float& low, float& high)
+    {
+        const int64 plateauStart = probe.stimulus.rampOnset;
+        const int64 offsetStart = plateauStart + probe.stimulus.rampPlateau;
+
+        probe.include(from, from, to, low, high);
+        probe.include(to - 1, from, to, low, high);
+
+        for (int64 boundary : { plateauStart - 1, plateauStart, offsetStart - 1, offsetStart })
+            probe.include(boundary, from, to, low, high);
+    }
+
+    /** Intensity is 0.5 - 0.5 cos(2 pi f n), with troughs at whole cycles and peaks halfway between */
+    void summarizeSine(const EnvelopeProbe& probe, int64 from, int64 to, float& low, float& high)
+    {
+        const double frequency = probe.stimulus.sineFrequency;
+
+        probe.include(from, from, to, low, high);
+        probe.include(to - 1, from, to, low, high);
+
+        if (frequency <= 0)
+            return;
+
+        // The first peak and trough after the bucket starts (later ones repeat them)
+        const double firstExtreme = std::ceil(2.0 * frequency * (double) from);
+
+        for (int i = 0; i < 2; ++i)
+        {
+            const double position = (firstExtreme + i) / (2.0 * frequency);
+
+            probe.include((int64) std::floor(position), from, to, low, high);
+            probe.include((int64) std::ceil(position), from, to, low, high);
+        }
+    }
+}
+
+bool StimulusPreview::update(const StimulusSpec& stimulus)
+{
+    const uint64 newHash = stimulus.getHash();
+
+    if (hasSummary && newHash == hash)
+        return false;
+
+    hash = newHash;
+    hasSummary = true;
+    numSamples = stimulus.numSamples;
+
+    levels.clearQuick();
+    levels.add(summarize(stimulus));
+
+    while (levels.getLast().size() > 1)
+    {
+        const WaveformOverview& finer = levels.getReference(levels.size() - 1);
+        WaveformOverview coarser;
+
+        for (int bucket = 0; bucket < finer.size(); bucket += 2)
+        {
+            const int next = jmin(bucket + 1, finer.size() - 1);
+            coarser.minimum.add(jmin(finer.minimum[bucket], finer.minimum[next]));
+            coarser.maximum.add(jmax(finer.maximum[bucket], finer.maximum[next]));
+        }
+
+        levels.add(coarser);
+    }
+
+    return true;
+}
+
+WaveformOverview StimulusPreview::getColumns(int numColumns) const
+{
+    WaveformOverview columns;
+
+    if (levels.size() == 0 || levels.getReference(0).size() == 0 || numColumns <= 0)
+        return columns;
+
+    // The coarsest level that still has a bucket per column
+    int level = 0;
+
+    while (level + 1 < levels.size() && levels.getReference(level + 1).size() >= numColumns)
+        ++level;
+
+    const WaveformOverview& buckets = levels.getReference(level);
+    const int size = buckets.size();
+
+    columns.minimum.resize(numColumns);
+    columns.maximum.resize(numColumns);
+
+    for (int column = 0; column < numColumns; ++column)
+    {
+        const int first = jmin(size - 1, column * size / numColumns);
+        const int last = jmax(first + 1, (column + 1) * size / numColumns);
+
+        float low = buckets.minimum[first];
+        float high = buckets.maximum[first];
+
+        for (int bucket = first + 1; bucket < last; ++bucket)
+        {
+            low = jmin(low, buckets.minimum[bucket]);
+            high = jmax(high, buckets.maximum[bucket]);
+        }
+
+        columns.minimum.set(column, low);
+        columns.maximum.set(column, high);
+    }
+
+    return columns;
+}
+
+float StimulusPreview::getMinimum() const
+{
+    return levels.size() > 0 && levels.getLast().size() > 0 ? levels.getLast().minimum[0] : 0.0f;
+}
+
+float StimulusPreview::getMaximum() const
+{
+    return levels.size() > 0 && levels.getLast().size() > 0 ? levels.getLast().maximum[0] : 0.0f;
+}
+
+size_t StimulusPreview::getMemoryUsage() const
+{
+    size_t bytes = (size_t) levels.size() * sizeof(WaveformOverview);
+
+    for (const auto& level : levels)
+        bytes += level.getMemoryUsage();
+
+    return bytes;
+}
+
+WaveformOverview StimulusPreview::summarize(const StimulusSpec& stimulus)
+{
+    if (stimulus.numSamples <= 0)
+        return WaveformOverview();
+
+    if (stimulus.type == CUSTOM)
+    {
+        // The waveform spans the whole stimulus at whatever rate it is stored
+        if (stimulus.waveform == nullptr)
+            return WaveformOverview();
+
+        const Array<float>& samples = stimulus.waveform->samples;
+        return WaveformOverview::create(samples.begin(), samples.size(), maxBuckets);
+    }
+
+    const EnvelopeProbe probe(stimulus);
+    const int numBuckets = (int) jmin((int64) maxBuckets, stimulus.numSamples);
+
+    WaveformOverview overview;
+    overview.minimum.resize(numBuckets);
+    overview.maximum.resize(numBuckets);
+
+    for (int bucket = 0; bucket < numBuckets; ++bucket)
+    {
+        const int64 from = (int64) bucket * stimulus.numSamples / numBuckets;
+        const int64 to = (int64) (bucket + 1) * stimulus.numSamples / numBuckets;
+
+        float low = 1.0f;
+        float high = 0.0f;
+
+        if (stimulus.type == PULSE_TRAIN)
+            summarizePulses(probe, from, to, low, high);
+        else if (stimulus.type == RAMP)
+            summarizeRamp(probe, from, to, low, high);
+        else
+            summarizeSine(probe, from, to, low, high);
+
+        overview.minimum.set(bucket, jmin(low, high));
+        overview.maximum.set(bucket, high);
+    }
+
+    return overview;
+}
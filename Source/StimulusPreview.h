@@ -0,0 +1,84 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef STIMULUSPREVIEW_H_DEFINED
+#define STIMULUSPREVIEW_H_DEFINED
+
+#include "StimulusRenderer.h"
+#include "WaveformFile.h"
+
+/**
+    Min/max summary of a stimulus's intensity, for thumbnails.
+
+    Pulse trains, ramps and sines are summarized from their
+    parameters: each bucket only evaluates the envelope at its edges
+    and at the extremes of the pulses or cycles inside it, so the
+    cost doesn't grow with the stimulus duration. Custom waveforms
+    are scanned once. The buckets are kept as a pyramid in which each
+    level halves the one before, so a summary for any width only
+    merges one or two buckets per column.
+
+    The summary is rebuilt only when the stimulus's hash changes.
+*/
+class StimulusPreview
+{
+public:
+    /** Constructor */
+    StimulusPreview() { }
+
+    /** Resummarizes a stimulus if it has changed since the last call; returns true if it did */
+    bool update(const StimulusSpec& stimulus);
+
+    /** Returns one bucket per column (empty if the stimulus is) */
+    WaveformOverview getColumns(int numColumns) const;
+
+    /** Duration of the summarized stimulus, in samples */
+    int64 getNumSamples() const { return numSamples; }
+
+    /** Smallest value in the stimulus */
+    float getMinimum() const;
+
+    /** Largest value in the stimulus */
+    float getMaximum() const;
+
+    /** Heap memory used by the summary, in bytes */
+    size_t getMemoryUsage() const;
+
+    /** Number of buckets in the finest level */
+    static const int maxBuckets = 2048;
+
+private:
+
+    /** Summarizes a stimulus in at most maxBuckets buckets */
+    static WaveformOverview summarize(const StimulusSpec& stimulus);
+
+    uint64 hash = 0;
+    bool hasSummary = false;
+    int64 numSamples = 0;
+
+    /** Finest level first; the last level has a single bucket */
+    Array<WaveformOverview> levels;
+};
+
+#endif // STIMULUSPREVIEW_H_DEFINED
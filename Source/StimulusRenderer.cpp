@@ -0,0 +1,394 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include "StimulusRenderer.h"
+
+namespace
+{
+    /** Shapes a linear ramp position (0 to 1) */
+    template <RampProfile Profile>
+    inline float shapeRamp(float x)
+    {
+        if constexpr (Profile == COSINE_RAMP)
+            return 0.5f - 0.5f * std::cos(MathConstants<float>::pi * x);
+        else
+            return x;
+    }
+
+    /** Length of each pulse's linear ramp, in samples */
+    int64 getPulseRamp(const StimulusSpec& stimulus)
+    {
+        return jmin(stimulus.pulseRamp, stimulus.pulseWidth / 2);
+    }
+
+    template <bool HasRamp>
+    void renderPulseTrain(const StimulusSpec& stimulus, int64 start, int numSamples, float* destination)
+    {
+        const int64 end = start + numSamples;
+        const int64 width = stimulus.pulseWidth;
+
+        // Only visit the pulses that overlap [start, end)
+        int64 first = jmax((int64) 0, (int64) std::floor((start - width) / stimulus.pulsePeriod));
+
+        for (int64 pulse = first; pulse < stimulus.numPulses; ++pulse)
+        {
+            const int64 onset = (int64) std::llround(pulse * stimulus.pulsePeriod);
+
+            if (onset >= end)
+                break;
+
+            const int64 from = jmax(onset, start);
+            const int64 to = jmin(onset + width, end);
+
+            if (to <= from)
+                continue;
+
+            float* output = destination + (from - start);
+            const int count = (int) (to - from);
+
+            if constexpr (HasRamp)
+            {
+                // Rising and falling edges are two lines; the pulse is their minimum, capped at 1
+                const float scale = 1.0f / (float) getPulseRamp(stimulus);
+                const float position = (float) (from - onset) + 0.5f;
+
+                for (int i = 0; i < count; ++i)
+                    output[i] = jmin(1.0f,
+                                     (position + (float) i) * scale,
+                                     ((float) width - position - (float) i) * scale);
+            }
+            else
+            {
+                std::fill(output, output + count, 1.0f);
+            }
+        }
+    }
+
+    template <RampProfile Profile, bool HasRamp>
+    void renderRamp(const StimulusSpec& stimulus, int64 start, int numSamples, float* destination)
+    {
+        const int64 end = start + numSamples;
+        const int64 plateauStart = stimulus.rampOnset;
+        const int64 offsetStart = plateauStart + stimulus.rampPlateau;
+
+        // Each segment gets its own loop, so no sample tests which segment it is in
+        if constexpr (HasRamp)
+        {
+            const int64 onsetEnd = jmin(end, plateauStart);
+
+            if (start < onsetEnd)
+            {
+                const float scale = 1.0f / (float) stimulus.rampOnset;
+                const float position = (float) start + 0.5f;
+                const int count = (int) (onsetEnd - start);
+
+                for (int i = 0; i < count; ++i)
+                    destination[i] = shapeRamp<Profile>((position + (float) i) * scale);
+            }
+        }
+
+        const int64 plateauFrom = jmax(start, plateauStart);
+        const int64 plateauTo = jmin(end, offsetStart);
+
+        if (plateauFrom < plateauTo)
+            std::fill(destination + (plateauFrom - start), destination + (plateauTo - start), 1.0f);
+
+        if constexpr (HasRamp)
+        {
+            const int64 offsetFrom = jmax(start, offsetStart);
+
+            if (offsetFrom < end)
+            {
+                const float scale = 1.0f / (float) stimulus.rampOffset;
+                const float remaining = (float) (stimulus.rampOffset - (offsetFrom - offsetStart)) - 0.5f;
+                const int count = (int) (end - offsetFrom);
+                float* output = destination + (offsetFrom - start);
+
+                for (int i = 0; i < count; ++i)
+                    output[i] = shapeRamp<Profile>((remaining - (float) i) * scale);
+            }
+        }
+    }
+
+    void renderSine(const StimulusSpec& stimulus, int64 start, int numSamples, float* destination)
+    {
+        // Intensity starts at zero and follows a raised cosine. Instead of a cos() per
+        // sample, a unit phasor per lane is rotated by a fixed step; the lanes are
+        // interleaved so the rotation vectorizes. Every chunk is re-seeded from the
+        // absolute phase, which bounds rounding drift and makes the output independent
+        // of where blocks start.
+        constexpr int numLanes = 8;
+        constexpr int chunkSize = 512;
+
+        const double frequency = stimulus.sineFrequency;
+        const double stepCos = std::cos(MathConstants<double>::twoPi * frequency * numLanes);
+        const double stepSin = std::sin(MathConstants<double>::twoPi * frequency * numLanes);
+
+        for (int offset = 0; offset < numSamples; offset += chunkSize)
+        {
+            const int count = jmin(chunkSize, numSamples - offset);
+            double re[numLanes], im[numLanes];
+
+            for (int lane = 0; lane < numLanes; ++lane)
+            {
+                // Wrapping the number of cycles first keeps the phase exact for long stimuli
+                const double cycles = frequency * (double) (start + offset + lane);
+                const double phase = MathConstants<double>::twoPi * (cycles - std::floor(cycles));
+
+                re[lane] = std::cos(phase);
+                im[lane] = std::sin(phase);
+            }
+
+            float* output = destination + offset;
+            const int numFullSteps = count / numLanes;
+
+            for (int step = 0; step < numFullSteps; ++step)
+            {
+                for (int lane = 0; lane < numLanes; ++lane)
+                {
+                    output[step * numLanes + lane] = (float) (0.5 - 0.5 * re[lane]);
+
+                    const double rotated = re[lane] * stepCos - im[lane] * stepSin;
+                    im[lane] = re[lane] * stepSin + im[lane] * stepCos;
+                    re[lane] = rotated;
+                }
+            }
+
+            for (int lane = 0; lane < count - numFullSteps * numLanes; ++lane)
+                output[numFullSteps * numLanes + lane] = (float) (0.5 - 0.5 * re[lane]);
+        }
+    }
+
+    void renderCustom(const StimulusSpec& stimulus, int64 start, int numSamples, float* destination)
+    {
+        if (stimulus.waveform == nullptr)
+            return;
+
+        const float* samples = stimulus.waveform->samples.begin();
+        const int numWaveformSamples = stimulus.waveform->samples.size();
+
+        // Long waveforms are resampled as they play
+        if (stimulus.waveform->resampler != nullptr)
+        {
+            stimulus.waveform->resampler->process(samples, numWaveformSamples, start, numSamples, destination);
+            return;
+        }
+
+        // Short ones were resampled to the output rate up front
+        if (numWaveformSamples == stimulus.numSamples)
+        {
+            std::copy(samples + start, samples + start + numSamples, destination);
+            return;
+        }
+
+        const double step = (double) numWaveformSamples / (double) jmax((int64) 1, stimulus.numSamples);
+
+        // Otherwise, linear interpolation between waveform samples
+        for (int i = 0; i < numSamples; ++i)
+        {
+            const double position = (start + i) * step;
+            const int index = (int) position;
+
+            if (index >= numWaveformSamples)
+                break;
+
+            const float next = index + 1 < numWaveformSamples ? samples[index + 1] : samples[index];
+            destination[i] = samples[index] + (float) (position - index) * (next - samples[index]);
+        }
+    }
+
+    /** One envelope kernel per (type, profile, ramp) combination */
+    template <StimulusType Type, RampProfile Profile, bool HasRamp>
+    void renderKernel(const StimulusSpec& stimulus, int64 start, int numSamples, float* destination)
+    {
+        if constexpr (Type == PULSE_TRAIN)
+            renderPulseTrain<HasRamp>(stimulus, start, numSamples, destination);
+        else if constexpr (Type == RAMP)
+            renderRamp<Profile, HasRamp>(stimulus, start, numSamples, destination);
+        else if constexpr (Type == SINUSOID)
+            renderSine(stimulus, start, numSamples, destination);
+        else
+            renderCustom(stimulus, start, numSamples, destination);
+    }
+
+    /** Indexed by [StimulusType][RampProfile][has ramp] */
+    const StimulusRenderer::EnvelopeKernel envelopeKernels[4][2][2] =
+    {
+        { { renderKernel<PULSE_TRAIN, LINEAR_RAMP, false>, renderKernel<PULSE_TRAIN, LINEAR_RAMP, true> },
+          { renderKernel<PULSE_TRAIN, COSINE_RAMP, false>, renderKernel<PULSE_TRAIN, COSINE_RAMP, true> } },
+        { { renderKernel<SINUSOID, LINEAR_RAMP, false>, renderKernel<SINUSOID, LINEAR_RAMP, true> },
+          { renderKernel<SINUSOID, COSINE_RAMP, false>, renderKernel<SINUSOID, COSINE_RAMP, true> } },
+        { { renderKernel<RAMP, LINEAR_RAMP, false>, renderKernel<RAMP, LINEAR_RAMP, true> },
+          { renderKernel<RAMP, COSINE_RAMP, false>, renderKernel<RAMP, COSINE_RAMP, true> } },
+        { { renderKernel<CUSTOM, LINEAR_RAMP, false>, renderKernel<CUSTOM, LINEAR_RAMP, true> },
+          { renderKernel<CUSTOM, COSINE_RAMP, false>, renderKernel<CUSTOM, COSINE_RAMP, true> } }
+    };
+}
+
+StimulusRenderer::StimulusRenderer(const SourceDescription& source_,
+                                   int maxBlockSize_,
+                                   const CalibrationTable* calibration_)
+    : source(source_),
+      numChannels(source_.getNumChannels()),
+      maxBlockSize(jmax(1, maxBlockSize_)),
+      envelope((size_t) maxBlockSize),
+      writeKernel(getWriteKernel(numChannels)),
+      calibration(calibration_)
+{
+    if (calibration == nullptr)
+    {
+        linearCalibration = std::make_unique<CalibrationTable>(source);
+        calibration = linearCalibration.get();
+    }
+}
+
+void StimulusRenderer::setTemplateCache(StimulusTemplateCache* cache, double sampleRate)
+{
+    templateCache = cache;
+    templateSampleRate = sampleRate;
+}
+
+void StimulusRenderer::clear(float* block, int numFrames) const
+{
+    std::fill(block, block + numFrames * numChannels, 0.0f);
+}
+
+StimulusRenderer::EnvelopeKernel StimulusRenderer::getEnvelopeKernel(const StimulusSpec& stimulus)
+{
+    jassert(isPositiveAndBelow((int) stimulus.type, 4));
+
+    bool hasRamp = false;
+
+    if (stimulus.type == PULSE_TRAIN)
+        hasRamp = getPulseRamp(stimulus) > 0;
+    else if (stimulus.type == RAMP)
+        hasRamp = stimulus.rampOnset > 0 || stimulus.rampOffset > 0;
+
+    return envelopeKernels[stimulus.type][stimulus.rampProfile == COSINE_RAMP ? 1 : 0][hasRamp ? 1 : 0];
+}
+
+void StimulusRenderer::renderEnvelope(const StimulusSpec& stimulus,
+                                      int64 startSample,
+                                      int numSamples,
+                                      float* destination,
+                                      EnvelopeKernel kernel)
+{
+    std::fill(destination, destination + numSamples, 0.0f);
+
+    // Nothing is rendered outside the stimulus
+    const int64 start = jmax((int64) 0, startSample);
+    const int64 end = jmin(stimulus.numSamples, startSample + numSamples);
+
+    if (end <= start)
+        return;
+
+    if (kernel == nullptr)
+        kernel = getEnvelopeKernel(stimulus);
+
+    kernel(stimulus, start, (int) (end - start), destination + (start - startSample));
+}
+
+void StimulusRenderer::render(const StimulusSpec& stimulus,
+                              int64 startSample,
+                              int numFrames,
+                              int channel,
+                              float power,
+                              float* block)
+{
+    jassert(isPositiveAndBelow(channel, numChannels));
+
+    // The channel is left untouched outside the stimulus
+    const int first = (int) jlimit((int64) 0, (int64) numFrames, -startSample);
+    const int last = (int) jlimit((int64) 0, (int64) numFrames, stimulus.numSamples - startSample);
+
+    const EnvelopeKernel kernel = getEnvelopeKernel(stimulus);
+
+    for (int offset = first; offset < last; offset += maxBlockSize)
+    {
+        const int count = jmin(maxBlockSize, last - offset);
+
+        renderDrive(stimulus, startSample + offset, count, channel, power, envelope.get(), kernel);
+        writeKernel(envelope.get(), 1.0f, count, channel, numChannels, block + offset * numChannels);
+    }
+}
+
+void StimulusRenderer::renderDrive(const StimulusSpec& stimulus,
+                                   int64 startSample,
+                                   int numSamples,
+                                   int channel,
+                                   float power,
+                                   float* destination,
+                                   EnvelopeKernel kernel)
+{
+    jassert(startSample >= 0 && startSample + numSamples <= stimulus.numSamples);
+
+    StimulusTemplate::Ptr cached;
+
+    if (templateCache != nullptr)
+        cached = templateCache->getTemplate(stimulus, templateSampleRate);
+
+    if (cached != nullptr)
+    {
+        calibration->apply(cached->getSamples() + startSample, power, destination, numSamples, channel);
+        return;
+    }
+
+    renderEnvelope(stimulus, startSample, numSamples, destination, kernel);
+    calibration->apply(destination, power, destination, numSamples, channel);
+}
+
+template <int NumChannels>
+void StimulusRenderer::writeChannel(const float* source, float gain, int numFrames,
+                                    int channel, int, float* block)
+{
+    float* output = block + channel;
+
+    for (int i = 0; i < numFrames; ++i)
+        output[i * NumChannels] += source[i] * gain;
+}
+
+void StimulusRenderer::writeChannelGeneric(const float* source, float gain, int numFrames,
+                                           int channel, int numChannels, float* block)
+{
+    float* output = block + channel;
+
+    for (int i = 0; i < numFrames; ++i)
+        output[i * numChannels] += source[i] * gain;
+}
+
+StimulusRenderer::WriteKernel StimulusRenderer::getWriteKernel(int numChannels)
+{
+    switch (numChannels)
+    {
+        case 1:  return writeChannel<1>;
+        case 2:  return writeChannel<2>;
+        case 4:  return writeChannel<4>;
+        case 8:  return writeChannel<8>;
+        case 14: return writeChannel<14>;
+        case 16: return writeChannel<16>;
+        case 28: return writeChannel<28>;
+        case 32: return writeChannel<32>;
+        default: return writeChannelGeneric;
+    }
+}
@@ -0,0 +1,143 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef STIMULUSRENDERER_H_DEFINED
+#define STIMULUSRENDERER_H_DEFINED
+
+#include "PowerCalibration.h"
+#include "StimulusTemplateCache.h"
+
+/**
+    Renders stimuli into interleaved output blocks for one source.
+
+    The block layout comes from the source's description: one
+    channel per site and wavelength, with the channel for a site and
+    wavelength given by SourceDescription::getChannel(). The kernel
+    that writes a channel is picked once, when the renderer is
+    created, from versions specialized for common channel counts,
+    so the stride is a compile-time constant in the inner loop.
+    Envelopes are rendered the same way: there is one kernel for each
+    combination of stimulus type, ramp profile and ramp presence,
+    looked up once per stimulus, so the per-sample loops have no
+    branches on parameters that are fixed for the whole stimulus.
+
+    Rendered power is converted to drive levels through the source's
+    CalibrationTable before it is written. With a template cache,
+    each distinct stimulus is synthesized once and later trials only
+    copy its template through the calibration table.
+*/
+class StimulusRenderer
+{
+public:
+    /** Renders samples [start, start + numSamples) of an envelope, all within the stimulus */
+    using EnvelopeKernel = void (*)(const StimulusSpec& stimulus, int64 start, int numSamples, float* destination);
+
+    /** Constructor (uses a linear calibration if none is given) */
+    StimulusRenderer(const SourceDescription& source,
+                     int maxBlockSize,
+                     const CalibrationTable* calibration = nullptr);
+
+    /** Destructor */
+    ~StimulusRenderer() { }
+
+    /** Returns the number of interleaved channels */
+    int getNumChannels() const { return numChannels; }
+
+    /** Returns the source this renderer writes for */
+    const SourceDescription& getSource() const { return source; }
+
+    /** Uses a cache of rendered templates (may be nullptr) */
+    void setTemplateCache(StimulusTemplateCache* cache, double sampleRate);
+
+    /** Clears an interleaved block */
+    void clear(float* block, int numFrames) const;
+
+    /** Adds samples [startSample, startSample + numFrames) of a stimulus
+        at a given power (uW) to one channel of an interleaved block */
+    void render(const StimulusSpec& stimulus,
+                int64 startSample,
+                int numFrames,
+                int channel,
+                float power,
+                float* block);
+
+    /** Renders samples [startSample, startSample + numSamples) of a
+        stimulus as calibrated drive levels into a mono buffer
+        (the range must lie within the stimulus) */
+    void renderDrive(const StimulusSpec& stimulus,
+                     int64 startSample,
+                     int numSamples,
+                     int channel,
+                     float power,
+                     float* destination,
+                     EnvelopeKernel kernel = nullptr);
+
+    /** Renders samples [startSample, startSample + numSamples) of a
+        stimulus's envelope (0 to 1) into a mono buffer */
+    static void renderEnvelope(const StimulusSpec& stimulus,
+                               int64 startSample,
+                               int numSamples,
+                               float* destination,
+                               EnvelopeKernel kernel = nullptr);
+
+    /** Returns the envelope kernel for a stimulus (can be kept for the whole trial) */
+    static EnvelopeKernel getEnvelopeKernel(const StimulusSpec& stimulus);
+
+private:
+
+    /** Adds a scaled mono buffer to one channel of an interleaved block */
+    using WriteKernel = void (*)(const float* source, float gain, int numFrames,
+                                 int channel, int numChannels, float* block);
+
+    /** Returns the kernel for a channel count */
+    static WriteKernel getWriteKernel(int numChannels);
+
+    template <int NumChannels>
+    static void writeChannel(const float* source, float gain, int numFrames,
+                             int channel, int numChannels, float* block);
+
+    static void writeChannelGeneric(const float* source, float gain, int numFrames,
+                                    int channel, int numChannels, float* block);
+
+    SourceDescription source;
+    int numChannels;
+    int maxBlockSize;
+
+    /** Envelope scratch buffer (maxBlockSize samples) */
+    HeapBlock<float> envelope;
+
+    WriteKernel writeKernel;
+
+    /** Used when no calibration is given */
+    std::unique_ptr<CalibrationTable> linearCalibration;
+
+    const CalibrationTable* calibration;
+
+    StimulusTemplateCache* templateCache = nullptr;
+    double templateSampleRate = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(StimulusRenderer);
+};
+
+#endif // STIMULUSRENDERER_H_DEFINED
@@ -0,0 +1,131 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include "StimulusTemplateCache.h"
+#include "StimulusRenderer.h"
+
+StimulusTemplate::StimulusTemplate(const StimulusSpec& stimulus, uint64 key_)
+    : key(key_),
+      numSamples((int) stimulus.numSamples),
+      samples((size_t) jmax(1, numSamples))
+{
+    StimulusRenderer::renderEnvelope(stimulus, 0, numSamples, samples.get());
+}
+
+StimulusTemplateCache::StimulusTemplateCache(size_t memoryLimitBytes)
+    : memoryLimit(memoryLimitBytes)
+{
+}
+
+uint64 StimulusTemplateCache::getKey(const StimulusSpec& stimulus, double sampleRate)
+{
+    uint64 sampleRateBits;
+    std::memcpy(&sampleRateBits, &sampleRate, sizeof(sampleRateBits));
+
+    return ScheduleCompiler::hashCombine(stimulus.getHash(), sampleRateBits);
+}
+
+StimulusTemplate::Ptr StimulusTemplateCache::getTemplate(const StimulusSpec& stimulus, double sampleRate)
+{
+    // A single template may use at most a quarter of the cache
+    if (stimulus.numSamples <= 0
+        || stimulus.numSamples > maxTemplateSamples
+        || (size_t) stimulus.numSamples * sizeof(float) > memoryLimit / 4)
+        return nullptr;
+
+    const uint64 key = getKey(stimulus, sampleRate);
+
+    {
+        const ScopedLock sl(lock);
+        auto found = index.find(key);
+
+        if (found != index.end())
+        {
+            recentlyUsed.splice(recentlyUsed.begin(), recentlyUsed, found->second);
+            numHits.fetch_add(1, std::memory_order_relaxed);
+
+            return recentlyUsed.front();
+        }
+    }
+
+    // Render without holding the lock; if another thread renders the
+    // same stimulus at the same time, the first one to finish is kept
+    StimulusTemplate::Ptr rendered = new StimulusTemplate(stimulus, key);
+    numMisses.fetch_add(1, std::memory_order_relaxed);
+
+    const ScopedLock sl(lock);
+    auto found = index.find(key);
+
+    if (found != index.end())
+        return *found->second;
+
+    recentlyUsed.push_front(rendered);
+    index[key] = recentlyUsed.begin();
+    memoryUsage += rendered->getSizeInBytes();
+
+    evict();
+
+    return rendered;
+}
+
+void StimulusTemplateCache::evict()
+{
+    while (memoryUsage > memoryLimit && !recentlyUsed.empty())
+    {
+        StimulusTemplate::Ptr oldest = recentlyUsed.back();
+
+        memoryUsage -= oldest->getSizeInBytes();
+        index.erase(oldest->key);
+        recentlyUsed.pop_back();
+    }
+}
+
+void StimulusTemplateCache::setMemoryLimit(size_t memoryLimitBytes)
+{
+    const ScopedLock sl(lock);
+
+    memoryLimit = memoryLimitBytes;
+    evict();
+}
+
+void StimulusTemplateCache::clear()
+{
+    const ScopedLock sl(lock);
+
+    recentlyUsed.clear();
+    index.clear();
+    memoryUsage = 0;
+}
+
+size_t StimulusTemplateCache::getMemoryUsage() const
+{
+    const ScopedLock sl(lock);
+    return memoryUsage;
+}
+
+int StimulusTemplateCache::getNumTemplates() const
+{
+    const ScopedLock sl(lock);
+    return (int) index.size();
+}
@@ -0,0 +1,136 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef STIMULUSTEMPLATECACHE_H_DEFINED
+#define STIMULUSTEMPLATECACHE_H_DEFINED
+
+#include "ScheduleCompiler.h"
+
+#include <list>
+#include <unordered_map>
+
+/** A stimulus envelope (0 to 1), rendered once for its whole duration */
+class StimulusTemplate : public ReferenceCountedObject
+{
+public:
+    /** Constructor (renders the stimulus) */
+    StimulusTemplate(const StimulusSpec& stimulus, uint64 key);
+
+    /** Cache key */
+    const uint64 key;
+
+    /** Number of samples */
+    const int numSamples;
+
+    /** Returns the rendered samples */
+    const float* getSamples() const { return samples.get(); }
+
+    /** Memory used by the samples, in bytes */
+    size_t getSizeInBytes() const { return (size_t) numSamples * sizeof(float); }
+
+    using Ptr = ReferenceCountedObjectPtr<StimulusTemplate>;
+
+private:
+    HeapBlock<float> samples;
+};
+
+/**
+    Rendered stimulus envelopes, keyed by a hash of the stimulus's
+    type, parameters and sample rate.
+
+    Stimuli that are repeated across trials, sites and wavelengths
+    are rendered once; playing them back is a copy through the
+    calibration table. The least recently used templates are evicted
+    once the memory limit is exceeded. Templates are reference
+    counted, so an evicted template stays valid for as long as a
+    renderer is still holding it.
+
+    Safe to use from several threads.
+*/
+class StimulusTemplateCache
+{
+public:
+    /** Constructor */
+    StimulusTemplateCache(size_t memoryLimitBytes = defaultMemoryLimit);
+
+    /** Destructor */
+    ~StimulusTemplateCache() { }
+
+    /** Returns the template for a stimulus, rendering it if necessary
+        (nullptr if the stimulus is longer than maxTemplateSamples or
+        would use more than a quarter of the cache) */
+    StimulusTemplate::Ptr getTemplate(const StimulusSpec& stimulus, double sampleRate);
+
+    /** Returns the key for a stimulus at a sample rate */
+    static uint64 getKey(const StimulusSpec& stimulus, double sampleRate);
+
+    /** Sets the memory limit, evicting templates if necessary */
+    void setMemoryLimit(size_t memoryLimitBytes);
+
+    /** Removes every template */
+    void clear();
+
+    /** Memory used by cached templates, in bytes */
+    size_t getMemoryUsage() const;
+
+    /** Number of cached templates */
+    int getNumTemplates() const;
+
+    /** Lookups that found a cached template */
+    int64 getNumHits() const { return numHits.load(std::memory_order_relaxed); }
+
+    /** Lookups that had to render */
+    int64 getNumMisses() const { return numMisses.load(std::memory_order_relaxed); }
+
+    /** Default memory limit (256 MB) */
+    static const size_t defaultMemoryLimit = 256 * 1024 * 1024;
+
+    /** Longest stimulus that is cached (about 9 s at 30 kHz). A miss renders
+        the whole template on the caller's thread, so longer stimuli are
+        rendered block by block as they are played instead. */
+    static const int64 maxTemplateSamples = 1 << 18;
+
+private:
+
+    /** Evicts least recently used templates until usage fits the limit */
+    void evict();
+
+    /** Most recently used first */
+    std::list<StimulusTemplate::Ptr> recentlyUsed;
+
+    /** Key -> position in recentlyUsed */
+    std::unordered_map<uint64, std::list<StimulusTemplate::Ptr>::iterator> index;
+
+    size_t memoryLimit;
+    size_t memoryUsage = 0;
+
+    std::atomic<int64> numHits { 0 };
+    std::atomic<int64> numMisses { 0 };
+
+    CriticalSection lock;
+
+    JUCE_DECLARE_NON_COPYABLE(StimulusTemplateCache);
+};
+
+#endif // STIMULUSTEMPLATECACHE_H_DEFINED
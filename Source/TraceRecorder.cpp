@@ -0,0 +1,301 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "TraceRecorder.h"
+
+std::atomic<bool> TraceRecorder::enabled { false };
+
+namespace
+{
+    /** One thread's ring of spans */
+    struct ThreadBuffer
+    {
+        explicit ThreadBuffer(int index_)
+            : index(index_),
+              events((size_t) TraceRecorder::eventsPerThread)
+        {
+        }
+
+        /** Thread number in the trace */
+        const int index;
+
+        HeapBlock<TraceEvent> events;
+
+        /** Spans written in the current session (written by the owner only) */
+        std::atomic<uint64> numWritten { 0 };
+
+        /** Session the spans belong to */
+        std::atomic<uint32> session { 0 };
+
+        /** True while a thread owns the buffer */
+        std::atomic<bool> claimed { false };
+
+        /** Set by TraceRecorder::setThreadName() (a string literal) */
+        std::atomic<const char*> givenName { nullptr };
+
+        /** The juce::Thread's name when the buffer was claimed, copied so that
+            claiming frees nothing (guarded by the state's lock) */
+        char threadName[64] = {};
+    };
+
+    /** Everything shared between threads */
+    struct TraceState
+    {
+        CriticalSection lock;
+        OwnedArray<ThreadBuffer> buffers;
+
+        /** Incremented by every start() */
+        std::atomic<uint32> session { 0 };
+
+        /** Time of the last start(), which the exported timestamps count from */
+        int64 startNanos = 0;
+
+        /** Spans dropped in the current session */
+        std::atomic<int64> numDropped { 0 };
+    };
+
+    /** Never destroyed, so threads that exit during shutdown can still release their buffers */
+    TraceState& getState()
+    {
+        static TraceState* state = new TraceState();
+        return *state;
+    }
+
+    /** Buffers kept free for threads that start recording during a session */
+    const int numSpareBuffers = 4;
+
+    /** The calling thread's buffer, given back when the thread exits */
+    struct ThreadHandle
+    {
+        ThreadBuffer* buffer = nullptr;
+        const char* name = nullptr;
+
+        ~ThreadHandle()
+        {
+            if (buffer != nullptr)
+                buffer->claimed.store(false, std::memory_order_release);
+        }
+    };
+
+    thread_local ThreadHandle threadHandle;
+
+    /** Returns the name a thread is shown with */
+    String getThreadName(const ThreadBuffer& buffer)
+    {
+        if (const char* name = buffer.givenName.load(std::memory_order_acquire))
+            return name;
+
+        if (buffer.threadName[0] != 0)
+            return String::fromUTF8(buffer.threadName);
+
+        return "Thread " + String(buffer.index);
+    }
+
+    /** Whether a buffer can be given to a thread without losing spans of the current session */
+    bool isFree(const ThreadBuffer& buffer, uint32 session)
+    {
+        return !buffer.claimed.load(std::memory_order_acquire)
+               && buffer.session.load(std::memory_order_acquire) != session;
+    }
+
+    /** Gives the calling thread a free buffer; returns nullptr, without
+        waiting or allocating, if the lock is busy or none is free */
+    ThreadBuffer* claimBuffer(ThreadHandle& handle)
+    {
+        TraceState& state = getState();
+        const ScopedTryLock lock(state.lock);
+
+        if (!lock.isLocked())
+            return nullptr;
+
+        const uint32 session = state.session.load(std::memory_order_acquire);
+
+        for (auto* buffer : state.buffers)
+        {
+            if (isFree(*buffer, session))
+            {
+                buffer->claimed.store(true, std::memory_order_relaxed);
+                buffer->givenName.store(handle.name, std::memory_order_release);
+                buffer->threadName[0] = 0;
+
+                if (auto* thread = Thread::getCurrentThread())
+                    thread->getThreadName().copyToUTF8(buffer->threadName, sizeof(buffer->threadName));
+
+                return buffer;
+            }
+        }
+
+        return nullptr;
+    }
+}
+
+void TraceRecorder::start()
+{
+    TraceState& state = getState();
+    const ScopedLock lock(state.lock);
+
+    const uint32 session = state.session.fetch_add(1, std::memory_order_acq_rel) + 1;
+    state.startNanos = MetricHistogram::getTimeNanos();
+    state.numDropped.store(0, std::memory_order_relaxed);
+
+    // Buffers are only allocated here, so threads that start recording
+    // during the session (such as the audio thread) find one ready
+    int numFree = 0;
+
+    for (auto* buffer : state.buffers)
+    {
+        if (isFree(*buffer, session))
+            numFree++;
+    }
+
+    for (; numFree < numSpareBuffers; ++numFree)
+        state.buffers.add(new ThreadBuffer(state.buffers.size() + 1));
+
+    enabled.store(true, std::memory_order_release);
+}
+
+void TraceRecorder::stop()
+{
+    enabled.store(false, std::memory_order_release);
+}
+
+void TraceRecorder::record(const char* category, const char* name,
+                           int64 startNanos, int64 endNanos, int64 argument) noexcept
+{
+    if (!isEnabled())
+        return;
+
+    ThreadHandle& handle = threadHandle;
+
+    if (handle.buffer == nullptr)
+    {
+        handle.buffer = claimBuffer(handle);
+
+        if (handle.buffer == nullptr)
+        {
+            getState().numDropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+
+    ThreadBuffer& buffer = *handle.buffer;
+    const uint32 session = getState().session.load(std::memory_order_acquire);
+
+    // The first span of a session discards the thread's spans from earlier ones
+    if (buffer.session.load(std::memory_order_relaxed) != session)
+    {
+        buffer.numWritten.store(0, std::memory_order_relaxed);
+        buffer.session.store(session, std::memory_order_release);
+    }
+
+    const uint64 index = buffer.numWritten.load(std::memory_order_relaxed);
+
+    buffer.events[index & (uint64) (eventsPerThread - 1)] = { category, name, startNanos, endNanos - startNanos, argument };
+    buffer.numWritten.store(index + 1, std::memory_order_release);
+}
+
+void TraceRecorder::setThreadName(const char* name) noexcept
+{
+    ThreadHandle& handle = threadHandle;
+    handle.name = name;
+
+    if (handle.buffer != nullptr)
+        handle.buffer->givenName.store(name, std::memory_order_release);
+}
+
+int64 TraceRecorder::getNumDroppedEvents() noexcept
+{
+    return getState().numDropped.load(std::memory_order_relaxed);
+}
+
+int64 TraceRecorder::getNumEvents()
+{
+    TraceState& state = getState();
+    const ScopedLock lock(state.lock);
+
+    const uint32 session = state.session.load(std::memory_order_acquire);
+    int64 numEvents = 0;
+
+    for (auto* buffer : state.buffers)
+    {
+        if (buffer->session.load(std::memory_order_acquire) == session)
+            numEvents += (int64) buffer->numWritten.load(std::memory_order_acquire);
+    }
+
+    return numEvents;
+}
+
+Result TraceRecorder::writeJson(const File& file)
+{
+    static_assert((eventsPerThread & (eventsPerThread - 1)) == 0, "Ring indices are masked");
+
+    file.deleteFile();
+    FileOutputStream stream(file, 1 << 20);
+
+    if (stream.failedToOpen())
+        return Result::fail("Could not create " + file.getFullPathName() + ": " + stream.getStatus().getErrorMessage());
+
+    TraceState& state = getState();
+    const ScopedLock lock(state.lock);
+
+    const uint32 session = state.session.load(std::memory_order_acquire);
+
+    stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+           << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"Opto Protocol Generator\"}}";
+
+    for (auto* buffer : state.buffers)
+    {
+        if (buffer->session.load(std::memory_order_acquire) != session)
+            continue;
+
+        const uint64 numWritten = buffer->numWritten.load(std::memory_order_acquire);
+        const uint64 first = numWritten > (uint64) eventsPerThread ? numWritten - (uint64) eventsPerThread : 0;
+        const String tid = String(buffer->index);
+
+        stream << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid
+               << ",\"args\":{\"name\":" << JSON::toString(var(getThreadName(*buffer))) << "}}";
+
+        for (uint64 i = first; i < numWritten; ++i)
+        {
+            const TraceEvent& event = buffer->events[i & (uint64) (eventsPerThread - 1)];
+
+            stream << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"" << event.category
+                   << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+                   << ",\"ts\":" << String((double) (event.startNanos - state.startNanos) / 1000.0, 3)
+                   << ",\"dur\":" << String((double) event.durationNanos / 1000.0, 3);
+
+            if (event.argument >= 0)
+                stream << ",\"args\":{\"value\":" << String(event.argument) << "}";
+
+            stream << "}";
+        }
+    }
+
+    stream << "\n]}\n";
+    stream.flush();
+
+    if (stream.getStatus().failed())
+        return Result::fail("Could not write " + file.getFullPathName() + ": " + stream.getStatus().getErrorMessage());
+
+    return Result::ok();
+}
@@ -0,0 +1,134 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef TRACERECORDER_H_DEFINED
+#define TRACERECORDER_H_DEFINED
+
+#include "RuntimeMetrics.h"
+
+/** A span of work on one thread */
+struct TraceEvent
+{
+    /** Category and name (string literals, so nothing is copied) */
+    const char* category;
+    const char* name;
+
+    /** Start time and duration (ns, see MetricHistogram::getTimeNanos()) */
+    int64 startNanos;
+    int64 durationNanos;
+
+    /** Shown with the span (e.g. a trial number); -1 for none */
+    int64 argument;
+};
+
+/**
+    Records spans of work on every thread while tracing is enabled,
+    and exports them in the Chrome Trace Event format, which Perfetto
+    (ui.perfetto.dev) and chrome://tracing can open.
+
+    Each thread writes to a ring of its own that it claims the first
+    time it records a span, so recording takes no locks. Rings are
+    only allocated by start(); claiming one never waits or allocates,
+    so the audio thread can record too. If no ring is free, or another
+    thread holds the recorder's lock, the span is dropped and the next
+    one tries again. The ring keeps the latest eventsPerThread spans
+    of the thread. A thread that exits gives its ring back once its
+    spans are no longer part of the current trace, so threads that
+    come and go don't add up.
+
+    While tracing is disabled, a TraceScope costs one relaxed atomic
+    load. Tracing is process-wide, and the recorder is a set of
+    static functions so that any thread can record without being
+    handed a pointer.
+*/
+class TraceRecorder
+{
+public:
+    /** Discards the previous trace and starts recording */
+    static void start();
+
+    /** Stops recording (the trace is kept until the next start()) */
+    static void stop();
+
+    /** Whether spans are being recorded */
+    static bool isEnabled() noexcept { return enabled.load(std::memory_order_relaxed); }
+
+    /** Records a span on the calling thread */
+    static void record(const char* category, const char* name,
+                       int64 startNanos, int64 endNanos, int64 argument = -1) noexcept;
+
+    /** Names the calling thread in the trace with a string literal (threads
+        are otherwise named after their juce::Thread, or numbered); safe to
+        call from the audio thread */
+    static void setThreadName(const char* name) noexcept;
+
+    /** Returns the number of spans in the current trace, including overwritten ones */
+    static int64 getNumEvents();
+
+    /** Returns the number of spans dropped because their thread had no ring */
+    static int64 getNumDroppedEvents() noexcept;
+
+    /** Writes the current trace as Chrome Trace Event JSON (best after stop()) */
+    static Result writeJson(const File& file);
+
+    /** Spans kept for each thread (a power of two) */
+    static const int eventsPerThread = 32768;
+
+private:
+    static std::atomic<bool> enabled;
+};
+
+/**
+    Records the time from construction to destruction as a span,
+    if tracing was enabled when it was constructed.
+*/
+class TraceScope
+{
+public:
+    /** Starts the span; category and name must be string literals */
+    TraceScope(const char* category_, const char* name_, int64 argument_ = -1) noexcept
+        : category(category_),
+          name(name_),
+          argument(argument_),
+          startNanos(TraceRecorder::isEnabled() ? MetricHistogram::getTimeNanos() : -1)
+    {
+    }
+
+    /** Ends the span */
+    ~TraceScope()
+    {
+        if (startNanos >= 0)
+            TraceRecorder::record(category, name, startNanos, MetricHistogram::getTimeNanos(), argument);
+    }
+
+private:
+    const char* const category;
+    const char* const name;
+    const int64 argument;
+    const int64 startNanos;
+
+    JUCE_DECLARE_NON_COPYABLE(TraceScope);
+};
+
+#endif // TRACERECORDER_H_DEFINED
@@ -0,0 +1,383 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "TrialEventRing.h"
+
+#include <thread>
+
+#if !JUCE_WINDOWS
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    /** Returns the size of a ring with the given number of slots */
+    size_t getRingSize(uint64 capacity)
+    {
+        return sizeof(TrialEventRingHeader) + (size_t) capacity * sizeof(TrialEventSlot);
+    }
+
+    /** Whether a header describes a ring this code can use */
+    bool isCompatible(const TrialEventRingHeader& header)
+    {
+        return header.magic == TrialEventRing::magic
+            && header.version == TrialEventRing::version
+            && header.slotSize == sizeof(TrialEventSlot)
+            && header.capacity > 0
+            && isPowerOfTwo(header.capacity);
+    }
+
+    /** Whether a process is still running */
+    bool isProcessAlive(uint32 pid)
+    {
+        return pid != 0 && (::kill((pid_t) pid, 0) == 0 || errno == EPERM);
+    }
+
+    /** Rings this process writes to, so a second writer in the same process can be refused */
+    struct OpenRings
+    {
+        CriticalSection lock;
+        StringArray names;
+    };
+
+    OpenRings& getOpenRings()
+    {
+        static OpenRings openRings;
+        return openRings;
+    }
+
+    /** Returns a failure describing errno */
+    Result failWithErrno(const String& what, const String& name)
+    {
+        return Result::fail(what + " " + name + ": " + String(std::strerror(errno)));
+    }
+}
+#endif
+
+int64 TrialEventRing::getTimeNanos()
+{
+#if JUCE_WINDOWS
+    const int64 ticks = Time::getHighResolutionTicks();
+    return (int64) ((double) ticks * 1.0e9 / (double) Time::getHighResolutionTicksPerSecond());
+#else
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64) now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+Result TrialEventRing::open(const String& name, int capacity)
+{
+    close();
+
+#if JUCE_WINDOWS
+    ignoreUnused(name, capacity);
+    return Result::fail("The trial event ring is not supported on Windows");
+#else
+    const uint64 numSlots = (uint64) nextPowerOfTwo(jmax(2, capacity));
+    const size_t size = getRingSize(numSlots);
+
+    // Events carry nothing that tells writers apart, so each process has one writer per ring
+    OpenRings& openRings = getOpenRings();
+    const ScopedLock lock(openRings.lock);
+
+    if (openRings.names.contains(name))
+        return Result::fail(name + " is already in use by another writer in this process");
+
+    const int fd = ::shm_open(name.toRawUTF8(), O_RDWR | O_CREAT, 0644);
+
+    if (fd < 0)
+        return failWithErrno("Could not open", name);
+
+    struct stat info;
+
+    if (::fstat(fd, &info) != 0)
+    {
+        const Result result = failWithErrno("Could not inspect", name);
+        ::close(fd);
+        return result;
+    }
+
+    bool reuse = false;
+
+    if ((size_t) info.st_size >= sizeof(TrialEventRingHeader))
+    {
+        // Look at the existing ring before touching it: it may belong to a live writer
+        void* existing = ::mmap(nullptr, sizeof(TrialEventRingHeader), PROT_READ, MAP_SHARED, fd, 0);
+
+        if (existing != MAP_FAILED)
+        {
+            const TrialEventRingHeader* existingHeader = (const TrialEventRingHeader*) existing;
+            const uint32 pid = existingHeader->writerPid;
+
+            if (isCompatible(*existingHeader) && pid != (uint32) ::getpid() && isProcessAlive(pid))
+            {
+                ::munmap(existing, sizeof(TrialEventRingHeader));
+                ::close(fd);
+                return Result::fail(name + " is already in use by process " + String(pid));
+            }
+
+            reuse = isCompatible(*existingHeader)
+                 && existingHeader->capacity == numSlots
+                 && (size_t) info.st_size == size;
+
+            ::munmap(existing, sizeof(TrialEventRingHeader));
+        }
+    }
+
+    if (! reuse && ::ftruncate(fd, (off_t) size) != 0)
+    {
+        const Result result = failWithErrno("Could not resize", name);
+        ::close(fd);
+        return result;
+    }
+
+    void* memory = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (memory == MAP_FAILED)
+        return failWithErrno("Could not map", name);
+
+    header = (TrialEventRingHeader*) memory;
+    slots = (TrialEventSlot*) ((char*) memory + sizeof(TrialEventRingHeader));
+    mappedSize = size;
+    mask = numSlots - 1;
+
+    if (! reuse)
+    {
+        // A new ring: readers wait for the magic number before trusting anything else
+        std::memset(memory, 0, size);
+        new (&header->writeCount) std::atomic<uint64>(0);
+
+        for (uint64 i = 0; i < numSlots; ++i)
+            new (&slots[i].sequence) std::atomic<uint64>(0);
+
+        header->version = version;
+        header->slotSize = (uint16) sizeof(TrialEventSlot);
+        header->capacity = (uint32) numSlots;
+        std::atomic_thread_fence(std::memory_order_release);
+        header->magic = magic;
+    }
+
+    // Keep counting from where the last writer stopped, so attached readers carry on
+    header->writerPid = (uint32) ::getpid();
+
+    openRings.names.add(name);
+    openName = name;
+
+    return Result::ok();
+#endif
+}
+
+void TrialEventRing::close()
+{
+#if !JUCE_WINDOWS
+    if (header == nullptr)
+        return;
+
+    OpenRings& openRings = getOpenRings();
+    const ScopedLock lock(openRings.lock);
+
+    header->writerPid = 0;
+    ::munmap(header, mappedSize);
+
+    openRings.names.removeString(openName);
+#endif
+
+    openName.clear();
+    header = nullptr;
+    slots = nullptr;
+    mappedSize = 0;
+    mask = 0;
+}
+
+void TrialEventRing::publish(const TrialRecord& record)
+{
+    if (header == nullptr)
+        return;
+
+    const uint64 n = header->writeCount.load(std::memory_order_relaxed);
+    TrialEventSlot& slot = slots[n & mask];
+
+    slot.sequence.store(2 * n + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.publishNanos = getTimeNanos();
+    slot.record = record;
+
+    slot.sequence.store(2 * n + 2, std::memory_order_release);
+    header->writeCount.store(n + 1, std::memory_order_release);
+}
+
+uint64 TrialEventRing::getWriteCount() const
+{
+    return header != nullptr ? header->writeCount.load(std::memory_order_acquire) : 0;
+}
+
+Result TrialEventReader::open(const String& name)
+{
+    close();
+
+#if JUCE_WINDOWS
+    ignoreUnused(name);
+    return Result::fail("The trial event ring is not supported on Windows");
+#else
+    const int fd = ::shm_open(name.toRawUTF8(), O_RDONLY, 0);
+
+    if (fd < 0)
+        return failWithErrno("Could not open", name);
+
+    struct stat info;
+
+    if (::fstat(fd, &info) != 0 || (size_t) info.st_size < sizeof(TrialEventRingHeader))
+    {
+        ::close(fd);
+        return Result::fail(name + " is not a trial event ring");
+    }
+
+    void* memory = ::mmap(nullptr, (size_t) info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (memory == MAP_FAILED)
+        return failWithErrno("Could not map", name);
+
+    const TrialEventRingHeader* ringHeader = (const TrialEventRingHeader*) memory;
+
+    if (! isCompatible(*ringHeader) || (size_t) info.st_size < getRingSize(ringHeader->capacity))
+    {
+        ::munmap(memory, (size_t) info.st_size);
+        return Result::fail(name + " is not a compatible trial event ring");
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    header = ringHeader;
+    slots = (const TrialEventSlot*) ((const char*) memory + sizeof(TrialEventRingHeader));
+    mappedSize = (size_t) info.st_size;
+    capacity = ringHeader->capacity;
+    position = header->writeCount.load(std::memory_order_acquire);
+    numLost = 0;
+
+    return Result::ok();
+#endif
+}
+
+void TrialEventReader::close()
+{
+#if !JUCE_WINDOWS
+    if (header == nullptr)
+        return;
+
+    ::munmap((void*) header, mappedSize);
+#endif
+
+    header = nullptr;
+    slots = nullptr;
+    mappedSize = 0;
+    capacity = 0;
+    position = 0;
+}
+
+TrialEventReader::ReadResult TrialEventReader::read(TrialEvent& event)
+{
+    if (header == nullptr)
+        return NO_EVENT;
+
+    const uint64 written = header->writeCount.load(std::memory_order_acquire);
+
+    // The ring was recreated: follow the new numbering
+    if (written < position)
+        position = written;
+
+    if (position == written)
+        return NO_EVENT;
+
+    if (written - position > capacity)
+    {
+        numLost += written - position - capacity;
+        position = written - capacity;
+        return EVENTS_LOST;
+    }
+
+    const TrialEventSlot& slot = slots[position & (capacity - 1)];
+    const uint64 expected = 2 * position + 2;
+
+    if (slot.sequence.load(std::memory_order_acquire) == expected)
+    {
+        const int64 publishNanos = slot.publishNanos;
+        const TrialRecord record = slot.record;
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if (slot.sequence.load(std::memory_order_relaxed) == expected)
+        {
+            event.index = position++;
+            event.publishNanos = publishNanos;
+            event.record = record;
+            return EVENT_READ;
+        }
+    }
+
+    // Overwritten while we were looking at it
+    ++numLost;
+    ++position;
+    return EVENTS_LOST;
+}
+
+TrialEventReader::ReadResult TrialEventReader::waitForEvent(TrialEvent& event, int timeoutMs, int spinMicros)
+{
+    const int64 start = TrialEventRing::getTimeNanos();
+    const int64 spinEnd = start + (int64) spinMicros * 1000;
+    const int64 end = start + (int64) timeoutMs * 1000000;
+
+    for (;;)
+    {
+        const ReadResult result = read(event);
+
+        if (result != NO_EVENT)
+            return result;
+
+        const int64 now = TrialEventRing::getTimeNanos();
+
+        if (now >= end)
+            return NO_EVENT;
+
+        if (now >= spinEnd)
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+}
+
+void TrialEventReader::rewind()
+{
+    if (header == nullptr)
+        return;
+
+    const uint64 written = header->writeCount.load(std::memory_order_acquire);
+    position = written > capacity ? written - capacity : 0;
+}
@@ -0,0 +1,241 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef TRIALEVENTRING_H_DEFINED
+#define TRIALEVENTRING_H_DEFINED
+
+#include "TrialLog.h"
+
+#include <atomic>
+
+/**
+    Shared-memory layout of the trial event ring.
+
+    The ring is a POSIX shared memory object (on Linux, a file in
+    /dev/shm) holding a TrialEventRingHeader followed by capacity
+    TrialEventSlots. All fields are little-endian. There is one
+    writer and any number of readers, which map the object read-only
+    and never block the writer.
+
+    Event n (counting from 0) is written to slot n % capacity:
+     1. the slot's sequence is set to 2n + 1 (odd: being written)
+     2. the payload is written
+     3. the slot's sequence is set to 2n + 2 (even: complete)
+     4. the header's writeCount is set to n + 1
+    A reader that wants event n waits for writeCount > n, copies the
+    slot, and accepts the copy only if the slot's sequence was 2n + 2
+    both before and after copying. A larger sequence means the writer
+    has lapped the reader and event n is lost.
+*/
+struct TrialEventRingHeader
+{
+    /** "OPTE" */
+    uint32 magic;
+
+    /** Layout version */
+    uint16 version;
+
+    /** sizeof(TrialEventSlot) */
+    uint16 slotSize;
+
+    /** Number of slots (a power of two) */
+    uint32 capacity;
+
+    /** Process ID of the writer (0 if no writer is attached) */
+    uint32 writerPid;
+
+    uint8 reserved[48];
+
+    /** Number of events published so far (on its own cache line) */
+    std::atomic<uint64> writeCount;
+
+    uint8 padding[56];
+};
+
+/** One event in the ring */
+struct TrialEventSlot
+{
+    /** 2n + 1 while event n is being written, 2n + 2 once it is complete */
+    std::atomic<uint64> sequence;
+
+    /** CLOCK_MONOTONIC time at which the event was published (ns) */
+    int64 publishNanos;
+
+    /** The trial that started */
+    TrialRecord record;
+
+    uint8 padding[48];
+};
+
+static_assert(sizeof(TrialEventRingHeader) == 128, "TrialEventRingHeader layout is shared with other processes");
+static_assert(sizeof(TrialEventSlot) == 128, "TrialEventSlot layout is shared with other processes");
+static_assert(std::atomic<uint64>::is_always_lock_free, "The ring needs lock-free 64-bit atomics");
+
+/** A trial event as seen by a reader */
+struct TrialEvent
+{
+    /** Event number (counting from 0 since the ring was created) */
+    uint64 index = 0;
+
+    /** CLOCK_MONOTONIC time at which the event was published (ns) */
+    int64 publishNanos = 0;
+
+    /** The trial that started */
+    TrialRecord record;
+};
+
+/**
+    Publishes trial onsets to other processes through shared memory.
+
+    publish() is wait-free: it writes one slot and never waits for
+    readers, so a slow reader loses events instead of holding up the
+    protocol. The object is kept when the writer closes, so readers
+    stay attached across restarts and a new writer continues the
+    event numbering.
+
+    A process can only have one writer per ring, since events don't say
+    which writer sent them: a second open() of the same name in the same
+    process fails until the first one is closed.
+
+    publish() must only be called from one thread at a time.
+    Not available on Windows.
+*/
+class TrialEventRing
+{
+public:
+    /** Constructor */
+    TrialEventRing() { }
+
+    /** Destructor */
+    ~TrialEventRing() { close(); }
+
+    /** Creates or attaches to a ring; fails if another live process, or another
+        TrialEventRing in this one, is writing to it */
+    Result open(const String& name = getDefaultName(), int capacity = defaultCapacity);
+
+    /** Detaches from the ring */
+    void close();
+
+    /** Whether the ring is open */
+    bool isOpen() const { return header != nullptr; }
+
+    /** Publishes a trial onset */
+    void publish(const TrialRecord& record);
+
+    /** Returns the number of events published so far */
+    uint64 getWriteCount() const;
+
+    /** Name of the shared memory object used when none is given */
+    static String getDefaultName() { return "/opto-protocol-generator-trials"; }
+
+    /** Returns the CLOCK_MONOTONIC time in nanoseconds (comparable across processes) */
+    static int64 getTimeNanos();
+
+    /** Number of slots used when none is given */
+    static const int defaultCapacity = 4096;
+
+    /** Identifies the ring ("OPTE") */
+    static const uint32 magic = 0x4554504f;
+
+    /** Current layout version */
+    static const uint16 version = 1;
+
+private:
+
+    TrialEventRingHeader* header = nullptr;
+    TrialEventSlot* slots = nullptr;
+    size_t mappedSize = 0;
+    uint64 mask = 0;
+
+    /** Name the ring was opened with */
+    String openName;
+
+    JUCE_DECLARE_NON_COPYABLE(TrialEventRing);
+};
+
+/**
+    Reads trial events published by a TrialEventRing in another process.
+
+    The ring is mapped read-only. read() never blocks; readers that
+    want the lowest latency poll it (see waitForEvent()).
+*/
+class TrialEventReader
+{
+public:
+    /** Constructor */
+    TrialEventReader() { }
+
+    /** Destructor */
+    ~TrialEventReader() { close(); }
+
+    /** Attaches to a ring; the first event read is the next one published */
+    Result open(const String& name = TrialEventRing::getDefaultName());
+
+    /** Detaches from the ring */
+    void close();
+
+    /** Whether the ring is open */
+    bool isOpen() const { return header != nullptr; }
+
+    /** Outcome of a read */
+    enum ReadResult
+    {
+        /** An event was read */
+        EVENT_READ,
+
+        /** No new event has been published */
+        NO_EVENT,
+
+        /** The writer overwrote unread events; the next read() returns the oldest one left */
+        EVENTS_LOST
+    };
+
+    /** Reads the next event if there is one */
+    ReadResult read(TrialEvent& event);
+
+    /** Polls for the next event for up to timeoutMs (spinning for the first
+        spinMicros, then sleeping briefly between polls) */
+    ReadResult waitForEvent(TrialEvent& event, int timeoutMs, int spinMicros = 200);
+
+    /** Number of events lost so far */
+    uint64 getNumLost() const { return numLost; }
+
+    /** Index of the next event to read */
+    uint64 getPosition() const { return position; }
+
+    /** Moves the read position back to the oldest event still in the ring */
+    void rewind();
+
+private:
+
+    const TrialEventRingHeader* header = nullptr;
+    const TrialEventSlot* slots = nullptr;
+    size_t mappedSize = 0;
+    uint64 capacity = 0;
+    uint64 position = 0;
+    uint64 numLost = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(TrialEventReader);
+};
+
+#endif // TRIALEVENTRING_H_DEFINED
@@ -0,0 +1,346 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "TrialGenerator.h"
+
+namespace
+{
+    /** Returns the length of the run of categories through a position */
+    int getRunThrough(const Array<int>& categories, int position)
+    {
+        const int category = categories[position];
+        int from = position;
+        int to = position + 1;
+
+        while (from > 0 && categories[from - 1] == category)
+            --from;
+
+        while (to < categories.size() && categories[to] == category)
+            ++to;
+
+        return to - from;
+    }
+}
+
+IndexPermutation::IndexPermutation(int64 size_, int64 seed, bool shuffle_)
+    : size(size_), shuffle(shuffle_ && size_ > 1)
+{
+    while ((int64(1) << (2 * halfBits)) < size)
+        ++halfBits;
+
+    halfMask = (uint64(1) << halfBits) - 1;
+
+    for (int round = 0; round < numRounds; ++round)
+        keys[round] = (uint64) ScheduleCompiler::deriveSeed(seed, 2 + round);
+}
+
+uint64 IndexPermutation::encrypt(uint64 value) const
+{
+    uint64 left = value >> halfBits;
+    uint64 right = value & halfMask;
+
+    for (int round = 0; round < numRounds; ++round)
+    {
+        uint64 next = left ^ ((uint64) ScheduleCompiler::deriveSeed((int64) keys[round], (int64) right) & halfMask);
+        left = right;
+        right = next;
+    }
+
+    return (left << halfBits) | right;
+}
+
+int64 IndexPermutation::operator()(int64 index) const
+{
+    if (!shuffle)
+        return index;
+
+    // The domain is at most 4x larger than size, so this loop
+    // runs fewer than four times on average
+    uint64 value = (uint64) index;
+
+    do
+    {
+        value = encrypt(value);
+    } while (value >= (uint64) size);
+
+    return (int64) value;
+}
+
+TrialGenerator::TrialGenerator(const SequenceSpec& spec)
+    : conditions(spec.conditions),
+      itiSampler(spec),
+      trialOrder(spec.order),
+      seed(spec.seed),
+      permutation(spec.getNumTrials(), spec.seed, spec.order == SHUFFLED_ORDER || spec.order == MAX_RUN_ORDER)
+{
+    for (auto& condition : conditions)
+    {
+        offsets.add(numTrials);
+        numTrials += condition.getNumTrials();
+    }
+
+    if (trialOrder == BLOCKED_ORDER)
+    {
+        for (int block = 0; block <= spec.getNumBlocks(); ++block)
+        {
+            int64 start = 0;
+
+            for (auto& condition : conditions)
+                start += condition.getBlockStart(block);
+
+            blockStarts.add(start);
+        }
+    }
+
+    if (trialOrder == MAX_RUN_ORDER)
+    {
+        runCategory = spec.runCategory;
+        maxRunLength = jmax(1, spec.maxRunLength);
+
+        // Numbered as ScheduleCompiler::getRunCategories() numbers them
+        if (runCategory == RUN_BY_SITE)
+        {
+            for (auto& condition : conditions)
+                for (int site : condition.sites)
+                    runSites.addIfNotAlreadyThere(site);
+
+            runSites.sort();
+        }
+
+        numRunCategories = (runCategory == RUN_BY_SITE ? runSites.size() : conditions.size()) + 1;
+    }
+}
+
+int TrialGenerator::getRunCategory(const TrialEntry& trial) const
+{
+    if (trial.catchTrial)
+        return numRunCategories - 1;
+
+    if (runCategory == RUN_BY_SITE)
+        return runSites.indexOf(trial.site);
+
+    return trial.condition;
+}
+
+void TrialGenerator::createWindow(int64 window, Array<int64>& slots, Array<int>& categories) const
+{
+    // The window's trials are the next ones of the shuffled order
+    const int64 first = window * maxRunWindow;
+    const int count = (int) jmin((int64) maxRunWindow, numTrials - first);
+
+    HeapBlock<int64> shuffled((size_t) count);
+    HeapBlock<int> shuffledCategories((size_t) count);
+    HeapBlock<int> order((size_t) count);
+
+    for (int i = 0; i < count; ++i)
+    {
+        shuffled[i] = permutation(first + i);
+        shuffledCategories[i] = getRunCategory(getTrialAtSlot(shuffled[i]));
+    }
+
+    Random random(ScheduleCompiler::deriveSeed(ScheduleCompiler::deriveSeed(seed, 6), window));
+    ScheduleCompiler::orderWithMaxRun(shuffledCategories, count, numRunCategories, maxRunLength, random, order);
+
+    slots.resize(count);
+    categories.resize(count);
+
+    for (int i = 0; i < count; ++i)
+    {
+        slots.set(i, shuffled[order[i]]);
+        categories.set(i, shuffledCategories[order[i]]);
+    }
+}
+
+int TrialGenerator::getTailRun(const Array<int>& categories)
+{
+    int run = 0;
+
+    while (run < categories.size() && categories[categories.size() - 1 - run] == categories.getLast())
+        ++run;
+
+    return run;
+}
+
+int64 TrialGenerator::getMaxRunSlot(int64 position) const
+{
+    const ScopedLock lock(windowLock);
+    const int64 window = position / maxRunWindow;
+
+    if (window != currentWindow)
+    {
+        // The last run of the window before, which this one must not extend too far
+        int previousCategory = -1;
+        int previousRun = 0;
+
+        if (window > 0 && window == currentWindow + 1)
+        {
+            previousCategory = tailCategory;
+            previousRun = tailRun;
+        }
+        else if (window > 0)
+        {
+            Array<int64> previousSlots;
+            Array<int> previousCategories;
+            createWindow(window - 1, previousSlots, previousCategories);
+
+            previousCategory = previousCategories.getLast();
+            previousRun = getTailRun(previousCategories);
+        }
+
+        Array<int> categories;
+        createWindow(window, windowSlots, categories);
+
+        tailCategory = categories.getLast();
+        tailRun = getTailRun(categories);
+        currentWindow = window;
+
+        int leading = 0;
+
+        while (leading < categories.size() && categories[leading] == previousCategory)
+            ++leading;
+
+        if (previousRun + leading > maxRunLength)
+        {
+            // The first trial that would be one too many is swapped with a later one of
+            // another category, as long as neither makes a run too long. Trials next to
+            // the last run are left alone, so the next window sees the same run.
+            const int limit = jmax(0, maxRunLength - previousRun);
+            const int lastSwap = categories.size() - tailRun - 1;
+
+            for (int other = leading; other < lastSwap && limit < lastSwap; ++other)
+            {
+                if (categories[other] == previousCategory)
+                    continue;
+
+                categories.swap(limit, other);
+
+                if (getRunThrough(categories, limit) <= maxRunLength
+                    && getRunThrough(categories, other) <= maxRunLength)
+                {
+                    windowSlots.swap(limit, other);
+                    break;
+                }
+
+                categories.swap(limit, other);
+            }
+        }
+    }
+
+    return windowSlots[(int) (position - window * maxRunWindow)];
+}
+
+TrialEntry TrialGenerator::getTrialAtSlot(int64 slot) const
+{
+    // Last condition whose first index is <= slot (empty conditions are skipped)
+    const int64* first = offsets.begin();
+    int c = (int) (std::upper_bound(first, offsets.end(), slot) - first) - 1;
+
+    while (conditions.getReference(c).getNumTrials() == 0)
+        --c;
+
+    const ConditionSpec& condition = conditions.getReference(c);
+
+    // Catch trials follow the stimulus trials and copy one of them
+    int64 local = slot - offsets[c];
+
+    if (local >= condition.getNumStimulusTrials())
+    {
+        TrialEntry trial = getTrialAtSlot(offsets[c] + condition.getCatchSource((int) (local - condition.getNumStimulusTrials())));
+        trial.catchTrial = true;
+        return trial;
+    }
+
+    // Invert the repeat -> site -> wavelength -> stimulus nesting used by the compiler
+    const int stimulus = (int) (local % condition.numStimuli);
+    local /= condition.numStimuli;
+
+    const int wavelength = condition.wavelengths[(int) (local % condition.wavelengths.size())];
+    local /= condition.wavelengths.size();
+
+    const int site = condition.sites[(int) (local % condition.sites.size())];
+
+    return { c, stimulus, site, wavelength };
+}
+
+int64 TrialGenerator::getSlot(int64 position) const
+{
+    if (trialOrder == BLOCKED_ORDER)
+        return getBlockedSlot(position);
+
+    if (trialOrder == MAX_RUN_ORDER)
+        return getMaxRunSlot(position);
+
+    return permutation(position);
+}
+
+int64 TrialGenerator::getBlockedSlot(int64 position) const
+{
+    // Last block that starts at or before position
+    const int64* first = blockStarts.begin();
+    const int block = (int) (std::upper_bound(first, blockStarts.end() - 1, position) - first) - 1;
+    const int64 blockStart = blockStarts[block];
+
+    // Each block has its own permutation, so blocks can be generated independently
+    const IndexPermutation blockPermutation(blockStarts[block + 1] - blockStart,
+                                            ScheduleCompiler::deriveSeed(seed, 16 + (int64) block),
+                                            true);
+    int index = (int) blockPermutation(position - blockStart);
+
+    for (int c = 0; c < conditions.size(); ++c)
+    {
+        const ConditionSpec& condition = conditions.getReference(c);
+        const int size = condition.getBlockSize(block);
+
+        if (index < size)
+            return offsets[c] + condition.getBlockTrial(block, index);
+
+        index -= size;
+    }
+
+    jassertfalse;
+    return 0;
+}
+
+TrialEntry TrialGenerator::getTrial(int64 position) const
+{
+    return getTrialAtSlot(getSlot(position));
+}
+
+int64 TrialGenerator::getIti(int64 position) const
+{
+    return itiSampler.sample(getSlot(position));
+}
+
+size_t TrialGenerator::getMemoryUsage() const
+{
+    size_t bytes = (size_t) conditions.size() * sizeof(ConditionSpec)
+                 + (size_t) (offsets.size() + blockStarts.size()) * sizeof(int64)
+                 + (size_t) windowSlots.size() * sizeof(int64)
+                 + (size_t) runSites.size() * sizeof(int)
+                 + itiSampler.getMemoryUsage();
+
+    for (const auto& condition : conditions)
+        bytes += condition.getMemoryUsage();
+
+    return bytes;
+}
@@ -0,0 +1,156 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef TRIALGENERATOR_H_DEFINED
+#define TRIALGENERATOR_H_DEFINED
+
+#include "ItiSampler.h"
+
+/**
+    A pseudo-random bijection on [0, size).
+
+    Uses a balanced Feistel network over the smallest power-of-four
+    domain that covers size, and cycle-walks values that fall outside
+    the range. Needs no storage beyond the round keys, and any index
+    can be mapped independently of the others.
+*/
+class IndexPermutation
+{
+public:
+    /** Constructor (an identity permutation if shuffle is false) */
+    IndexPermutation(int64 size, int64 seed, bool shuffle);
+
+    /** Maps an index in [0, size) to its permuted position */
+    int64 operator()(int64 index) const;
+
+private:
+
+    /** Number of Feistel rounds */
+    static const int numRounds = 4;
+
+    /** One pass through the Feistel network */
+    uint64 encrypt(uint64 value) const;
+
+    int64 size;
+    bool shuffle;
+    int halfBits = 1;
+    uint64 halfMask = 1;
+    uint64 keys[numRounds];
+};
+
+/**
+    Produces the trials of a sequence on demand.
+
+    Trials are derived from (seed, trial index) instead of being stored,
+    so memory use is proportional to the number of conditions rather
+    than the number of trials. Any trial can be generated in constant
+    time (logarithmic in the number of blocks for BLOCKED_ORDER, which
+    stores where each block starts), which makes seeking and resuming
+    cheap.
+
+    MAX_RUN_ORDER can't be derived trial by trial, so it is generated a
+    window of maxRunWindow trials at a time: each window takes the next
+    trials of a shuffled order, orders them with
+    ScheduleCompiler::orderWithMaxRun() from a seed of its own, and then
+    swaps a trial near its start if its first run would join the last
+    run of the window before. Only the window being played is stored.
+*/
+class TrialGenerator
+{
+public:
+    /** Constructor */
+    TrialGenerator(const SequenceSpec& spec);
+
+    /** Destructor */
+    ~TrialGenerator() { }
+
+    /** Total number of trials */
+    int64 getNumTrials() const { return numTrials; }
+
+    /** Returns the trial played at a given position */
+    TrialEntry getTrial(int64 position) const;
+
+    /** Returns the ITI (in samples) that follows the trial played at a given position */
+    int64 getIti(int64 position) const;
+
+    /** Heap memory used by the generator's tables, in bytes */
+    size_t getMemoryUsage() const;
+
+    /** Trials ordered at a time for MAX_RUN_ORDER */
+    static const int maxRunWindow = 4096;
+
+private:
+
+    /** Maps an expansion-order index to its trial */
+    TrialEntry getTrialAtSlot(int64 slot) const;
+
+    /** Maps a playback position to its expansion-order index */
+    int64 getSlot(int64 position) const;
+
+    /** Maps a playback position to its expansion-order index for BLOCKED_ORDER */
+    int64 getBlockedSlot(int64 position) const;
+
+    /** Maps a playback position to its expansion-order index for MAX_RUN_ORDER */
+    int64 getMaxRunSlot(int64 position) const;
+
+    /** Returns the run category of a trial for MAX_RUN_ORDER */
+    int getRunCategory(const TrialEntry& trial) const;
+
+    /** Orders the trials of a MAX_RUN_ORDER window on their own, returning
+        their slots and run categories in playback order */
+    void createWindow(int64 window, Array<int64>& slots, Array<int>& categories) const;
+
+    /** Returns the length of the run that ends at the end of a window */
+    static int getTailRun(const Array<int>& categories);
+
+    Array<ConditionSpec> conditions;
+
+    /** First expansion-order index of each condition */
+    Array<int64> offsets;
+
+    int64 numTrials = 0;
+    ItiSampler itiSampler;
+
+    TrialOrder trialOrder;
+    int64 seed;
+
+    /** First playback position of each block, and the total, for BLOCKED_ORDER */
+    Array<int64> blockStarts;
+
+    IndexPermutation permutation;
+
+    /** MAX_RUN_ORDER: what a run is made of, the sites in category order and the number of categories */
+    RunCategory runCategory = RUN_BY_CONDITION;
+    Array<int> runSites;
+    int numRunCategories = 0;
+    int maxRunLength = 1;
+
+    /** MAX_RUN_ORDER: the window being played, and the last run of its unrepaired order */
+    mutable CriticalSection windowLock;
+    mutable int64 currentWindow = -1;
+    mutable Array<int64> windowSlots;
+    mutable int tailCategory = -1;
+    mutable int tailRun = 0;
+};
+
+#endif // TRIALGENERATOR_H_DEFINED
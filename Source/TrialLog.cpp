@@ -0,0 +1,67 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "TrialLog.h"
+
+TrialLogWriter::TrialLogWriter()
+    : RecordWriter<TrialRecord>("Opto trial log writer", 4096, 500)
+{
+}
+
+String TrialLogWriter::getFields()
+{
+    return "('trial', '<i8'), "
+           "('timestamp', '<i8'), "
+           "('protocol', '<i4'), "
+           "('sequence', '<i4'), "
+           "('sequence_trial', '<i4'), "
+           "('condition', '<i4'), "
+           "('stimulus_type', '<i4'), "
+           "('source', '<i4'), "
+           "('site', '<i4'), "
+           "('wavelength', '<i4'), "
+           "('power', '<f4'), "
+           "('duration', '<f4'), "
+           "('iti', '<f4'), "
+           "('catch_trial', '<i4')";
+}
+
+MemoryBlock TrialLogWriter::createHeader(int64 numRecords)
+{
+    return NpyHeader::create(getFields(), numRecords, headerSize);
+}
+
+void TrialLogWriter::startFile(FILE* stream)
+{
+    MemoryBlock header = createHeader(0);
+    std::fwrite(header.getData(), 1, header.getSize(), stream);
+}
+
+void TrialLogWriter::finishFile(FILE* stream)
+{
+    MemoryBlock header = createHeader(getNumWritten());
+
+    std::fseek(stream, 0, SEEK_SET);
+    std::fwrite(header.getData(), 1, header.getSize(), stream);
+    std::fseek(stream, 0, SEEK_END);
+}
@@ -0,0 +1,121 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef TRIALLOG_H_DEFINED
+#define TRIALLOG_H_DEFINED
+
+#include "RecordWriter.h"
+
+/**
+    What was delivered on one trial.
+
+    Fields are naturally aligned with no padding, so the file can be
+    read directly as a NumPy structured array (see TrialLogWriter).
+*/
+struct TrialRecord
+{
+    /** Trial number within the run (across sequences) */
+    int64 trial = 0;
+
+    /** Wall-clock onset time (ms since epoch) */
+    int64 timestamp = 0;
+
+    /** Protocol index */
+    int32 protocol = 0;
+
+    /** Sequence index within the protocol */
+    int32 sequence = 0;
+
+    /** Trial index within the sequence */
+    int32 sequenceTrial = 0;
+
+    /** Condition index within the sequence */
+    int32 condition = 0;
+
+    /** StimulusType */
+    int32 stimulusType = 0;
+
+    /** Source index */
+    int32 source = 0;
+
+    /** Emission site */
+    int32 site = 0;
+
+    /** Wavelength (nm) */
+    int32 wavelength = 0;
+
+    /** Light power (uW) */
+    float power = 0;
+
+    /** Stimulus duration (s) */
+    float duration = 0;
+
+    /** ITI that follows the stimulus (s) */
+    float iti = 0;
+
+    /** 1 for a catch trial (delivered with the light off), 0 otherwise */
+    int32 catchTrial = 0;
+};
+
+static_assert(sizeof(TrialRecord) == 64, "TrialRecord layout must match the NPY header");
+
+/**
+    Streams TrialRecords to a .npy file.
+
+    The file starts with a NPY v1.0 header describing a structured
+    array of TrialRecords, so it can be opened with numpy.load() and
+    converted to Parquet or a data frame without a custom parser.
+    The header reserves room for the final shape, which is filled in
+    when the file is closed. If the run is interrupted, the number of
+    records is (file size - header size) / 64.
+*/
+class TrialLogWriter : public RecordWriter<TrialRecord>
+{
+public:
+    /** Constructor */
+    TrialLogWriter();
+
+    /** Destructor */
+    ~TrialLogWriter() { close(); }
+
+    /** Returns the NPY dtype fields of a TrialRecord */
+    static String getFields();
+
+    /** Size of the NPY header, in bytes */
+    static const int headerSize = 512;
+
+protected:
+
+    /** Writes a header with an empty shape */
+    void startFile(FILE* stream) override;
+
+    /** Rewrites the header with the final number of records */
+    void finishFile(FILE* stream) override;
+
+private:
+
+    /** Builds the NPY header for a given number of records */
+    static MemoryBlock createHeader(int64 numRecords);
+};
+
+#endif // TRIALLOG_H_DEFINED
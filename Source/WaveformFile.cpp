@@ -0,0 +1,438 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include "WaveformFile.h"
+
+namespace
+{
+    /** Samples converted between progress reports */
+    const int chunkSize = 1 << 16;
+
+    uint16 readUint16(const uint8* data)
+    {
+        return (uint16) (data[0] | (data[1] << 8));
+    }
+
+    uint32 readUint32(const uint8* data)
+    {
+        return (uint32) data[0] | ((uint32) data[1] << 8) | ((uint32) data[2] << 16) | ((uint32) data[3] << 24);
+    }
+
+    /** Reads an unaligned value of any type */
+    template <typename Type>
+    Type readValue(const uint8* data)
+    {
+        Type value;
+        std::memcpy(&value, data, sizeof(Type));
+        return value;
+    }
+
+    /** Fills a waveform with numSamples values from decode(index), reporting progress */
+    template <typename Decoder>
+    Result convertSamples(int numSamples, Decoder decode, DecodedWaveform& waveform,
+                          WaveformFile::ProgressCallback& progress)
+    {
+        if (numSamples > WaveformFile::maxSamples)
+            return Result::fail("The waveform has more than " + String(WaveformFile::maxSamples) + " samples");
+
+        waveform.samples.resize(numSamples);
+        float* destination = waveform.samples.begin();
+
+        for (int start = 0; start < numSamples; start += chunkSize)
+        {
+            const int end = jmin(numSamples, start + chunkSize);
+
+            for (int i = start; i < end; ++i)
+                destination[i] = decode(i);
+
+            if (progress != nullptr && !progress(end / (double) numSamples))
+                return Result::fail("Cancelled");
+        }
+
+        return Result::ok();
+    }
+
+    /** Returns the text after a key in a NPY header dictionary */
+    String getHeaderValue(const String& header, const String& key)
+    {
+        return header.fromFirstOccurrenceOf("'" + key + "'", false, false)
+                     .fromFirstOccurrenceOf(":", false, false)
+                     .trimStart();
+    }
+}
+
+WaveformOverview WaveformOverview::create(const float* samples, int numSamples, int numBuckets)
+{
+    WaveformOverview overview;
+
+    if (numSamples <= 0 || numBuckets <= 0)
+        return overview;
+
+    const int size = jmin(numBuckets, numSamples);
+    overview.minimum.resize(size);
+    overview.maximum.resize(size);
+
+    for (int bucket = 0; bucket < size; ++bucket)
+    {
+        const int64 from = (int64) bucket * numSamples / size;
+        const int64 to = (int64) (bucket + 1) * numSamples / size;
+        const auto range = std::minmax_element(samples + from, samples + to);
+
+        overview.minimum.set(bucket, *range.first);
+        overview.maximum.set(bucket, *range.second);
+    }
+
+    return overview;
+}
+
+Result WaveformFile::read(const File& file, DecodedWaveform& waveform, ProgressCallback progress)
+{
+    if (!file.existsAsFile())
+        return Result::fail("Can't find " + file.getFullPathName());
+
+    MemoryMappedFile mapped(file, MemoryMappedFile::readOnly);
+
+    if (mapped.getData() == nullptr)
+        return Result::fail("Unable to read " + file.getFileName());
+
+    const uint8* data = static_cast<const uint8*>(mapped.getData());
+    const String extension = file.getFileExtension().toLowerCase();
+
+    waveform = DecodedWaveform();
+    Result result = Result::fail("Unsupported file type: " + extension);
+
+    if (extension == ".npy")
+        result = readNpy(data, mapped.getSize(), waveform, progress);
+    else if (extension == ".wav")
+        result = readWav(data, mapped.getSize(), waveform, progress);
+    else if (extension == ".csv" || extension == ".txt")
+        result = readCsv(data, mapped.getSize(), waveform, progress);
+
+    if (result.wasOk() && waveform.samples.isEmpty())
+        result = Result::fail(file.getFileName() + " contains no samples");
+
+    if (result.failed())
+    {
+        waveform = DecodedWaveform();
+        return result;
+    }
+
+    waveform.overview = WaveformOverview::create(waveform.samples.begin(), waveform.samples.size());
+
+    return result;
+}
+
+Result WaveformFile::readNpy(const uint8* data, size_t size, DecodedWaveform& waveform, ProgressCallback& progress)
+{
+    if (size < 10 || std::memcmp(data, "\x93NUMPY", 6) != 0)
+        return Result::fail("Not a NPY file");
+
+    const int majorVersion = data[6];
+    const size_t headerStart = majorVersion == 1 ? 10 : 12;
+
+    if (size < headerStart)
+        return Result::fail("Truncated NPY header");
+
+    const size_t headerLength = majorVersion == 1 ? readUint16(data + 8) : readUint32(data + 8);
+
+    if (headerStart + headerLength > size)
+        return Result::fail("Truncated NPY header");
+
+    const String header = String::fromUTF8((const char*) data + headerStart, (int) headerLength);
+
+    // e.g. '<f4': byte order, kind and item size
+    const String descr = getHeaderValue(header, "descr").fromFirstOccurrenceOf("'", false, false)
+                                                         .upToFirstOccurrenceOf("'", false, false);
+
+    if (descr.length() < 3 || descr.substring(2).getIntValue() <= 0)
+        return Result::fail("Unsupported NPY data type");
+
+    const juce_wchar byteOrder = descr[0];
+    const juce_wchar kind = descr[1];
+    const int itemSize = descr.substring(2).getIntValue();
+
+    if (byteOrder == '>' && itemSize > 1)
+        return Result::fail("Big-endian NPY files are not supported");
+
+    const bool fortranOrder = getHeaderValue(header, "fortran_order").startsWith("True");
+
+    StringArray shape = StringArray::fromTokens(getHeaderValue(header, "shape").fromFirstOccurrenceOf("(", false, false)
+                                                                                .upToFirstOccurrenceOf(")", false, false),
+                                                ",", "");
+    shape.trim();
+    shape.removeEmptyStrings();
+
+    if (shape.isEmpty())
+        return Result::fail("NPY file holds a scalar, not a waveform");
+
+    // The shape comes from the file, so each product is checked against
+    // the number of items the data can hold before it is formed
+    const size_t dataStart = headerStart + headerLength;
+    const int64 maxItems = (int64) ((size - dataStart) / (size_t) itemSize);
+    const int64 numRows = shape[0].getLargeIntValue();
+    int64 numColumns = 1;
+
+    for (int i = 1; i < shape.size(); ++i)
+    {
+        const int64 dimension = shape[i].getLargeIntValue();
+
+        if (dimension <= 0 || numColumns > maxItems / dimension)
+            return Result::fail("NPY data is shorter than its shape");
+
+        numColumns *= dimension;
+    }
+
+    if (numRows < 0 || (numRows > 0 && numColumns > maxItems / numRows))
+        return Result::fail("NPY data is shorter than its shape");
+
+    if (numRows > maxSamples)
+        return Result::fail("The waveform has more than " + String(maxSamples) + " samples");
+
+    // The first column is contiguous in Fortran order, and strided in C order
+    const uint8* source = data + dataStart;
+    const size_t stride = (size_t) itemSize * (fortranOrder ? 1 : (size_t) numColumns);
+    const int numSamples = (int) numRows;
+
+    auto at = [source, stride] (int i) { return source + (size_t) i * stride; };
+
+    if (kind == 'f' && itemSize == 4)
+        return convertSamples(numSamples, [&] (int i) { return readValue<float>(at(i)); }, waveform, progress);
+
+    if (kind == 'f' && itemSize == 8)
+        return convertSamples(numSamples, [&] (int i) { return (float) readValue<double>(at(i)); }, waveform, progress);
+
+    if (kind == 'i' && itemSize == 1)
+        return convertSamples(numSamples, [&] (int i) { return (float) readValue<int8>(at(i)); }, waveform, progress);
+
+    if (kind == 'i' && itemSize == 2)
+        return convertSamples(numSamples, [&] (int i) { return (float) readValue<int16>(at(i)); }, waveform, progress);
+
+    if (kind == 'i' && itemSize == 4)
+        return convertSamples(numSamples, [&] (int i) { return (float) readValue<int32>(at(i)); }, waveform, progress);
+
+    if (kind == 'i' && itemSize == 8)
+        return convertSamples(numSamples, [&] (int i) { return (float) readValue<int64>(at(i)); }, waveform, progress);
+
+    if (kind == 'u' && itemSize == 1)
+        return convertSamples(numSamples, [&] (int i) { return (float) readValue<uint8>(at(i)); }, waveform, progress);
+
+    if (kind == 'u' && itemSize == 2)
+        return convertSamples(numSamples, [&] (int i) { return (float) readValue<uint16>(at(i)); }, waveform, progress);
+
+    return Result::fail("Unsupported NPY data type: " + descr);
+}
+
+Result WaveformFile::readWav(const uint8* data, size_t size, DecodedWaveform& waveform, ProgressCallback& progress)
+{
+    if (size < 12 || std::memcmp(data, "RIFF", 4) != 0 || std::memcmp(data + 8, "WAVE", 4) != 0)
+        return Result::fail("Not a WAV file");
+
+    int format = 0, numChannels = 0, bitsPerSample = 0;
+    const uint8* samples = nullptr;
+    size_t dataSize = 0;
+
+    for (size_t position = 12; position + 8 <= size;)
+    {
+        const uint8* chunk = data + position;
+        const size_t chunkSize = readUint32(chunk + 4);
+        const uint8* body = chunk + 8;
+        const size_t available = jmin(chunkSize, size - position - 8);
+
+        if (std::memcmp(chunk, "fmt ", 4) == 0 && available >= 16)
+        {
+            format = readUint16(body);
+            numChannels = readUint16(body + 2);
+            waveform.sampleRate = readUint32(body + 4);
+            bitsPerSample = readUint16(body + 14);
+
+            // WAVE_FORMAT_EXTENSIBLE keeps the real format at the start of its sub-format GUID
+            if (format == 0xfffe && available >= 26)
+                format = readUint16(body + 24);
+        }
+        else if (std::memcmp(chunk, "data", 4) == 0)
+        {
+            samples = body;
+            dataSize = available;
+        }
+
+        position += 8 + chunkSize + (chunkSize & 1);
+    }
+
+    if (numChannels <= 0 || bitsPerSample <= 0 || bitsPerSample % 8 != 0)
+        return Result::fail("WAV file has no valid format chunk");
+
+    if (samples == nullptr)
+        return Result::fail("WAV file has no data chunk");
+
+    // Only the first channel is used
+    const size_t frameSize = (size_t) numChannels * (size_t) (bitsPerSample / 8);
+    const size_t numFrames = dataSize / frameSize;
+
+    if (numFrames > (size_t) maxSamples)
+        return Result::fail("The waveform has more than " + String(maxSamples) + " samples");
+
+    const int numSamples = (int) numFrames;
+
+    auto at = [samples, frameSize] (int i) { return samples + (size_t) i * frameSize; };
+
+    if (format == 1)
+    {
+        switch (bitsPerSample)
+        {
+            case 8:  return convertSamples(numSamples, [&] (int i) { return (at(i)[0] - 128) / 128.0f; }, waveform, progress);
+            case 16: return convertSamples(numSamples, [&] (int i) { return readValue<int16>(at(i)) / 32768.0f; }, waveform, progress);
+            case 24: return convertSamples(numSamples, [&] (int i)
+                     {
+                         const uint8* p = at(i);
+                         return (float) (int32) (((uint32) p[0] << 8) | ((uint32) p[1] << 16) | ((uint32) p[2] << 24)) / 2147483648.0f;
+                     }, waveform, progress);
+            case 32: return convertSamples(numSamples, [&] (int i) { return readValue<int32>(at(i)) / 2147483648.0f; }, waveform, progress);
+            default: break;
+        }
+    }
+    else if (format == 3)
+    {
+        if (bitsPerSample == 32)
+            return convertSamples(numSamples, [&] (int i) { return readValue<float>(at(i)); }, waveform, progress);
+
+        if (bitsPerSample == 64)
+            return convertSamples(numSamples, [&] (int i) { return (float) readValue<double>(at(i)); }, waveform, progress);
+    }
+
+    return Result::fail("Unsupported WAV format (" + String(bitsPerSample) + "-bit, format " + String(format) + ")");
+}
+
+Result WaveformFile::readCsv(const uint8* data, size_t size, DecodedWaveform& waveform, ProgressCallback& progress)
+{
+    const char* text = (const char*) data;
+    const char* end = text + size;
+    int numLines = 0;
+
+    while (text < end)
+    {
+        const char* lineEnd = static_cast<const char*>(std::memchr(text, '\n', (size_t) (end - text)));
+
+        if (lineEnd == nullptr)
+            lineEnd = end;
+
+        while (text < lineEnd && (*text == ' ' || *text == '\t'))
+            ++text;
+
+        // Copy the first field, so parsing can't run past the end of the mapping
+        char field[64];
+        int length = 0;
+
+        while (text + length < lineEnd && length < (int) sizeof(field) - 1
+               && std::strchr(",;\t \r", text[length]) == nullptr)
+        {
+            field[length] = text[length];
+            ++length;
+        }
+
+        field[length] = 0;
+
+        char* parsedEnd = nullptr;
+        const double value = std::strtod(field, &parsedEnd);
+
+        // Headers and comments don't parse as numbers
+        if (length > 0 && parsedEnd != field)
+        {
+            if (waveform.samples.size() == maxSamples)
+                return Result::fail("The waveform has more than " + String(maxSamples) + " samples");
+
+            waveform.samples.add((float) value);
+        }
+
+        text = lineEnd + 1;
+
+        if (progress != nullptr && ++numLines % chunkSize == 0
+            && !progress((double) (text - (const char*) data) / (double) size))
+            return Result::fail("Cancelled");
+    }
+
+    if (progress != nullptr)
+        progress(1.0);
+
+    return Result::ok();
+}
+
+WaveformLoader::WaveformLoader()
+    : Thread("Opto waveform loader")
+{
+}
+
+WaveformLoader::~WaveformLoader()
+{
+    stopThread(2000);
+}
+
+void WaveformLoader::load(const File& file_)
+{
+    cancel();
+
+    file = file_;
+    progress = 0.0;
+    hasResult = false;
+    loading = true;
+
+    startThread();
+}
+
+void WaveformLoader::cancel()
+{
+    stopThread(2000);
+    loading = false;
+}
+
+bool WaveformLoader::getResult(Result& result, DecodedWaveform& waveform)
+{
+    if (loading || !hasResult)
+        return false;
+
+    result = loadResult;
+    waveform = std::move(decoded);
+    hasResult = false;
+
+    return true;
+}
+
+void WaveformLoader::run()
+{
+    DecodedWaveform waveform;
+
+    Result result = WaveformFile::read(file, waveform, [this] (double fraction)
+    {
+        progress = fraction;
+        return !threadShouldExit();
+    });
+
+    if (!threadShouldExit())
+    {
+        loadResult = result;
+        decoded = std::move(waveform);
+        hasResult = true;
+    }
+
+    loading = false;
+}
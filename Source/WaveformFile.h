@@ -0,0 +1,148 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef WAVEFORMFILE_H_DEFINED
+#define WAVEFORMFILE_H_DEFINED
+
+#include "SampleTime.h"
+
+/** A decimated min/max summary of a waveform, for drawing */
+struct WaveformOverview
+{
+    /** Smallest sample in each bucket */
+    Array<float> minimum;
+
+    /** Largest sample in each bucket */
+    Array<float> maximum;
+
+    /** Number of buckets */
+    int size() const { return minimum.size(); }
+
+    /** Heap memory used by the buckets, in bytes */
+    size_t getMemoryUsage() const { return (size_t) (minimum.size() + maximum.size()) * sizeof(float); }
+
+    /** Summarizes a waveform in at most numBuckets buckets */
+    static WaveformOverview create(const float* samples, int numSamples, int numBuckets = defaultNumBuckets);
+
+    /** Enough buckets for a full-width drawing */
+    static const int defaultNumBuckets = 2048;
+};
+
+/** A waveform decoded from a file */
+struct DecodedWaveform
+{
+    /** The first channel (or column) of the file */
+    Array<float> samples;
+
+    /** Sample rate stored in the file (0 if the format has none) */
+    double sampleRate = 0;
+
+    /** Summary for drawing */
+    WaveformOverview overview;
+};
+
+/**
+    Decodes custom stimulus waveforms.
+
+    Supported formats:
+     - .npy: 1-D or 2-D arrays of little-endian floats or integers
+       (integers are used as they are)
+     - .wav: 8/16/24/32-bit PCM or 32/64-bit float, scaled to -1 to 1
+     - .csv or .txt: one sample per line (the first column is used; lines
+       that don't start with a number are skipped)
+
+    Binary files are memory-mapped and converted in place; only the
+    first channel or column is kept.
+*/
+class WaveformFile
+{
+public:
+    /** Receives progress from 0 to 1; returning false cancels decoding */
+    using ProgressCallback = std::function<bool(double progress)>;
+
+    /** Decodes a file */
+    static Result read(const File& file, DecodedWaveform& waveform, ProgressCallback progress = nullptr);
+
+    /** File chooser pattern for every supported format */
+    static String getWildcard() { return "*.npy;*.wav;*.csv;*.txt"; }
+
+    /** Waveforms longer than this are rejected */
+    static const int maxSamples = 1 << 27;
+
+private:
+
+    static Result readNpy(const uint8* data, size_t size, DecodedWaveform& waveform, ProgressCallback& progress);
+    static Result readWav(const uint8* data, size_t size, DecodedWaveform& waveform, ProgressCallback& progress);
+    static Result readCsv(const uint8* data, size_t size, DecodedWaveform& waveform, ProgressCallback& progress);
+};
+
+/**
+    Decodes a waveform file on a background thread.
+
+    The owner polls getProgress() and collects the waveform with
+    getResult() once isLoading() returns false, so the message thread
+    never waits on a large file.
+*/
+class WaveformLoader : private Thread
+{
+public:
+    /** Constructor */
+    WaveformLoader();
+
+    /** Destructor (cancels loading) */
+    ~WaveformLoader();
+
+    /** Starts loading a file, cancelling any load in progress */
+    void load(const File& file);
+
+    /** Cancels loading */
+    void cancel();
+
+    /** Whether a file is being decoded */
+    bool isLoading() const { return loading.load(); }
+
+    /** Fraction of the file decoded so far */
+    double getProgress() const { return progress.load(); }
+
+    /** Takes the result of the last load; returns false if there is none */
+    bool getResult(Result& result, DecodedWaveform& waveform);
+
+private:
+
+    /** Decodes the file */
+    void run() override;
+
+    File file;
+
+    std::atomic<bool> loading { false };
+    std::atomic<bool> hasResult { false };
+    std::atomic<double> progress { 0.0 };
+
+    Result loadResult { Result::ok() };
+    DecodedWaveform decoded;
+
+    JUCE_DECLARE_NON_COPYABLE(WaveformLoader);
+};
+
+#endif // WAVEFORMFILE_H_DEFINED
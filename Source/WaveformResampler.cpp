@@ -0,0 +1,138 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include "WaveformResampler.h"
+
+namespace
+{
+    /** Partial sums per dot product; matches a SIMD register of floats */
+    const int numAccumulators = 8;
+}
+
+WaveformResampler::WaveformResampler(double inputRate_, double outputRate_)
+    : inputRate(inputRate_),
+      outputRate(outputRate_),
+      step(inputRate_ / outputRate_)
+{
+    jassert(inputRate > 0 && outputRate > 0);
+
+    // Cutoff as a fraction of the input rate, lowered to the output Nyquist when decimating
+    const double cutoff = 0.5 * jmin(1.0, outputRate / inputRate) * 0.95;
+
+    halfTaps = jmin(maxTaps / 2, (int) std::ceil(numZeroCrossings / (2.0 * cutoff)));
+    numTaps = ((2 * halfTaps + numAccumulators - 1) / numAccumulators) * numAccumulators;
+
+    coefficients.calloc((size_t) (numPhases + 1) * (size_t) numTaps);
+
+    // Row p holds the taps for an output position p / numPhases past an input sample.
+    // Tap k multiplies input sample (base - halfTaps + 1 + k).
+    for (int phase = 0; phase <= numPhases; ++phase)
+    {
+        float* row = coefficients.get() + (size_t) phase * (size_t) numTaps;
+        const double fraction = phase / (double) numPhases;
+        double sum = 0;
+
+        for (int k = 0; k < 2 * halfTaps; ++k)
+        {
+            const double t = fraction + halfTaps - 1 - k;
+
+            if (std::abs(t) >= halfTaps)
+                continue;
+
+            const double x = MathConstants<double>::twoPi * cutoff * t;
+            const double sinc = t == 0 ? 1.0 : std::sin(x) / x;
+            const double window = 0.42 + 0.5 * std::cos(MathConstants<double>::pi * t / halfTaps)
+                                  + 0.08 * std::cos(MathConstants<double>::twoPi * t / halfTaps);
+
+            row[k] = (float) (sinc * window);
+            sum += row[k];
+        }
+
+        // Unity gain at DC, so a constant waveform stays constant
+        for (int k = 0; k < numTaps; ++k)
+            row[k] = (float) (row[k] / sum);
+    }
+}
+
+int64 WaveformResampler::getNumOutputSamples(int numInputSamples) const
+{
+    return SampleTime::fromSeconds(numInputSamples / inputRate, outputRate);
+}
+
+void WaveformResampler::process(const float* input,
+                                int numInputSamples,
+                                int64 outputStart,
+                                int numOutputSamples,
+                                float* destination) const
+{
+    for (int i = 0; i < numOutputSamples; ++i)
+    {
+        const double position = (double) (outputStart + i) * step;
+        const double base = std::floor(position);
+        const double phasePosition = (position - base) * numPhases;
+        const int phase = jmin(numPhases - 1, (int) phasePosition);
+        const float blend = (float) (phasePosition - phase);
+
+        const float* row0 = coefficients.get() + (size_t) phase * (size_t) numTaps;
+        const float* row1 = row0 + numTaps;
+        const int64 first = (int64) base - halfTaps + 1;
+
+        float sum = 0;
+
+        if (first >= 0 && first + numTaps <= numInputSamples)
+        {
+            // Independent partial sums let the dot product vectorize
+            const float* samples = input + first;
+            float partial[numAccumulators] = {};
+
+            for (int k = 0; k < numTaps; k += numAccumulators)
+                for (int j = 0; j < numAccumulators; ++j)
+                    partial[j] += samples[k + j] * (row0[k + j] + blend * (row1[k + j] - row0[k + j]));
+
+            for (float value : partial)
+                sum += value;
+        }
+        else
+        {
+            // Near the edges, samples outside the waveform are zero
+            const int from = (int) jlimit((int64) 0, (int64) numTaps, -first);
+            const int to = (int) jlimit((int64) 0, (int64) numTaps, (int64) numInputSamples - first);
+
+            for (int k = from; k < to; ++k)
+                sum += input[first + k] * (row0[k] + blend * (row1[k] - row0[k]));
+        }
+
+        destination[i] = sum;
+    }
+}
+
+Array<float> WaveformResampler::process(const Array<float>& input) const
+{
+    Array<float> output;
+    output.resize((int) getNumOutputSamples(input.size()));
+
+    process(input.begin(), input.size(), 0, output.size(), output.begin());
+
+    return output;
+}
@@ -0,0 +1,98 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef WAVEFORMRESAMPLER_H_DEFINED
+#define WAVEFORMRESAMPLER_H_DEFINED
+
+#include "SampleTime.h"
+
+/**
+    Converts a waveform from its own sample rate to an output rate.
+
+    A windowed-sinc low-pass filter is stored as a polyphase table:
+    one row of taps for each fraction of an input sample, with the
+    taps for an arbitrary position interpolated between neighbouring
+    rows. When the output rate is lower than the input rate, the
+    cutoff moves down to the output Nyquist frequency, so nothing
+    aliases.
+
+    Any range of output samples can be computed on its own, so long
+    waveforms can be streamed block by block with no state carried
+    between blocks.
+*/
+class WaveformResampler
+{
+public:
+    /** Constructor (designs the filter) */
+    WaveformResampler(double inputRate, double outputRate);
+
+    /** Destructor */
+    ~WaveformResampler() { }
+
+    /** Number of output samples for a waveform of a given length */
+    int64 getNumOutputSamples(int numInputSamples) const;
+
+    /** Computes output samples [outputStart, outputStart + numOutputSamples) */
+    void process(const float* input,
+                 int numInputSamples,
+                 int64 outputStart,
+                 int numOutputSamples,
+                 float* destination) const;
+
+    /** Resamples a whole waveform */
+    Array<float> process(const Array<float>& input) const;
+
+    /** Heap memory used by the filter table, in bytes */
+    size_t getMemoryUsage() const { return (size_t) (numPhases + 1) * (size_t) numTaps * sizeof(float); }
+
+    /** Rows in the polyphase table */
+    static const int numPhases = 256;
+
+    /** Zero crossings of the sinc on each side of the centre */
+    static const int numZeroCrossings = 8;
+
+    /** Upper limit on the number of taps per row */
+    static const int maxTaps = 1024;
+
+private:
+
+    double inputRate;
+    double outputRate;
+
+    /** Input samples per output sample */
+    double step;
+
+    /** Taps on each side of the centre */
+    int halfTaps;
+
+    /** Taps per row (2 * halfTaps, padded with zeros to a multiple of the accumulator width) */
+    int numTaps;
+
+    /** numPhases + 1 rows of numTaps coefficients */
+    HeapBlock<float> coefficients;
+
+    JUCE_DECLARE_NON_COPYABLE(WaveformResampler);
+};
+
+#endif // WAVEFORMRESAMPLER_H_DEFINED
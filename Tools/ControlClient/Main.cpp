@@ -0,0 +1,181 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "ControlClient.h"
+
+#include <iostream>
+
+/**
+    Command-line client for the plugin's local control API.
+
+    Sends one command and prints the resulting status, or measures
+    round-trip latency with a burst of status requests.
+*/
+
+namespace
+{
+    void printUsage()
+    {
+        std::cout << "Usage: opto-control [-s <socket>] <command>\n"
+                     "\n"
+                     "Commands:\n"
+                     "  status           Print the playback status\n"
+                     "  select <index>   Select a protocol (numbered from 0)\n"
+                     "  arm              Queue every protocol without starting\n"
+                     "  run              Start or continue playback\n"
+                     "  pause            Pause playback\n"
+                     "  reset            Stop playback and rewind every protocol\n"
+                     "  trace-start      Start recording a trace\n"
+                     "  trace-stop       Stop tracing and save the trace\n"
+                     "  bench [count]    Measure the round-trip time of status requests (default 1000)\n"
+                     "\n"
+                     "Options:\n"
+                     "  -s, --socket <path>  Socket to connect to (default: " << getDefaultControlSocketPath() << ")\n"
+                     "  -t, --timeout <ms>   How long to wait for each response (default: 1000)\n";
+    }
+
+    void printStatus(const ControlResponse& response, double roundTripMicros)
+    {
+        std::cout << "status:     " << ControlClient::getStatusName(response.status) << "\n"
+                  << "state:      " << ControlClient::getStateName(response.state) << "\n"
+                  << "protocol:   " << response.protocol << " of " << response.numProtocols << "\n"
+                  << "sequence:   " << response.sequence << "\n"
+                  << "trial:      " << response.trial << "\n"
+                  << "delivered:  " << response.trialsDelivered << " of " << response.totalTrials << "\n"
+                  << "round trip: " << String(roundTripMicros, 1) << " us (" << response.handlingMicros << " us in the plugin)\n";
+    }
+
+    /** Returns a percentile of sorted values */
+    double percentile(const Array<double>& sorted, double fraction)
+    {
+        return sorted[jlimit(0, sorted.size() - 1, (int) std::ceil(fraction * sorted.size()) - 1)];
+    }
+
+    int benchmark(ControlClient& client, int count, int timeoutMs)
+    {
+        Array<double> roundTrips;
+        Array<double> handling;
+        roundTrips.ensureStorageAllocated(count);
+        handling.ensureStorageAllocated(count);
+
+        for (int i = 0; i < count; ++i)
+        {
+            ControlResponse response;
+
+            if (!client.send(CONTROL_STATUS, 0, response, timeoutMs))
+            {
+                std::cerr << "No response to request " << i + 1 << " within " << timeoutMs << " ms\n";
+                return 1;
+            }
+
+            roundTrips.add(client.getLastRoundTripMicros());
+            handling.add((double) response.handlingMicros);
+        }
+
+        roundTrips.sort();
+        handling.sort();
+
+        std::cout << count << " status requests, round trip (us):\n"
+                  << "  min " << String(roundTrips.getFirst(), 1)
+                  << "  median " << String(percentile(roundTrips, 0.5), 1)
+                  << "  p99 " << String(percentile(roundTrips, 0.99), 1)
+                  << "  p99.9 " << String(percentile(roundTrips, 0.999), 1)
+                  << "  max " << String(roundTrips.getLast(), 1) << "\n"
+                  << "  in the plugin: median " << String(percentile(handling, 0.5), 1)
+                  << "  max " << String(handling.getLast(), 1) << "\n";
+
+        return 0;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    String socketPath = getDefaultControlSocketPath();
+    int timeoutMs = 1000;
+    StringArray arguments;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const String argument(argv[i]);
+
+        if ((argument == "-s" || argument == "--socket") && i + 1 < argc)
+            socketPath = argv[++i];
+        else if ((argument == "-t" || argument == "--timeout") && i + 1 < argc)
+            timeoutMs = jmax(1, String(argv[++i]).getIntValue());
+        else if (argument == "-h" || argument == "--help")
+        {
+            printUsage();
+            return 0;
+        }
+        else
+            arguments.add(argument);
+    }
+
+    if (arguments.isEmpty())
+    {
+        printUsage();
+        return 2;
+    }
+
+    const String command = arguments[0];
+    const StringArray names = { "status", "select", "arm", "run", "pause", "reset", "trace-start", "trace-stop" };
+    const ControlCommand commands[] = { CONTROL_STATUS, CONTROL_SELECT, CONTROL_ARM, CONTROL_RUN, CONTROL_PAUSE, CONTROL_RESET,
+                                        CONTROL_START_TRACE, CONTROL_STOP_TRACE };
+
+    if (command != "bench" && !names.contains(command))
+    {
+        std::cerr << "Unknown command " << command << "\n";
+        printUsage();
+        return 2;
+    }
+
+    if (command == "select" && (arguments.size() < 2 || !arguments[1].containsOnly("0123456789")))
+    {
+        std::cerr << "select needs a protocol index\n";
+        return 2;
+    }
+
+    ControlClient client;
+    Result result = client.connect(socketPath);
+
+    if (result.failed())
+    {
+        std::cerr << result.getErrorMessage() << "\n";
+        return 1;
+    }
+
+    if (command == "bench")
+        return benchmark(client, arguments.size() > 1 ? jmax(1, arguments[1].getIntValue()) : 1000, timeoutMs);
+
+    ControlResponse response;
+
+    if (!client.send(commands[names.indexOf(command)], arguments[1].getIntValue(), response, timeoutMs))
+    {
+        std::cerr << "No response within " << timeoutMs << " ms\n";
+        return 1;
+    }
+
+    printStatus(response, client.getLastRoundTripMicros());
+
+    return response.status == CONTROL_OK ? 0 : 1;
+}
@@ -0,0 +1,312 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "ScheduleExport.h"
+
+#include <iostream>
+
+/**
+    Command-line protocol compiler.
+
+    Loads protocol definitions exported from the plugin, checks them,
+    compiles each one to the schedule the plugin would play, and
+    writes the schedule (.schedule.npy) and its statistics
+    (.summary.json). Definitions are compiled concurrently, one per
+    worker thread.
+*/
+
+namespace
+{
+    /** One definition to compile, and what came of it */
+    struct CompileJob
+    {
+        File input;
+        File scheduleFile;
+        File summaryFile;
+
+        String name;
+        double sampleRate = 0;
+        StringArray errors;
+        StringArray warnings;
+        ScheduleSummary summary;
+        double milliseconds = 0;
+    };
+
+    void printUsage()
+    {
+        std::cout << "Usage: opto-protocol-compiler [options] <definition.xml | directory>...\n"
+                     "\n"
+                     "Compiles protocol definitions exported from the Opto Protocol Generator.\n"
+                     "Directories are searched recursively for .xml files.\n"
+                     "\n"
+                     "Options:\n"
+                     "  -o, --output <dir>   Write results here, mirroring each input directory\n"
+                     "                       (default: next to each definition); also writes summary.csv\n"
+                     "  -j, --jobs <n>       Number of definitions compiled at once (default: number of cores)\n"
+                     "  -c, --check          Only check and summarize; write nothing\n"
+                     "  -q, --quiet          Only report definitions with errors or warnings\n"
+                     "  -h, --help           Show this message\n";
+    }
+
+    /** Returns path without its extension */
+    String removeExtension(const String& path)
+    {
+        return path.upToLastOccurrenceOf(".", false, false);
+    }
+
+    void runJob(CompileJob& job, bool checkOnly)
+    {
+        const double start = Time::getMillisecondCounterHiRes();
+
+        ProtocolDefinition definition;
+        Result result = ProtocolFile::load(job.input, definition);
+
+        if (result.failed())
+        {
+            job.errors.add(result.getErrorMessage());
+            return;
+        }
+
+        job.name = definition.name;
+        job.sampleRate = definition.sampleRate;
+
+        ScheduleExport::validate(definition, job.errors, job.warnings);
+
+        if (job.errors.isEmpty())
+        {
+            // One compiler per job; large sequences still share the compiler's thread pool
+            ScheduleCompiler compiler;
+            result = ScheduleExport::write(definition, compiler, checkOnly ? File() : job.scheduleFile, job.summary);
+
+            if (result.failed())
+            {
+                job.errors.add(result.getErrorMessage());
+            }
+            else
+            {
+                job.warnings.addArray(job.summary.warnings);
+
+                if (!checkOnly)
+                {
+                    var summary = job.summary.toVar(job.sampleRate);
+                    summary.getDynamicObject()->setProperty("name", job.name);
+                    summary.getDynamicObject()->setProperty("sample_rate", job.sampleRate);
+                    summary.getDynamicObject()->setProperty("definition", job.input.getFullPathName());
+
+                    if (!job.summaryFile.replaceWithText(JSON::toString(summary)))
+                        job.errors.add("Could not write " + job.summaryFile.getFullPathName());
+                }
+            }
+        }
+
+        job.milliseconds = Time::getMillisecondCounterHiRes() - start;
+    }
+
+    String formatDuration(double samples, double sampleRate)
+    {
+        return String(samples / sampleRate, 1) + " s";
+    }
+
+    void report(const CompileJob& job, bool quiet)
+    {
+        const bool ok = job.errors.isEmpty();
+
+        if (quiet && ok && job.warnings.isEmpty())
+            return;
+
+        String line = (ok ? "ok     " : "FAILED ") + job.input.getFullPathName();
+
+        if (ok)
+        {
+            line << "  (" << job.name << ": " << job.summary.numTrials << " trials, "
+                 << formatDuration((double) job.summary.totalSamples, job.sampleRate) << ", expected "
+                 << formatDuration(job.summary.expectedSamples, job.sampleRate) << " +/- "
+                 << formatDuration(job.summary.stdDevSamples, job.sampleRate) << ", "
+                 << String(job.milliseconds, 1) << " ms)";
+        }
+
+        std::cout << line << "\n";
+
+        for (auto& error : job.errors)
+            std::cout << "    error: " << error << "\n";
+
+        for (auto& warning : job.warnings)
+            std::cout << "    warning: " << warning << "\n";
+    }
+
+    bool writeCsv(const OwnedArray<CompileJob>& jobs, const File& file)
+    {
+        String csv = "definition,name,status,trials,catch_trials,duration_s,expected_duration_s,duration_std_s,hash,warnings\n";
+
+        for (auto* job : jobs)
+        {
+            const double rate = job->sampleRate > 0 ? job->sampleRate : 1.0;
+            const bool ok = job->errors.isEmpty();
+
+            csv << job->input.getFullPathName().quoted() << ","
+                << job->name.quoted() << ","
+                << (ok ? "ok" : "failed") << ","
+                << job->summary.numTrials << ","
+                << job->summary.numCatchTrials << ","
+                << String((double) job->summary.totalSamples / rate, 3) << ","
+                << String(job->summary.expectedSamples / rate, 3) << ","
+                << String(job->summary.stdDevSamples / rate, 3) << ","
+                << String::toHexString((int64) job->summary.hash) << ","
+                << job->warnings.size() << "\n";
+        }
+
+        return file.replaceWithText(csv);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    File outputDirectory;
+    int numThreads = SystemStats::getNumCpus();
+    bool checkOnly = false;
+    bool quiet = false;
+    StringArray inputs;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const String argument(argv[i]);
+
+        if ((argument == "-o" || argument == "--output") && i + 1 < argc)
+            outputDirectory = File::getCurrentWorkingDirectory().getChildFile(argv[++i]);
+        else if ((argument == "-j" || argument == "--jobs") && i + 1 < argc)
+            numThreads = jmax(1, String(argv[++i]).getIntValue());
+        else if (argument == "-c" || argument == "--check")
+            checkOnly = true;
+        else if (argument == "-q" || argument == "--quiet")
+            quiet = true;
+        else if (argument == "-h" || argument == "--help")
+        {
+            printUsage();
+            return 0;
+        }
+        else if (argument.startsWith("-"))
+        {
+            std::cerr << "Unknown option " << argument << "\n";
+            printUsage();
+            return 2;
+        }
+        else
+            inputs.add(argument);
+    }
+
+    if (inputs.isEmpty())
+    {
+        printUsage();
+        return 2;
+    }
+
+    OwnedArray<CompileJob> jobs;
+
+    for (auto& input : inputs)
+    {
+        const File path = File::getCurrentWorkingDirectory().getChildFile(input);
+
+        Array<File> files;
+        File root = path.getParentDirectory();
+
+        if (path.isDirectory())
+        {
+            files = path.findChildFiles(File::findFiles, true, ProtocolFile::getWildcard());
+            files.sort();
+            root = path;
+        }
+        else if (path.existsAsFile())
+        {
+            files.add(path);
+        }
+        else
+        {
+            std::cerr << "No such file or directory: " << path.getFullPathName() << "\n";
+            return 2;
+        }
+
+        for (auto& file : files)
+        {
+            auto* job = jobs.add(new CompileJob());
+            job->input = file;
+
+            const File base = outputDirectory == File()
+                                  ? file.getParentDirectory().getChildFile(file.getFileNameWithoutExtension())
+                                  : outputDirectory.getChildFile(removeExtension(file.getRelativePathFrom(root)));
+
+            job->scheduleFile = base.getSiblingFile(base.getFileName() + ".schedule.npy");
+            job->summaryFile = base.getSiblingFile(base.getFileName() + ".summary.json");
+        }
+    }
+
+    const double start = Time::getMillisecondCounterHiRes();
+
+    {
+        ThreadPool pool(jmin(numThreads, jmax(1, jobs.size())));
+
+        std::atomic<int> remaining { jobs.size() };
+        WaitableEvent finished;
+
+        for (auto* job : jobs)
+        {
+            pool.addJob([job, checkOnly, &remaining, &finished]
+            {
+                runJob(*job, checkOnly);
+
+                if (--remaining == 0)
+                    finished.signal();
+            });
+        }
+
+        if (jobs.size() > 0)
+            finished.wait();
+    }
+
+    const double seconds = (Time::getMillisecondCounterHiRes() - start) / 1000.0;
+
+    int numFailed = 0;
+    int64 numTrials = 0;
+
+    for (auto* job : jobs)
+    {
+        report(*job, quiet);
+
+        if (!job->errors.isEmpty())
+            numFailed++;
+
+        numTrials += job->summary.numTrials;
+    }
+
+    if (!checkOnly && outputDirectory != File())
+    {
+        outputDirectory.createDirectory();
+
+        if (!writeCsv(jobs, outputDirectory.getChildFile("summary.csv")))
+            std::cerr << "Could not write " << outputDirectory.getChildFile("summary.csv").getFullPathName() << "\n";
+    }
+
+    std::cout << jobs.size() - numFailed << " of " << jobs.size() << " definitions compiled ("
+              << numTrials << " trials) in " << String(seconds, 2) << " s\n";
+
+    return numFailed > 0 ? 1 : 0;
+}
@@ -0,0 +1,280 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "StimulusRenderer.h"
+
+#include <iostream>
+
+/**
+    Envelope rendering benchmark.
+
+    Times the envelope kernels StimulusRenderer picks for each stimulus
+    type and ramp profile against a reference that renders every sample
+    through one generic loop, branching on the stimulus parameters as
+    it goes. Both render the same stimulus in blocks, and the largest
+    difference between them is reported with the throughputs.
+
+    Sine waves are then rendered by the oscillator for the longest
+    SineWave (10 s) at a range of frequencies and sample rates, and
+    compared with a cos() per sample: the largest error, the largest
+    difference between block-wise and single-call rendering (which
+    shows the phase carries across blocks), and both throughputs.
+*/
+
+namespace
+{
+    void printUsage()
+    {
+        std::cout << "Usage: opto-render-benchmark [options]\n"
+                     "\n"
+                     "Times envelope rendering for each kind of stimulus, and sine\n"
+                     "rendering against cos().\n"
+                     "\n"
+                     "Options:\n"
+                     "  -s, --samples <n>    Length of each stimulus (default: 300000)\n"
+                     "  -b, --block <n>      Samples rendered per call (default: 1024)\n"
+                     "  -r, --repeats <n>    Times each stimulus is rendered (default: 5)\n"
+                     "  -h, --help           Show this message\n";
+    }
+
+    /** Renders an envelope one sample at a time, branching on the stimulus parameters */
+    void renderReference(const StimulusSpec& stimulus, int64 start, int numSamples, float* destination)
+    {
+        auto shape = [&] (float x) { return stimulus.rampProfile == COSINE_RAMP ? 0.5f - 0.5f * std::cos(MathConstants<float>::pi * x) : x; };
+
+        const int64 width = stimulus.pulseWidth;
+        const int64 ramp = jmin(stimulus.pulseRamp, width / 2);
+        const int64 offsetStart = stimulus.rampOnset + stimulus.rampPlateau;
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            const int64 n = start + i;
+            float value = 0.0f;
+
+            if (n < 0 || n >= stimulus.numSamples)
+                value = 0.0f;
+            else if (stimulus.type == PULSE_TRAIN)
+            {
+                const int64 pulse = jmax((int64) 0, (int64) std::floor(n / stimulus.pulsePeriod));
+
+                for (int64 p = jmax((int64) 0, pulse - 1); p <= pulse && p < stimulus.numPulses; ++p)
+                {
+                    const int64 j = n - (int64) std::llround(p * stimulus.pulsePeriod);
+
+                    if (j >= 0 && j < width)
+                        value = ramp > 0 ? jmin(1.0f, (j + 0.5f) / ramp, (width - j - 0.5f) / ramp) : 1.0f;
+                }
+            }
+            else if (stimulus.type == RAMP)
+            {
+                if (n < stimulus.rampOnset)
+                    value = shape((n + 0.5f) / stimulus.rampOnset);
+                else if (n < offsetStart)
+                    value = 1.0f;
+                else
+                    value = shape((stimulus.rampOffset - (n - offsetStart) - 0.5f) / stimulus.rampOffset);
+            }
+
+            destination[i] = value;
+        }
+    }
+
+    /** A stimulus to time */
+    struct Variant
+    {
+        String name;
+        StimulusSpec stimulus;
+    };
+
+    Array<Variant> createVariants(int64 numSamples)
+    {
+        Array<Variant> variants;
+
+        StimulusSpec pulses;
+        pulses.type = PULSE_TRAIN;
+        pulses.numSamples = numSamples;
+        pulses.pulsePeriod = 300;
+        pulses.pulseWidth = 150;
+        pulses.numPulses = (int) (numSamples / 300);
+        variants.add({ "pulse train", pulses });
+
+        pulses.pulseRamp = 30;
+        variants.add({ "pulse train, ramped", pulses });
+
+        StimulusSpec ramp;
+        ramp.type = RAMP;
+        ramp.numSamples = numSamples;
+        ramp.rampOnset = numSamples / 3;
+        ramp.rampOffset = numSamples / 3;
+        ramp.rampPlateau = numSamples - 2 * (numSamples / 3);
+        ramp.rampProfile = LINEAR_RAMP;
+        variants.add({ "ramp, linear", ramp });
+
+        ramp.rampProfile = COSINE_RAMP;
+        variants.add({ "ramp, cosine", ramp });
+
+        ramp.rampOnset = 0;
+        ramp.rampOffset = 0;
+        ramp.rampPlateau = numSamples;
+        variants.add({ "ramp, flat", ramp });
+
+        return variants;
+    }
+
+    /** Renders a stimulus in blocks, repeatedly; returns the time taken in seconds */
+    template <typename Render>
+    double timeRendering(const StimulusSpec& stimulus, int blockSize, int repeats, float* destination, Render&& render)
+    {
+        const int64 startTicks = Time::getHighResolutionTicks();
+
+        for (int repeat = 0; repeat < repeats; ++repeat)
+            for (int64 start = 0; start < stimulus.numSamples; start += blockSize)
+                render(stimulus, start, (int) jmin((int64) blockSize, stimulus.numSamples - start),
+                       destination + start);
+
+        return Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - startTicks);
+    }
+
+    /** Returns the largest difference between two renderings */
+    float getMaxDifference(const float* a, const float* b, int64 numSamples)
+    {
+        float difference = 0.0f;
+
+        for (int64 i = 0; i < numSamples; ++i)
+            difference = jmax(difference, std::abs(a[i] - b[i]));
+
+        return difference;
+    }
+
+    String formatRate(int64 numSamples, double seconds)
+    {
+        return String((double) numSamples / jmax(1.0e-9, seconds) / 1.0e6, 1) + " M/s";
+    }
+
+    /** Renders a raised cosine with a cos() per sample */
+    void renderSineReference(const StimulusSpec& stimulus, int64 start, int numSamples, float* destination)
+    {
+        for (int i = 0; i < numSamples; ++i)
+            destination[i] = (float) (0.5 - 0.5 * std::cos(MathConstants<double>::twoPi * stimulus.sineFrequency * (double) (start + i)));
+    }
+
+    void benchmarkSines(int blockSize, int repeats)
+    {
+        const double sampleRates[] = { 30000.0, 300000.0 };
+        const double frequencies[] = { 1.0, 40.0, 1000.0 };
+
+        std::cout << "\nSine waves (10 s, " << blockSize << "-sample blocks, " << repeats << " repeats)\n\n"
+                  << String("rate (Hz)").paddedRight(' ', 12) << String("frequency").paddedRight(' ', 12)
+                  << String("oscillator").paddedRight(' ', 14) << String("cos()").paddedRight(' ', 14)
+                  << String("max error").paddedRight(' ', 14) << "block difference\n";
+
+        for (double sampleRate : sampleRates)
+        {
+            for (double frequency : frequencies)
+            {
+                StimulusSpec sine;
+                sine.type = SINUSOID;
+                sine.numSamples = (int64) (10 * sampleRate);
+                sine.sineFrequency = frequency / sampleRate;
+
+                HeapBlock<float> oscillatorOutput((size_t) sine.numSamples);
+                HeapBlock<float> referenceOutput((size_t) sine.numSamples);
+                HeapBlock<float> singleCallOutput((size_t) sine.numSamples);
+
+                const double oscillatorSeconds = timeRendering(sine, blockSize, repeats, oscillatorOutput,
+                                                               [] (const StimulusSpec& stimulus, int64 start, int count, float* destination)
+                                                               {
+                                                                   StimulusRenderer::renderEnvelope(stimulus, start, count, destination);
+                                                               });
+
+                const double referenceSeconds = timeRendering(sine, blockSize, repeats, referenceOutput, renderSineReference);
+
+                StimulusRenderer::renderEnvelope(sine, 0, (int) sine.numSamples, singleCallOutput);
+
+                const int64 numRendered = sine.numSamples * repeats;
+
+                std::cout << String(sampleRate, 0).paddedRight(' ', 12)
+                          << String(frequency, 0).paddedRight(' ', 12)
+                          << formatRate(numRendered, oscillatorSeconds).paddedRight(' ', 14)
+                          << formatRate(numRendered, referenceSeconds).paddedRight(' ', 14)
+                          << String(getMaxDifference(oscillatorOutput, referenceOutput, sine.numSamples), 9).paddedRight(' ', 14)
+                          << String(getMaxDifference(oscillatorOutput, singleCallOutput, sine.numSamples), 9) << "\n";
+            }
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    int64 numSamples = 300000;
+    int blockSize = 1024;
+    int repeats = 5;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const String argument(argv[i]);
+
+        if ((argument == "-s" || argument == "--samples") && i + 1 < argc)
+            numSamples = jmax((int64) 1, String(argv[++i]).getLargeIntValue());
+        else if ((argument == "-b" || argument == "--block") && i + 1 < argc)
+            blockSize = jmax(1, String(argv[++i]).getIntValue());
+        else if ((argument == "-r" || argument == "--repeats") && i + 1 < argc)
+            repeats = jmax(1, String(argv[++i]).getIntValue());
+        else
+        {
+            printUsage();
+            return argument == "-h" || argument == "--help" ? 0 : 1;
+        }
+    }
+
+    HeapBlock<float> kernelOutput((size_t) numSamples);
+    HeapBlock<float> referenceOutput((size_t) numSamples);
+    const int64 numRendered = numSamples * repeats;
+
+    std::cout << "Envelopes (" << numSamples << " samples, " << blockSize << "-sample blocks, "
+              << repeats << " repeats)\n\n"
+              << String("stimulus").paddedRight(' ', 24) << String("kernel").paddedRight(' ', 14)
+              << String("reference").paddedRight(' ', 14) << String("speedup").paddedRight(' ', 10)
+              << "max difference\n";
+
+    for (auto& variant : createVariants(numSamples))
+    {
+        const double kernelSeconds = timeRendering(variant.stimulus, blockSize, repeats, kernelOutput,
+                                                   [] (const StimulusSpec& stimulus, int64 start, int count, float* destination)
+                                                   {
+                                                       StimulusRenderer::renderEnvelope(stimulus, start, count, destination);
+                                                   });
+
+        const double referenceSeconds = timeRendering(variant.stimulus, blockSize, repeats, referenceOutput, renderReference);
+
+        std::cout << variant.name.paddedRight(' ', 24)
+                  << formatRate(numRendered, kernelSeconds).paddedRight(' ', 14)
+                  << formatRate(numRendered, referenceSeconds).paddedRight(' ', 14)
+                  << (String(referenceSeconds / jmax(1.0e-9, kernelSeconds), 1) + "x").paddedRight(' ', 10)
+                  << String(getMaxDifference(kernelOutput, referenceOutput, numSamples), 9) << "\n";
+    }
+
+    benchmarkSines(blockSize, repeats);
+
+    return 0;
+}
@@ -0,0 +1,152 @@
+/*
+	------------------------------------------------------------------
+
+	This file is part of the Open Ephys GUI
+	Copyright (C) 2025 Open Ephys
+
+	------------------------------------------------------------------
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "TrialEventRing.h"
+
+#include <iostream>
+
+/**
+    Prints the trial events the plugin publishes to shared memory.
+
+    Follows the ring like tail -f, printing one line per trial with the
+    time between publication and reception. With a count, stops after
+    that many events and summarises the latency.
+*/
+
+namespace
+{
+    void printUsage()
+    {
+        std::cout << "Usage: opto-trial-events [options]\n"
+                     "\n"
+                     "Options:\n"
+                     "  -r, --ring <name>   Shared memory object to read (default: " << TrialEventRing::getDefaultName() << ")\n"
+                     "  -c, --count <n>     Stop after n events and print latency statistics\n"
+                     "  -a, --all           Start with the oldest event still in the ring\n"
+                     "  -q, --quiet         Don't print individual events\n";
+    }
+
+    /** Returns a percentile of sorted values */
+    double percentile(const Array<double>& sorted, double fraction)
+    {
+        return sorted[jlimit(0, sorted.size() - 1, (int) std::ceil(fraction * sorted.size()) - 1)];
+    }
+
+    void printEvent(const TrialEvent& event, double latencyMicros)
+    {
+        const TrialRecord& record = event.record;
+
+        std::cout << event.index
+                  << "  protocol " << record.protocol
+                  << "  sequence " << record.sequence
+                  << "  trial " << record.sequenceTrial
+                  << "  condition " << record.condition
+                  << "  site " << record.site
+                  << "  " << record.wavelength << " nm"
+                  << (record.catchTrial != 0 ? "  catch" : "")
+                  << "  latency " << String(latencyMicros, 1) << " us\n";
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    String name = TrialEventRing::getDefaultName();
+    int64 count = 0;
+    bool all = false;
+    bool quiet = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const String argument(argv[i]);
+
+        if ((argument == "-r" || argument == "--ring") && i + 1 < argc)
+            name = argv[++i];
+        else if ((argument == "-c" || argument == "--count") && i + 1 < argc)
+            count = jmax((int64) 0, String(argv[++i]).getLargeIntValue());
+        else if (argument == "-a" || argument == "--all")
+            all = true;
+        else if (argument == "-q" || argument == "--quiet")
+            quiet = true;
+        else if (argument == "-h" || argument == "--help")
+        {
+            printUsage();
+            return 0;
+        }
+        else
+        {
+            std::cerr << "Unknown option " << argument << "\n";
+            printUsage();
+            return 2;
+        }
+    }
+
+    TrialEventReader reader;
+    Result result = reader.open(name);
+
+    if (result.failed())
+    {
+        std::cerr << result.getErrorMessage() << "\n";
+        return 1;
+    }
+
+    if (all)
+        reader.rewind();
+
+    Array<double> latencies;
+    int64 numRead = 0;
+
+    while (count == 0 || numRead < count)
+    {
+        TrialEvent event;
+        const TrialEventReader::ReadResult readResult = reader.waitForEvent(event, 100);
+
+        if (readResult == TrialEventReader::EVENTS_LOST)
+        {
+            std::cerr << "Fell behind; " << (int64) reader.getNumLost() << " events lost so far\n";
+            continue;
+        }
+
+        if (readResult == TrialEventReader::NO_EVENT)
+            continue;
+
+        const double latencyMicros = (double) (TrialEventRing::getTimeNanos() - event.publishNanos) / 1000.0;
+
+        if (count > 0)
+            latencies.add(latencyMicros);
+
+        if (!quiet)
+            printEvent(event, latencyMicros);
+
+        ++numRead;
+    }
+
+    latencies.sort();
+
+    std::cout << numRead << " events, " << (int64) reader.getNumLost() << " lost, latency (us):\n"
+              << "  min " << String(latencies.getFirst(), 1)
+              << "  median " << String(percentile(latencies, 0.5), 1)
+              << "  p99 " << String(percentile(latencies, 0.99), 1)
+              << "  max " << String(latencies.getLast(), 1) << "\n";
+
+    return 0;
+}